@@ -0,0 +1,275 @@
+#include <gst/gst.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+
+/*
+ * Offline throughput benchmark for the fakesink pipelines in this directory.
+ *
+ * Every variant runs with non-live test sources producing a fixed number of
+ * buffers into fakesink sync=false, so the pipeline runs as fast as the CPU
+ * allows and ends with EOS. Each variant runs in its own child process
+ * (the same binary, re-executed with --run) so peak RSS and allocation
+ * counts are not polluted by earlier variants.
+ *
+ *   bench-fakesink [--buffers N] [variant ...]
+ *
+ * One JSON object per variant is printed on stdout.
+ */
+
+#define DEFAULT_BUFFERS 900    // 60 s of media at 15 fps
+#define FRAMERATE 15
+
+#define VIDEO_SOURCE "videotestsrc name=video_source is-live=false num-buffers=%d ! video/x-raw,format=I420,width=720,height=1280,framerate=15/1"
+#define AUDIO_SOURCE "audiotestsrc is-live=false num-buffers=%d samplesperbuffer=3200 ! audio/x-raw,rate=48000,channels=2"
+#define AUDIO_ENCODE "queue ! audioconvert ! audioresample ! audio/x-raw,rate=16000,channels=1 ! avenc_aac bitrate=256"
+
+typedef struct {
+    const gchar *name;
+    const gchar *description;   // gst-launch syntax, %d is replaced by the buffer count
+} BenchVariant;
+
+static const BenchVariant variants[] = {
+    /* fakesink.c */
+    { "fakesink",
+      VIDEO_SOURCE " ! queue ! videoconvert ! x264enc speed-preset=1 bitrate=128 ! fakesink sync=false" },
+    /* mp4mux-fakesink.c */
+    { "mp4mux-fakesink",
+      VIDEO_SOURCE " ! queue ! videoconvert ! x264enc speed-preset=1 bitrate=128 ! queue ! mp4mux ! fakesink sync=false" },
+    /* bt7-enc-video-audio-filter-mp4mux-fakesink.c */
+    { "bt7-mp4mux-fakesink",
+      VIDEO_SOURCE " ! queue ! videoconvert ! x264enc speed-preset=1 bitrate=128 ! queue ! mp4mux name=mux ! fakesink sync=false "
+      AUDIO_SOURCE " ! " AUDIO_ENCODE " ! queue ! mux." },
+    /* Encoder configurations */
+    { "x264-veryfast",
+      VIDEO_SOURCE " ! queue ! videoconvert ! x264enc speed-preset=3 bitrate=128 ! fakesink sync=false" },
+    { "x264-zerolatency",
+      VIDEO_SOURCE " ! queue ! videoconvert ! x264enc speed-preset=1 bitrate=128 tune=zerolatency ! fakesink sync=false" },
+    { "x264-1-thread",
+      VIDEO_SOURCE " ! queue ! videoconvert ! x264enc speed-preset=1 bitrate=128 threads=1 ! fakesink sync=false" },
+    /* Queue configurations */
+    { "no-queue",
+      VIDEO_SOURCE " ! videoconvert ! x264enc speed-preset=1 bitrate=128 ! fakesink sync=false" },
+    { "small-queue",
+      VIDEO_SOURCE " ! queue max-size-buffers=2 max-size-bytes=0 max-size-time=0 ! videoconvert ! x264enc speed-preset=1 bitrate=128 ! fakesink sync=false" },
+    /* Mux configurations */
+    { "mp4mux-fragmented",
+      VIDEO_SOURCE " ! queue ! videoconvert ! x264enc speed-preset=1 bitrate=128 ! queue ! mp4mux fragment-duration=1000 ! fakesink sync=false" },
+    { "mpegtsmux-fakesink",
+      VIDEO_SOURCE " ! queue ! videoconvert ! x264enc speed-preset=1 bitrate=128 ! h264parse ! queue ! mpegtsmux ! fakesink sync=false" },
+};
+
+/*
+ * Default allocator that counts what it hands out. Memory is allocated from
+ * (and returned to) the system allocator, so only gst_allocator_alloc() with
+ * the default allocator is seen; buffers recycled by pools are not counted,
+ * which is what makes the number useful.
+ */
+typedef struct {
+    GstAllocator parent;
+} CountingAllocator;
+
+typedef struct {
+    GstAllocatorClass parent_class;
+} CountingAllocatorClass;
+
+static GstAllocator *system_allocator;
+static gint allocations;
+static gsize allocated_bytes;
+
+G_DEFINE_TYPE (CountingAllocator, counting_allocator, GST_TYPE_ALLOCATOR);
+
+static GstMemory* counting_allocator_alloc(GstAllocator *allocator, gsize size, GstAllocationParams *params) {
+    g_atomic_int_inc(&allocations);
+    g_atomic_pointer_add(&allocated_bytes, size);
+    return gst_allocator_alloc(system_allocator, size, params);
+}
+
+static void counting_allocator_free(GstAllocator *allocator, GstMemory *memory) {
+    gst_allocator_free(system_allocator, memory);
+}
+
+static void counting_allocator_class_init(CountingAllocatorClass *klass) {
+    GstAllocatorClass *allocator_class = GST_ALLOCATOR_CLASS(klass);
+
+    allocator_class->alloc = counting_allocator_alloc;
+    allocator_class->free = counting_allocator_free;
+}
+
+static void counting_allocator_init(CountingAllocator *allocator) {
+}
+
+static GstPadProbeReturn count_frames_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
+    g_atomic_int_inc((gint *) user_data);
+    return GST_PAD_PROBE_OK;
+}
+
+static gdouble cpu_seconds(void) {
+    struct rusage usage;
+
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+           (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+/* Child side: run one variant to EOS and print its results */
+static int run_variant(const BenchVariant *variant, gint buffers) {
+    GstElement *pipeline, *video_source;
+    GstBus *bus;
+    GstMessage *msg;
+    GstPad *pad;
+    GError *err = NULL;
+    gchar *description;
+    gint frames = 0;
+    gint64 started, finished;
+    gdouble cpu_started, cpu_finished, media_seconds, wall_seconds;
+    struct rusage usage;
+    int ret = 0;
+
+    system_allocator = gst_allocator_find(NULL);
+    gst_allocator_set_default(g_object_new(counting_allocator_get_type(), NULL));
+
+    description = g_strdup_printf(variant->description, buffers, buffers);
+    pipeline = gst_parse_launch(description, &err);
+    g_free(description);
+    if (!pipeline) {
+        g_printerr("Could not build variant %s: %s\n", variant->name, err->message);
+        g_clear_error(&err);
+        return -1;
+    }
+
+    video_source = gst_bin_get_by_name(GST_BIN(pipeline), "video_source");
+    pad = gst_element_get_static_pad(video_source, "src");
+    gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, count_frames_probe, &frames, NULL);
+    gst_object_unref(pad);
+    gst_object_unref(video_source);
+
+    /* Don't count setup and preroll allocations as steady state */
+    gst_element_set_state(pipeline, GST_STATE_PAUSED);
+    gst_element_get_state(pipeline, NULL, NULL, GST_CLOCK_TIME_NONE);
+    g_atomic_int_set(&allocations, 0);
+    allocated_bytes = 0;
+
+    started = g_get_monotonic_time();
+    cpu_started = cpu_seconds();
+    gst_element_set_state(pipeline, GST_STATE_PLAYING);
+
+    bus = gst_element_get_bus(pipeline);
+    msg = gst_bus_timed_pop_filtered(bus, GST_CLOCK_TIME_NONE, GST_MESSAGE_ERROR | GST_MESSAGE_EOS);
+    finished = g_get_monotonic_time();
+    cpu_finished = cpu_seconds();
+
+    if (GST_MESSAGE_TYPE(msg) == GST_MESSAGE_ERROR) {
+        gchar *debug_info;
+
+        gst_message_parse_error(msg, &err, &debug_info);
+        g_printerr("Error received from element %s: %s\n", GST_OBJECT_NAME(msg->src), err->message);
+        g_printerr("Debugging information: %s\n", debug_info ? debug_info : "none");
+        g_clear_error(&err);
+        g_free(debug_info);
+        ret = -1;
+    } else {
+        getrusage(RUSAGE_SELF, &usage);
+        wall_seconds = (finished - started) / 1e6;
+        media_seconds = (gdouble) frames / FRAMERATE;
+
+        printf("{\"variant\":\"%s\",\"frames\":%d,\"media_s\":%.3f,\"wall_s\":%.3f,\"fps\":%.1f,"
+               "\"cpu_s\":%.3f,\"cpu_s_per_media_s\":%.4f,\"peak_rss_kb\":%ld,"
+               "\"allocs_per_frame\":%.2f,\"alloc_bytes_per_frame\":%.0f}\n",
+               variant->name, frames, media_seconds, wall_seconds, frames / wall_seconds,
+               cpu_finished - cpu_started, (cpu_finished - cpu_started) / media_seconds, usage.ru_maxrss,
+               (gdouble) allocations / MAX(frames, 1), (gdouble) allocated_bytes / MAX(frames, 1));
+        fflush(stdout);
+    }
+
+    gst_message_unref(msg);
+    gst_object_unref(bus);
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+    gst_object_unref(pipeline);
+    gst_object_unref(system_allocator);
+    return ret;
+}
+
+static const BenchVariant* find_variant(const gchar *name) {
+    guint i;
+
+    for (i = 0; i < G_N_ELEMENTS(variants); i++) {
+        if (g_strcmp0(variants[i].name, name) == 0) {
+            return &variants[i];
+        }
+    }
+    return NULL;
+}
+
+/* Parent side: re-execute this binary once per variant */
+static gboolean spawn_variant(const gchar *self, const BenchVariant *variant, gint buffers) {
+    gchar *buffers_arg = g_strdup_printf("%d", buffers);
+    gchar *child_argv[] = { (gchar *) self, "--buffers", buffers_arg, "--run", (gchar *) variant->name, NULL };
+    GError *err = NULL;
+    gint status;
+    gboolean ok;
+
+    // stdout and stderr are inherited, so the child's JSON line goes straight out
+    ok = g_spawn_sync(NULL, child_argv, NULL, G_SPAWN_SEARCH_PATH, NULL, NULL, NULL, NULL, &status, &err) &&
+         g_spawn_check_wait_status(status, &err);
+    if (!ok) {
+        g_printerr("Variant %s failed: %s\n", variant->name, err->message);
+        g_clear_error(&err);
+    }
+    g_free(buffers_arg);
+    return ok;
+}
+
+int main(int argc, char *argv[]) {
+    const BenchVariant *variant;
+    const gchar *run = NULL;
+    GPtrArray *selected = g_ptr_array_new();
+    gint buffers = DEFAULT_BUFFERS;
+    gint i, failed = 0;
+
+    /* Initialize GStreamer */
+    gst_init (&argc, &argv);
+
+    for (i = 1; i < argc; i++) {
+        if (g_strcmp0(argv[i], "--buffers") == 0 && i + 1 < argc) {
+            buffers = atoi(argv[++i]);
+        } else if (g_strcmp0(argv[i], "--run") == 0 && i + 1 < argc) {
+            run = argv[++i];
+        } else if ((variant = find_variant(argv[i])) != NULL) {
+            g_ptr_array_add(selected, (gpointer) variant);
+        } else {
+            g_printerr("Unknown variant %s. Variants:", argv[i]);
+            for (i = 0; i < (gint) G_N_ELEMENTS(variants); i++) {
+                g_printerr(" %s", variants[i].name);
+            }
+            g_printerr("\n");
+            return -1;
+        }
+    }
+
+    if (buffers <= 0) {
+        g_printerr("--buffers must be positive.\n");
+        return -1;
+    }
+
+    if (run) {
+        variant = find_variant(run);
+        return variant ? run_variant(variant, buffers) : -1;
+    }
+
+    if (selected->len == 0) {
+        for (i = 0; i < (gint) G_N_ELEMENTS(variants); i++) {
+            g_ptr_array_add(selected, (gpointer) &variants[i]);
+        }
+    }
+
+    for (i = 0; i < (gint) selected->len; i++) {
+        if (!spawn_variant(argv[0], g_ptr_array_index(selected, i), buffers)) {
+            failed++;
+        }
+    }
+
+    g_ptr_array_unref(selected);
+    return failed ? -1 : 0;
+}
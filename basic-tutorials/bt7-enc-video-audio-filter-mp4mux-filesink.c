@@ -117,11 +117,11 @@ int main(int argc, char *argv[]) {
     /* Manually link the mp4mux which has "Request" pads */
     video_mp4mux_queue_src_pad = gst_element_get_static_pad (video_mp4mux_queue, "src");
     mp4mux_video_pad = gst_element_request_pad_simple (mp4_mux, "video_%u");
-    g_print ("Obtained request pad %s for mp4mux video branch.\n", gst_pad_get_name (mp4mux_video_pad));
+    g_print ("Obtained request pad %s for mp4mux video branch.\n", GST_PAD_NAME (mp4mux_video_pad));
 
     audio_mp4mux_queue_src_pad = gst_element_get_static_pad (audio_mp4mux_queue, "src");
     mp4mux_audio_pad = gst_element_request_pad_simple (mp4_mux, "audio_%u");
-    g_print ("Obtained request pad %s for mp4mux audio branch.\n", gst_pad_get_name (mp4mux_audio_pad));
+    g_print ("Obtained request pad %s for mp4mux audio branch.\n", GST_PAD_NAME (mp4mux_audio_pad));
 
     if (gst_pad_link (video_mp4mux_queue_src_pad, mp4mux_video_pad) != GST_PAD_LINK_OK ||
     gst_pad_link (audio_mp4mux_queue_src_pad, mp4mux_audio_pad) != GST_PAD_LINK_OK) {
@@ -57,10 +57,10 @@ int main(int argc, char *argv[]) {
 
   /* Manually link the Tee, which has "Request" pads */
   tee_audio_pad = gst_element_request_pad_simple (tee, "src_%u");
-  g_print ("Obtained request pad %s for audio branch.\n", gst_pad_get_name (tee_audio_pad));
+  g_print ("Obtained request pad %s for audio branch.\n", GST_PAD_NAME (tee_audio_pad));
   queue_audio_pad = gst_element_get_static_pad (audio_queue, "sink");
   tee_video_pad = gst_element_request_pad_simple (tee, "src_%u");
-  g_print ("Obtained request pad %s for video branch.\n", gst_pad_get_name (tee_video_pad));
+  g_print ("Obtained request pad %s for video branch.\n", GST_PAD_NAME (tee_video_pad));
   queue_video_pad = gst_element_get_static_pad (video_queue, "sink");
   if (gst_pad_link (tee_audio_pad, queue_audio_pad) != GST_PAD_LINK_OK ||
       gst_pad_link (tee_video_pad, queue_video_pad) != GST_PAD_LINK_OK) {
@@ -0,0 +1,492 @@
+#include <gst/gst.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <signal.h>
+#include <string.h>
+#include <time.h>
+#include <sys/time.h>
+
+#define SEGMENT_DURATION 15000 // Duration for each segment in milliseconds
+#define SAMPLE_INTERVAL 50 // Milliseconds between two samples of every queue
+#define RING_CAPACITY 65536 // Samples kept in memory, about 6 min of history for 8 queues at 50 ms
+#define TIMELINE_DIR "/Users/vivekchandela/Documents/flvtest" // Where timelines are dumped
+#define MAX_QUEUES 64
+
+typedef enum {
+    QUEUE_SAMPLE = 0,
+    QUEUE_OVERRUN = 1,
+    QUEUE_UNDERRUN = 2,
+} QueueEventType;
+
+/* Fixed-size record so a binary dump is just the ring buffer contents */
+typedef struct {
+    guint64 timestamp_us;   // Monotonic time since the recorder started
+    guint64 level_time;     // current-level-time in nanoseconds
+    guint32 level_bytes;
+    guint32 level_buffers;
+    guint16 queue_index;
+    guint16 event;          // QueueEventType
+    guint32 reserved;
+} QueueSample;
+
+typedef struct {
+    GstElement *queues[MAX_QUEUES];
+    gchar *queue_names[MAX_QUEUES];
+    guint n_queues;
+
+    GMutex lock;
+    QueueSample *ring;
+    guint64 written;        // Total samples ever written; ring index is written % RING_CAPACITY
+    gint64 start_time;
+
+    GThread *thread;
+    volatile gboolean running;
+} QueueLevelRecorder;
+
+volatile sig_atomic_t dump_requested = 0;
+
+// Signal handler for SIGUSR1: ask the sampler thread for a dump
+void signal_handler(int signal) {
+  if (signal == SIGUSR1) {
+    dump_requested = 1;
+  }
+}
+
+// Function to get the current time in milliseconds since the Unix epoch
+static long long current_time_millis() {
+    struct timeval time_now;
+    gettimeofday(&time_now, NULL);
+    return (long long)(time_now.tv_sec) * 1000 + (long long)(time_now.tv_usec) / 1000;
+}
+
+static gchar* format_location_callback(GstElement *splitmuxsink, guint fragment_id, gpointer user_data) {
+    // Get the (Unix epoch time) for start and end time
+    long long start_time = current_time_millis();
+    long long end_time = start_time + SEGMENT_DURATION;
+
+    gchar *filename = g_strdup_printf("vm/test/%lld_%lld.mp4", start_time, end_time);
+
+    GstElement *gcs_sink = GST_ELEMENT(user_data); // Retrieve gcs_sink passed via user_data
+    if (gcs_sink) {
+        g_object_set(gcs_sink, "key", filename, NULL);  // Set the key dynamically
+    }
+
+    return filename;
+}
+
+static gboolean link_elements_with_video_filter (GstElement *element1, GstElement *element2)
+{
+    gboolean link_ok;
+    GstCaps *caps;
+
+    caps = gst_caps_new_simple ("video/x-raw",
+            "format", G_TYPE_STRING, "I420",
+            "width", G_TYPE_INT, 360,
+            "height", G_TYPE_INT, 640,
+            "framerate", GST_TYPE_FRACTION, 15, 1,
+            NULL);
+
+    link_ok = gst_element_link_filtered (element1, element2, caps);
+    gst_caps_unref (caps);
+
+    if (!link_ok) {
+        g_warning ("Failed to link element1 and element2 using video filter!");
+    }
+
+    return link_ok;
+}
+
+static gboolean link_elements_with_audio_filter (GstElement *element1, GstElement *element2, int sampleRate, int numChannels)
+{
+    gboolean link_ok;
+    GstCaps *caps;
+
+    caps = gst_caps_new_simple ("audio/x-raw",
+            "rate", G_TYPE_INT, sampleRate,
+            "channels", G_TYPE_INT, numChannels,
+            NULL);
+
+    link_ok = gst_element_link_filtered (element1, element2, caps);
+    gst_caps_unref (caps);
+
+    if (!link_ok) {
+        g_warning ("Failed to link element1 and element2 using audio filter!");
+    }
+
+    return link_ok;
+}
+
+static void recorder_append(QueueLevelRecorder *recorder, guint queue_index, QueueEventType event)
+{
+    GstElement *queue = recorder->queues[queue_index];
+    QueueSample sample = {0};
+    guint buffers, bytes;
+    guint64 time;
+
+    g_object_get (queue, "current-level-buffers", &buffers, "current-level-bytes", &bytes, "current-level-time", &time, NULL);
+
+    sample.timestamp_us = g_get_monotonic_time () - recorder->start_time;
+    sample.level_time = time;
+    sample.level_bytes = bytes;
+    sample.level_buffers = buffers;
+    sample.queue_index = queue_index;
+    sample.event = event;
+
+    g_mutex_lock (&recorder->lock);
+    recorder->ring[recorder->written % RING_CAPACITY] = sample;
+    recorder->written++;
+    g_mutex_unlock (&recorder->lock);
+}
+
+static void queue_overrun_callback(GstElement *queue, gpointer user_data)
+{
+    QueueLevelRecorder *recorder = (QueueLevelRecorder *) user_data;
+
+    for (guint i = 0; i < recorder->n_queues; i++) {
+        if (recorder->queues[i] == queue) {
+            recorder_append (recorder, i, QUEUE_OVERRUN);
+        }
+    }
+}
+
+static void queue_underrun_callback(GstElement *queue, gpointer user_data)
+{
+    QueueLevelRecorder *recorder = (QueueLevelRecorder *) user_data;
+
+    for (guint i = 0; i < recorder->n_queues; i++) {
+        if (recorder->queues[i] == queue) {
+            recorder_append (recorder, i, QUEUE_UNDERRUN);
+        }
+    }
+}
+
+/* Dump the ring buffer oldest first. format is "csv" or "bin". */
+static void recorder_dump(QueueLevelRecorder *recorder, const gchar *format)
+{
+    gboolean binary = g_strcmp0 (format, "bin") == 0;
+    gchar *path = g_strdup_printf ("%s/queue-levels-%" G_GINT64_FORMAT ".%s", TIMELINE_DIR, g_get_real_time () / 1000, binary ? "bin" : "csv");
+    FILE *file = fopen (path, binary ? "wb" : "w");
+    guint64 first, count;
+
+    if (!file) {
+        g_printerr ("Could not open %s for writing\n", path);
+        g_free (path);
+        return;
+    }
+
+    g_mutex_lock (&recorder->lock);
+    count = MIN (recorder->written, RING_CAPACITY);
+    first = recorder->written - count;
+
+    if (binary) {
+        /* Header: magic, queue count, NUL-terminated queue names, sample count, then the raw samples */
+        guint32 n_queues = recorder->n_queues;
+        fwrite ("QLVL", 1, 4, file);
+        fwrite (&n_queues, sizeof (n_queues), 1, file);
+        for (guint i = 0; i < recorder->n_queues; i++) {
+            fwrite (recorder->queue_names[i], 1, strlen (recorder->queue_names[i]) + 1, file);
+        }
+        fwrite (&count, sizeof (count), 1, file);
+        for (guint64 i = first; i < recorder->written; i++) {
+            fwrite (&recorder->ring[i % RING_CAPACITY], sizeof (QueueSample), 1, file);
+        }
+    } else {
+        static const gchar *event_names[] = { "sample", "overrun", "underrun" };
+        fprintf (file, "timestamp_us,queue,event,buffers,bytes,time_ns\n");
+        for (guint64 i = first; i < recorder->written; i++) {
+            QueueSample *sample = &recorder->ring[i % RING_CAPACITY];
+            fprintf (file, "%" G_GUINT64_FORMAT ",%s,%s,%u,%u,%" G_GUINT64_FORMAT "\n",
+                    sample->timestamp_us, recorder->queue_names[sample->queue_index], event_names[sample->event],
+                    sample->level_buffers, sample->level_bytes, sample->level_time);
+        }
+    }
+    g_mutex_unlock (&recorder->lock);
+
+    fclose (file);
+    g_print ("Dumped %" G_GUINT64_FORMAT " queue samples to %s\n", count, path);
+    g_free (path);
+}
+
+static gpointer recorder_thread(gpointer user_data)
+{
+    QueueLevelRecorder *recorder = (QueueLevelRecorder *) user_data;
+
+    while (recorder->running) {
+        for (guint i = 0; i < recorder->n_queues; i++) {
+            recorder_append (recorder, i, QUEUE_SAMPLE);
+        }
+        if (dump_requested) {
+            dump_requested = 0;
+            recorder_dump (recorder, g_getenv ("QUEUE_TIMELINE_FORMAT"));
+        }
+        g_usleep (SAMPLE_INTERVAL * 1000);
+    }
+
+    return NULL;
+}
+
+/* Collect every queue in the pipeline, including the ones inside splitmuxsink */
+static void recorder_start(QueueLevelRecorder *recorder, GstElement *pipeline)
+{
+    GstIterator *it = gst_bin_iterate_recurse (GST_BIN (pipeline));
+    GValue item = G_VALUE_INIT;
+    gboolean done = FALSE;
+
+    g_mutex_init (&recorder->lock);
+    recorder->ring = g_new0 (QueueSample, RING_CAPACITY);
+    recorder->start_time = g_get_monotonic_time ();
+
+    while (!done) {
+        switch (gst_iterator_next (it, &item)) {
+            case GST_ITERATOR_OK: {
+                GstElement *element = GST_ELEMENT (g_value_get_object (&item));
+                GstElementFactory *factory = gst_element_get_factory (element);
+                if (factory && g_strcmp0 (gst_plugin_feature_get_name (GST_PLUGIN_FEATURE (factory)), "queue") == 0 &&
+                    recorder->n_queues < MAX_QUEUES) {
+                    recorder->queues[recorder->n_queues] = gst_object_ref (element);
+                    recorder->queue_names[recorder->n_queues] = gst_object_get_path_string (GST_OBJECT (element));
+                    g_signal_connect (element, "overrun", G_CALLBACK (queue_overrun_callback), recorder);
+                    g_signal_connect (element, "underrun", G_CALLBACK (queue_underrun_callback), recorder);
+                    g_print ("Recording levels of %s\n", recorder->queue_names[recorder->n_queues]);
+                    recorder->n_queues++;
+                }
+                g_value_reset (&item);
+                break;
+            }
+            case GST_ITERATOR_RESYNC:
+                // Start over, dropping what was collected so far
+                gst_iterator_resync (it);
+                for (guint i = 0; i < recorder->n_queues; i++) {
+                    g_signal_handlers_disconnect_by_data (recorder->queues[i], recorder);
+                    gst_object_unref (recorder->queues[i]);
+                    g_free (recorder->queue_names[i]);
+                }
+                recorder->n_queues = 0;
+                break;
+            case GST_ITERATOR_ERROR:
+            case GST_ITERATOR_DONE:
+                done = TRUE;
+                break;
+        }
+    }
+    g_value_unset (&item);
+    gst_iterator_free (it);
+
+    recorder->running = TRUE;
+    recorder->thread = g_thread_new ("queue-levels", recorder_thread, recorder);
+}
+
+/* Stop sampling and dump the timeline leading up to this point */
+static void recorder_stop(QueueLevelRecorder *recorder)
+{
+    recorder->running = FALSE;
+    g_thread_join (recorder->thread);
+    recorder_dump (recorder, g_getenv ("QUEUE_TIMELINE_FORMAT"));
+
+    for (guint i = 0; i < recorder->n_queues; i++) {
+        g_signal_handlers_disconnect_by_data (recorder->queues[i], recorder);
+        gst_object_unref (recorder->queues[i]);
+        g_free (recorder->queue_names[i]);
+    }
+    g_free (recorder->ring);
+    g_mutex_clear (&recorder->lock);
+}
+
+int main(int argc, char *argv[]) {
+    GstElement *pipeline;
+    GstElement *video_source, *video_queue, *video_convert, *x264_enc, *video_tee, *video_flv_queue;
+    GstElement *audio_source, *audio_queue, *audio_convert, *audio_resample, *avenc_aac, *audio_tee, *audio_flv_queue;
+    GstElement *flv_mux, *flv_filesink, *split_mux_sink, *gcs_sink;
+
+    GstBus *bus;
+    GstMessage *msg;
+    
+    GstPad *video_tee_flv_pad, *video_tee_mp4_pad;
+    GstPad *video_flv_queue_sink_pad, *splitmuxsink_video_pad;
+
+    GstPad *audio_tee_flv_pad, *audio_tee_mp4_pad;
+    GstPad *audio_flv_queue_sink_pad, *splitmuxsink_audio_pad;
+
+    GstPad *video_flv_queue_src_pad, *audio_flv_queue_src_pad;
+    GstPad *flv_mux_video_pad, *flv_mux_audio_pad;
+
+    QueueLevelRecorder recorder = {0};
+
+    /* Initialize GStreamer */
+    gst_init (&argc, &argv);
+
+    /* Create the elements */
+    video_source = gst_element_factory_make ("videotestsrc", "video_source");
+    video_queue = gst_element_factory_make ("queue", "video_queue");
+    video_convert = gst_element_factory_make ("videoconvert", "video_convert");
+    x264_enc = gst_element_factory_make ("x264enc", "x264_enc");
+    video_tee = gst_element_factory_make ("tee", "video_tee");
+    video_flv_queue = gst_element_factory_make ("queue", "video_flv_queue");
+
+    audio_source = gst_element_factory_make ("audiotestsrc", "audio_source");
+    audio_queue = gst_element_factory_make ("queue", "audio_queue");
+    audio_convert = gst_element_factory_make ("audioconvert", "audio_convert");
+    audio_resample = gst_element_factory_make ("audioresample", "audio_resample");
+    avenc_aac = gst_element_factory_make ("avenc_aac", "avenc_aac");
+    audio_tee = gst_element_factory_make ("tee", "audio_tee");
+    audio_flv_queue = gst_element_factory_make ("queue", "audio_flv_queue");
+
+    flv_mux = gst_element_factory_make ("flvmux", "flv_mux");
+    flv_filesink = gst_element_factory_make ("filesink", "flv_filesink");
+    split_mux_sink = gst_element_factory_make ("splitmuxsink", "split_mux_sink");
+    gcs_sink = gst_element_factory_make ("awss3sink", "gcs_sink");
+
+    /* Create the empty pipeline */
+    pipeline = gst_pipeline_new ("test-pipeline");
+
+    if (!pipeline || !video_source || !video_queue || !video_convert || !x264_enc || !video_tee || !video_flv_queue ||
+    !audio_source || !audio_queue || !audio_convert || !audio_resample || !avenc_aac || !audio_tee || !audio_flv_queue ||
+    !flv_mux || !flv_filesink || !split_mux_sink || !gcs_sink) {
+        g_printerr ("Not all elements could be created.\n");
+        return -1;
+    } else {
+        g_print ("All elements created successfully.\n");
+    }
+
+    /* Configure elements */
+    g_object_set (x264_enc, "speed-preset", 1, "bitrate", 128, NULL);
+    g_object_set (avenc_aac, "bitrate", 256, NULL);
+    g_object_set (flv_mux, "streamable", true, "enforce-increasing-timestamps", false, NULL);
+    g_object_set (flv_filesink, "location", "/Users/vivekchandela/Documents/flvtest/output.flv", "sync", true, NULL);
+    g_object_set (gcs_sink, "access-key", "add-here", "bucket", "add-here", "endpoint-uri", "https://storage.googleapis.com", "force-path-style", true, "region", "add-here", "secret-access-key", "add-here", "sync", true,  NULL);
+    g_object_set(split_mux_sink, "max-size-time", (guint64)SEGMENT_DURATION * GST_MSECOND, "send-keyframe-requests", true, "sink", gcs_sink, NULL);
+
+    // Connect the format-location signal to generate dynamic filenames
+    g_signal_connect(split_mux_sink, "format-location", G_CALLBACK(format_location_callback), gcs_sink);
+
+    g_print ("All elements configured successfully.\n");
+  
+    /* Link all elements that can be automatically linked because they have "Always" pads */
+    /* Adding caps filter between video_source and video_convert */
+    gst_bin_add_many (GST_BIN (pipeline), video_source, video_queue, video_convert, x264_enc, video_tee, video_flv_queue,
+    audio_source, audio_queue, audio_convert, audio_resample, avenc_aac, audio_tee, audio_flv_queue,
+    flv_mux, flv_filesink, split_mux_sink, NULL);
+
+    if (link_elements_with_video_filter (video_source, video_queue) != TRUE ||
+        gst_element_link_many (video_queue, video_convert, x264_enc, video_tee, NULL) != TRUE ||
+
+        link_elements_with_audio_filter (audio_source, audio_queue, 48000, 2) != TRUE ||
+        gst_element_link_many (audio_queue, audio_convert, audio_resample, NULL) != TRUE ||
+        link_elements_with_audio_filter (audio_resample, avenc_aac, 16000, 1) != TRUE ||
+        gst_element_link_many (avenc_aac, audio_tee, NULL) != TRUE ||
+        
+        gst_element_link_many (flv_mux, flv_filesink, NULL) != TRUE
+        ) {
+        g_printerr ("Elements could not be linked.\n");
+        gst_object_unref (pipeline);
+        return -1;
+    } else {
+        g_print ("All elements linked successfully.\n");
+    }
+
+    /* Manually link the video_tee, which has "Request" pads */
+    video_tee_flv_pad = gst_element_request_pad_simple (video_tee, "src_%u");
+    g_print ("Obtained request pad %s for video_tee's flvmux branch.\n", GST_PAD_NAME (video_tee_flv_pad));
+    video_flv_queue_sink_pad = gst_element_get_static_pad (video_flv_queue, "sink");
+    
+    video_tee_mp4_pad = gst_element_request_pad_simple (video_tee, "src_%u");
+    g_print ("Obtained request pad %s for video_tee's mp4mux branch.\n", GST_PAD_NAME (video_tee_mp4_pad));
+    splitmuxsink_video_pad = gst_element_request_pad_simple (split_mux_sink, "video");
+    g_print ("Obtained request pad %s for splitmuxsink video branch.\n", GST_PAD_NAME (splitmuxsink_video_pad));
+
+    if (gst_pad_link (video_tee_flv_pad, video_flv_queue_sink_pad) != GST_PAD_LINK_OK ||
+        gst_pad_link (video_tee_mp4_pad, splitmuxsink_video_pad) != GST_PAD_LINK_OK) {
+        g_printerr ("video_tee could not be linked.\n");
+        gst_object_unref (pipeline);
+        return -1;
+    } else {
+        g_print ("video_tee linked successfully.\n");
+    }
+    gst_object_unref (video_flv_queue_sink_pad);
+    gst_object_unref (splitmuxsink_video_pad);
+
+    /* Manually link the audio_tee, which has "Request" pads */
+    audio_tee_flv_pad = gst_element_request_pad_simple (audio_tee, "src_%u");
+    g_print ("Obtained request pad %s for audio_tee's flvmux branch.\n", GST_PAD_NAME (audio_tee_flv_pad));
+    audio_flv_queue_sink_pad = gst_element_get_static_pad (audio_flv_queue, "sink");
+    
+    audio_tee_mp4_pad = gst_element_request_pad_simple (audio_tee, "src_%u");
+    g_print ("Obtained request pad %s for audio_tee's mp4mux branch.\n", GST_PAD_NAME (audio_tee_mp4_pad));
+    splitmuxsink_audio_pad = gst_element_request_pad_simple (split_mux_sink, "audio_%u");
+    g_print ("Obtained request pad %s for splitmuxsink audio branch.\n", GST_PAD_NAME (splitmuxsink_audio_pad));
+
+    if (gst_pad_link (audio_tee_flv_pad, audio_flv_queue_sink_pad) != GST_PAD_LINK_OK ||
+        gst_pad_link (audio_tee_mp4_pad, splitmuxsink_audio_pad) != GST_PAD_LINK_OK) {
+        g_printerr ("audio_tee could not be linked.\n");
+        gst_object_unref (pipeline);
+        return -1;
+    } else {
+        g_print ("audio_tee linked successfully.\n");
+    }
+    gst_object_unref (audio_flv_queue_sink_pad);
+    gst_object_unref (splitmuxsink_audio_pad);
+
+    /* Manually link the flvmux which has "Request" pads */
+    video_flv_queue_src_pad = gst_element_get_static_pad (video_flv_queue, "src");
+    flv_mux_video_pad = gst_element_request_pad_simple (flv_mux, "video");
+    g_print ("Obtained request pad %s for flvmux video branch.\n", GST_PAD_NAME (flv_mux_video_pad));
+
+    audio_flv_queue_src_pad = gst_element_get_static_pad (audio_flv_queue, "src");
+    flv_mux_audio_pad = gst_element_request_pad_simple (flv_mux, "audio");
+    g_print ("Obtained request pad %s for flvmux audio branch.\n", GST_PAD_NAME (flv_mux_audio_pad));
+
+    if (gst_pad_link (video_flv_queue_src_pad, flv_mux_video_pad) != GST_PAD_LINK_OK ||
+    gst_pad_link (audio_flv_queue_src_pad, flv_mux_audio_pad) != GST_PAD_LINK_OK) {
+        g_printerr ("flvmux could not be linked!\n");
+        gst_object_unref (pipeline);
+        return -1;
+    } else {
+        g_print ("flvmux linked successfully.\n");
+    }
+    gst_object_unref (video_flv_queue_src_pad);
+    gst_object_unref (audio_flv_queue_src_pad);
+
+    /* Sample every queue; `kill -USR1 <pid>` dumps the timeline on demand */
+    recorder_start (&recorder, pipeline);
+    signal (SIGUSR1, signal_handler);
+
+    /* Start playing the pipeline */
+    gst_element_set_state (pipeline, GST_STATE_PLAYING);
+
+    /* Visualize the pipeline using GraphViz */
+    gst_debug_bin_to_dot_file(GST_BIN(pipeline), GST_DEBUG_GRAPH_SHOW_ALL, "pipeline-doubletee-doublequeue-awss3sink-queuelevels");
+
+    /* Wait until error or EOS */
+    bus = gst_element_get_bus (pipeline);
+    msg = gst_bus_timed_pop_filtered (bus, GST_CLOCK_TIME_NONE, GST_MESSAGE_ERROR | GST_MESSAGE_EOS);
+
+    /* Release the request pads from the video_tee, and unref them */
+    gst_element_release_request_pad (video_tee, video_tee_flv_pad);
+    gst_element_release_request_pad (video_tee, video_tee_mp4_pad);
+    gst_object_unref (video_tee_flv_pad);
+    gst_object_unref (video_tee_mp4_pad);
+
+    /* Release the request pads from the audio_tee, and unref them */
+    gst_element_release_request_pad (audio_tee, audio_tee_flv_pad);
+    gst_element_release_request_pad (audio_tee, audio_tee_mp4_pad);
+    gst_object_unref (audio_tee_flv_pad);
+    gst_object_unref (audio_tee_mp4_pad);
+
+    /* Release the request pads from flvmux, and unref them */
+    gst_element_release_request_pad (flv_mux, flv_mux_video_pad);
+    gst_element_release_request_pad (flv_mux, flv_mux_audio_pad);
+    gst_object_unref (flv_mux_video_pad);
+    gst_object_unref (flv_mux_audio_pad);
+
+    /* Free resources */
+    if (msg != NULL)
+        gst_message_unref (msg);
+    gst_object_unref (bus);
+    gst_element_set_state (pipeline, GST_STATE_NULL);
+
+    /* Dump the timeline leading up to EOS or the error */
+    recorder_stop (&recorder);
+
+    gst_object_unref (pipeline);
+    return 0;
+}
@@ -0,0 +1,464 @@
+#include <gst/gst.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#define SEGMENT_DURATION 15000 // Duration for each segment in milliseconds
+#define RAMP_START 1 // Streams in the first step
+#define RAMP_STEP 2 // Streams added per step
+#define MAX_STREAMS 64 // Stop ramping here even if no stream fell behind
+#define WARMUP_SECONDS 10 // Settling time after adding streams, not measured
+#define WINDOW_SECONDS 30 // Measurement window of every step
+#define MIN_REALTIME_FACTOR 0.98 // Media time per wall time below which a stream is behind
+#define MAX_LATENCY_MS 2000 // Capture to splitmuxsink latency above which a stream is behind
+#define DEFAULT_S3_ENDPOINT "http://127.0.0.1:9000" // Local S3-compatible stand-in (e.g. MinIO)
+
+/*
+ * Ramps up concurrent doubletee-doublequeue-awss3sink.c pipelines in one
+ * process until one of them can no longer keep up in real time.
+ *
+ * Every step adds RAMP_STEP streams, waits WARMUP_SECONDS and then measures
+ * for WINDOW_SECONDS. A stream is behind when the media time reaching
+ * splitmuxsink advances slower than MIN_REALTIME_FACTOR of the wall time, or
+ * when a buffer reaches splitmuxsink more than MAX_LATENCY_MS after it was
+ * captured. The first step with a stream behind is the knee.
+ *
+ * Uploads go to S3_ENDPOINT (default DEFAULT_S3_ENDPOINT) with S3_BUCKET,
+ * S3_ACCESS_KEY and S3_SECRET_KEY; the FLV branch is written to /dev/null.
+ */
+
+typedef struct {
+    guint id;
+    GstElement *pipeline;
+    GstElement *video_tee, *audio_tee, *flv_mux, *split_mux_sink, *gcs_sink;
+    GstPad *tee_pads[4];
+    GstPad *mux_pads[2];
+    GstPad *splitmuxsink_video_pad, *splitmuxsink_audio_pad;
+
+    GMutex lock;
+    GstClockTime last_pts;      // Running time of the last video buffer into splitmuxsink
+    gint64 max_latency_us;      // Worst capture to splitmuxsink latency in the window
+    gint overruns;              // Queue overruns since the stream started
+    gboolean failed;
+
+    /* Window snapshot */
+    GstClockTime window_pts;
+    gint64 window_wall;
+    gint window_overruns;
+} BenchStream;
+
+typedef struct {
+    guint64 busy;
+    guint64 total;
+} HostCpu;
+
+typedef struct {
+    GMainLoop *loop;
+    GPtrArray *streams;
+    HostCpu window_cpu;
+    guint knee;                 // Streams at the first step with a stream behind, 0 if none
+    guint sustained;            // Largest step where every stream kept up
+} ScalabilityRun;
+
+// Function to get the current time in milliseconds since the Unix epoch
+static long long current_time_millis() {
+    struct timeval time_now;
+    gettimeofday(&time_now, NULL);
+    return (long long)(time_now.tv_sec) * 1000 + (long long)(time_now.tv_usec) / 1000;
+}
+
+static gchar* format_location_callback(GstElement *splitmuxsink, guint fragment_id, gpointer user_data) {
+    BenchStream *stream = (BenchStream *) user_data;
+
+    // Get the (Unix epoch time) for start and end time
+    long long start_time = current_time_millis();
+    long long end_time = start_time + SEGMENT_DURATION;
+
+    gchar *filename = g_strdup_printf("vm/bench/%u/%lld_%lld.mp4", stream->id, start_time, end_time);
+
+    g_object_set(stream->gcs_sink, "key", filename, NULL);  // Set the key dynamically
+
+    return filename;
+}
+
+static gboolean link_elements_with_video_filter (GstElement *element1, GstElement *element2)
+{
+    gboolean link_ok;
+    GstCaps *caps;
+
+    caps = gst_caps_new_simple ("video/x-raw",
+            "format", G_TYPE_STRING, "I420",
+            "width", G_TYPE_INT, 360,
+            "height", G_TYPE_INT, 640,
+            "framerate", GST_TYPE_FRACTION, 15, 1,
+            NULL);
+
+    link_ok = gst_element_link_filtered (element1, element2, caps);
+    gst_caps_unref (caps);
+
+    if (!link_ok) {
+        g_warning ("Failed to link element1 and element2 using video filter!");
+    }
+
+    return link_ok;
+}
+
+static gboolean link_elements_with_audio_filter (GstElement *element1, GstElement *element2, int sampleRate, int numChannels)
+{
+    gboolean link_ok;
+    GstCaps *caps;
+
+    caps = gst_caps_new_simple ("audio/x-raw",
+            "rate", G_TYPE_INT, sampleRate,
+            "channels", G_TYPE_INT, numChannels,
+            NULL);
+
+    link_ok = gst_element_link_filtered (element1, element2, caps);
+    gst_caps_unref (caps);
+
+    if (!link_ok) {
+        g_warning ("Failed to link element1 and element2 using audio filter!");
+    }
+
+    return link_ok;
+}
+
+static void queue_overrun_callback(GstElement *queue, gpointer user_data) {
+    BenchStream *stream = (BenchStream *) user_data;
+
+    g_mutex_lock (&stream->lock);
+    stream->overruns++;
+    g_mutex_unlock (&stream->lock);
+}
+
+/* Live test sources stamp buffers with their capture running time */
+static GstPadProbeReturn splitmuxsink_video_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
+    BenchStream *stream = (BenchStream *) user_data;
+    GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER (info);
+    GstClock *clock;
+    GstClockTime now;
+
+    if (!GST_BUFFER_PTS_IS_VALID (buffer) || !(clock = gst_element_get_clock (stream->pipeline))) {
+        return GST_PAD_PROBE_OK;
+    }
+
+    now = gst_clock_get_time (clock) - gst_element_get_base_time (stream->pipeline);
+    gst_object_unref (clock);
+
+    g_mutex_lock (&stream->lock);
+    stream->last_pts = GST_BUFFER_PTS (buffer);
+    if (now > stream->last_pts) {
+        stream->max_latency_us = MAX (stream->max_latency_us, (gint64) GST_TIME_AS_USECONDS (now - stream->last_pts));
+    }
+    g_mutex_unlock (&stream->lock);
+
+    return GST_PAD_PROBE_OK;
+}
+
+static gboolean stream_bus_callback(GstBus *bus, GstMessage *msg, gpointer user_data) {
+    BenchStream *stream = (BenchStream *) user_data;
+
+    if (GST_MESSAGE_TYPE (msg) == GST_MESSAGE_ERROR) {
+        GError *err;
+        gchar *debug;
+
+        gst_message_parse_error (msg, &err, &debug);
+        g_printerr ("[stream %u] Error from %s: %s\n", stream->id, GST_OBJECT_NAME (GST_MESSAGE_SRC (msg)), err->message);
+        g_error_free (err);
+        g_free (debug);
+
+        // A stream that errors out is as good as one that fell behind
+        g_mutex_lock (&stream->lock);
+        stream->failed = TRUE;
+        g_mutex_unlock (&stream->lock);
+    }
+
+    return G_SOURCE_CONTINUE;
+}
+
+/* Same element graph as doubletee-doublequeue-awss3sink.c */
+static BenchStream* build_stream(guint id) {
+    BenchStream *stream = g_new0 (BenchStream, 1);
+    GstElement *video_source, *video_queue, *video_convert, *x264_enc, *video_flv_queue;
+    GstElement *audio_source, *audio_queue, *audio_convert, *audio_resample, *avenc_aac, *audio_flv_queue;
+    GstElement *flv_filesink;
+    GstElement *queues[4];
+    GstBus *bus;
+    const gchar *endpoint = g_getenv ("S3_ENDPOINT");
+    gboolean linked;
+    guint i;
+
+    stream->id = id;
+    g_mutex_init (&stream->lock);
+
+    video_source = gst_element_factory_make ("videotestsrc", "video_source");
+    video_queue = gst_element_factory_make ("queue", "video_queue");
+    video_convert = gst_element_factory_make ("videoconvert", "video_convert");
+    x264_enc = gst_element_factory_make ("x264enc", "x264_enc");
+    stream->video_tee = gst_element_factory_make ("tee", "video_tee");
+    video_flv_queue = gst_element_factory_make ("queue", "video_flv_queue");
+
+    audio_source = gst_element_factory_make ("audiotestsrc", "audio_source");
+    audio_queue = gst_element_factory_make ("queue", "audio_queue");
+    audio_convert = gst_element_factory_make ("audioconvert", "audio_convert");
+    audio_resample = gst_element_factory_make ("audioresample", "audio_resample");
+    avenc_aac = gst_element_factory_make ("avenc_aac", "avenc_aac");
+    stream->audio_tee = gst_element_factory_make ("tee", "audio_tee");
+    audio_flv_queue = gst_element_factory_make ("queue", "audio_flv_queue");
+
+    stream->flv_mux = gst_element_factory_make ("flvmux", "flv_mux");
+    flv_filesink = gst_element_factory_make ("filesink", "flv_filesink");
+    stream->split_mux_sink = gst_element_factory_make ("splitmuxsink", "split_mux_sink");
+    stream->gcs_sink = gst_element_factory_make ("awss3sink", "gcs_sink");
+
+    stream->pipeline = gst_pipeline_new (NULL);
+
+    if (!stream->pipeline || !video_source || !video_queue || !video_convert || !x264_enc || !stream->video_tee || !video_flv_queue ||
+    !audio_source || !audio_queue || !audio_convert || !audio_resample || !avenc_aac || !stream->audio_tee || !audio_flv_queue ||
+    !stream->flv_mux || !flv_filesink || !stream->split_mux_sink || !stream->gcs_sink) {
+        g_printerr ("[stream %u] Not all elements could be created.\n", id);
+        return NULL;
+    }
+
+    /* Configure elements */
+    g_object_set (video_source, "is-live", true, NULL);
+    g_object_set (audio_source, "is-live", true, NULL);
+    g_object_set (x264_enc, "speed-preset", 1, "bitrate", 128, NULL);
+    g_object_set (avenc_aac, "bitrate", 256, NULL);
+    g_object_set (stream->flv_mux, "streamable", true, "enforce-increasing-timestamps", false, NULL);
+    g_object_set (flv_filesink, "location", "/dev/null", "sync", true, NULL);
+    g_object_set (stream->gcs_sink, "access-key", g_getenv ("S3_ACCESS_KEY") ? g_getenv ("S3_ACCESS_KEY") : "minioadmin",
+                  "bucket", g_getenv ("S3_BUCKET") ? g_getenv ("S3_BUCKET") : "bench",
+                  "endpoint-uri", endpoint ? endpoint : DEFAULT_S3_ENDPOINT, "force-path-style", true, "region", "us-east-1",
+                  "secret-access-key", g_getenv ("S3_SECRET_KEY") ? g_getenv ("S3_SECRET_KEY") : "minioadmin", "sync", true, NULL);
+    g_object_set (stream->split_mux_sink, "max-size-time", (guint64)SEGMENT_DURATION * GST_MSECOND, "send-keyframe-requests", true, "sink", stream->gcs_sink, NULL);
+    g_signal_connect (stream->split_mux_sink, "format-location", G_CALLBACK (format_location_callback), stream);
+
+    queues[0] = video_queue;
+    queues[1] = video_flv_queue;
+    queues[2] = audio_queue;
+    queues[3] = audio_flv_queue;
+    for (i = 0; i < G_N_ELEMENTS (queues); i++) {
+        g_signal_connect (queues[i], "overrun", G_CALLBACK (queue_overrun_callback), stream);
+    }
+
+    gst_bin_add_many (GST_BIN (stream->pipeline), video_source, video_queue, video_convert, x264_enc, stream->video_tee, video_flv_queue,
+    audio_source, audio_queue, audio_convert, audio_resample, avenc_aac, stream->audio_tee, audio_flv_queue,
+    stream->flv_mux, flv_filesink, stream->split_mux_sink, NULL);
+
+    if (link_elements_with_video_filter (video_source, video_queue) != TRUE ||
+        gst_element_link_many (video_queue, video_convert, x264_enc, stream->video_tee, NULL) != TRUE ||
+
+        link_elements_with_audio_filter (audio_source, audio_queue, 48000, 2) != TRUE ||
+        gst_element_link_many (audio_queue, audio_convert, audio_resample, NULL) != TRUE ||
+        link_elements_with_audio_filter (audio_resample, avenc_aac, 16000, 1) != TRUE ||
+        gst_element_link_many (avenc_aac, stream->audio_tee, NULL) != TRUE ||
+
+        gst_element_link_many (stream->flv_mux, flv_filesink, NULL) != TRUE) {
+        g_printerr ("[stream %u] Elements could not be linked.\n", id);
+        return NULL;
+    }
+
+    /* Tee, splitmuxsink and flvmux request pads */
+    stream->tee_pads[0] = gst_element_request_pad_simple (stream->video_tee, "src_%u");
+    stream->tee_pads[1] = gst_element_request_pad_simple (stream->video_tee, "src_%u");
+    stream->tee_pads[2] = gst_element_request_pad_simple (stream->audio_tee, "src_%u");
+    stream->tee_pads[3] = gst_element_request_pad_simple (stream->audio_tee, "src_%u");
+    stream->splitmuxsink_video_pad = gst_element_request_pad_simple (stream->split_mux_sink, "video");
+    stream->splitmuxsink_audio_pad = gst_element_request_pad_simple (stream->split_mux_sink, "audio_%u");
+    stream->mux_pads[0] = gst_element_request_pad_simple (stream->flv_mux, "video");
+    stream->mux_pads[1] = gst_element_request_pad_simple (stream->flv_mux, "audio");
+
+    linked = gst_element_link_pads (stream->video_tee, GST_PAD_NAME (stream->tee_pads[0]), video_flv_queue, "sink") &&
+             gst_pad_link (stream->tee_pads[1], stream->splitmuxsink_video_pad) == GST_PAD_LINK_OK &&
+             gst_element_link_pads (stream->audio_tee, GST_PAD_NAME (stream->tee_pads[2]), audio_flv_queue, "sink") &&
+             gst_pad_link (stream->tee_pads[3], stream->splitmuxsink_audio_pad) == GST_PAD_LINK_OK &&
+             gst_element_link_pads (video_flv_queue, "src", stream->flv_mux, GST_PAD_NAME (stream->mux_pads[0])) &&
+             gst_element_link_pads (audio_flv_queue, "src", stream->flv_mux, GST_PAD_NAME (stream->mux_pads[1]));
+    if (!linked) {
+        g_printerr ("[stream %u] Request pads could not be linked.\n", id);
+        return NULL;
+    }
+
+    gst_pad_add_probe (stream->splitmuxsink_video_pad, GST_PAD_PROBE_TYPE_BUFFER, splitmuxsink_video_probe, stream, NULL);
+
+    bus = gst_element_get_bus (stream->pipeline);
+    gst_bus_add_watch (bus, stream_bus_callback, stream);
+    gst_object_unref (bus);
+    return stream;
+}
+
+static void free_stream(gpointer data) {
+    BenchStream *stream = (BenchStream *) data;
+    GstBus *bus = gst_element_get_bus (stream->pipeline);
+    guint i;
+
+    gst_element_set_state (stream->pipeline, GST_STATE_NULL);
+    gst_bus_remove_watch (bus);
+    gst_object_unref (bus);
+
+    for (i = 0; i < G_N_ELEMENTS (stream->tee_pads); i++) {
+        gst_element_release_request_pad (i < 2 ? stream->video_tee : stream->audio_tee, stream->tee_pads[i]);
+        gst_object_unref (stream->tee_pads[i]);
+    }
+    for (i = 0; i < G_N_ELEMENTS (stream->mux_pads); i++) {
+        gst_element_release_request_pad (stream->flv_mux, stream->mux_pads[i]);
+        gst_object_unref (stream->mux_pads[i]);
+    }
+    gst_element_release_request_pad (stream->split_mux_sink, stream->splitmuxsink_video_pad);
+    gst_object_unref (stream->splitmuxsink_video_pad);
+    gst_element_release_request_pad (stream->split_mux_sink, stream->splitmuxsink_audio_pad);
+    gst_object_unref (stream->splitmuxsink_audio_pad);
+
+    gst_object_unref (stream->pipeline);
+    g_mutex_clear (&stream->lock);
+    g_free (stream);
+}
+
+/* Busy and total jiffies of all CPUs from /proc/stat */
+static HostCpu read_host_cpu(void) {
+    HostCpu cpu = {0};
+    guint64 user, nice, system, idle, iowait, irq, softirq, steal;
+    FILE *file = fopen ("/proc/stat", "r");
+
+    if (file && fscanf (file, "cpu %" G_GUINT64_FORMAT " %" G_GUINT64_FORMAT " %" G_GUINT64_FORMAT " %" G_GUINT64_FORMAT
+                        " %" G_GUINT64_FORMAT " %" G_GUINT64_FORMAT " %" G_GUINT64_FORMAT " %" G_GUINT64_FORMAT,
+                        &user, &nice, &system, &idle, &iowait, &irq, &softirq, &steal) == 8) {
+        cpu.busy = user + nice + system + irq + softirq + steal;
+        cpu.total = cpu.busy + idle + iowait;
+    }
+    if (file) {
+        fclose (file);
+    }
+    return cpu;
+}
+
+static long read_rss_kb(void) {
+    long pages = 0;
+    FILE *file = fopen ("/proc/self/statm", "r");
+
+    if (file) {
+        if (fscanf (file, "%*ld %ld", &pages) != 1) {
+            pages = 0;
+        }
+        fclose (file);
+    }
+    return pages * (sysconf (_SC_PAGESIZE) / 1024);
+}
+
+static void start_step(ScalabilityRun *run, guint target);
+
+static gboolean end_window(gpointer user_data) {
+    ScalabilityRun *run = (ScalabilityRun *) user_data;
+    HostCpu cpu = read_host_cpu ();
+    gint64 now = g_get_monotonic_time ();
+    gdouble worst_factor = G_MAXDOUBLE;
+    gint64 worst_latency_us = 0;
+    gint overruns = 0;
+    guint behind = 0, i;
+
+    g_print ("--- %u stream(s) ---\n", run->streams->len);
+    for (i = 0; i < run->streams->len; i++) {
+        BenchStream *stream = g_ptr_array_index (run->streams, i);
+        gdouble factor;
+        gboolean is_behind;
+
+        g_mutex_lock (&stream->lock);
+        factor = (gdouble) GST_TIME_AS_USECONDS (stream->last_pts - stream->window_pts) / (now - stream->window_wall);
+        is_behind = stream->failed || factor < MIN_REALTIME_FACTOR || stream->max_latency_us > MAX_LATENCY_MS * 1000;
+        g_print ("  stream %2u: realtime=%.3f latency_max=%" G_GINT64_FORMAT "ms overruns=%d%s\n", stream->id, factor,
+                stream->max_latency_us / 1000, stream->overruns - stream->window_overruns, is_behind ? "  BEHIND" : "");
+        worst_factor = MIN (worst_factor, factor);
+        worst_latency_us = MAX (worst_latency_us, stream->max_latency_us);
+        overruns += stream->overruns - stream->window_overruns;
+        g_mutex_unlock (&stream->lock);
+
+        if (is_behind) {
+            behind++;
+        }
+    }
+
+    printf ("{\"streams\":%u,\"behind\":%u,\"worst_realtime_factor\":%.3f,\"worst_latency_ms\":%" G_GINT64_FORMAT ","
+            "\"queue_overruns\":%d,\"host_cpu_pct\":%.1f,\"rss_kb\":%ld}\n",
+            run->streams->len, behind, worst_factor, worst_latency_us / 1000, overruns,
+            cpu.total > run->window_cpu.total ? 100.0 * (cpu.busy - run->window_cpu.busy) / (cpu.total - run->window_cpu.total) : 0.0,
+            read_rss_kb ());
+    fflush (stdout);
+
+    if (behind > 0) {
+        run->knee = run->streams->len;
+        g_main_loop_quit (run->loop);
+    } else if (run->streams->len >= MAX_STREAMS) {
+        run->sustained = run->streams->len;
+        g_main_loop_quit (run->loop);
+    } else {
+        run->sustained = run->streams->len;
+        start_step (run, MIN (run->streams->len + RAMP_STEP, MAX_STREAMS));
+    }
+
+    return G_SOURCE_REMOVE;
+}
+
+static gboolean begin_window(gpointer user_data) {
+    ScalabilityRun *run = (ScalabilityRun *) user_data;
+    gint64 now = g_get_monotonic_time ();
+    guint i;
+
+    for (i = 0; i < run->streams->len; i++) {
+        BenchStream *stream = g_ptr_array_index (run->streams, i);
+
+        g_mutex_lock (&stream->lock);
+        stream->window_pts = stream->last_pts;
+        stream->window_wall = now;
+        stream->window_overruns = stream->overruns;
+        stream->max_latency_us = 0;
+        g_mutex_unlock (&stream->lock);
+    }
+    run->window_cpu = read_host_cpu ();
+
+    g_timeout_add_seconds (WINDOW_SECONDS, end_window, run);
+    return G_SOURCE_REMOVE;
+}
+
+static void start_step(ScalabilityRun *run, guint target) {
+    while (run->streams->len < target) {
+        BenchStream *stream = build_stream (run->streams->len);
+
+        if (!stream) {
+            g_main_loop_quit (run->loop);
+            return;
+        }
+        g_ptr_array_add (run->streams, stream);
+        gst_element_set_state (stream->pipeline, GST_STATE_PLAYING);
+    }
+
+    g_print ("Running %u stream(s), measuring in %d sec\n", run->streams->len, WARMUP_SECONDS);
+    g_timeout_add_seconds (WARMUP_SECONDS, begin_window, run);
+}
+
+int main(int argc, char *argv[]) {
+    ScalabilityRun run = {0};
+
+    /* Initialize GStreamer */
+    gst_init (&argc, &argv);
+
+    run.loop = g_main_loop_new (NULL, FALSE);
+    run.streams = g_ptr_array_new_with_free_func (free_stream);
+
+    start_step (&run, RAMP_START);
+    g_main_loop_run (run.loop);
+
+    if (run.knee) {
+        g_print ("Knee point: stream(s) fall behind at %u, %u sustained in real time\n", run.knee, run.sustained);
+    } else {
+        g_print ("No stream fell behind up to %u stream(s)\n", run.sustained);
+    }
+    printf ("{\"knee_streams\":%u,\"sustained_streams\":%u}\n", run.knee, run.sustained);
+
+    g_ptr_array_unref (run.streams);
+    g_main_loop_unref (run.loop);
+    return 0;
+}
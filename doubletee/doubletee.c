@@ -135,13 +135,13 @@ int main(int argc, char *argv[]) {
 
     /* Manually link the video_tee, which has "Request" pads */
     video_tee_flv_pad = gst_element_request_pad_simple (video_tee, "src_%u");
-    g_print ("Obtained request pad %s for video_tee's flvmux branch.\n", gst_pad_get_name (video_tee_flv_pad));
+    g_print ("Obtained request pad %s for video_tee's flvmux branch.\n", GST_PAD_NAME (video_tee_flv_pad));
     video_flv_queue_sink_pad = gst_element_get_static_pad (video_flv_queue, "sink");
     
     video_tee_mp4_pad = gst_element_request_pad_simple (video_tee, "src_%u");
-    g_print ("Obtained request pad %s for video_tee's mp4mux branch.\n", gst_pad_get_name (video_tee_mp4_pad));
+    g_print ("Obtained request pad %s for video_tee's mp4mux branch.\n", GST_PAD_NAME (video_tee_mp4_pad));
     splitmuxsink_video_pad = gst_element_request_pad_simple (split_mux_sink, "video");
-    g_print ("Obtained request pad %s for splitmuxsink video branch.\n", gst_pad_get_name (splitmuxsink_video_pad));
+    g_print ("Obtained request pad %s for splitmuxsink video branch.\n", GST_PAD_NAME (splitmuxsink_video_pad));
 
     if (gst_pad_link (video_tee_flv_pad, video_flv_queue_sink_pad) != GST_PAD_LINK_OK ||
         gst_pad_link (video_tee_mp4_pad, splitmuxsink_video_pad) != GST_PAD_LINK_OK) {
@@ -156,13 +156,13 @@ int main(int argc, char *argv[]) {
 
     /* Manually link the audio_tee, which has "Request" pads */
     audio_tee_flv_pad = gst_element_request_pad_simple (audio_tee, "src_%u");
-    g_print ("Obtained request pad %s for audio_tee's flvmux branch.\n", gst_pad_get_name (audio_tee_flv_pad));
+    g_print ("Obtained request pad %s for audio_tee's flvmux branch.\n", GST_PAD_NAME (audio_tee_flv_pad));
     audio_flv_queue_sink_pad = gst_element_get_static_pad (audio_flv_queue, "sink");
     
     audio_tee_mp4_pad = gst_element_request_pad_simple (audio_tee, "src_%u");
-    g_print ("Obtained request pad %s for audio_tee's mp4mux branch.\n", gst_pad_get_name (audio_tee_mp4_pad));
+    g_print ("Obtained request pad %s for audio_tee's mp4mux branch.\n", GST_PAD_NAME (audio_tee_mp4_pad));
     splitmuxsink_audio_pad = gst_element_request_pad_simple (split_mux_sink, "audio_%u");
-    g_print ("Obtained request pad %s for splitmuxsink audio branch.\n", gst_pad_get_name (splitmuxsink_audio_pad));
+    g_print ("Obtained request pad %s for splitmuxsink audio branch.\n", GST_PAD_NAME (splitmuxsink_audio_pad));
 
     if (gst_pad_link (audio_tee_flv_pad, audio_flv_queue_sink_pad) != GST_PAD_LINK_OK ||
         gst_pad_link (audio_tee_mp4_pad, splitmuxsink_audio_pad) != GST_PAD_LINK_OK) {
@@ -178,11 +178,11 @@ int main(int argc, char *argv[]) {
     /* Manually link the flvmux which has "Request" pads */
     video_flv_queue_src_pad = gst_element_get_static_pad (video_flv_queue, "src");
     flv_mux_video_pad = gst_element_request_pad_simple (flv_mux, "video");
-    g_print ("Obtained request pad %s for flvmux video branch.\n", gst_pad_get_name (flv_mux_video_pad));
+    g_print ("Obtained request pad %s for flvmux video branch.\n", GST_PAD_NAME (flv_mux_video_pad));
 
     audio_flv_queue_src_pad = gst_element_get_static_pad (audio_flv_queue, "src");
     flv_mux_audio_pad = gst_element_request_pad_simple (flv_mux, "audio");
-    g_print ("Obtained request pad %s for flvmux audio branch.\n", gst_pad_get_name (flv_mux_audio_pad));
+    g_print ("Obtained request pad %s for flvmux audio branch.\n", GST_PAD_NAME (flv_mux_audio_pad));
 
     if (gst_pad_link (video_flv_queue_src_pad, flv_mux_video_pad) != GST_PAD_LINK_OK ||
     gst_pad_link (audio_flv_queue_src_pad, flv_mux_audio_pad) != GST_PAD_LINK_OK) {
@@ -0,0 +1,645 @@
+#define _GNU_SOURCE
+#include <gst/gst.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+
+#define SEGMENT_DURATION 15000 // Duration for each segment in milliseconds
+#define REPORT_INTERVAL 1 // Seconds between two CPU reports
+#define MAX_THREADS 256
+#define MAX_ELEMENTS 16
+
+/* CPU time of one streaming thread, named after the pad that owns it (e.g. video_queue:src) */
+typedef struct {
+    pid_t tid;
+    gchar *name;
+    gchar comm[16];         // name as truncated by the kernel, used to match helper threads
+    guint64 last_ticks;
+    guint64 delta_ticks;
+    gboolean seen;
+} ThreadCpu;
+
+/* CPU time spent inside one element, measured in the calling streaming thread */
+typedef struct {
+    GstElement *element;
+    guint index;
+    guint64 cpu_ns;         // Accumulated by the probes, swapped out by the reporter
+} ElementCpu;
+
+typedef struct {
+    GMutex lock;
+    ThreadCpu threads[MAX_THREADS];
+    guint n_threads;
+    ElementCpu elements[MAX_ELEMENTS];
+    guint n_elements;
+} CpuAccounting;
+
+/* Thread CPU time at the last sink pad probe of each element, per thread */
+static __thread guint64 element_entry_cpu[MAX_ELEMENTS];
+
+typedef struct _CustomData
+{
+    GstElement *pipeline;
+    GstElement *source;
+
+    GstElement *video_queue;
+    GstElement *video_convert;
+    GstElement *face_blur;
+    GstElement *video_convert2;
+    GstElement *x264_enc;
+    GstElement *video_tee;
+    GstElement *video_flv_queue;
+
+    GstElement *audio_source;
+    GstElement *audio_queue;
+    GstElement *audio_convert;
+    GstElement *audio_resample;
+    GstElement *avenc_aac;
+    GstElement *audio_tee;
+    GstElement *audio_flv_queue;
+
+    GstElement *flv_mux;
+    GstElement *flv_filesink;
+    GstElement *split_mux_sink;
+    GstElement *gcs_sink;
+} CustomData;
+
+// Function to get the current time in milliseconds since the Unix epoch
+static long long current_time_millis()
+{
+    struct timeval time_now;
+    gettimeofday(&time_now, NULL);
+    return (long long)(time_now.tv_sec) * 1000 + (long long)(time_now.tv_usec) / 1000;
+}
+
+static gchar *format_location_callback(GstElement *splitmuxsink, guint fragment_id, gpointer user_data)
+{
+    // Get the (Unix epoch time) for start and end time
+    long long start_time = current_time_millis();
+    long long end_time = start_time + SEGMENT_DURATION;
+
+    gchar *filename = g_strdup_printf("vm/4/%lld_%lld.mp4", start_time, end_time);
+
+    GstElement *gcs_sink = GST_ELEMENT(user_data); // Retrieve gcs_sink passed via user_data
+    if (gcs_sink)
+    {
+        g_object_set(gcs_sink, "key", filename, NULL); // Set the key dynamically
+    }
+
+    return filename;
+}
+
+static gboolean link_elements_with_video_filter(GstElement *element1, GstElement *element2)
+{
+    gboolean link_ok;
+    GstCaps *caps;
+
+    caps = gst_caps_new_simple("video/x-raw",
+                               "format", G_TYPE_STRING, "I420",
+                               "width", G_TYPE_INT, 360,
+                               "height", G_TYPE_INT, 640,
+                               "framerate", GST_TYPE_FRACTION, 15, 1,
+                               NULL);
+
+    link_ok = gst_element_link_filtered(element1, element2, caps);
+    gst_caps_unref(caps);
+
+    if (!link_ok)
+    {
+        g_warning("Failed to link element1 and element2 using video filter!");
+    }
+
+    return link_ok;
+}
+
+static gboolean link_elements_with_audio_filter(GstElement *element1, GstElement *element2, int sampleRate, int numChannels)
+{
+    gboolean link_ok;
+    GstCaps *caps;
+
+    caps = gst_caps_new_simple("audio/x-raw",
+                               "rate", G_TYPE_INT, sampleRate,
+                               "channels", G_TYPE_INT, numChannels,
+                               NULL);
+
+    link_ok = gst_element_link_filtered(element1, element2, caps);
+    gst_caps_unref(caps);
+
+    if (!link_ok)
+    {
+        g_warning("Failed to link element1 and element2 using audio filter!");
+    }
+
+    return link_ok;
+}
+
+static guint64 thread_cpu_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (guint64)ts.tv_sec * GST_SECOND + ts.tv_nsec;
+}
+
+/* A buffer enters the element: remember the thread's CPU time */
+static GstPadProbeReturn element_sink_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+    ElementCpu *element = (ElementCpu *)user_data;
+
+    element_entry_cpu[element->index] = thread_cpu_ns();
+    return GST_PAD_PROBE_OK;
+}
+
+/*
+ * A buffer leaves the element before being pushed downstream, so the CPU time
+ * since the last entry on this thread was spent inside the element. Work done
+ * after the push returns, or in chain calls that produce no output, is not
+ * counted; this matters little for converters and encoders.
+ */
+static GstPadProbeReturn element_src_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+    ElementCpu *element = (ElementCpu *)user_data;
+    guint64 entry = element_entry_cpu[element->index];
+
+    if (entry != 0)
+    {
+        __atomic_fetch_add(&element->cpu_ns, thread_cpu_ns() - entry, __ATOMIC_RELAXED);
+        element_entry_cpu[element->index] = 0;
+    }
+    return GST_PAD_PROBE_OK;
+}
+
+static void track_element(CpuAccounting *accounting, GstElement *element)
+{
+    ElementCpu *tracked = &accounting->elements[accounting->n_elements];
+    GstPad *sink_pad = gst_element_get_static_pad(element, "sink");
+    GstPad *src_pad = gst_element_get_static_pad(element, "src");
+
+    tracked->element = element;
+    tracked->index = accounting->n_elements++;
+    gst_pad_add_probe(sink_pad, GST_PAD_PROBE_TYPE_BUFFER, element_sink_probe, tracked, NULL);
+    gst_pad_add_probe(src_pad, GST_PAD_PROBE_TYPE_BUFFER, element_src_probe, tracked, NULL);
+
+    gst_object_unref(sink_pad);
+    gst_object_unref(src_pad);
+}
+
+/*
+ * The ENTER stream-status message is posted from the new streaming thread by
+ * the pad that owns the task: name the thread after it and remember its tid.
+ * Threads spawned later from it (x264 and OpenCV workers) inherit the name.
+ */
+static GstBusSyncReply stream_status_sync_handler(GstBus *bus, GstMessage *msg, gpointer user_data)
+{
+    CpuAccounting *accounting = (CpuAccounting *)user_data;
+    GstStreamStatusType type;
+    GstElement *owner;
+    ThreadCpu *thread;
+
+    if (GST_MESSAGE_TYPE(msg) != GST_MESSAGE_STREAM_STATUS)
+        return GST_BUS_PASS;
+
+    gst_message_parse_stream_status(msg, &type, &owner);
+    if (type != GST_STREAM_STATUS_TYPE_ENTER)
+        return GST_BUS_PASS;
+
+    g_mutex_lock(&accounting->lock);
+    if (accounting->n_threads < MAX_THREADS)
+    {
+        thread = &accounting->threads[accounting->n_threads++];
+        thread->tid = (pid_t)syscall(SYS_gettid);
+        thread->name = g_strdup_printf("%s:%s", GST_ELEMENT_NAME(owner), GST_MESSAGE_SRC_NAME(msg));
+        g_strlcpy(thread->comm, thread->name, sizeof(thread->comm));
+        prctl(PR_SET_NAME, thread->comm, 0, 0, 0);
+    }
+    g_mutex_unlock(&accounting->lock);
+
+    return GST_BUS_PASS;
+}
+
+/* utime + stime of /proc/self/task/<tid>/stat in clock ticks, and the thread's comm */
+static gboolean read_task_stat(const gchar *tid, gchar *comm, gsize comm_size, guint64 *ticks)
+{
+    gchar *path = g_strdup_printf("/proc/self/task/%s/stat", tid);
+    gchar *contents = NULL, *open_paren, *close_paren;
+    unsigned long long utime, stime;
+    gboolean ok = FALSE;
+
+    if (g_file_get_contents(path, &contents, NULL, NULL))
+    {
+        // comm may contain spaces and parentheses: it runs from the first '(' to the last ')'
+        open_paren = strchr(contents, '(');
+        close_paren = strrchr(contents, ')');
+        if (open_paren && close_paren && close_paren > open_paren &&
+            sscanf(close_paren + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu", &utime, &stime) == 2)
+        {
+            g_strlcpy(comm, open_paren + 1, MIN(comm_size, (gsize)(close_paren - open_paren)));
+            *ticks = utime + stime;
+            ok = TRUE;
+        }
+    }
+
+    g_free(contents);
+    g_free(path);
+    return ok;
+}
+
+/*
+ * Sample every task of the process and print CPU-ms per second per streaming
+ * thread (helper threads are folded into the thread they inherited their name
+ * from) and per tracked element.
+ */
+static void report_cpu(CpuAccounting *accounting, GHashTable *helper_ticks, gdouble elapsed_s)
+{
+    static GHashTable *last_ticks = NULL;
+    long ticks_per_s = sysconf(_SC_CLK_TCK);
+    DIR *dir = opendir("/proc/self/task");
+    struct dirent *entry;
+    GHashTableIter iter;
+    gpointer key, value;
+
+    if (last_ticks == NULL)
+        last_ticks = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, g_free);
+    if (dir == NULL)
+        return;
+
+    g_mutex_lock(&accounting->lock);
+    for (guint i = 0; i < accounting->n_threads; i++)
+        accounting->threads[i].seen = FALSE;
+    g_hash_table_remove_all(helper_ticks);
+
+    while ((entry = readdir(dir)) != NULL)
+    {
+        gchar comm[16];
+        guint64 ticks, delta, *previous;
+        pid_t tid = atoi(entry->d_name);
+        gboolean streaming = FALSE;
+
+        if (tid <= 0 || !read_task_stat(entry->d_name, comm, sizeof(comm), &ticks))
+            continue;
+
+        previous = g_hash_table_lookup(last_ticks, GINT_TO_POINTER(tid));
+        delta = previous ? ticks - *previous : 0;
+        if (!previous)
+        {
+            previous = g_new(guint64, 1);
+            g_hash_table_insert(last_ticks, GINT_TO_POINTER(tid), previous);
+        }
+        *previous = ticks;
+
+        for (guint i = 0; i < accounting->n_threads; i++)
+        {
+            if (accounting->threads[i].tid == tid)
+            {
+                accounting->threads[i].delta_ticks = delta;
+                accounting->threads[i].seen = TRUE;
+                streaming = TRUE;
+                break;
+            }
+        }
+        if (!streaming)
+        {
+            guint64 *helper = g_hash_table_lookup(helper_ticks, comm);
+            if (!helper)
+            {
+                helper = g_new0(guint64, 1);
+                g_hash_table_insert(helper_ticks, g_strdup(comm), helper);
+            }
+            *helper += delta;
+        }
+    }
+    closedir(dir);
+
+    g_print("---- CPU-ms per second ----\n");
+    for (guint i = 0; i < accounting->n_threads; i++)
+    {
+        ThreadCpu *thread = &accounting->threads[i];
+        guint64 *helper = g_hash_table_lookup(helper_ticks, thread->comm);
+        if (!thread->seen)
+            continue;
+        g_print("thread %-28s %8.1f", thread->name, thread->delta_ticks * 1000.0 / ticks_per_s / elapsed_s);
+        if (helper)
+        {
+            g_print("  + helpers %8.1f", *helper * 1000.0 / ticks_per_s / elapsed_s);
+            g_hash_table_remove(helper_ticks, thread->comm);
+        }
+        g_print("\n");
+    }
+    g_mutex_unlock(&accounting->lock);
+
+    g_hash_table_iter_init(&iter, helper_ticks);
+    while (g_hash_table_iter_next(&iter, &key, &value))
+        g_print("other  %-28s %8.1f\n", (gchar *)key, *(guint64 *)value * 1000.0 / ticks_per_s / elapsed_s);
+
+    for (guint i = 0; i < accounting->n_elements; i++)
+    {
+        ElementCpu *element = &accounting->elements[i];
+        guint64 cpu_ns = __atomic_exchange_n(&element->cpu_ns, 0, __ATOMIC_RELAXED);
+        g_print("element %-27s %8.1f\n", GST_ELEMENT_NAME(element->element), cpu_ns / 1e6 / elapsed_s);
+    }
+}
+
+/* This function will be called by the pad-added signal */
+static void pad_added_handler(GstElement *src, GstPad *new_pad, CustomData *data)
+{
+    GstPad *video_sink_pad = gst_element_get_static_pad(data->video_queue, "sink");
+    GstPad *audio_sink_pad = gst_element_get_static_pad(data->audio_queue, "sink");
+    GstPadLinkReturn ret;
+    GstCaps *new_pad_caps = NULL;
+    GstStructure *new_pad_struct = NULL;
+    const gchar *new_pad_type = NULL;
+
+    g_print("Received new pad '%s' from '%s':\n", GST_PAD_NAME(new_pad), GST_ELEMENT_NAME(src));
+
+    /* If our queues are already linked, we have nothing to do here */
+
+    /* Check the new pad's type */
+    new_pad_caps = gst_pad_get_current_caps(new_pad);
+    new_pad_struct = gst_caps_get_structure(new_pad_caps, 0);
+    new_pad_type = gst_structure_get_name(new_pad_struct);
+    if (g_str_has_prefix(new_pad_type, "video/x-raw"))
+    {
+        if (gst_pad_is_linked(video_sink_pad))
+        {
+            g_print("We are already linked. Ignoring.\n");
+            goto exit;
+        }
+
+        ret = gst_pad_link(new_pad, video_sink_pad);
+    }
+    else if (g_str_has_prefix(new_pad_type, "audio/x-raw"))
+    {
+        if (gst_pad_is_linked(audio_sink_pad))
+        {
+            g_print("We are already linked. Ignoring.\n");
+            goto exit;
+        }
+
+        ret = gst_pad_link(new_pad, audio_sink_pad);
+    }
+    else
+    {
+        g_print("It has type '%s' which is not raw video/audio. Ignoring.\n", new_pad_type);
+        goto exit;
+    }
+
+    if (GST_PAD_LINK_FAILED(ret))
+    {
+        g_print("Type is '%s' but link failed.\n", new_pad_type);
+    }
+    else
+    {
+        g_print("Link succeeded (type '%s').\n", new_pad_type);
+    }
+
+exit:
+    /* Unreference the new pad's caps, if we got them */
+    if (new_pad_caps != NULL)
+        gst_caps_unref(new_pad_caps);
+
+    /* Unreference the sink pads */
+    gst_object_unref(video_sink_pad);
+    gst_object_unref(audio_sink_pad);
+}
+
+int main(int argc, char *argv[])
+{
+    CustomData data;
+    GstBus *bus;
+    GstMessage *msg;
+
+    GstPad *video_tee_flv_pad, *video_tee_mp4_pad;
+    GstPad *video_flv_queue_sink_pad, *splitmuxsink_video_pad;
+
+    GstPad *audio_tee_flv_pad, *audio_tee_mp4_pad;
+    GstPad *audio_flv_queue_sink_pad, *splitmuxsink_audio_pad;
+
+    GstPad *video_flv_queue_src_pad, *audio_flv_queue_src_pad;
+    GstPad *flv_mux_video_pad, *flv_mux_audio_pad;
+
+    CpuAccounting accounting = {0};
+    GHashTable *helper_ticks = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+    gint64 last_report;
+
+    /* Initialize GStreamer */
+    gst_init(&argc, &argv);
+
+    /* Create the elements */
+    data.source = gst_element_factory_make("uridecodebin", "source");
+
+    data.video_queue = gst_element_factory_make("queue", "video_queue");
+    data.video_convert = gst_element_factory_make("videoconvert", "video_convert");
+    data.face_blur = gst_element_factory_make("faceblur", "face_blur");
+    data.video_convert2 = gst_element_factory_make("videoconvert", "video_convert2");
+    data.x264_enc = gst_element_factory_make("x264enc", "x264_enc");
+    data.video_tee = gst_element_factory_make("tee", "video_tee");
+    data.video_flv_queue = gst_element_factory_make("queue", "video_flv_queue");
+
+    data.audio_queue = gst_element_factory_make("queue", "audio_queue");
+    data.audio_convert = gst_element_factory_make("audioconvert", "audio_convert");
+    data.audio_resample = gst_element_factory_make("audioresample", "audio_resample");
+    data.avenc_aac = gst_element_factory_make("fdkaacenc", "avenc_aac");
+    data.audio_tee = gst_element_factory_make("tee", "audio_tee");
+    data.audio_flv_queue = gst_element_factory_make("queue", "audio_flv_queue");
+
+    data.flv_mux = gst_element_factory_make("flvmux", "flv_mux");
+    data.flv_filesink = gst_element_factory_make("filesink", "flv_filesink");
+    data.split_mux_sink = gst_element_factory_make("splitmuxsink", "split_mux_sink");
+    data.gcs_sink = gst_element_factory_make("awss3sink", "gcs_sink");
+
+    /* Create the empty pipeline */
+    data.pipeline = gst_pipeline_new("test-pipeline");
+
+    if (!data.pipeline || !data.source ||
+        !data.video_queue || !data.video_convert || !data.face_blur || !data.video_convert2 || !data.x264_enc || !data.video_tee || !data.video_flv_queue ||
+        !data.audio_queue || !data.audio_convert || !data.audio_resample || !data.avenc_aac || !data.audio_tee || !data.audio_flv_queue ||
+        !data.flv_mux || !data.flv_filesink || !data.split_mux_sink || !data.gcs_sink)
+    {
+        g_printerr("Not all elements could be created.\n");
+        return -1;
+    }
+    else
+    {
+        g_print("All elements created successfully.\n");
+    }
+
+    /* Configure elements */
+    g_object_set(data.source, "uri", "add-here", NULL);
+    g_object_set(data.x264_enc, "speed-preset", 2, "pass", 5, "bitrate", 1200, "key-int-max", 30, "quantizer", 22, NULL);
+    g_object_set(data.face_blur, "scale-factor", 1.1, "profile", "/usr/share/opencv4/haarcascades/haarcascade_frontalface_alt.xml", NULL);
+
+    g_object_set(data.avenc_aac, "rate-control", 1, "vbr-preset", 1, NULL);
+    g_object_set(data.flv_mux, "streamable", true, "enforce-increasing-timestamps", false, NULL);
+    g_object_set(data.flv_filesink, "location", "/home/ubuntu/vivek-personal/flvtest/output.flv", "sync", true, NULL);
+    g_object_set(data.gcs_sink, "access-key", "add-here", "bucket", "livestream-recording-service-stage-bucket", "endpoint-uri", "https://storage.googleapis.com", "force-path-style", true, "region", "asia-southeast1", "secret-access-key", "add-here", "sync", true, NULL);
+    g_object_set(data.split_mux_sink, "max-size-time", (guint64)SEGMENT_DURATION * GST_MSECOND, "send-keyframe-requests", true, "sink", data.gcs_sink, NULL);
+
+    // Connect the format-location signal to generate dynamic filenames
+    g_signal_connect(data.split_mux_sink, "format-location", G_CALLBACK(format_location_callback), data.gcs_sink);
+    /* Connect to the pad-added signal */
+    g_signal_connect(data.source, "pad-added", G_CALLBACK(pad_added_handler), &data);
+
+    g_print("All elements configured successfully.\n");
+
+    /* Link all elements that can be automatically linked because they have "Always" pads */
+    gst_bin_add_many(GST_BIN(data.pipeline), data.source,
+                     data.video_queue, data.video_convert, data.face_blur, data.video_convert2, data.x264_enc, data.video_tee, data.video_flv_queue,
+                     data.audio_queue, data.audio_convert, data.audio_resample, data.avenc_aac, data.audio_tee, data.audio_flv_queue,
+                     data.flv_mux, data.flv_filesink, data.split_mux_sink, NULL);
+
+    if (gst_element_link_many(data.video_queue, data.video_convert, data.face_blur, NULL) != TRUE ||
+        gst_element_link_many(data.face_blur, data.video_convert2, data.x264_enc, data.video_tee, NULL) != TRUE ||
+
+        gst_element_link_many(data.audio_queue, data.audio_convert, data.audio_resample, NULL) != TRUE ||
+        link_elements_with_audio_filter(data.audio_resample, data.avenc_aac, 16000, 1) != TRUE ||
+        gst_element_link(data.avenc_aac, data.audio_tee) != TRUE ||
+
+        gst_element_link_many(data.flv_mux, data.flv_filesink, NULL) != TRUE)
+    {
+        g_printerr("Elements could not be linked.\n");
+        gst_object_unref(data.pipeline);
+        return -1;
+    }
+    else
+    {
+        g_print("All elements linked successfully.\n");
+    }
+
+    /* Manually link the video_tee, which has "Request" pads */
+    video_tee_flv_pad = gst_element_request_pad_simple(data.video_tee, "src_%u");
+    g_print("Obtained request pad %s for video_tee's flvmux branch.\n", GST_PAD_NAME(video_tee_flv_pad));
+    video_flv_queue_sink_pad = gst_element_get_static_pad(data.video_flv_queue, "sink");
+
+    video_tee_mp4_pad = gst_element_request_pad_simple(data.video_tee, "src_%u");
+    g_print("Obtained request pad %s for video_tee's mp4mux branch.\n", GST_PAD_NAME(video_tee_mp4_pad));
+    splitmuxsink_video_pad = gst_element_request_pad_simple(data.split_mux_sink, "video");
+    g_print("Obtained request pad %s for splitmuxsink video branch.\n", GST_PAD_NAME(splitmuxsink_video_pad));
+
+    if (gst_pad_link(video_tee_flv_pad, video_flv_queue_sink_pad) != GST_PAD_LINK_OK ||
+        gst_pad_link(video_tee_mp4_pad, splitmuxsink_video_pad) != GST_PAD_LINK_OK)
+    {
+        g_printerr("video_tee could not be linked.\n");
+        gst_object_unref(data.pipeline);
+        return -1;
+    }
+    else
+    {
+        g_print("video_tee linked successfully.\n");
+    }
+    gst_object_unref(video_flv_queue_sink_pad);
+    gst_object_unref(splitmuxsink_video_pad);
+
+    /* Manually link the audio_tee, which has "Request" pads */
+    audio_tee_flv_pad = gst_element_request_pad_simple(data.audio_tee, "src_%u");
+    g_print("Obtained request pad %s for audio_tee's flvmux branch.\n", GST_PAD_NAME(audio_tee_flv_pad));
+    audio_flv_queue_sink_pad = gst_element_get_static_pad(data.audio_flv_queue, "sink");
+
+    audio_tee_mp4_pad = gst_element_request_pad_simple(data.audio_tee, "src_%u");
+    g_print("Obtained request pad %s for audio_tee's mp4mux branch.\n", GST_PAD_NAME(audio_tee_mp4_pad));
+    splitmuxsink_audio_pad = gst_element_request_pad_simple(data.split_mux_sink, "audio_%u");
+    g_print("Obtained request pad %s for splitmuxsink audio branch.\n", GST_PAD_NAME(splitmuxsink_audio_pad));
+
+    if (gst_pad_link(audio_tee_flv_pad, audio_flv_queue_sink_pad) != GST_PAD_LINK_OK ||
+        gst_pad_link(audio_tee_mp4_pad, splitmuxsink_audio_pad) != GST_PAD_LINK_OK)
+    {
+        g_printerr("audio_tee could not be linked.\n");
+        gst_object_unref(data.pipeline);
+        return -1;
+    }
+    else
+    {
+        g_print("audio_tee linked successfully.\n");
+    }
+    gst_object_unref(audio_flv_queue_sink_pad);
+    gst_object_unref(splitmuxsink_audio_pad);
+
+    /* Manually link the flvmux which has "Request" pads */
+    video_flv_queue_src_pad = gst_element_get_static_pad(data.video_flv_queue, "src");
+    flv_mux_video_pad = gst_element_request_pad_simple(data.flv_mux, "video");
+    g_print("Obtained request pad %s for flvmux video branch.\n", GST_PAD_NAME(flv_mux_video_pad));
+
+    audio_flv_queue_src_pad = gst_element_get_static_pad(data.audio_flv_queue, "src");
+    flv_mux_audio_pad = gst_element_request_pad_simple(data.flv_mux, "audio");
+    g_print("Obtained request pad %s for flvmux audio branch.\n", GST_PAD_NAME(flv_mux_audio_pad));
+
+    if (gst_pad_link(video_flv_queue_src_pad, flv_mux_video_pad) != GST_PAD_LINK_OK ||
+        gst_pad_link(audio_flv_queue_src_pad, flv_mux_audio_pad) != GST_PAD_LINK_OK)
+    {
+        g_printerr("flvmux could not be linked!\n");
+        gst_object_unref(data.pipeline);
+        return -1;
+    }
+    else
+    {
+        g_print("flvmux linked successfully.\n");
+    }
+    gst_object_unref(video_flv_queue_src_pad);
+    gst_object_unref(audio_flv_queue_src_pad);
+
+    /* Per-element CPU time, measured in whichever streaming thread runs the element */
+    g_mutex_init(&accounting.lock);
+    track_element(&accounting, data.video_convert);
+    track_element(&accounting, data.face_blur);
+    track_element(&accounting, data.video_convert2);
+    track_element(&accounting, data.x264_enc);
+    track_element(&accounting, data.audio_convert);
+    track_element(&accounting, data.audio_resample);
+    track_element(&accounting, data.avenc_aac);
+
+    /* Name and register every streaming thread as it starts */
+    bus = gst_element_get_bus(data.pipeline);
+    gst_bus_set_sync_handler(bus, stream_status_sync_handler, &accounting, NULL);
+
+    /* Start playing the pipeline */
+    gst_element_set_state(data.pipeline, GST_STATE_PLAYING);
+
+    /* Visualize the pipeline using GraphViz */
+    gst_debug_bin_to_dot_file(GST_BIN(data.pipeline), GST_DEBUG_GRAPH_SHOW_ALL, "pipeline-faceblur-cpu");
+
+    /* Wait until error or EOS, reporting CPU usage every REPORT_INTERVAL seconds */
+    last_report = g_get_monotonic_time();
+    while ((msg = gst_bus_timed_pop_filtered(bus, REPORT_INTERVAL * GST_SECOND, GST_MESSAGE_ERROR | GST_MESSAGE_EOS)) == NULL)
+    {
+        gint64 now = g_get_monotonic_time();
+        report_cpu(&accounting, helper_ticks, (now - last_report) / 1e6);
+        last_report = now;
+    }
+
+    /* Release the request pads from the video_tee, and unref them */
+    gst_element_release_request_pad(data.video_tee, video_tee_flv_pad);
+    gst_element_release_request_pad(data.video_tee, video_tee_mp4_pad);
+    gst_object_unref(video_tee_flv_pad);
+    gst_object_unref(video_tee_mp4_pad);
+
+    /* Release the request pads from the audio_tee, and unref them */
+    gst_element_release_request_pad(data.audio_tee, audio_tee_flv_pad);
+    gst_element_release_request_pad(data.audio_tee, audio_tee_mp4_pad);
+    gst_object_unref(audio_tee_flv_pad);
+    gst_object_unref(audio_tee_mp4_pad);
+
+    /* Release the request pads from flvmux, and unref them */
+    gst_element_release_request_pad(data.flv_mux, flv_mux_video_pad);
+    gst_element_release_request_pad(data.flv_mux, flv_mux_audio_pad);
+    gst_object_unref(flv_mux_video_pad);
+    gst_object_unref(flv_mux_audio_pad);
+
+    /* Free resources */
+    if (msg != NULL)
+        gst_message_unref(msg);
+    gst_object_unref(bus);
+    gst_element_set_state(data.pipeline, GST_STATE_NULL);
+
+    gst_object_unref(data.pipeline);
+
+    for (guint i = 0; i < accounting.n_threads; i++)
+        g_free(accounting.threads[i].name);
+    g_mutex_clear(&accounting.lock);
+    g_hash_table_destroy(helper_ticks);
+    return 0;
+}
@@ -0,0 +1,650 @@
+#include <gst/gst.h>
+#include <stdbool.h>
+#include <time.h>
+#include <sys/time.h>
+
+#define SEGMENT_DURATION 15000 // Duration for each segment in milliseconds
+#define EXPORT_INTERVAL 10 // Seconds between rewrites of the Prometheus text file
+#define PROMETHEUS_PATH "/home/ubuntu/vivek-personal/latency/faceblur-latency.prom"
+#define SUMMARY_PATH "/home/ubuntu/vivek-personal/latency/faceblur-latency.json"
+#define MAX_PENDING 512 // Buffers remembered per span before the oldest entry is dropped
+
+/*
+ * Log-linear (HDR style) histogram of nanoseconds: 64 sub-buckets per power
+ * of two, i.e. about 3% worst case relative error, from 1 ns to 2^64 ns.
+ */
+#define HISTOGRAM_SUB_BITS 6
+#define HISTOGRAM_SUB_BUCKETS (1 << HISTOGRAM_SUB_BITS)
+#define HISTOGRAM_BUCKETS (64 - HISTOGRAM_SUB_BITS + 1)
+
+typedef struct {
+    guint64 counts[HISTOGRAM_BUCKETS][HISTOGRAM_SUB_BUCKETS];
+    guint64 total;
+    guint64 sum;
+    guint64 min;
+    guint64 max;
+} LatencyHistogram;
+
+typedef struct {
+    GstClockTime pts;
+    GstClockTime entered;
+} PendingBuffer;
+
+/*
+ * Time spent by buffers between an entry pad and an exit pad: one span per
+ * element src pad (processing + queueing time of that element) and one per
+ * source-to-splitmuxsink path (end-to-end latency).
+ */
+typedef struct {
+    gchar *name;
+    GMutex lock;
+    GQueue pending;     // PendingBuffer entries ordered by arrival
+    LatencyHistogram histogram;
+} LatencySpan;
+
+typedef struct _CustomData
+{
+    GstElement *pipeline;
+    GstElement *source;
+
+    GstElement *video_queue;
+    GstElement *video_convert;
+    GstElement *face_blur;
+    GstElement *video_convert2;
+    GstElement *x264_enc;
+    GstElement *video_tee;
+    GstElement *video_flv_queue;
+
+    GstElement *audio_source;
+    GstElement *audio_queue;
+    GstElement *audio_convert;
+    GstElement *audio_resample;
+    GstElement *avenc_aac;
+    GstElement *audio_tee;
+    GstElement *audio_flv_queue;
+
+    GstElement *flv_mux;
+    GstElement *flv_filesink;
+    GstElement *split_mux_sink;
+    GstElement *gcs_sink;
+} CustomData;
+
+// Function to get the current time in milliseconds since the Unix epoch
+static long long current_time_millis()
+{
+    struct timeval time_now;
+    gettimeofday(&time_now, NULL);
+    return (long long)(time_now.tv_sec) * 1000 + (long long)(time_now.tv_usec) / 1000;
+}
+
+static gchar *format_location_callback(GstElement *splitmuxsink, guint fragment_id, gpointer user_data)
+{
+    // Get the (Unix epoch time) for start and end time
+    long long start_time = current_time_millis();
+    long long end_time = start_time + SEGMENT_DURATION;
+
+    gchar *filename = g_strdup_printf("vm/4/%lld_%lld.mp4", start_time, end_time);
+
+    GstElement *gcs_sink = GST_ELEMENT(user_data); // Retrieve gcs_sink passed via user_data
+    if (gcs_sink)
+    {
+        g_object_set(gcs_sink, "key", filename, NULL); // Set the key dynamically
+    }
+
+    return filename;
+}
+
+static gboolean link_elements_with_video_filter(GstElement *element1, GstElement *element2)
+{
+    gboolean link_ok;
+    GstCaps *caps;
+
+    caps = gst_caps_new_simple("video/x-raw",
+                               "format", G_TYPE_STRING, "I420",
+                               "width", G_TYPE_INT, 360,
+                               "height", G_TYPE_INT, 640,
+                               "framerate", GST_TYPE_FRACTION, 15, 1,
+                               NULL);
+
+    link_ok = gst_element_link_filtered(element1, element2, caps);
+    gst_caps_unref(caps);
+
+    if (!link_ok)
+    {
+        g_warning("Failed to link element1 and element2 using video filter!");
+    }
+
+    return link_ok;
+}
+
+static gboolean link_elements_with_audio_filter(GstElement *element1, GstElement *element2, int sampleRate, int numChannels)
+{
+    gboolean link_ok;
+    GstCaps *caps;
+
+    caps = gst_caps_new_simple("audio/x-raw",
+                               "rate", G_TYPE_INT, sampleRate,
+                               "channels", G_TYPE_INT, numChannels,
+                               NULL);
+
+    link_ok = gst_element_link_filtered(element1, element2, caps);
+    gst_caps_unref(caps);
+
+    if (!link_ok)
+    {
+        g_warning("Failed to link element1 and element2 using audio filter!");
+    }
+
+    return link_ok;
+}
+
+static void histogram_record(LatencyHistogram *h, guint64 value)
+{
+    int msb = 63 - __builtin_clzll(value | (HISTOGRAM_SUB_BUCKETS - 1));
+    int bucket = msb - (HISTOGRAM_SUB_BITS - 1);
+    int sub_bucket = (int)(value >> bucket);
+
+    h->counts[bucket][sub_bucket]++;
+    if (h->total == 0 || value < h->min)
+        h->min = value;
+    if (value > h->max)
+        h->max = value;
+    h->total++;
+    h->sum += value;
+}
+
+/* Upper bound of the sub-bucket holding the given quantile */
+static guint64 histogram_quantile(const LatencyHistogram *h, gdouble quantile)
+{
+    guint64 target = (guint64)(quantile * h->total);
+    guint64 seen = 0;
+
+    if (h->total == 0)
+        return 0;
+    if (target >= h->total)
+        target = h->total - 1;
+
+    for (int bucket = 0; bucket < HISTOGRAM_BUCKETS; bucket++)
+    {
+        // Bucket 0 uses every sub-bucket, the others only the upper half
+        for (int sub_bucket = bucket == 0 ? 0 : HISTOGRAM_SUB_BUCKETS / 2; sub_bucket < HISTOGRAM_SUB_BUCKETS; sub_bucket++)
+        {
+            seen += h->counts[bucket][sub_bucket];
+            if (seen > target)
+                return MIN(((guint64)(sub_bucket + 1) << bucket) - 1, h->max);
+        }
+    }
+
+    return h->max;
+}
+
+static GstPadProbeReturn span_entry_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+    LatencySpan *span = (LatencySpan *)user_data;
+    GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+    PendingBuffer *entry;
+
+    if (!GST_BUFFER_PTS_IS_VALID(buffer))
+        return GST_PAD_PROBE_OK;
+
+    entry = g_new(PendingBuffer, 1);
+    entry->pts = GST_BUFFER_PTS(buffer);
+    entry->entered = gst_util_get_timestamp();
+
+    g_mutex_lock(&span->lock);
+    g_queue_push_tail(&span->pending, entry);
+    if (g_queue_get_length(&span->pending) > MAX_PENDING)
+        g_free(g_queue_pop_head(&span->pending));
+    g_mutex_unlock(&span->lock);
+
+    return GST_PAD_PROBE_OK;
+}
+
+/*
+ * Match the outgoing buffer with the newest entry whose PTS is not later than
+ * its own. This handles 1:1 elements as well as encoders and queues that
+ * merge, split or drop buffers.
+ */
+static GstPadProbeReturn span_exit_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+    LatencySpan *span = (LatencySpan *)user_data;
+    GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+    GstClockTime now = gst_util_get_timestamp();
+    PendingBuffer *entry, *matched = NULL;
+
+    if (!GST_BUFFER_PTS_IS_VALID(buffer))
+        return GST_PAD_PROBE_OK;
+
+    g_mutex_lock(&span->lock);
+    while ((entry = g_queue_peek_head(&span->pending)) != NULL && entry->pts <= GST_BUFFER_PTS(buffer))
+    {
+        g_free(matched);
+        matched = g_queue_pop_head(&span->pending);
+    }
+    if (matched != NULL)
+        histogram_record(&span->histogram, now - matched->entered);
+    g_mutex_unlock(&span->lock);
+
+    g_free(matched);
+    return GST_PAD_PROBE_OK;
+}
+
+static LatencySpan *latency_span_new(GPtrArray *spans, GstPad *entry_pad, GstPad *exit_pad, const gchar *name)
+{
+    LatencySpan *span = g_new0(LatencySpan, 1);
+
+    span->name = g_strdup(name);
+    g_mutex_init(&span->lock);
+    g_queue_init(&span->pending);
+    gst_pad_add_probe(entry_pad, GST_PAD_PROBE_TYPE_BUFFER, span_entry_probe, span, NULL);
+    gst_pad_add_probe(exit_pad, GST_PAD_PROBE_TYPE_BUFFER, span_exit_probe, span, NULL);
+    g_ptr_array_add(spans, span);
+
+    return span;
+}
+
+/* One span from the element's sink pad to the given src pad, named element:pad */
+static void add_element_span(GPtrArray *spans, GstElement *element, GstPad *src_pad)
+{
+    GstPad *sink_pad = gst_element_get_static_pad(element, "sink");
+    gchar *name = g_strdup_printf("%s:%s", GST_ELEMENT_NAME(element), GST_PAD_NAME(src_pad));
+
+    latency_span_new(spans, sink_pad, src_pad, name);
+
+    g_free(name);
+    gst_object_unref(sink_pad);
+}
+
+static void add_element_spans(GPtrArray *spans, GstElement *element)
+{
+    GstPad *src_pad = gst_element_get_static_pad(element, "src");
+
+    add_element_span(spans, element, src_pad);
+    gst_object_unref(src_pad);
+}
+
+static void latency_span_free(gpointer data)
+{
+    LatencySpan *span = (LatencySpan *)data;
+
+    g_queue_clear_full(&span->pending, g_free);
+    g_mutex_clear(&span->lock);
+    g_free(span->name);
+    g_free(span);
+}
+
+/* Rewrite the Prometheus text file atomically so a node exporter never reads a partial file */
+static void write_prometheus(GPtrArray *spans)
+{
+    static const gdouble quantiles[] = {0.5, 0.9, 0.99, 0.999};
+    GString *out = g_string_new("# HELP faceblur_latency_seconds Time buffers spend between two pads.\n"
+                                "# TYPE faceblur_latency_seconds summary\n");
+    GError *err = NULL;
+
+    for (guint i = 0; i < spans->len; i++)
+    {
+        LatencySpan *span = g_ptr_array_index(spans, i);
+
+        g_mutex_lock(&span->lock);
+        for (guint q = 0; q < G_N_ELEMENTS(quantiles); q++)
+        {
+            g_string_append_printf(out, "faceblur_latency_seconds{span=\"%s\",quantile=\"%g\"} %.9f\n",
+                                   span->name, quantiles[q], histogram_quantile(&span->histogram, quantiles[q]) / 1e9);
+        }
+        g_string_append_printf(out, "faceblur_latency_seconds_sum{span=\"%s\"} %.9f\n", span->name, span->histogram.sum / 1e9);
+        g_string_append_printf(out, "faceblur_latency_seconds_count{span=\"%s\"} %" G_GUINT64_FORMAT "\n", span->name, span->histogram.total);
+        g_mutex_unlock(&span->lock);
+    }
+
+    if (!g_file_set_contents(PROMETHEUS_PATH, out->str, out->len, &err))
+    {
+        g_printerr("Could not write %s: %s\n", PROMETHEUS_PATH, err->message);
+        g_error_free(err);
+    }
+    g_string_free(out, TRUE);
+}
+
+/* Summary in microseconds, written once at EOS or error */
+static void write_summary(GPtrArray *spans)
+{
+    GString *out = g_string_new("{\n  \"spans\": [\n");
+    GError *err = NULL;
+
+    for (guint i = 0; i < spans->len; i++)
+    {
+        LatencySpan *span = g_ptr_array_index(spans, i);
+        LatencyHistogram *h = &span->histogram;
+
+        g_mutex_lock(&span->lock);
+        g_string_append_printf(out,
+                               "    {\"span\": \"%s\", \"count\": %" G_GUINT64_FORMAT ", \"min_us\": %.1f, \"mean_us\": %.1f, "
+                               "\"p50_us\": %.1f, \"p90_us\": %.1f, \"p99_us\": %.1f, \"p999_us\": %.1f, \"max_us\": %.1f}%s\n",
+                               span->name, h->total, h->min / 1e3, h->total ? (gdouble)h->sum / h->total / 1e3 : 0.0,
+                               histogram_quantile(h, 0.5) / 1e3, histogram_quantile(h, 0.9) / 1e3,
+                               histogram_quantile(h, 0.99) / 1e3, histogram_quantile(h, 0.999) / 1e3, h->max / 1e3,
+                               i + 1 < spans->len ? "," : "");
+        g_mutex_unlock(&span->lock);
+    }
+    g_string_append(out, "  ]\n}\n");
+
+    if (!g_file_set_contents(SUMMARY_PATH, out->str, out->len, &err))
+    {
+        g_printerr("Could not write %s: %s\n", SUMMARY_PATH, err->message);
+        g_error_free(err);
+    }
+    else
+    {
+        g_print("Latency summary written to %s\n", SUMMARY_PATH);
+    }
+    g_string_free(out, TRUE);
+}
+
+/* This function will be called by the pad-added signal */
+static void pad_added_handler(GstElement *src, GstPad *new_pad, CustomData *data)
+{
+    GstPad *video_sink_pad = gst_element_get_static_pad(data->video_queue, "sink");
+    GstPad *audio_sink_pad = gst_element_get_static_pad(data->audio_queue, "sink");
+    GstPadLinkReturn ret;
+    GstCaps *new_pad_caps = NULL;
+    GstStructure *new_pad_struct = NULL;
+    const gchar *new_pad_type = NULL;
+
+    g_print("Received new pad '%s' from '%s':\n", GST_PAD_NAME(new_pad), GST_ELEMENT_NAME(src));
+
+    /* If our queues are already linked, we have nothing to do here */
+
+    /* Check the new pad's type */
+    new_pad_caps = gst_pad_get_current_caps(new_pad);
+    new_pad_struct = gst_caps_get_structure(new_pad_caps, 0);
+    new_pad_type = gst_structure_get_name(new_pad_struct);
+    if (g_str_has_prefix(new_pad_type, "video/x-raw"))
+    {
+        if (gst_pad_is_linked(video_sink_pad))
+        {
+            g_print("We are already linked. Ignoring.\n");
+            goto exit;
+        }
+
+        ret = gst_pad_link(new_pad, video_sink_pad);
+    }
+    else if (g_str_has_prefix(new_pad_type, "audio/x-raw"))
+    {
+        if (gst_pad_is_linked(audio_sink_pad))
+        {
+            g_print("We are already linked. Ignoring.\n");
+            goto exit;
+        }
+
+        ret = gst_pad_link(new_pad, audio_sink_pad);
+    }
+    else
+    {
+        g_print("It has type '%s' which is not raw video/audio. Ignoring.\n", new_pad_type);
+        goto exit;
+    }
+
+    if (GST_PAD_LINK_FAILED(ret))
+    {
+        g_print("Type is '%s' but link failed.\n", new_pad_type);
+    }
+    else
+    {
+        g_print("Link succeeded (type '%s').\n", new_pad_type);
+    }
+
+exit:
+    /* Unreference the new pad's caps, if we got them */
+    if (new_pad_caps != NULL)
+        gst_caps_unref(new_pad_caps);
+
+    /* Unreference the sink pads */
+    gst_object_unref(video_sink_pad);
+    gst_object_unref(audio_sink_pad);
+}
+
+int main(int argc, char *argv[])
+{
+    CustomData data;
+    GstBus *bus;
+    GstMessage *msg;
+
+    GstPad *video_tee_flv_pad, *video_tee_mp4_pad;
+    GstPad *video_flv_queue_sink_pad, *splitmuxsink_video_pad;
+
+    GstPad *audio_tee_flv_pad, *audio_tee_mp4_pad;
+    GstPad *audio_flv_queue_sink_pad, *splitmuxsink_audio_pad;
+
+    GstPad *video_flv_queue_src_pad, *audio_flv_queue_src_pad;
+    GstPad *flv_mux_video_pad, *flv_mux_audio_pad;
+
+    GPtrArray *spans = g_ptr_array_new_with_free_func(latency_span_free);
+    GstPad *video_ingress_pad, *audio_ingress_pad;
+    gboolean terminate = FALSE;
+
+    /* Initialize GStreamer */
+    gst_init(&argc, &argv);
+
+    /* Create the elements */
+    data.source = gst_element_factory_make("uridecodebin", "source");
+
+    data.video_queue = gst_element_factory_make("queue", "video_queue");
+    data.video_convert = gst_element_factory_make("videoconvert", "video_convert");
+    data.face_blur = gst_element_factory_make("faceblur", "face_blur");
+    data.video_convert2 = gst_element_factory_make("videoconvert", "video_convert2");
+    data.x264_enc = gst_element_factory_make("x264enc", "x264_enc");
+    data.video_tee = gst_element_factory_make("tee", "video_tee");
+    data.video_flv_queue = gst_element_factory_make("queue", "video_flv_queue");
+
+    data.audio_queue = gst_element_factory_make("queue", "audio_queue");
+    data.audio_convert = gst_element_factory_make("audioconvert", "audio_convert");
+    data.audio_resample = gst_element_factory_make("audioresample", "audio_resample");
+    data.avenc_aac = gst_element_factory_make("fdkaacenc", "avenc_aac");
+    data.audio_tee = gst_element_factory_make("tee", "audio_tee");
+    data.audio_flv_queue = gst_element_factory_make("queue", "audio_flv_queue");
+
+    data.flv_mux = gst_element_factory_make("flvmux", "flv_mux");
+    data.flv_filesink = gst_element_factory_make("filesink", "flv_filesink");
+    data.split_mux_sink = gst_element_factory_make("splitmuxsink", "split_mux_sink");
+    data.gcs_sink = gst_element_factory_make("awss3sink", "gcs_sink");
+
+    /* Create the empty pipeline */
+    data.pipeline = gst_pipeline_new("test-pipeline");
+
+    if (!data.pipeline || !data.source ||
+        !data.video_queue || !data.video_convert || !data.face_blur || !data.video_convert2 || !data.x264_enc || !data.video_tee || !data.video_flv_queue ||
+        !data.audio_queue || !data.audio_convert || !data.audio_resample || !data.avenc_aac || !data.audio_tee || !data.audio_flv_queue ||
+        !data.flv_mux || !data.flv_filesink || !data.split_mux_sink || !data.gcs_sink)
+    {
+        g_printerr("Not all elements could be created.\n");
+        return -1;
+    }
+    else
+    {
+        g_print("All elements created successfully.\n");
+    }
+
+    /* Configure elements */
+    g_object_set(data.source, "uri", "add-here", NULL);
+    g_object_set(data.x264_enc, "speed-preset", 2, "pass", 5, "bitrate", 1200, "key-int-max", 30, "quantizer", 22, NULL);
+    g_object_set(data.face_blur, "scale-factor", 1.1, "profile", "/usr/share/opencv4/haarcascades/haarcascade_frontalface_alt.xml", NULL);
+
+    g_object_set(data.avenc_aac, "rate-control", 1, "vbr-preset", 1, NULL);
+    g_object_set(data.flv_mux, "streamable", true, "enforce-increasing-timestamps", false, NULL);
+    g_object_set(data.flv_filesink, "location", "/home/ubuntu/vivek-personal/flvtest/output.flv", "sync", true, NULL);
+    g_object_set(data.gcs_sink, "access-key", "add-here", "bucket", "livestream-recording-service-stage-bucket", "endpoint-uri", "https://storage.googleapis.com", "force-path-style", true, "region", "asia-southeast1", "secret-access-key", "add-here", "sync", true, NULL);
+    g_object_set(data.split_mux_sink, "max-size-time", (guint64)SEGMENT_DURATION * GST_MSECOND, "send-keyframe-requests", true, "sink", data.gcs_sink, NULL);
+
+    // Connect the format-location signal to generate dynamic filenames
+    g_signal_connect(data.split_mux_sink, "format-location", G_CALLBACK(format_location_callback), data.gcs_sink);
+    /* Connect to the pad-added signal */
+    g_signal_connect(data.source, "pad-added", G_CALLBACK(pad_added_handler), &data);
+
+    g_print("All elements configured successfully.\n");
+
+    /* Link all elements that can be automatically linked because they have "Always" pads */
+    gst_bin_add_many(GST_BIN(data.pipeline), data.source,
+                     data.video_queue, data.video_convert, data.face_blur, data.video_convert2, data.x264_enc, data.video_tee, data.video_flv_queue,
+                     data.audio_queue, data.audio_convert, data.audio_resample, data.avenc_aac, data.audio_tee, data.audio_flv_queue,
+                     data.flv_mux, data.flv_filesink, data.split_mux_sink, NULL);
+
+    if (gst_element_link_many(data.video_queue, data.video_convert, data.face_blur, NULL) != TRUE ||
+        gst_element_link_many(data.face_blur, data.video_convert2, data.x264_enc, data.video_tee, NULL) != TRUE ||
+
+        gst_element_link_many(data.audio_queue, data.audio_convert, data.audio_resample, NULL) != TRUE ||
+        link_elements_with_audio_filter(data.audio_resample, data.avenc_aac, 16000, 1) != TRUE ||
+        gst_element_link(data.avenc_aac, data.audio_tee) != TRUE ||
+
+        gst_element_link_many(data.flv_mux, data.flv_filesink, NULL) != TRUE)
+    {
+        g_printerr("Elements could not be linked.\n");
+        gst_object_unref(data.pipeline);
+        return -1;
+    }
+    else
+    {
+        g_print("All elements linked successfully.\n");
+    }
+
+    /* Manually link the video_tee, which has "Request" pads */
+    video_tee_flv_pad = gst_element_request_pad_simple(data.video_tee, "src_%u");
+    g_print("Obtained request pad %s for video_tee's flvmux branch.\n", GST_PAD_NAME(video_tee_flv_pad));
+    video_flv_queue_sink_pad = gst_element_get_static_pad(data.video_flv_queue, "sink");
+
+    video_tee_mp4_pad = gst_element_request_pad_simple(data.video_tee, "src_%u");
+    g_print("Obtained request pad %s for video_tee's mp4mux branch.\n", GST_PAD_NAME(video_tee_mp4_pad));
+    splitmuxsink_video_pad = gst_element_request_pad_simple(data.split_mux_sink, "video");
+    g_print("Obtained request pad %s for splitmuxsink video branch.\n", GST_PAD_NAME(splitmuxsink_video_pad));
+
+    if (gst_pad_link(video_tee_flv_pad, video_flv_queue_sink_pad) != GST_PAD_LINK_OK ||
+        gst_pad_link(video_tee_mp4_pad, splitmuxsink_video_pad) != GST_PAD_LINK_OK)
+    {
+        g_printerr("video_tee could not be linked.\n");
+        gst_object_unref(data.pipeline);
+        return -1;
+    }
+    else
+    {
+        g_print("video_tee linked successfully.\n");
+    }
+    gst_object_unref(video_flv_queue_sink_pad);
+
+    /* Manually link the audio_tee, which has "Request" pads */
+    audio_tee_flv_pad = gst_element_request_pad_simple(data.audio_tee, "src_%u");
+    g_print("Obtained request pad %s for audio_tee's flvmux branch.\n", GST_PAD_NAME(audio_tee_flv_pad));
+    audio_flv_queue_sink_pad = gst_element_get_static_pad(data.audio_flv_queue, "sink");
+
+    audio_tee_mp4_pad = gst_element_request_pad_simple(data.audio_tee, "src_%u");
+    g_print("Obtained request pad %s for audio_tee's mp4mux branch.\n", GST_PAD_NAME(audio_tee_mp4_pad));
+    splitmuxsink_audio_pad = gst_element_request_pad_simple(data.split_mux_sink, "audio_%u");
+    g_print("Obtained request pad %s for splitmuxsink audio branch.\n", GST_PAD_NAME(splitmuxsink_audio_pad));
+
+    if (gst_pad_link(audio_tee_flv_pad, audio_flv_queue_sink_pad) != GST_PAD_LINK_OK ||
+        gst_pad_link(audio_tee_mp4_pad, splitmuxsink_audio_pad) != GST_PAD_LINK_OK)
+    {
+        g_printerr("audio_tee could not be linked.\n");
+        gst_object_unref(data.pipeline);
+        return -1;
+    }
+    else
+    {
+        g_print("audio_tee linked successfully.\n");
+    }
+    gst_object_unref(audio_flv_queue_sink_pad);
+
+    /* Manually link the flvmux which has "Request" pads */
+    video_flv_queue_src_pad = gst_element_get_static_pad(data.video_flv_queue, "src");
+    flv_mux_video_pad = gst_element_request_pad_simple(data.flv_mux, "video");
+    g_print("Obtained request pad %s for flvmux video branch.\n", GST_PAD_NAME(flv_mux_video_pad));
+
+    audio_flv_queue_src_pad = gst_element_get_static_pad(data.audio_flv_queue, "src");
+    flv_mux_audio_pad = gst_element_request_pad_simple(data.flv_mux, "audio");
+    g_print("Obtained request pad %s for flvmux audio branch.\n", GST_PAD_NAME(flv_mux_audio_pad));
+
+    if (gst_pad_link(video_flv_queue_src_pad, flv_mux_video_pad) != GST_PAD_LINK_OK ||
+        gst_pad_link(audio_flv_queue_src_pad, flv_mux_audio_pad) != GST_PAD_LINK_OK)
+    {
+        g_printerr("flvmux could not be linked!\n");
+        gst_object_unref(data.pipeline);
+        return -1;
+    }
+    else
+    {
+        g_print("flvmux linked successfully.\n");
+    }
+    gst_object_unref(video_flv_queue_src_pad);
+    gst_object_unref(audio_flv_queue_src_pad);
+
+    /* Per-element spans: sink pad to each src pad */
+    add_element_spans(spans, data.video_queue);
+    add_element_spans(spans, data.video_convert);
+    add_element_spans(spans, data.face_blur);
+    add_element_spans(spans, data.video_convert2);
+    add_element_spans(spans, data.x264_enc);
+    add_element_span(spans, data.video_tee, video_tee_flv_pad);
+    add_element_span(spans, data.video_tee, video_tee_mp4_pad);
+    add_element_spans(spans, data.video_flv_queue);
+    add_element_spans(spans, data.audio_queue);
+    add_element_spans(spans, data.audio_convert);
+    add_element_spans(spans, data.audio_resample);
+    add_element_spans(spans, data.avenc_aac);
+    add_element_span(spans, data.audio_tee, audio_tee_flv_pad);
+    add_element_span(spans, data.audio_tee, audio_tee_mp4_pad);
+    add_element_spans(spans, data.audio_flv_queue);
+
+    /* End-to-end spans: decoded source pad to splitmuxsink input */
+    video_ingress_pad = gst_element_get_static_pad(data.video_queue, "sink");
+    audio_ingress_pad = gst_element_get_static_pad(data.audio_queue, "sink");
+    latency_span_new(spans, video_ingress_pad, splitmuxsink_video_pad, "video:source-to-splitmuxsink");
+    latency_span_new(spans, audio_ingress_pad, splitmuxsink_audio_pad, "audio:source-to-splitmuxsink");
+    gst_object_unref(video_ingress_pad);
+    gst_object_unref(audio_ingress_pad);
+    gst_object_unref(splitmuxsink_video_pad);
+    gst_object_unref(splitmuxsink_audio_pad);
+
+    /* Start playing the pipeline */
+    gst_element_set_state(data.pipeline, GST_STATE_PLAYING);
+
+    /* Visualize the pipeline using GraphViz */
+    gst_debug_bin_to_dot_file(GST_BIN(data.pipeline), GST_DEBUG_GRAPH_SHOW_ALL, "pipeline-faceblur-latency");
+
+    /* Wait until error or EOS, exporting the histograms every EXPORT_INTERVAL seconds */
+    bus = gst_element_get_bus(data.pipeline);
+    do
+    {
+        msg = gst_bus_timed_pop_filtered(bus, EXPORT_INTERVAL * GST_SECOND, GST_MESSAGE_ERROR | GST_MESSAGE_EOS);
+        if (msg != NULL)
+        {
+            terminate = TRUE;
+        }
+        write_prometheus(spans);
+    } while (!terminate);
+    write_summary(spans);
+
+    /* Release the request pads from the video_tee, and unref them */
+    gst_element_release_request_pad(data.video_tee, video_tee_flv_pad);
+    gst_element_release_request_pad(data.video_tee, video_tee_mp4_pad);
+    gst_object_unref(video_tee_flv_pad);
+    gst_object_unref(video_tee_mp4_pad);
+
+    /* Release the request pads from the audio_tee, and unref them */
+    gst_element_release_request_pad(data.audio_tee, audio_tee_flv_pad);
+    gst_element_release_request_pad(data.audio_tee, audio_tee_mp4_pad);
+    gst_object_unref(audio_tee_flv_pad);
+    gst_object_unref(audio_tee_mp4_pad);
+
+    /* Release the request pads from flvmux, and unref them */
+    gst_element_release_request_pad(data.flv_mux, flv_mux_video_pad);
+    gst_element_release_request_pad(data.flv_mux, flv_mux_audio_pad);
+    gst_object_unref(flv_mux_video_pad);
+    gst_object_unref(flv_mux_audio_pad);
+
+    /* Free resources */
+    if (msg != NULL)
+        gst_message_unref(msg);
+    gst_object_unref(bus);
+    gst_element_set_state(data.pipeline, GST_STATE_NULL);
+
+    gst_object_unref(data.pipeline);
+    g_ptr_array_free(spans, TRUE);
+    return 0;
+}
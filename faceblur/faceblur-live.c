@@ -0,0 +1,560 @@
+#include <gst/gst.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <time.h>
+#include <sys/time.h>
+
+/*
+ * faceblur.c with a live ingest front end for SRT and RTMP instead of uridecodebin.
+ *
+ *   faceblur-live srt://0.0.0.0:7001?mode=listener
+ *   faceblur-live rtmp://127.0.0.1/live/stream
+ *   faceblur-live --send srt://127.0.0.1:7001?mode=caller     (loopback test sender)
+ *
+ * LATENCY_BUDGET_MS is the pipeline latency: every sink renders a frame that
+ * much after it was captured. It is split between the transport (SRT's
+ * retransmission/TSBPD buffer), the jitter queues ahead of face_blur and the
+ * processing that follows them. Decoded frames that can no longer make their
+ * deadline are dropped before face_blur instead of being processed late.
+ */
+
+#define SEGMENT_DURATION 15000 // Duration for each segment in milliseconds
+#define LATENCY_BUDGET_MS 600 // Default glass-to-glass budget, override with LATENCY_BUDGET_MS
+#define TRANSPORT_SHARE 40 // Percent of the budget given to srtsrc's latency
+#define JITTER_SHARE 20 // Percent of the budget the jitter queues (and tsdemux) may hold
+#define PROCESSING_RESERVE_MS 150 // face_blur + x264_enc + muxing, a frame later than budget - this is dropped
+#define STATS_INTERVAL 5 // Seconds between two ingest reports
+
+typedef struct
+{
+    guint budget_ms;
+    guint transport_ms;
+    guint jitter_ms;
+    gint64 frames;
+    gint64 dropped_late;
+    gint64 max_lateness_ms;     // Since the last report
+} LatencyPolicy;
+
+typedef struct _CustomData
+{
+    GstElement *pipeline;
+    GstElement *source;         // srtsrc or rtmp2src
+    GstElement *demuxer;        // tsdemux or flvdemux
+    GstElement *video_parse;
+    GstElement *video_decoder;
+    GstElement *audio_parse;
+    GstElement *audio_decoder;
+
+    GstElement *video_queue;
+    GstElement *video_convert;
+    GstElement *face_blur;
+    GstElement *video_convert2;
+    GstElement *x264_enc;
+    GstElement *video_tee;
+    GstElement *video_flv_queue;
+
+    GstElement *audio_source;
+    GstElement *audio_queue;
+    GstElement *audio_convert;
+    GstElement *audio_resample;
+    GstElement *avenc_aac;
+    GstElement *audio_tee;
+    GstElement *audio_flv_queue;
+
+    GstElement *flv_mux;
+    GstElement *flv_filesink;
+    GstElement *split_mux_sink;
+    GstElement *gcs_sink;
+
+    LatencyPolicy latency;
+} CustomData;
+
+// Function to get the current time in milliseconds since the Unix epoch
+static long long current_time_millis()
+{
+    struct timeval time_now;
+    gettimeofday(&time_now, NULL);
+    return (long long)(time_now.tv_sec) * 1000 + (long long)(time_now.tv_usec) / 1000;
+}
+
+static gchar *format_location_callback(GstElement *splitmuxsink, guint fragment_id, gpointer user_data)
+{
+    // Get the (Unix epoch time) for start and end time
+    long long start_time = current_time_millis();
+    long long end_time = start_time + SEGMENT_DURATION;
+
+    gchar *filename = g_strdup_printf("vm/4/%lld_%lld.mp4", start_time, end_time);
+
+    GstElement *gcs_sink = GST_ELEMENT(user_data); // Retrieve gcs_sink passed via user_data
+    if (gcs_sink)
+    {
+        g_object_set(gcs_sink, "key", filename, NULL); // Set the key dynamically
+    }
+
+    return filename;
+}
+
+static gboolean link_elements_with_video_filter(GstElement *element1, GstElement *element2)
+{
+    gboolean link_ok;
+    GstCaps *caps;
+
+    caps = gst_caps_new_simple("video/x-raw",
+                               "format", G_TYPE_STRING, "I420",
+                               "width", G_TYPE_INT, 360,
+                               "height", G_TYPE_INT, 640,
+                               "framerate", GST_TYPE_FRACTION, 15, 1,
+                               NULL);
+
+    link_ok = gst_element_link_filtered(element1, element2, caps);
+    gst_caps_unref(caps);
+
+    if (!link_ok)
+    {
+        g_warning("Failed to link element1 and element2 using video filter!");
+    }
+
+    return link_ok;
+}
+
+static gboolean link_elements_with_audio_filter(GstElement *element1, GstElement *element2, int sampleRate, int numChannels)
+{
+    gboolean link_ok;
+    GstCaps *caps;
+
+    caps = gst_caps_new_simple("audio/x-raw",
+                               "rate", G_TYPE_INT, sampleRate,
+                               "channels", G_TYPE_INT, numChannels,
+                               NULL);
+
+    link_ok = gst_element_link_filtered(element1, element2, caps);
+    gst_caps_unref(caps);
+
+    if (!link_ok)
+    {
+        g_warning("Failed to link element1 and element2 using audio filter!");
+    }
+
+    return link_ok;
+}
+
+/* Demuxer pads go to the parsers by media type; parsers and decoders are linked up front */
+static void pad_added_handler(GstElement *src, GstPad *new_pad, CustomData *data)
+{
+    GstPad *video_sink_pad = gst_element_get_static_pad(data->video_parse, "sink");
+    GstPad *audio_sink_pad = gst_element_get_static_pad(data->audio_parse, "sink");
+    GstPad *sink_pad = NULL;
+    GstCaps *new_pad_caps = gst_pad_get_current_caps(new_pad);
+    const gchar *new_pad_type;
+
+    if (!new_pad_caps)
+        new_pad_caps = gst_pad_query_caps(new_pad, NULL);
+    new_pad_type = gst_structure_get_name(gst_caps_get_structure(new_pad_caps, 0));
+    g_print("Received new pad '%s' from '%s' of type '%s'\n", GST_PAD_NAME(new_pad), GST_ELEMENT_NAME(src), new_pad_type);
+
+    if (g_str_has_prefix(new_pad_type, "video/x-h264"))
+        sink_pad = video_sink_pad;
+    else if (g_str_has_prefix(new_pad_type, "audio/mpeg"))
+        sink_pad = audio_sink_pad;
+
+    if (!sink_pad || gst_pad_is_linked(sink_pad))
+    {
+        g_print("Not an H.264/AAC stream or already linked. Ignoring.\n");
+    }
+    else if (GST_PAD_LINK_FAILED(gst_pad_link(new_pad, sink_pad)))
+    {
+        g_print("Type is '%s' but link failed.\n", new_pad_type);
+    }
+    else
+    {
+        g_print("Link succeeded (type '%s').\n", new_pad_type);
+    }
+
+    gst_caps_unref(new_pad_caps);
+    gst_object_unref(video_sink_pad);
+    gst_object_unref(audio_sink_pad);
+}
+
+/* On the video decoder's src pad: drop frames that would reach the sinks after their deadline anyway */
+static GstPadProbeReturn drop_late_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+    CustomData *data = (CustomData *)user_data;
+    GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+    GstEvent *event = gst_pad_get_sticky_event(pad, GST_EVENT_SEGMENT, 0);
+    GstClock *clock = gst_element_get_clock(data->pipeline);
+    const GstSegment *segment;
+    GstClockTime running_time, now;
+    gint64 lateness_ms;
+    GstPadProbeReturn ret = GST_PAD_PROBE_OK;
+
+    if (!event || !clock || !GST_BUFFER_PTS_IS_VALID(buffer))
+        goto exit;
+
+    gst_event_parse_segment(event, &segment);
+    running_time = gst_segment_to_running_time(segment, GST_FORMAT_TIME, GST_BUFFER_PTS(buffer));
+    now = gst_clock_get_time(clock) - gst_element_get_base_time(data->pipeline);
+    if (!GST_CLOCK_TIME_IS_VALID(running_time))
+        goto exit;
+
+    /* The sinks render at running_time + budget; what is left must cover the processing */
+    lateness_ms = GST_CLOCK_DIFF(running_time, now) / GST_MSECOND - ((gint64)data->latency.budget_ms - PROCESSING_RESERVE_MS);
+    data->latency.frames++;
+    data->latency.max_lateness_ms = MAX(data->latency.max_lateness_ms, lateness_ms);
+    if (lateness_ms > 0)
+    {
+        data->latency.dropped_late++;
+        ret = GST_PAD_PROBE_DROP;
+    }
+
+exit:
+    if (event)
+        gst_event_unref(event);
+    if (clock)
+        gst_object_unref(clock);
+    return ret;
+}
+
+static void print_latency_stats(CustomData *data)
+{
+    if (data->latency.frames == 0)
+    {
+        g_print("Ingest: no frames yet\n");
+        return;
+    }
+    g_print("Ingest: budget=%ums (transport %ums, jitter %ums) frames=%" G_GINT64_FORMAT " dropped-late=%" G_GINT64_FORMAT " max-lateness=%" G_GINT64_FORMAT "ms\n",
+            data->latency.budget_ms, data->latency.transport_ms, data->latency.jitter_ms,
+            data->latency.frames, data->latency.dropped_late, data->latency.max_lateness_ms);
+    data->latency.max_lateness_ms = G_MININT64;
+}
+
+/* Loopback test sender: a live test pattern with the wall clock burnt in, encoded for low latency */
+static int run_sender(const gchar *uri, guint transport_ms)
+{
+    GstElement *pipeline;
+    GstBus *bus;
+    GstMessage *msg;
+    GError *err = NULL;
+    gboolean srt = g_str_has_prefix(uri, "srt://");
+    gchar *sink = srt ? g_strdup_printf("srtsink uri=\"%s\" latency=%u", uri, transport_ms)
+                      : g_strdup_printf("rtmp2sink location=\"%s\"", uri);
+    gchar *launch = g_strdup_printf(
+        "videotestsrc is-live=true pattern=ball ! video/x-raw,format=I420,width=360,height=640,framerate=15/1 ! "
+        "clockoverlay time-format=\"%%H:%%M:%%S\" ! x264enc tune=zerolatency speed-preset=1 bitrate=800 key-int-max=15 ! h264parse ! queue ! mux. "
+        "audiotestsrc is-live=true ! audio/x-raw,rate=48000,channels=2 ! audioconvert ! avenc_aac ! aacparse ! queue ! mux. "
+        "%s name=mux ! %s",
+        srt ? "mpegtsmux alignment=7" : "flvmux streamable=true", sink);
+
+    pipeline = gst_parse_launch(launch, &err);
+    g_free(sink);
+    g_free(launch);
+    if (!pipeline)
+    {
+        g_printerr("Could not build the sender: %s\n", err->message);
+        g_clear_error(&err);
+        return -1;
+    }
+
+    g_print("Sending to %s\n", uri);
+    gst_element_set_state(pipeline, GST_STATE_PLAYING);
+    bus = gst_element_get_bus(pipeline);
+    msg = gst_bus_timed_pop_filtered(bus, GST_CLOCK_TIME_NONE, GST_MESSAGE_ERROR | GST_MESSAGE_EOS);
+    if (GST_MESSAGE_TYPE(msg) == GST_MESSAGE_ERROR)
+    {
+        gst_message_parse_error(msg, &err, NULL);
+        g_printerr("Sender error from %s: %s\n", GST_OBJECT_NAME(msg->src), err->message);
+        g_clear_error(&err);
+    }
+    gst_message_unref(msg);
+    gst_object_unref(bus);
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+    gst_object_unref(pipeline);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    CustomData data = {0};
+    GstBus *bus;
+    GstMessage *msg;
+    const gchar *budget_env = g_getenv("LATENCY_BUDGET_MS");
+    const gchar *uri;
+    gboolean srt;
+    gint64 next_stats;
+
+    GstPad *video_tee_flv_pad, *video_tee_mp4_pad;
+    GstPad *video_flv_queue_sink_pad, *splitmuxsink_video_pad;
+
+    GstPad *audio_tee_flv_pad, *audio_tee_mp4_pad;
+    GstPad *audio_flv_queue_sink_pad, *splitmuxsink_audio_pad;
+
+    GstPad *video_flv_queue_src_pad, *audio_flv_queue_src_pad;
+    GstPad *flv_mux_video_pad, *flv_mux_audio_pad;
+    GstPad *video_decoder_src_pad;
+
+    /* Initialize GStreamer */
+    gst_init(&argc, &argv);
+
+    /* Split the latency budget */
+    data.latency.budget_ms = budget_env ? atoi(budget_env) : LATENCY_BUDGET_MS;
+    data.latency.transport_ms = data.latency.budget_ms * TRANSPORT_SHARE / 100;
+    data.latency.jitter_ms = data.latency.budget_ms * JITTER_SHARE / 100;
+    data.latency.max_lateness_ms = G_MININT64;
+    if (data.latency.budget_ms <= PROCESSING_RESERVE_MS)
+    {
+        g_printerr("LATENCY_BUDGET_MS must be more than the %d ms processing reserve.\n", PROCESSING_RESERVE_MS);
+        return -1;
+    }
+
+    if (argc == 3 && g_strcmp0(argv[1], "--send") == 0)
+    {
+        return run_sender(argv[2], data.latency.transport_ms);
+    }
+    if (argc != 2 || !(g_str_has_prefix(argv[1], "srt://") || g_str_has_prefix(argv[1], "rtmp://")))
+    {
+        g_printerr("Usage: %s [--send] srt://host:port?mode=listener|caller | rtmp://host/app/stream\n", argv[0]);
+        return -1;
+    }
+    uri = argv[1];
+    srt = g_str_has_prefix(uri, "srt://");
+
+    /* Create the elements */
+    if (srt)
+    {
+        data.source = gst_element_factory_make("srtsrc", "source");
+        data.demuxer = gst_element_factory_make("tsdemux", "demuxer");
+    }
+    else
+    {
+        data.source = gst_element_factory_make("rtmp2src", "source");
+        data.demuxer = gst_element_factory_make("flvdemux", "demuxer");
+    }
+    data.video_parse = gst_element_factory_make("h264parse", "video_parse");
+    data.video_decoder = gst_element_factory_make("avdec_h264", "video_decoder");
+    data.audio_parse = gst_element_factory_make("aacparse", "audio_parse");
+    data.audio_decoder = gst_element_factory_make("avdec_aac", "audio_decoder");
+
+    data.video_queue = gst_element_factory_make("queue", "video_queue");
+    data.video_convert = gst_element_factory_make("videoconvert", "video_convert");
+    data.face_blur = gst_element_factory_make("faceblur", "face_blur");
+    data.video_convert2 = gst_element_factory_make("videoconvert", "video_convert2");
+    data.x264_enc = gst_element_factory_make("x264enc", "x264_enc");
+    data.video_tee = gst_element_factory_make("tee", "video_tee");
+    data.video_flv_queue = gst_element_factory_make("queue", "video_flv_queue");
+
+    data.audio_queue = gst_element_factory_make("queue", "audio_queue");
+    data.audio_convert = gst_element_factory_make("audioconvert", "audio_convert");
+    data.audio_resample = gst_element_factory_make("audioresample", "audio_resample");
+    data.avenc_aac = gst_element_factory_make("fdkaacenc", "avenc_aac");
+    data.audio_tee = gst_element_factory_make("tee", "audio_tee");
+    data.audio_flv_queue = gst_element_factory_make("queue", "audio_flv_queue");
+
+    data.flv_mux = gst_element_factory_make("flvmux", "flv_mux");
+    data.flv_filesink = gst_element_factory_make("filesink", "flv_filesink");
+    data.split_mux_sink = gst_element_factory_make("splitmuxsink", "split_mux_sink");
+    data.gcs_sink = gst_element_factory_make("awss3sink", "gcs_sink");
+
+    /* Create the empty pipeline */
+    data.pipeline = gst_pipeline_new("test-pipeline");
+
+    if (!data.pipeline || !data.source || !data.demuxer ||
+        !data.video_parse || !data.video_decoder || !data.audio_parse || !data.audio_decoder ||
+        !data.video_queue || !data.video_convert || !data.face_blur || !data.video_convert2 || !data.x264_enc || !data.video_tee || !data.video_flv_queue ||
+        !data.audio_queue || !data.audio_convert || !data.audio_resample || !data.avenc_aac || !data.audio_tee || !data.audio_flv_queue ||
+        !data.flv_mux || !data.flv_filesink || !data.split_mux_sink || !data.gcs_sink)
+    {
+        g_printerr("Not all elements could be created.\n");
+        return -1;
+    }
+    else
+    {
+        g_print("All elements created successfully.\n");
+    }
+
+    /* Configure elements */
+    if (srt)
+    {
+        /* SRT's latency is its retransmission window, and the receive buffer that absorbs network jitter */
+        g_object_set(data.source, "uri", uri, "latency", (gint)data.latency.transport_ms, "wait-for-connection", true, NULL);
+        /* tsdemux only needs to cover PCR jitter, not its 700 ms default */
+        g_object_set(data.demuxer, "latency", (gint)data.latency.jitter_ms, NULL);
+    }
+    else
+    {
+        /* RTMP runs over TCP: nothing to retransmit at this level, buffering is the jitter queues */
+        g_object_set(data.source, "location", uri, NULL);
+    }
+    /* Slice threads, frame threads would add a frame of latency per thread */
+    g_object_set(data.video_decoder, "max-threads", 2, NULL);
+    gst_util_set_object_arg(G_OBJECT(data.video_decoder), "thread-type", "slice");
+    /* Jitter queues: bounded in time only, and once full they drop the oldest data instead of blocking the source */
+    g_object_set(data.video_queue, "max-size-time", (guint64)data.latency.jitter_ms * GST_MSECOND, "max-size-buffers", 0, "max-size-bytes", 0, "leaky", 2, NULL);
+    g_object_set(data.audio_queue, "max-size-time", (guint64)data.latency.jitter_ms * GST_MSECOND, "max-size-buffers", 0, "max-size-bytes", 0, "leaky", 2, NULL);
+    /* Fixed pipeline latency instead of the sum of what every element reports */
+    gst_pipeline_set_latency(GST_PIPELINE(data.pipeline), (GstClockTime)data.latency.budget_ms * GST_MSECOND);
+    g_object_set(data.x264_enc, "speed-preset", 2, "pass", 5, "bitrate", 1200, "key-int-max", 30, "quantizer", 22, NULL);
+    g_object_set(data.face_blur, "scale-factor", 1.1, "profile", "/usr/share/opencv4/haarcascades/haarcascade_frontalface_alt.xml", NULL);
+
+    g_object_set(data.avenc_aac, "rate-control", 1, "vbr-preset", 1, NULL);
+    g_object_set(data.flv_mux, "streamable", true, "enforce-increasing-timestamps", false, NULL);
+    g_object_set(data.flv_filesink, "location", "/home/ubuntu/vivek-personal/flvtest/output.flv", "sync", true, NULL);
+    g_object_set(data.gcs_sink, "access-key", "add-here", "bucket", "livestream-recording-service-stage-bucket", "endpoint-uri", "https://storage.googleapis.com", "force-path-style", true, "region", "asia-southeast1", "secret-access-key", "add-here", "sync", true, NULL);
+    g_object_set(data.split_mux_sink, "max-size-time", (guint64)SEGMENT_DURATION * GST_MSECOND, "send-keyframe-requests", true, "sink", data.gcs_sink, NULL);
+
+    // Connect the format-location signal to generate dynamic filenames
+    g_signal_connect(data.split_mux_sink, "format-location", G_CALLBACK(format_location_callback), data.gcs_sink);
+    /* Connect to the demuxer's pad-added signal */
+    g_signal_connect(data.demuxer, "pad-added", G_CALLBACK(pad_added_handler), &data);
+
+    g_print("All elements configured successfully.\n");
+
+    /* Link all elements that can be automatically linked because they have "Always" pads */
+    gst_bin_add_many(GST_BIN(data.pipeline), data.source, data.demuxer,
+                     data.video_parse, data.video_decoder, data.audio_parse, data.audio_decoder,
+                     data.video_queue, data.video_convert, data.face_blur, data.video_convert2, data.x264_enc, data.video_tee, data.video_flv_queue,
+                     data.audio_queue, data.audio_convert, data.audio_resample, data.avenc_aac, data.audio_tee, data.audio_flv_queue,
+                     data.flv_mux, data.flv_filesink, data.split_mux_sink, NULL);
+
+    if (gst_element_link(data.source, data.demuxer) != TRUE ||
+        gst_element_link_many(data.video_parse, data.video_decoder, data.video_queue, NULL) != TRUE ||
+        gst_element_link_many(data.audio_parse, data.audio_decoder, data.audio_queue, NULL) != TRUE ||
+
+        gst_element_link_many(data.video_queue, data.video_convert, data.face_blur, NULL) != TRUE ||
+        gst_element_link_many(data.face_blur, data.video_convert2, data.x264_enc, data.video_tee, NULL) != TRUE ||
+
+        gst_element_link_many(data.audio_queue, data.audio_convert, data.audio_resample, NULL) != TRUE ||
+        link_elements_with_audio_filter(data.audio_resample, data.avenc_aac, 16000, 1) != TRUE ||
+        gst_element_link(data.avenc_aac, data.audio_tee) != TRUE ||
+
+        gst_element_link_many(data.flv_mux, data.flv_filesink, NULL) != TRUE)
+    {
+        g_printerr("Elements could not be linked.\n");
+        gst_object_unref(data.pipeline);
+        return -1;
+    }
+    else
+    {
+        g_print("All elements linked successfully.\n");
+    }
+
+    /* Manually link the video_tee, which has "Request" pads */
+    video_tee_flv_pad = gst_element_request_pad_simple(data.video_tee, "src_%u");
+    g_print("Obtained request pad %s for video_tee's flvmux branch.\n", GST_PAD_NAME(video_tee_flv_pad));
+    video_flv_queue_sink_pad = gst_element_get_static_pad(data.video_flv_queue, "sink");
+
+    video_tee_mp4_pad = gst_element_request_pad_simple(data.video_tee, "src_%u");
+    g_print("Obtained request pad %s for video_tee's mp4mux branch.\n", GST_PAD_NAME(video_tee_mp4_pad));
+    splitmuxsink_video_pad = gst_element_request_pad_simple(data.split_mux_sink, "video");
+    g_print("Obtained request pad %s for splitmuxsink video branch.\n", GST_PAD_NAME(splitmuxsink_video_pad));
+
+    if (gst_pad_link(video_tee_flv_pad, video_flv_queue_sink_pad) != GST_PAD_LINK_OK ||
+        gst_pad_link(video_tee_mp4_pad, splitmuxsink_video_pad) != GST_PAD_LINK_OK)
+    {
+        g_printerr("video_tee could not be linked.\n");
+        gst_object_unref(data.pipeline);
+        return -1;
+    }
+    else
+    {
+        g_print("video_tee linked successfully.\n");
+    }
+    gst_object_unref(video_flv_queue_sink_pad);
+    gst_object_unref(splitmuxsink_video_pad);
+
+    /* Manually link the audio_tee, which has "Request" pads */
+    audio_tee_flv_pad = gst_element_request_pad_simple(data.audio_tee, "src_%u");
+    g_print("Obtained request pad %s for audio_tee's flvmux branch.\n", GST_PAD_NAME(audio_tee_flv_pad));
+    audio_flv_queue_sink_pad = gst_element_get_static_pad(data.audio_flv_queue, "sink");
+
+    audio_tee_mp4_pad = gst_element_request_pad_simple(data.audio_tee, "src_%u");
+    g_print("Obtained request pad %s for audio_tee's mp4mux branch.\n", GST_PAD_NAME(audio_tee_mp4_pad));
+    splitmuxsink_audio_pad = gst_element_request_pad_simple(data.split_mux_sink, "audio_%u");
+    g_print("Obtained request pad %s for splitmuxsink audio branch.\n", GST_PAD_NAME(splitmuxsink_audio_pad));
+
+    if (gst_pad_link(audio_tee_flv_pad, audio_flv_queue_sink_pad) != GST_PAD_LINK_OK ||
+        gst_pad_link(audio_tee_mp4_pad, splitmuxsink_audio_pad) != GST_PAD_LINK_OK)
+    {
+        g_printerr("audio_tee could not be linked.\n");
+        gst_object_unref(data.pipeline);
+        return -1;
+    }
+    else
+    {
+        g_print("audio_tee linked successfully.\n");
+    }
+    gst_object_unref(audio_flv_queue_sink_pad);
+    gst_object_unref(splitmuxsink_audio_pad);
+
+    /* Manually link the flvmux which has "Request" pads */
+    video_flv_queue_src_pad = gst_element_get_static_pad(data.video_flv_queue, "src");
+    flv_mux_video_pad = gst_element_request_pad_simple(data.flv_mux, "video");
+    g_print("Obtained request pad %s for flvmux video branch.\n", GST_PAD_NAME(flv_mux_video_pad));
+
+    audio_flv_queue_src_pad = gst_element_get_static_pad(data.audio_flv_queue, "src");
+    flv_mux_audio_pad = gst_element_request_pad_simple(data.flv_mux, "audio");
+    g_print("Obtained request pad %s for flvmux audio branch.\n", GST_PAD_NAME(flv_mux_audio_pad));
+
+    if (gst_pad_link(video_flv_queue_src_pad, flv_mux_video_pad) != GST_PAD_LINK_OK ||
+        gst_pad_link(audio_flv_queue_src_pad, flv_mux_audio_pad) != GST_PAD_LINK_OK)
+    {
+        g_printerr("flvmux could not be linked!\n");
+        gst_object_unref(data.pipeline);
+        return -1;
+    }
+    else
+    {
+        g_print("flvmux linked successfully.\n");
+    }
+    gst_object_unref(video_flv_queue_src_pad);
+    gst_object_unref(audio_flv_queue_src_pad);
+
+    /* Frames that can't make it to the sinks in time are dropped before face_blur */
+    video_decoder_src_pad = gst_element_get_static_pad(data.video_decoder, "src");
+    gst_pad_add_probe(video_decoder_src_pad, GST_PAD_PROBE_TYPE_BUFFER, drop_late_probe, &data, NULL);
+    gst_object_unref(video_decoder_src_pad);
+
+    /* Start playing the pipeline */
+    gst_element_set_state(data.pipeline, GST_STATE_PLAYING);
+
+    /* Visualize the pipeline using GraphViz */
+    gst_debug_bin_to_dot_file(GST_BIN(data.pipeline), GST_DEBUG_GRAPH_SHOW_ALL, "pipeline-faceblur");
+
+    /* Wait until error or EOS, reporting the ingest every STATS_INTERVAL seconds */
+    bus = gst_element_get_bus(data.pipeline);
+    next_stats = g_get_monotonic_time() + STATS_INTERVAL * G_USEC_PER_SEC;
+    while ((msg = gst_bus_timed_pop_filtered(bus, 1000 * GST_MSECOND, GST_MESSAGE_ERROR | GST_MESSAGE_EOS)) == NULL)
+    {
+        if (g_get_monotonic_time() >= next_stats)
+        {
+            print_latency_stats(&data);
+            next_stats += STATS_INTERVAL * G_USEC_PER_SEC;
+        }
+    }
+    print_latency_stats(&data);
+
+    /* Release the request pads from the video_tee, and unref them */
+    gst_element_release_request_pad(data.video_tee, video_tee_flv_pad);
+    gst_element_release_request_pad(data.video_tee, video_tee_mp4_pad);
+    gst_object_unref(video_tee_flv_pad);
+    gst_object_unref(video_tee_mp4_pad);
+
+    /* Release the request pads from the audio_tee, and unref them */
+    gst_element_release_request_pad(data.audio_tee, audio_tee_flv_pad);
+    gst_element_release_request_pad(data.audio_tee, audio_tee_mp4_pad);
+    gst_object_unref(audio_tee_flv_pad);
+    gst_object_unref(audio_tee_mp4_pad);
+
+    /* Release the request pads from flvmux, and unref them */
+    gst_element_release_request_pad(data.flv_mux, flv_mux_video_pad);
+    gst_element_release_request_pad(data.flv_mux, flv_mux_audio_pad);
+    gst_object_unref(flv_mux_video_pad);
+    gst_object_unref(flv_mux_audio_pad);
+
+    /* Free resources */
+    if (msg != NULL)
+        gst_message_unref(msg);
+    gst_object_unref(bus);
+    gst_element_set_state(data.pipeline, GST_STATE_NULL);
+
+    gst_object_unref(data.pipeline);
+    return 0;
+}
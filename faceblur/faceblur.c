@@ -1,9 +1,290 @@
 #include <gst/gst.h>
+#include <gst/video/video.h>
 #include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
 #include <time.h>
 #include <sys/time.h>
 
 #define SEGMENT_DURATION 15000 // Duration for each segment in milliseconds
+#define MEMORY_BUDGET_MB 256 // Default per-pipeline budget, override with MEMORY_BUDGET_MB
+#define BUDGET_INTERVAL 250 // Milliseconds between two budget checks
+#define BUDGET_HYSTERESIS 15 // A level is left only once usage is this many percent below where it was entered
+#define BUDGET_RECOVER_TICKS 20 // ... for this many checks in a row
+#define BUDGET_GRACE_TICKS 40 // Checks over 120% of the budget after all steps before the stream gives up
+#define DEGRADED_BITRATE 400 // x264_enc bitrate (kbit/s) at BUDGET_LOWER_QUALITY
+#define DEGRADED_QUANTIZER 32
+#define DECODE_CPU_BUDGET 2 // Decoder threads per stream, override with DECODE_CPU_BUDGET
+#define DECODE_CACHE_PATH "decode-cache.ini" // Decode chains learnt from uridecodebin, per URI
+
+/* Graded response, each level includes the previous ones */
+typedef enum
+{
+    BUDGET_OK = 0,
+    BUDGET_DROP_FLV,            // Stop feeding the live FLV branch
+    BUDGET_LOWER_QUALITY,       // Smaller encoded frames for splitmuxsink and the upload
+    BUDGET_SPLIT_NOW,           // Close the current fragment early so its buffered GOPs go out
+} BudgetLevel;
+
+static const gint budget_thresholds[] = {0, 70, 85, 100}; // Percent of the budget that enters each level
+static const gchar *budget_level_names[] = {"ok", "drop-flv", "lower-quality", "split-now"};
+
+typedef struct
+{
+    gint *level;                // BudgetLevel, shared with the main thread
+    gboolean resync;            // Video only: wait for a keyframe after the branch was dropped
+} FlvBranchGate;
+
+typedef struct
+{
+    guint64 budget;             // Bytes
+    gint level;                 // BudgetLevel, read by the FLV gates from streaming threads
+    guint recover_ticks;
+    guint over_ticks;
+    guint split_ticks;          // Checks since the last split-now
+    guint64 peak;
+    guint bitrate;              // x264_enc settings to restore
+    guint quantizer;
+    FlvBranchGate video_gate, audio_gate;
+} MemoryBudget;
+
+/* Return values of uridecodebin's autoplug-select, the enum lives in a header the playback plugin doesn't install */
+typedef enum
+{
+    GST_AUTOPLUG_SELECT_TRY,
+    GST_AUTOPLUG_SELECT_EXPOSE,
+    GST_AUTOPLUG_SELECT_SKIP,
+} GstAutoplugSelectResult;
+
+/* How to configure the threads of a decoder uridecodebin may plug. Matched on the factory name prefix. */
+typedef struct
+{
+    const gchar *factory_prefix;
+    const gchar *threads_property;
+    const gchar *thread_type_property; // Frame/slice flags, NULL if the decoder picks on its own
+} DecoderThreading;
+
+static const DecoderThreading decoder_threading[] = {
+    {"avdec_", "max-threads", "thread-type"},
+    {"dav1ddec", "n-threads", NULL},
+    {"vp8dec", "threads", NULL},
+    {"vp9dec", "threads", NULL},
+    {"libde265dec", "max-threads", NULL},
+};
+
+/* Protocols whose sources are live: frame threading would add a frame of latency per thread there */
+static const gchar *live_protocols[] = {"rtsp", "rtsps", "rtmp", "srt", "udp", "rtp", NULL};
+
+typedef struct
+{
+    guint threads;
+    gboolean live;              // Slice threads instead of frame threads
+} DecodePolicy;
+
+/*
+ * Decode chain cache. Once uridecodebin has exposed a raw pad, the elements
+ * it plugged are walked back to the demuxer (or the source, for sources such
+ * as rtspsrc that expose elementary streams) and stored per URI in
+ * DECODE_CACHE_PATH: the container demuxer, the caps of the demuxed stream
+ * and the parser/decoder chain. The next run for that URI builds
+ * source ! demuxer ! chain directly, without typefinding or autoplugging.
+ * If a demuxed stream doesn't fit its cached chain, or the pipeline fails
+ * before the first frame, the entry is dropped and uridecodebin takes over
+ * without saving it again in that run. Chains with another demuxer upstream
+ * (hlsdemux/dashdemux ! tsdemux, ...) are not cached, since source ! demuxer
+ * can't rebuild them.
+ */
+typedef struct
+{
+    GKeyFile *file;
+    gchar *group;               // SHA-1 of the URI
+    gchar *uri;
+    gboolean hit;               // Running the cached chain
+    gboolean failed;            // The cached chain failed in this run, don't learn it again
+    gint confirmed;             // A decoded frame reached video_queue
+    GPtrArray *elements;        // Everything the cached chain added to the pipeline
+} DecodeCache;
+
+static void decode_cache_save(DecodeCache *cache)
+{
+    GError *err = NULL;
+
+    if (!g_key_file_save_to_file(cache->file, DECODE_CACHE_PATH, &err))
+    {
+        g_warning("Could not save %s: %s", DECODE_CACHE_PATH, err->message);
+        g_clear_error(&err);
+    }
+}
+
+static void decode_cache_load(DecodeCache *cache, const gchar *uri)
+{
+    cache->file = g_key_file_new();
+    cache->group = g_compute_checksum_for_string(G_CHECKSUM_SHA1, uri, -1);
+    cache->uri = g_strdup(uri);
+    cache->elements = g_ptr_array_new();
+
+    // A missing file is an empty cache
+    g_key_file_load_from_file(cache->file, DECODE_CACHE_PATH, G_KEY_FILE_NONE, NULL);
+    cache->hit = g_key_file_has_key(cache->file, cache->group, "container", NULL) &&
+                 g_key_file_has_key(cache->file, cache->group, "video-chain", NULL);
+}
+
+static void decode_cache_forget(DecodeCache *cache)
+{
+    g_key_file_remove_group(cache->file, cache->group, NULL);
+    decode_cache_save(cache);
+}
+
+static gboolean klass_contains(GstElement *element, const gchar *word)
+{
+    const gchar *klass = gst_element_get_metadata(element, GST_ELEMENT_METADATA_KLASS);
+
+    return klass && strstr(klass, word) != NULL;
+}
+
+/* The pad feeding `pad` from upstream, looking through ghost and proxy pads */
+static GstPad *upstream_pad(GstPad *pad)
+{
+    GstPad *sink = NULL, *peer;
+    GstIterator *it = gst_pad_iterate_internal_links(pad);
+    GValue item = G_VALUE_INIT;
+
+    if (it && gst_iterator_next(it, &item) == GST_ITERATOR_OK)
+    {
+        sink = gst_object_ref(g_value_get_object(&item));
+        g_value_unset(&item);
+    }
+    if (it)
+        gst_iterator_free(it);
+    if (!sink)
+        return NULL;
+
+    peer = gst_pad_get_peer(sink);
+    gst_object_unref(sink);
+
+    /* Leaving a bin through its sink ghost pad: continue from the ghost pad's peer outside */
+    while (peer && GST_IS_PROXY_PAD(peer) && !GST_IS_GHOST_PAD(peer))
+    {
+        GstPad *ghost = GST_PAD(gst_proxy_pad_get_internal(GST_PROXY_PAD(peer)));
+
+        gst_object_unref(peer);
+        peer = ghost ? gst_pad_get_peer(ghost) : NULL;
+        if (ghost)
+            gst_object_unref(ghost);
+    }
+    /* A src ghost pad is left as is: its bin (e.g. rtspsrc) is where the walk stops */
+    return peer;
+}
+
+/* Record the chain behind a raw pad exposed by uridecodebin, `stream` is "video" or "audio" */
+static void decode_cache_learn(DecodeCache *cache, GstPad *raw_pad, const gchar *stream)
+{
+    GPtrArray *chain = g_ptr_array_new_with_free_func(g_free);
+    GstPad *pad = gst_object_ref(raw_pad);
+    GstCaps *caps = NULL;
+    gchar *container = NULL;
+    gchar *key, *value;
+    gboolean nested = FALSE, sourced = FALSE;
+    guint depth;
+
+    if (cache->failed)
+    {
+        gst_object_unref(pad);
+        g_ptr_array_unref(chain);
+        return;
+    }
+
+    while (GST_IS_GHOST_PAD(pad))
+    {
+        GstPad *target = gst_ghost_pad_get_target(GST_GHOST_PAD(pad));
+
+        gst_object_unref(pad);
+        if (!(pad = target))
+            break;
+    }
+
+    for (depth = 0; pad && depth < 32; depth++)
+    {
+        GstElement *element = gst_pad_get_parent_element(pad);
+        GstElementFactory *factory;
+        const gchar *name;
+        GstPad *next;
+
+        if (!element)
+            break;
+        factory = gst_element_get_factory(element);
+        name = factory ? gst_plugin_feature_get_name(GST_PLUGIN_FEATURE(factory)) : "";
+
+        if (container)
+        {
+            /* Past the demuxer: only the source may follow, anything demuxing before it can't be rebuilt from the cache */
+            if (klass_contains(element, "Source"))
+            {
+                sourced = TRUE;
+                gst_object_unref(element);
+                break;
+            }
+            if (klass_contains(element, "Demuxer"))
+            {
+                nested = TRUE;
+                gst_object_unref(element);
+                break;
+            }
+        }
+        else if (klass_contains(element, "Source"))
+        {
+            sourced = TRUE;
+            container = g_strdup("");
+            caps = gst_pad_get_current_caps(pad);
+            gst_object_unref(element);
+            break;
+        }
+        else if (klass_contains(element, "Demuxer"))
+        {
+            container = g_strdup(name);
+            caps = gst_pad_get_current_caps(pad);
+        }
+        else if (klass_contains(element, "Decoder") || klass_contains(element, "Parser") || klass_contains(element, "Depayloader"))
+        {
+            g_ptr_array_insert(chain, 0, g_strdup(name));
+        }
+        gst_object_unref(element);
+
+        next = upstream_pad(pad);
+        gst_object_unref(pad);
+        pad = next;
+    }
+    if (pad)
+        gst_object_unref(pad);
+
+    if (nested || (container && !sourced))
+    {
+        g_print("Not caching the %s decode chain for %s: %s is not fed by the source directly\n", stream, cache->uri, container);
+    }
+    else if (container && caps && chain->len > 0)
+    {
+        g_ptr_array_add(chain, NULL);
+        value = g_strjoinv(",", (gchar **)chain->pdata);
+        g_key_file_set_string(cache->file, cache->group, "uri", cache->uri);
+        g_key_file_set_string(cache->file, cache->group, "container", container);
+        key = g_strdup_printf("%s-chain", stream);
+        g_key_file_set_string(cache->file, cache->group, key, value);
+        g_free(key);
+        g_free(value);
+        key = g_strdup_printf("%s-caps", stream);
+        value = gst_caps_to_string(caps);
+        g_key_file_set_string(cache->file, cache->group, key, value);
+        g_free(key);
+        g_free(value);
+        decode_cache_save(cache);
+        g_print("Cached %s decode chain for %s\n", stream, cache->uri);
+    }
+
+    if (caps)
+        gst_caps_unref(caps);
+    g_free(container);
+    g_ptr_array_unref(chain);
+}
 
 typedef struct _CustomData
 {
@@ -30,6 +311,10 @@ typedef struct _CustomData
     GstElement *flv_filesink;
     GstElement *split_mux_sink;
     GstElement *gcs_sink;
+
+    MemoryBudget budget;
+    DecodePolicy decode;
+    DecodeCache cache;
 } CustomData;
 
 // Function to get the current time in milliseconds since the Unix epoch
@@ -101,6 +386,84 @@ static gboolean link_elements_with_audio_filter(GstElement *element1, GstElement
     return link_ok;
 }
 
+static const DecoderThreading *find_decoder_threading(GstElementFactory *factory)
+{
+    const gchar *name = gst_plugin_feature_get_name(GST_PLUGIN_FEATURE(factory));
+    guint i;
+
+    for (i = 0; i < G_N_ELEMENTS(decoder_threading); i++)
+    {
+        if (g_str_has_prefix(name, decoder_threading[i].factory_prefix))
+        {
+            return &decoder_threading[i];
+        }
+    }
+    return NULL;
+}
+
+/* Skip software video decoders whose threads can't be configured when a configurable one handles the same caps */
+static GstAutoplugSelectResult autoplug_select_handler(GstElement *bin, GstPad *pad, GstCaps *caps, GstElementFactory *factory, CustomData *data)
+{
+    GList *decoders, *candidates, *l;
+    gboolean alternative = FALSE;
+
+    // Hardware decoders outrank avdec_* and cost next to no CPU, only software decoders are skipped
+    if (!gst_element_factory_list_is_type(factory, GST_ELEMENT_FACTORY_TYPE_DECODER | GST_ELEMENT_FACTORY_TYPE_MEDIA_VIDEO) ||
+        find_decoder_threading(factory) || gst_element_factory_list_is_type(factory, GST_ELEMENT_FACTORY_TYPE_HARDWARE))
+    {
+        return GST_AUTOPLUG_SELECT_TRY;
+    }
+
+    decoders = gst_element_factory_list_get_elements(GST_ELEMENT_FACTORY_TYPE_DECODER | GST_ELEMENT_FACTORY_TYPE_MEDIA_VIDEO, GST_RANK_MARGINAL);
+    candidates = gst_element_factory_list_filter(decoders, caps, GST_PAD_SINK, FALSE);
+    for (l = candidates; l && !alternative; l = l->next)
+    {
+        alternative = find_decoder_threading(GST_ELEMENT_FACTORY(l->data)) != NULL;
+    }
+    gst_plugin_feature_list_free(candidates);
+    gst_plugin_feature_list_free(decoders);
+
+    if (alternative)
+    {
+        g_print("Skipping decoder %s, its threads can't be configured.\n", gst_plugin_feature_get_name(GST_PLUGIN_FEATURE(factory)));
+        return GST_AUTOPLUG_SELECT_SKIP;
+    }
+    return GST_AUTOPLUG_SELECT_TRY;
+}
+
+static void configure_decoder_threads(GstElement *element, CustomData *data)
+{
+    GstElementFactory *factory = gst_element_get_factory(element);
+    GObjectClass *klass = G_OBJECT_GET_CLASS(element);
+    const DecoderThreading *threading;
+    gchar *threads;
+
+    if (!factory || !(threading = find_decoder_threading(factory)) ||
+        !gst_element_factory_list_is_type(factory, GST_ELEMENT_FACTORY_TYPE_DECODER | GST_ELEMENT_FACTORY_TYPE_MEDIA_VIDEO))
+    {
+        return;
+    }
+
+    threads = g_strdup_printf("%u", data->decode.threads);
+    if (g_object_class_find_property(klass, threading->threads_property))
+    {
+        gst_util_set_object_arg(G_OBJECT(element), threading->threads_property, threads);
+    }
+    if (threading->thread_type_property && g_object_class_find_property(klass, threading->thread_type_property))
+    {
+        gst_util_set_object_arg(G_OBJECT(element), threading->thread_type_property, data->decode.live ? "slice" : "frame");
+    }
+    g_print("Decoder %s: %s threads, %s threading\n", GST_ELEMENT_NAME(element), threads,
+            threading->thread_type_property ? (data->decode.live ? "slice" : "frame") : "default");
+    g_free(threads);
+}
+
+/* Called for every element added inside uridecodebin, before it changes state */
+static void deep_element_added_handler(GstBin *bin, GstBin *sub_bin, GstElement *element, CustomData *data)
+{
+    configure_decoder_threads(element, data);
+}
+
 /* This function will be called by the pad-added signal */
 static void pad_added_handler(GstElement *src, GstPad *new_pad, CustomData *data)
 {
@@ -152,6 +515,7 @@ static void pad_added_handler(GstElement *src, GstPad *new_pad, CustomData *data
     else
     {
         g_print("Link succeeded (type '%s').\n", new_pad_type);
+        decode_cache_learn(&data->cache, new_pad, g_str_has_prefix(new_pad_type, "video/") ? "video" : "audio");
     }
 
 exit:
@@ -164,11 +528,536 @@ exit:
     gst_object_unref(audio_sink_pad);
 }
 
+/* Same structure name, and the same RTP media type where there is one */
+static gboolean cached_caps_match(GstCaps *caps, const gchar *cached)
+{
+    GstCaps *cached_caps = cached ? gst_caps_from_string(cached) : NULL;
+    GstStructure *s1, *s2;
+    gboolean match = FALSE;
+
+    if (cached_caps && !gst_caps_is_empty(cached_caps))
+    {
+        s1 = gst_caps_get_structure(caps, 0);
+        s2 = gst_caps_get_structure(cached_caps, 0);
+        match = gst_structure_has_name(s1, gst_structure_get_name(s2)) &&
+                g_strcmp0(gst_structure_get_string(s1, "media"), gst_structure_get_string(s2, "media")) == 0;
+    }
+    if (cached_caps)
+        gst_caps_unref(cached_caps);
+
+    return match;
+}
+
+static void decode_cache_miss(GstElement *element, const gchar *reason)
+{
+    g_print("Decode cache miss: %s\n", reason);
+    gst_element_post_message(element, gst_message_new_application(GST_OBJECT(element), gst_structure_new_empty("decode-cache-miss")));
+}
+
+/* pad-added of the cached demuxer (or source): plug the cached chain for this stream */
+static void cached_pad_added_handler(GstElement *src, GstPad *new_pad, CustomData *data)
+{
+    DecodeCache *cache = &data->cache;
+    GstCaps *caps = gst_pad_get_current_caps(new_pad);
+    GstElement *queue = NULL;
+    GstElement *first = NULL, *last = NULL;
+    GstPad *sink_pad;
+    gchar *key, *cached, *chain = NULL;
+    gchar **names = NULL;
+    const gchar *stream = NULL;
+    guint i;
+
+    if (!caps)
+        caps = gst_pad_query_caps(new_pad, NULL);
+
+    for (i = 0; i < 2 && !stream; i++)
+    {
+        const gchar *candidate = i == 0 ? "video" : "audio";
+
+        key = g_strdup_printf("%s-caps", candidate);
+        cached = g_key_file_get_string(cache->file, cache->group, key, NULL);
+        if (cached_caps_match(caps, cached))
+        {
+            stream = candidate;
+            queue = i == 0 ? data->video_queue : data->audio_queue;
+        }
+        g_free(cached);
+        g_free(key);
+    }
+
+    sink_pad = queue ? gst_element_get_static_pad(queue, "sink") : NULL;
+    if (!stream || gst_pad_is_linked(sink_pad))
+    {
+        g_print("Ignoring pad '%s' from '%s', no cached chain for it.\n", GST_PAD_NAME(new_pad), GST_ELEMENT_NAME(src));
+        goto exit;
+    }
+
+    key = g_strdup_printf("%s-chain", stream);
+    chain = g_key_file_get_string(cache->file, cache->group, key, NULL);
+    g_free(key);
+    names = g_strsplit(chain ? chain : "", ",", -1);
+
+    for (i = 0; names[i]; i++)
+    {
+        GstElement *element = gst_element_factory_make(names[i], NULL);
+
+        if (!element || (i == 0 && !gst_element_factory_can_sink_any_caps(gst_element_get_factory(element), caps)))
+        {
+            if (element)
+                gst_object_unref(element);
+            decode_cache_miss(src, "stream does not fit the cached chain");
+            goto exit;
+        }
+        gst_bin_add(GST_BIN(data->pipeline), element);
+        g_ptr_array_add(cache->elements, element);
+        configure_decoder_threads(element, data);
+        if (last && !gst_element_link(last, element))
+        {
+            decode_cache_miss(src, "cached chain does not link");
+            goto exit;
+        }
+        first = first ? first : element;
+        last = element;
+    }
+
+    if (!first || !gst_element_link(last, queue))
+    {
+        decode_cache_miss(src, "cached chain does not link");
+        goto exit;
+    }
+    for (i = cache->elements->len; i > 0; i--)
+    {
+        gst_element_sync_state_with_parent(g_ptr_array_index(cache->elements, i - 1));
+    }
+    if (!gst_element_link_pads(src, GST_PAD_NAME(new_pad), first, NULL))
+    {
+        decode_cache_miss(src, "stream does not link to the cached chain");
+        goto exit;
+    }
+    g_print("Plugged cached %s chain %s\n", stream, chain);
+
+exit:
+    g_strfreev(names);
+    g_free(chain);
+    if (sink_pad)
+        gst_object_unref(sink_pad);
+    gst_caps_unref(caps);
+}
+
+/* Called once data->source (made from the URI) is in the pipeline */
+static gboolean decode_cache_build(CustomData *data)
+{
+    gchar *container = g_key_file_get_string(data->cache.file, data->cache.group, "container", NULL);
+    GstElement *demuxer;
+    gboolean ok = TRUE;
+
+    if (!container || container[0] == '\0')
+    {
+        /* The source exposes the streams itself, e.g. rtspsrc */
+        g_signal_connect(data->source, "pad-added", G_CALLBACK(cached_pad_added_handler), data);
+    }
+    else if ((demuxer = gst_element_factory_make(container, NULL)) != NULL)
+    {
+        gst_bin_add(GST_BIN(data->pipeline), demuxer);
+        g_ptr_array_add(data->cache.elements, demuxer);
+        g_signal_connect(demuxer, "pad-added", G_CALLBACK(cached_pad_added_handler), data);
+        ok = gst_element_link(data->source, demuxer);
+    }
+    else
+    {
+        ok = FALSE;
+    }
+    g_free(container);
+
+    return ok;
+}
+
+/*
+ * Audio fast path. audioconvert ! audioresample ! capsfilter only matter when
+ * the decoded audio isn't already what avenc_aac (fdkaacenc) takes: S16
+ * interleaved at 16 kHz mono. Speech recordings often are (PCM/WAV, G.722),
+ * and then both converters run in passthrough for every buffer. A blocking
+ * probe on audio_queue's src pad sees the first CAPS event before anything
+ * downstream; if the encoder accepts those caps as they are and they fit the
+ * capsfilter, audio_queue is linked straight to the encoder and the
+ * converters are taken out of the pipeline. The decision is made once: a
+ * later switch to caps the encoder can't take fails negotiation.
+ */
+typedef struct
+{
+    GstElement *pipeline;
+    GstElement *encoder;
+} ConvertBypass;
+
+static void remove_stages(GstElement *pipeline, gpointer user_data)
+{
+    GPtrArray *stages = (GPtrArray *)user_data;
+
+    for (guint i = 0; i < stages->len; i++)
+    {
+        GstElement *stage = g_ptr_array_index(stages, i);
+        gst_element_set_state(stage, GST_STATE_NULL);
+        gst_bin_remove(GST_BIN(pipeline), stage);
+    }
+    g_ptr_array_unref(stages);
+}
+
+static GstPadProbeReturn convert_bypass_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+    ConvertBypass *bypass = (ConvertBypass *)user_data;
+    GstEvent *event = GST_PAD_PROBE_INFO_EVENT(info);
+    GstPad *encoder_sink_pad, *first_sink_pad, *last_src_pad = NULL, *peer;
+    GPtrArray *stages;
+    GstCaps *caps, *filter = NULL;
+    GString *names;
+    gboolean match;
+
+    if (GST_EVENT_TYPE(event) != GST_EVENT_CAPS)
+        return GST_PAD_PROBE_PASS;
+    gst_event_parse_caps(event, &caps);
+
+    /* Collect the stages between the queue and the encoder */
+    encoder_sink_pad = gst_element_get_static_pad(bypass->encoder, "sink");
+    stages = g_ptr_array_new_with_free_func(gst_object_unref);
+    first_sink_pad = gst_pad_get_peer(pad);
+    peer = gst_object_ref(first_sink_pad);
+    while (peer && GST_PAD_PARENT(peer) != GST_OBJECT(bypass->encoder))
+    {
+        GstElement *stage = gst_pad_get_parent_element(peer);
+        GstPad *src_pad = gst_element_get_static_pad(stage, "src");
+
+        if (g_strcmp0(gst_plugin_feature_get_name(GST_PLUGIN_FEATURE(gst_element_get_factory(stage))), "capsfilter") == 0)
+            g_object_get(stage, "caps", &filter, NULL);
+        g_ptr_array_add(stages, stage);
+        gst_object_unref(peer);
+        peer = gst_pad_get_peer(src_pad);
+        gst_clear_object(&last_src_pad);
+        last_src_pad = src_pad;
+    }
+    gst_clear_object(&peer);
+
+    match = stages->len > 0 && last_src_pad != NULL &&
+            (filter == NULL || gst_caps_is_subset(caps, filter)) &&
+            gst_pad_query_accept_caps(encoder_sink_pad, caps);
+    if (filter)
+        gst_caps_unref(filter);
+
+    names = g_string_new(NULL);
+    for (guint i = 0; i < stages->len; i++)
+        g_string_append_printf(names, "%s%s", i ? ", " : "", GST_ELEMENT_NAME(g_ptr_array_index(stages, i)));
+
+    if (match && gst_pad_unlink(pad, first_sink_pad) && gst_pad_unlink(last_src_pad, encoder_sink_pad) &&
+        gst_pad_link(pad, encoder_sink_pad) == GST_PAD_LINK_OK)
+    {
+        g_print("Decoded audio needs no conversion, bypassing %s\n", names->str);
+        /* State changes and bin removal don't belong on the streaming thread */
+        gst_element_call_async(bypass->pipeline, remove_stages, g_ptr_array_ref(stages), NULL);
+    }
+    else if (match)
+    {
+        g_warning("Could not bypass %s", names->str);
+    }
+    else
+    {
+        g_print("Decoded audio needs %s\n", names->str);
+    }
+
+    g_string_free(names, TRUE);
+    g_ptr_array_unref(stages);
+    gst_clear_object(&last_src_pad);
+    gst_object_unref(first_sink_pad);
+    gst_object_unref(encoder_sink_pad);
+    return GST_PAD_PROBE_REMOVE;
+}
+
+static void add_convert_bypass(GstElement *queue, ConvertBypass *bypass)
+{
+    GstPad *queue_src_pad = gst_element_get_static_pad(queue, "src");
+
+    gst_pad_add_probe(queue_src_pad, GST_PAD_PROBE_TYPE_BLOCK | GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM, convert_bypass_probe, bypass, NULL);
+    gst_object_unref(queue_src_pad);
+}
+
+static GstPadProbeReturn decode_cache_confirm_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+    g_atomic_int_set(&((DecodeCache *)user_data)->confirmed, TRUE);
+    return GST_PAD_PROBE_REMOVE;
+}
+
+static GstElement *make_uridecodebin(CustomData *data)
+{
+    GstElement *source = gst_element_factory_make("uridecodebin", "source");
+
+    if (source)
+    {
+        g_object_set(source, "uri", data->cache.uri, NULL);
+        /* Connect to the pad-added signal */
+        g_signal_connect(source, "pad-added", G_CALLBACK(pad_added_handler), data);
+        /* Pick and configure the decoder uridecodebin plugs */
+        g_signal_connect(source, "autoplug-select", G_CALLBACK(autoplug_select_handler), data);
+        g_signal_connect(source, "deep-element-added", G_CALLBACK(deep_element_added_handler), data);
+    }
+    return source;
+}
+
+/* Take the cached chain out of the (stopped) pipeline and put uridecodebin in its place */
+static gboolean decode_cache_use_uridecodebin(CustomData *data)
+{
+    guint i;
+
+    for (i = 0; i < data->cache.elements->len; i++)
+    {
+        gst_bin_remove(GST_BIN(data->pipeline), g_ptr_array_index(data->cache.elements, i));
+    }
+    g_ptr_array_set_size(data->cache.elements, 0);
+    gst_bin_remove(GST_BIN(data->pipeline), data->source);
+    decode_cache_forget(&data->cache);
+    data->cache.failed = data->cache.hit;
+    data->cache.hit = FALSE;
+
+    data->source = make_uridecodebin(data);
+    return data->source && gst_bin_add(GST_BIN(data->pipeline), data->source);
+}
+
+/* Replace the cached chain by uridecodebin if it failed before the first frame. Returns TRUE if msg was handled. */
+static gboolean decode_cache_fallback(CustomData *data, GstMessage *msg)
+{
+    GstBus *bus;
+
+    if (!data->cache.hit || g_atomic_int_get(&data->cache.confirmed) ||
+        !(GST_MESSAGE_TYPE(msg) == GST_MESSAGE_ERROR ||
+          (GST_MESSAGE_TYPE(msg) == GST_MESSAGE_APPLICATION && gst_message_has_name(msg, "decode-cache-miss"))))
+    {
+        return FALSE;
+    }
+
+    g_print("Cached decode chain failed for %s, falling back to uridecodebin.\n", data->cache.uri);
+    gst_element_set_state(data->pipeline, GST_STATE_NULL);
+
+    /* Drop what the old chain posted before it was stopped */
+    bus = gst_element_get_bus(data->pipeline);
+    gst_bus_set_flushing(bus, TRUE);
+    gst_bus_set_flushing(bus, FALSE);
+    gst_object_unref(bus);
+
+    if (!decode_cache_use_uridecodebin(data))
+    {
+        return FALSE;
+    }
+    gst_element_set_state(data->pipeline, GST_STATE_PLAYING);
+
+    return TRUE;
+}
+
+/* Bytes held by every queue and multiqueue in the pipeline, including the ones inside uridecodebin and splitmuxsink */
+static guint64 queued_bytes(GstElement *pipeline)
+{
+    GstIterator *it = gst_bin_iterate_recurse(GST_BIN(pipeline));
+    GValue item = G_VALUE_INIT;
+    gboolean done = FALSE;
+    guint64 total = 0;
+
+    while (!done)
+    {
+        switch (gst_iterator_next(it, &item))
+        {
+        case GST_ITERATOR_OK:
+        {
+            GstElement *element = GST_ELEMENT(g_value_get_object(&item));
+            GstElementFactory *factory = gst_element_get_factory(element);
+            const gchar *name = factory ? gst_plugin_feature_get_name(GST_PLUGIN_FEATURE(factory)) : NULL;
+            guint bytes;
+
+            if (g_strcmp0(name, "queue") == 0)
+            {
+                g_object_get(element, "current-level-bytes", &bytes, NULL);
+                total += bytes;
+            }
+            else if (g_strcmp0(name, "multiqueue") == 0)
+            {
+                /* multiqueue reports its levels per sink pad */
+                GList *l;
+
+                GST_OBJECT_LOCK(element);
+                for (l = element->sinkpads; l; l = l->next)
+                {
+                    if (g_object_class_find_property(G_OBJECT_GET_CLASS(l->data), "current-level-bytes"))
+                    {
+                        g_object_get(l->data, "current-level-bytes", &bytes, NULL);
+                        total += bytes;
+                    }
+                }
+                GST_OBJECT_UNLOCK(element);
+            }
+            g_value_reset(&item);
+            break;
+        }
+        case GST_ITERATOR_RESYNC:
+            gst_iterator_resync(it);
+            total = 0;
+            break;
+        case GST_ITERATOR_ERROR:
+        case GST_ITERATOR_DONE:
+            done = TRUE;
+            break;
+        }
+    }
+    g_value_unset(&item);
+    gst_iterator_free(it);
+
+    return total;
+}
+
+/* Raw frames x264_enc holds for lookahead and frame threads */
+static guint64 encoder_bytes(GstElement *x264_enc)
+{
+    GstPad *pad = gst_element_get_static_pad(x264_enc, "sink");
+    GstCaps *caps = gst_pad_get_current_caps(pad);
+    GstClockTime min_latency = 0, max_latency = 0;
+    GstVideoInfo info;
+    guint64 total = 0;
+
+    if (caps && gst_video_info_from_caps(&info, caps) && info.fps_n > 0)
+    {
+        gst_video_encoder_get_latency(GST_VIDEO_ENCODER(x264_enc), &min_latency, &max_latency);
+        if (GST_CLOCK_TIME_IS_VALID(max_latency))
+        {
+            total = gst_util_uint64_scale_ceil(max_latency, info.fps_n, GST_SECOND * info.fps_d) * info.size;
+        }
+    }
+    if (caps)
+        gst_caps_unref(caps);
+    gst_object_unref(pad);
+
+    return total;
+}
+
+/* Everything accounted against the budget: queues (raw frames and GOPs waiting in splitmuxsink),
+ * frames inside the encoder and the upload part buffer of gcs_sink */
+static guint64 pipeline_memory(CustomData *data)
+{
+    guint64 total = queued_bytes(data->pipeline) + encoder_bytes(data->x264_enc);
+
+    if (g_object_class_find_property(G_OBJECT_GET_CLASS(data->gcs_sink), "part-size"))
+    {
+        guint64 part_size;
+
+        g_object_get(data->gcs_sink, "part-size", &part_size, NULL);
+        total += part_size;
+    }
+
+    return total;
+}
+
+/* On the FLV tee pads: drop everything while the branch is shed, then resume video on a keyframe */
+static GstPadProbeReturn flv_branch_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+    FlvBranchGate *gate = (FlvBranchGate *)user_data;
+    GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+
+    if (g_atomic_int_get(gate->level) >= BUDGET_DROP_FLV)
+    {
+        gate->resync = TRUE;
+        return GST_PAD_PROBE_DROP;
+    }
+    if (gate->resync)
+    {
+        if (GST_BUFFER_FLAG_IS_SET(buffer, GST_BUFFER_FLAG_DELTA_UNIT))
+        {
+            return GST_PAD_PROBE_DROP;
+        }
+        gate->resync = FALSE;
+    }
+
+    return GST_PAD_PROBE_OK;
+}
+
+static void budget_apply(CustomData *data, BudgetLevel from, BudgetLevel to)
+{
+    MemoryBudget *budget = &data->budget;
+
+    if (to >= BUDGET_LOWER_QUALITY && from < BUDGET_LOWER_QUALITY)
+    {
+        g_object_set(data->x264_enc, "bitrate", MIN(budget->bitrate, DEGRADED_BITRATE),
+                     "quantizer", MAX(budget->quantizer, DEGRADED_QUANTIZER), NULL);
+    }
+    else if (to < BUDGET_LOWER_QUALITY && from >= BUDGET_LOWER_QUALITY)
+    {
+        g_object_set(data->x264_enc, "bitrate", budget->bitrate, "quantizer", budget->quantizer, NULL);
+    }
+
+    if (to >= BUDGET_SPLIT_NOW && from < BUDGET_SPLIT_NOW)
+    {
+        budget->split_ticks = 0;
+        /* splitmuxsink only cuts on a keyframe, so ask for one right away */
+        g_signal_emit_by_name(data->split_mux_sink, "split-now");
+        gst_element_send_event(data->x264_enc, gst_video_event_new_upstream_force_key_unit(GST_CLOCK_TIME_NONE, TRUE, 0));
+    }
+
+    g_atomic_int_set(&budget->level, to);
+}
+
+/* Called every BUDGET_INTERVAL. Returns FALSE when the stream is over budget with nothing left to shed */
+static gboolean budget_check(CustomData *data)
+{
+    MemoryBudget *budget = &data->budget;
+    BudgetLevel level = g_atomic_int_get(&budget->level);
+    BudgetLevel target = BUDGET_OK;
+    guint64 used = pipeline_memory(data);
+    gint percent = (gint)(used * 100 / budget->budget);
+
+    budget->peak = MAX(budget->peak, used);
+
+    while (target < BUDGET_SPLIT_NOW && percent >= budget_thresholds[target + 1])
+    {
+        target++;
+    }
+
+    if (target > level)
+    {
+        g_print("Memory budget: %" G_GUINT64_FORMAT " KB (%d%%), %s -> %s\n", used / 1024, percent,
+                budget_level_names[level], budget_level_names[target]);
+        budget_apply(data, level, target);
+        budget->recover_ticks = 0;
+    }
+    else if (level > BUDGET_OK && percent < budget_thresholds[level] - BUDGET_HYSTERESIS)
+    {
+        /* Step down one level at a time */
+        if (++budget->recover_ticks >= BUDGET_RECOVER_TICKS)
+        {
+            g_print("Memory budget: %" G_GUINT64_FORMAT " KB (%d%%), %s -> %s\n", used / 1024, percent,
+                    budget_level_names[level], budget_level_names[level - 1]);
+            budget_apply(data, level, level - 1);
+            budget->recover_ticks = 0;
+        }
+    }
+    else
+    {
+        budget->recover_ticks = 0;
+    }
+
+    /* A split is a one-off, cut again if the fragment after it fills up too */
+    if (level == BUDGET_SPLIT_NOW && target == BUDGET_SPLIT_NOW && ++budget->split_ticks >= BUDGET_RECOVER_TICKS)
+    {
+        budget_apply(data, BUDGET_LOWER_QUALITY, BUDGET_SPLIT_NOW);
+        budget->split_ticks = 0;
+    }
+
+    budget->over_ticks = percent >= 120 ? budget->over_ticks + 1 : 0;
+    return budget->over_ticks < BUDGET_GRACE_TICKS;
+}
+
 int main(int argc, char *argv[])
 {
-    CustomData data;
+    CustomData data = {0};
     GstBus *bus;
     GstMessage *msg;
+    const gchar *budget_env = g_getenv("MEMORY_BUDGET_MB");
+    const gchar *decode_env = g_getenv("DECODE_CPU_BUDGET");
+    const gchar *uri = "add-here";
+    gchar *protocol;
+    int ret = 0;
+    ConvertBypass audio_bypass;
 
     GstPad *video_tee_flv_pad, *video_tee_mp4_pad;
     GstPad *video_flv_queue_sink_pad, *splitmuxsink_video_pad;
@@ -182,8 +1071,18 @@ int main(int argc, char *argv[])
     /* Initialize GStreamer */
     gst_init(&argc, &argv);
 
-    /* Create the elements */
-    data.source = gst_element_factory_make("uridecodebin", "source");
+    /* Create the elements, with the cached decode chain for this URI if there is one */
+    decode_cache_load(&data.cache, uri);
+    if (data.cache.hit)
+    {
+        g_print("Using cached decode chain for %s\n", uri);
+        data.source = gst_element_make_from_uri(GST_URI_SRC, uri, "source", NULL);
+        data.cache.hit = data.source != NULL;
+    }
+    if (!data.cache.hit)
+    {
+        data.source = make_uridecodebin(&data);
+    }
 
     data.video_queue = gst_element_factory_make("queue", "video_queue");
     data.video_convert = gst_element_factory_make("videoconvert", "video_convert");
@@ -222,7 +1121,6 @@ int main(int argc, char *argv[])
     }
 
     /* Configure elements */
-    g_object_set(data.source, "uri", "add-here", NULL);
     g_object_set(data.x264_enc, "speed-preset", 2, "pass", 5, "bitrate", 1200, "key-int-max", 30, "quantizer", 22, NULL);
     g_object_set(data.face_blur, "scale-factor", 1.1, "profile", "/usr/share/opencv4/haarcascades/haarcascade_frontalface_alt.xml", NULL);
 
@@ -234,8 +1132,23 @@ int main(int argc, char *argv[])
 
     // Connect the format-location signal to generate dynamic filenames
     g_signal_connect(data.split_mux_sink, "format-location", G_CALLBACK(format_location_callback), data.gcs_sink);
-    /* Connect to the pad-added signal */
-    g_signal_connect(data.source, "pad-added", G_CALLBACK(pad_added_handler), &data);
+
+    /* Decoder threads: the stream's CPU budget, never more than the host has */
+    data.decode.threads = CLAMP(decode_env ? atoi(decode_env) : DECODE_CPU_BUDGET, 1, (gint)g_get_num_processors());
+    protocol = gst_uri_get_protocol(uri);
+    data.decode.live = protocol && g_strv_contains(live_protocols, protocol);
+    g_free(protocol);
+
+    /* Per-pipeline memory budget */
+    data.budget.budget = (guint64)(budget_env ? atoi(budget_env) : MEMORY_BUDGET_MB) * 1024 * 1024;
+    data.budget.video_gate.level = &data.budget.level;
+    data.budget.audio_gate.level = &data.budget.level;
+    g_object_get(data.x264_enc, "bitrate", &data.budget.bitrate, "quantizer", &data.budget.quantizer, NULL);
+    if (data.budget.budget == 0)
+    {
+        g_printerr("MEMORY_BUDGET_MB must be positive.\n");
+        return -1;
+    }
 
     g_print("All elements configured successfully.\n");
 
@@ -263,15 +1176,37 @@ int main(int argc, char *argv[])
         g_print("All elements linked successfully.\n");
     }
 
+    /* Source ! demuxer for the cached chain, decoders are plugged as the demuxer exposes its pads */
+    if (data.cache.hit)
+    {
+        if (!decode_cache_build(&data) && !decode_cache_use_uridecodebin(&data))
+        {
+            g_printerr("Could not build the decode chain.\n");
+            gst_object_unref(data.pipeline);
+            return -1;
+        }
+    }
+    if (data.cache.hit)
+    {
+        GstPad *video_queue_sink_pad = gst_element_get_static_pad(data.video_queue, "sink");
+
+        gst_pad_add_probe(video_queue_sink_pad, GST_PAD_PROBE_TYPE_BUFFER, decode_cache_confirm_probe, &data.cache, NULL);
+        gst_object_unref(video_queue_sink_pad);
+    }
+
+    /* Take the audio converters out of the data path when the decoded audio already suits the encoder */
+    audio_bypass = (ConvertBypass){data.pipeline, data.avenc_aac};
+    add_convert_bypass(data.audio_queue, &audio_bypass);
+
     /* Manually link the video_tee, which has "Request" pads */
     video_tee_flv_pad = gst_element_request_pad_simple(data.video_tee, "src_%u");
-    g_print("Obtained request pad %s for video_tee's flvmux branch.\n", gst_pad_get_name(video_tee_flv_pad));
+    g_print("Obtained request pad %s for video_tee's flvmux branch.\n", GST_PAD_NAME(video_tee_flv_pad));
     video_flv_queue_sink_pad = gst_element_get_static_pad(data.video_flv_queue, "sink");
 
     video_tee_mp4_pad = gst_element_request_pad_simple(data.video_tee, "src_%u");
-    g_print("Obtained request pad %s for video_tee's mp4mux branch.\n", gst_pad_get_name(video_tee_mp4_pad));
+    g_print("Obtained request pad %s for video_tee's mp4mux branch.\n", GST_PAD_NAME(video_tee_mp4_pad));
     splitmuxsink_video_pad = gst_element_request_pad_simple(data.split_mux_sink, "video");
-    g_print("Obtained request pad %s for splitmuxsink video branch.\n", gst_pad_get_name(splitmuxsink_video_pad));
+    g_print("Obtained request pad %s for splitmuxsink video branch.\n", GST_PAD_NAME(splitmuxsink_video_pad));
 
     if (gst_pad_link(video_tee_flv_pad, video_flv_queue_sink_pad) != GST_PAD_LINK_OK ||
         gst_pad_link(video_tee_mp4_pad, splitmuxsink_video_pad) != GST_PAD_LINK_OK)
@@ -289,13 +1224,13 @@ int main(int argc, char *argv[])
 
     /* Manually link the audio_tee, which has "Request" pads */
     audio_tee_flv_pad = gst_element_request_pad_simple(data.audio_tee, "src_%u");
-    g_print("Obtained request pad %s for audio_tee's flvmux branch.\n", gst_pad_get_name(audio_tee_flv_pad));
+    g_print("Obtained request pad %s for audio_tee's flvmux branch.\n", GST_PAD_NAME(audio_tee_flv_pad));
     audio_flv_queue_sink_pad = gst_element_get_static_pad(data.audio_flv_queue, "sink");
 
     audio_tee_mp4_pad = gst_element_request_pad_simple(data.audio_tee, "src_%u");
-    g_print("Obtained request pad %s for audio_tee's mp4mux branch.\n", gst_pad_get_name(audio_tee_mp4_pad));
+    g_print("Obtained request pad %s for audio_tee's mp4mux branch.\n", GST_PAD_NAME(audio_tee_mp4_pad));
     splitmuxsink_audio_pad = gst_element_request_pad_simple(data.split_mux_sink, "audio_%u");
-    g_print("Obtained request pad %s for splitmuxsink audio branch.\n", gst_pad_get_name(splitmuxsink_audio_pad));
+    g_print("Obtained request pad %s for splitmuxsink audio branch.\n", GST_PAD_NAME(splitmuxsink_audio_pad));
 
     if (gst_pad_link(audio_tee_flv_pad, audio_flv_queue_sink_pad) != GST_PAD_LINK_OK ||
         gst_pad_link(audio_tee_mp4_pad, splitmuxsink_audio_pad) != GST_PAD_LINK_OK)
@@ -314,11 +1249,11 @@ int main(int argc, char *argv[])
     /* Manually link the flvmux which has "Request" pads */
     video_flv_queue_src_pad = gst_element_get_static_pad(data.video_flv_queue, "src");
     flv_mux_video_pad = gst_element_request_pad_simple(data.flv_mux, "video");
-    g_print("Obtained request pad %s for flvmux video branch.\n", gst_pad_get_name(flv_mux_video_pad));
+    g_print("Obtained request pad %s for flvmux video branch.\n", GST_PAD_NAME(flv_mux_video_pad));
 
     audio_flv_queue_src_pad = gst_element_get_static_pad(data.audio_flv_queue, "src");
     flv_mux_audio_pad = gst_element_request_pad_simple(data.flv_mux, "audio");
-    g_print("Obtained request pad %s for flvmux audio branch.\n", gst_pad_get_name(flv_mux_audio_pad));
+    g_print("Obtained request pad %s for flvmux audio branch.\n", GST_PAD_NAME(flv_mux_audio_pad));
 
     if (gst_pad_link(video_flv_queue_src_pad, flv_mux_video_pad) != GST_PAD_LINK_OK ||
         gst_pad_link(audio_flv_queue_src_pad, flv_mux_audio_pad) != GST_PAD_LINK_OK)
@@ -334,15 +1269,42 @@ int main(int argc, char *argv[])
     gst_object_unref(video_flv_queue_src_pad);
     gst_object_unref(audio_flv_queue_src_pad);
 
+    /* The FLV branch is the first thing shed when the budget runs low */
+    gst_pad_add_probe(video_tee_flv_pad, GST_PAD_PROBE_TYPE_BUFFER, flv_branch_probe, &data.budget.video_gate, NULL);
+    gst_pad_add_probe(audio_tee_flv_pad, GST_PAD_PROBE_TYPE_BUFFER, flv_branch_probe, &data.budget.audio_gate, NULL);
+
     /* Start playing the pipeline */
     gst_element_set_state(data.pipeline, GST_STATE_PLAYING);
 
     /* Visualize the pipeline using GraphViz */
     gst_debug_bin_to_dot_file(GST_BIN(data.pipeline), GST_DEBUG_GRAPH_SHOW_ALL, "pipeline-faceblur");
 
-    /* Wait until error or EOS */
+    /* Wait until error or EOS, checking the memory budget in between */
     bus = gst_element_get_bus(data.pipeline);
-    msg = gst_bus_timed_pop_filtered(bus, GST_CLOCK_TIME_NONE, GST_MESSAGE_ERROR | GST_MESSAGE_EOS);
+    while (TRUE)
+    {
+        msg = gst_bus_timed_pop_filtered(bus, BUDGET_INTERVAL * GST_MSECOND, GST_MESSAGE_ERROR | GST_MESSAGE_EOS | GST_MESSAGE_APPLICATION);
+        if (msg != NULL)
+        {
+            /* A cached decode chain that failed before the first frame is replaced, anything else ends the stream */
+            if (!decode_cache_fallback(&data, msg) && GST_MESSAGE_TYPE(msg) != GST_MESSAGE_APPLICATION)
+            {
+                break;
+            }
+            gst_message_unref(msg);
+            msg = NULL;
+            continue;
+        }
+        if (!budget_check(&data))
+        {
+            /* Fail this stream alone rather than let it take the host down */
+            g_printerr("Memory budget of %d MB exceeded with every degradation step applied, stopping.\n",
+                       (gint)(data.budget.budget >> 20));
+            ret = -1;
+            break;
+        }
+    }
+    g_print("Memory budget: peak %" G_GUINT64_FORMAT " KB of %" G_GUINT64_FORMAT " KB\n", data.budget.peak / 1024, data.budget.budget / 1024);
 
     /* Release the request pads from the video_tee, and unref them */
     gst_element_release_request_pad(data.video_tee, video_tee_flv_pad);
@@ -369,5 +1331,9 @@ int main(int argc, char *argv[])
     gst_element_set_state(data.pipeline, GST_STATE_NULL);
 
     gst_object_unref(data.pipeline);
-    return 0;
+    g_key_file_free(data.cache.file);
+    g_ptr_array_unref(data.cache.elements);
+    g_free(data.cache.group);
+    g_free(data.cache.uri);
+    return ret;
 }
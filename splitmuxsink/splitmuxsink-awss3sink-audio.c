@@ -1,9 +1,102 @@
 #include <gst/gst.h>
+#include <glib/gstdio.h>
+#include <math.h>
+#include <signal.h>
 #include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <time.h>
+#include <unistd.h>
 #include <sys/time.h>
 
 #define SEGMENT_DURATION 15000 // Duration for each segment in milliseconds
+#define SPOOL_DIR "/tmp/vm2-spool" // Fragments and their silence sidecars wait here until they are uploaded
+#define SILENCE_THRESHOLD_DB -50.0 // A buffer whose RMS level is below this (dBFS) counts as silent
+#define SILENCE_HYSTERESIS_DB 6.0 // The level has to rise this far above the threshold to end silence
+#define SILENCE_HOLD_MS 500 // Quieter stretches shorter than this (pauses between words) are encoded as is
+#define SILENCE_EDGE_MS 50 // A fragment is fully silent if at most this much of it was not in a silence span
+#define AAC_VBR_PRESET 3 // fdkaacenc vbr-preset (1 very low - 5 very high); VBR makes zeroed input nearly free
+#define KEY_PREFIX "vm2"
+#define UPLOAD_ATTEMPTS 4 // Tries per spooled file before it is left in SPOOL_DIR
+#define UPLOAD_BACKOFF_MS 2000 // Wait before the first retry, doubled for each further one
+#define EOS_TIMEOUT 60 // Seconds to wait for EOS after SIGINT before giving up on the last fragment
+volatile gboolean terminate = FALSE;
+
+/*
+ * Silence-aware recording for audio-only rooms. A probe on the encoder's sink
+ * pad measures the RMS level of every buffer. Once the level stays below
+ * SILENCE_THRESHOLD_DB for SILENCE_HOLD_MS, the input is replaced with digital
+ * zero until it rises above the threshold plus SILENCE_HYSTERESIS_DB again;
+ * with fdkaacenc in VBR mode a zeroed frame costs a few bytes, which is the
+ * closest this encoder gets to DTX. Silence spans are kept in running time.
+ *
+ * splitmuxsink writes fragments to SPOOL_DIR instead of streaming them to
+ * awss3sink, so the decision to upload is made once a fragment is closed.
+ * Each fragment gets a <key>.silence.json sidecar with its silence spans;
+ * fully silent fragments are deleted and only the sidecar is uploaded, so the
+ * timeline has no unexplained holes. KEEP_SILENT_SEGMENTS=1 uploads them too.
+ *
+ * With COALESCE_FRAGMENTS=N, fragments are still cut at SEGMENT_DURATION but
+ * N consecutive ones are appended to one pack object, vm2/<start>_<end>.pack,
+ * next to a GKeyFile index, vm2/<start>_<end>.index. The index has one
+ * [segment NNNNN] group per fragment with its original key, time range,
+ * silence spans and the byte range of its complete MP4 inside the pack, so a
+ * segment is read back with a single ranged GET. Skipped silent fragments
+ * keep their group with size 0. Two objects are written per N fragments.
+ */
+typedef struct {
+    GstClockTime start;
+    GstClockTime end;
+} SilenceSpan;
+
+typedef struct {
+    gchar *location;        // Spooled file
+    gchar *key;             // Object key, same naming as when uploading directly
+    GstClockTime start;     // Running time of the fragment's first buffer
+    long long start_ms;     // Epoch times in the key
+    long long end_ms;
+} SpoolFragment;
+
+typedef struct {
+    gchar *location;        // Spooled pack, fragments appended back to back
+    GKeyFile *index;
+    long long start_ms;     // First fragment's start and last fragment's end, for the pack's key
+    long long end_ms;
+    guint64 size;
+    guint segments;
+} FragmentPack;
+
+typedef struct _UploadJob UploadJob;
+
+struct _UploadJob {
+    gchar *location;
+    gchar *key;
+    UploadJob *then;        // Uploaded only after this one succeeded
+};
+
+typedef struct {
+    GMutex lock;
+    GstSegment segment;         // Current segment on the encoder's sink pad
+    gboolean silent;
+    GstClockTime quiet_since;   // Running time the level first went below the threshold, or NONE
+    GstClockTime span_start;    // Start of the open span while silent
+    GArray *spans;              // Closed SilenceSpan, oldest first, dropped once every fragment they touch is closed
+    GHashTable *fragments;      // location -> SpoolFragment
+    GThreadPool *uploader;      // One thread, so uploads go out in fragment order
+    gboolean keep_silent;
+    guint coalesce;             // Fragments per pack, 1 uploads every fragment on its own
+    FragmentPack *pack;         // Open pack; only touched from splitmuxsink's fragment-closed handler and at exit
+    guint uploaded;
+    guint skipped;
+} SilenceTracker;
+
+// Signal handler for SIGINT
+void signal_handler(int signal) {
+  if (signal == SIGINT) {
+    g_print("Received SIGINT terminating\n");
+    terminate = TRUE;
+  }
+}
 
 // Function to get the current time in milliseconds since the Unix epoch
 static long long current_time_millis() {
@@ -12,19 +105,462 @@ static long long current_time_millis() {
     return (long long)(time_now.tv_sec) * 1000 + (long long)(time_now.tv_usec) / 1000;
 }
 
-static gchar* format_location_callback(GstElement *splitmuxsink, guint fragment_id, gpointer user_data) {
+static void configure_gcs_sink(GstElement *gcs_sink) {
+    g_object_set (gcs_sink, "access-key", "add-here", "bucket", "add-here", "endpoint-uri", "https://storage.googleapis.com", "force-path-style", true, "region", "add-here", "secret-access-key", "add-here", "sync", true,  NULL);
+}
+
+static void spool_fragment_free(gpointer data) {
+    SpoolFragment *fragment = (SpoolFragment *) data;
+
+    g_free(fragment->location);
+    g_free(fragment->key);
+    g_free(fragment);
+}
+
+static gchar* format_location_full_callback(GstElement *splitmuxsink, guint fragment_id, GstSample *first_sample, gpointer user_data) {
+    SilenceTracker *tracker = (SilenceTracker *) user_data;
+    GstBuffer *buffer = gst_sample_get_buffer(first_sample);
+    const GstSegment *segment = gst_sample_get_segment(first_sample);
+    SpoolFragment *fragment = g_new0(SpoolFragment, 1);
+
     // Get the (Unix epoch time) for start and end time
     long long start_time = current_time_millis();
     long long end_time = start_time + SEGMENT_DURATION;
 
-    gchar *filename = g_strdup_printf("vm2/%lld_%lld.mp4", start_time, end_time);
+    fragment->start_ms = start_time;
+    fragment->end_ms = end_time;
+    fragment->key = g_strdup_printf("%s/%lld_%lld.mp4", KEY_PREFIX, start_time, end_time);
+    fragment->location = g_strdup_printf("%s/%lld_%lld.mp4", SPOOL_DIR, start_time, end_time);
+    fragment->start = 0;
+    if (buffer && segment && GST_BUFFER_PTS_IS_VALID(buffer)) {
+        fragment->start = gst_segment_to_running_time(segment, GST_FORMAT_TIME, GST_BUFFER_PTS(buffer));
+    }
+
+    g_mutex_lock(&tracker->lock);
+    g_hash_table_insert(tracker->fragments, g_strdup(fragment->location), fragment);
+    g_mutex_unlock(&tracker->lock);
+
+    return g_strdup(fragment->location);
+}
+
+/* RMS level of interleaved S16 samples in dBFS; digital zero is -inf */
+static gdouble buffer_level_db(const gint16 *samples, gsize n_samples) {
+    gdouble sum = 0.0;
+
+    for (gsize i = 0; i < n_samples; i++) {
+        sum += (gdouble) samples[i] * samples[i];
+    }
+    if (n_samples == 0 || sum == 0.0) {
+        return -INFINITY;
+    }
+    return 10.0 * log10(sum / n_samples / (32768.0 * 32768.0));
+}
+
+/* Runs on the encoder's sink pad: track silence with hysteresis and zero the input while silent */
+static GstPadProbeReturn silence_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
+    SilenceTracker *tracker = (SilenceTracker *) user_data;
+    GstBuffer *buffer;
+    GstMapInfo map;
+    GstClockTime running_time, end_time;
+    gdouble level;
+    gboolean silent;
+
+    if (GST_PAD_PROBE_INFO_TYPE(info) & GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM) {
+        GstEvent *event = GST_PAD_PROBE_INFO_EVENT(info);
+
+        if (GST_EVENT_TYPE(event) == GST_EVENT_SEGMENT) {
+            g_mutex_lock(&tracker->lock);
+            gst_event_copy_segment(event, &tracker->segment);
+            g_mutex_unlock(&tracker->lock);
+        }
+        return GST_PAD_PROBE_OK;
+    }
+
+    buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+    if (!GST_BUFFER_PTS_IS_VALID(buffer) || !gst_buffer_map(buffer, &map, GST_MAP_READ)) {
+        return GST_PAD_PROBE_OK;
+    }
+    level = buffer_level_db((const gint16 *) map.data, map.size / sizeof(gint16));
+    gst_buffer_unmap(buffer, &map);
+
+    g_mutex_lock(&tracker->lock);
+    running_time = gst_segment_to_running_time(&tracker->segment, GST_FORMAT_TIME, GST_BUFFER_PTS(buffer));
+    end_time = running_time + (GST_BUFFER_DURATION_IS_VALID(buffer) ? GST_BUFFER_DURATION(buffer) : 0);
+
+    if (level < SILENCE_THRESHOLD_DB) {
+        if (!GST_CLOCK_TIME_IS_VALID(tracker->quiet_since)) {
+            tracker->quiet_since = running_time;
+        }
+        if (!tracker->silent && end_time - tracker->quiet_since >= SILENCE_HOLD_MS * GST_MSECOND) {
+            tracker->silent = TRUE;
+            tracker->span_start = tracker->quiet_since;
+        }
+    } else if (level > SILENCE_THRESHOLD_DB + SILENCE_HYSTERESIS_DB) {
+        if (tracker->silent) {
+            SilenceSpan span = { tracker->span_start, running_time };
+            g_array_append_val(tracker->spans, span);
+            tracker->silent = FALSE;
+        }
+        tracker->quiet_since = GST_CLOCK_TIME_NONE;
+    } else if (!tracker->silent) {
+        // Between threshold and threshold + hysteresis: not quiet enough to start a span
+        tracker->quiet_since = GST_CLOCK_TIME_NONE;
+    }
+    silent = tracker->silent;
+    g_mutex_unlock(&tracker->lock);
+
+    if (silent) {
+        buffer = gst_buffer_make_writable(buffer);
+        if (gst_buffer_map(buffer, &map, GST_MAP_WRITE)) {
+            memset(map.data, 0, map.size);
+            gst_buffer_unmap(buffer, &map);
+        }
+        GST_PAD_PROBE_INFO_DATA(info) = buffer;
+    }
+
+    return GST_PAD_PROBE_OK;
+}
+
+/* Upload one spooled file with its own filesrc ! awss3sink pipeline and remove it; on failure it stays in the spool */
+static gboolean upload_file_once(SilenceTracker *tracker, const gchar *location, const gchar *key) {
+    GstElement *pipeline, *file_source, *gcs_sink;
+    GstBus *bus;
+    GstMessage *msg;
+    gboolean uploaded;
+
+    pipeline = gst_pipeline_new("upload");
+    file_source = gst_element_factory_make("filesrc", "file_source");
+    gcs_sink = gst_element_factory_make("awss3sink", "gcs_sink");
+    if (!pipeline || !file_source || !gcs_sink) {
+        g_printerr("Could not create the upload pipeline for %s\n", location);
+        g_clear_object(&pipeline);
+        g_clear_object(&file_source);
+        g_clear_object(&gcs_sink);
+        return FALSE;
+    }
+
+    g_object_set(file_source, "location", location, NULL);
+    configure_gcs_sink(gcs_sink);
+    g_object_set(gcs_sink, "key", key, NULL);
+    gst_bin_add_many(GST_BIN(pipeline), file_source, gcs_sink, NULL);
+    if (!gst_element_link(file_source, gcs_sink)) {
+        g_printerr("Could not link the upload pipeline for %s\n", location);
+        gst_object_unref(pipeline);
+        return FALSE;
+    }
+
+    gst_element_set_state(pipeline, GST_STATE_PLAYING);
+    bus = gst_element_get_bus(pipeline);
+    msg = gst_bus_timed_pop_filtered(bus, GST_CLOCK_TIME_NONE, GST_MESSAGE_ERROR | GST_MESSAGE_EOS);
+    uploaded = GST_MESSAGE_TYPE(msg) != GST_MESSAGE_ERROR;
+    if (!uploaded) {
+        GError *err = NULL;
+
+        gst_message_parse_error(msg, &err, NULL);
+        g_printerr("Upload of %s failed: %s\n", key, err->message);
+        g_error_free(err);
+    } else {
+        g_print("Uploaded %s\n", key);
+        g_remove(location);
+        g_mutex_lock(&tracker->lock);
+        tracker->uploaded++;
+        g_mutex_unlock(&tracker->lock);
+    }
+    gst_message_unref(msg);
+    gst_object_unref(bus);
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+    gst_object_unref(pipeline);
+
+    return uploaded;
+}
 
-    GstElement *gcs_sink = GST_ELEMENT(user_data); // Retrieve gcs_sink passed via user_data
-    if (gcs_sink) {
-        g_object_set(gcs_sink, "key", filename, NULL);  // Set the key dynamically
+/*
+ * Retry a failed upload with exponential backoff. The uploader has one
+ * thread, so later files wait behind the retries and still go out in order.
+ * After UPLOAD_ATTEMPTS the file is left in SPOOL_DIR; nothing picks it up
+ * again, it has to be uploaded by hand.
+ */
+static gboolean upload_file(SilenceTracker *tracker, const gchar *location, const gchar *key) {
+    guint backoff_ms = UPLOAD_BACKOFF_MS;
+
+    for (guint attempt = 1; ; attempt++) {
+        if (upload_file_once(tracker, location, key)) {
+            return TRUE;
+        }
+        if (attempt == UPLOAD_ATTEMPTS) {
+            g_printerr("Giving up on %s after %d attempts, left at %s\n", key, UPLOAD_ATTEMPTS, location);
+            return FALSE;
+        }
+        g_printerr("Retrying %s in %u ms\n", key, backoff_ms);
+        g_usleep((gulong) backoff_ms * 1000);
+        backoff_ms *= 2;
     }
+}
 
-    return filename;
+/* Upload a job and the ones chained behind it; once one fails for good, the rest of the chain is left in the spool */
+static void upload_worker(gpointer data, gpointer user_data) {
+    UploadJob *job = (UploadJob *) data;
+    SilenceTracker *tracker = (SilenceTracker *) user_data;
+    gboolean ok = TRUE;
+
+    while (job) {
+        UploadJob *then = job->then;
+
+        if (ok) {
+            ok = upload_file(tracker, job->location, job->key);
+        } else {
+            g_printerr("Not uploading %s after an earlier failure, left in %s\n", job->key, SPOOL_DIR);
+        }
+        g_free(job->location);
+        g_free(job->key);
+        g_free(job);
+        job = then;
+    }
+}
+
+static UploadJob* upload_job_new(const gchar *location, const gchar *key) {
+    UploadJob *job = g_new0(UploadJob, 1);
+
+    job->location = g_strdup(location);
+    job->key = g_strdup(key);
+    return job;
+}
+
+static void queue_upload(SilenceTracker *tracker, const gchar *location, const gchar *key) {
+    g_thread_pool_push(tracker->uploader, upload_job_new(location, key), NULL);
+}
+
+/* Silence spans as a JSON array of [start, end] pairs, in ms from the fragment's first buffer */
+static gchar* silence_spans_json(SpoolFragment *fragment, GArray *spans) {
+    GString *json = g_string_new("[");
+
+    for (guint i = 0; i < spans->len; i++) {
+        SilenceSpan *span = &g_array_index(spans, SilenceSpan, i);
+        g_string_append_printf(json, "%s[%" G_GUINT64_FORMAT ",%" G_GUINT64_FORMAT "]", i ? "," : "",
+                GST_TIME_AS_MSECONDS(span->start - fragment->start), GST_TIME_AS_MSECONDS(span->end - fragment->start));
+    }
+    g_string_append_c(json, ']');
+    return g_string_free(json, FALSE);
+}
+
+/* Write the fragment's silence spans as a JSON sidecar */
+static gchar* write_silence_sidecar(SpoolFragment *fragment, GArray *spans, GstClockTime duration, GstClockTime silent) {
+    GString *json = g_string_new(NULL);
+    gchar *location = g_strdup_printf("%.*s.silence.json", (int) (strlen(fragment->location) - strlen(".mp4")), fragment->location);
+    gchar *spans_json = silence_spans_json(fragment, spans);
+    GError *err = NULL;
+
+    g_string_append_printf(json, "{\"key\":\"%s\",\"duration_ms\":%" G_GUINT64_FORMAT ",\"silent_ms\":%" G_GUINT64_FORMAT ",\"spans\":%s}\n",
+            fragment->key, GST_TIME_AS_MSECONDS(duration), GST_TIME_AS_MSECONDS(silent), spans_json);
+    g_free(spans_json);
+
+    if (!g_file_set_contents(location, json->str, json->len, &err)) {
+        g_printerr("Could not write %s: %s\n", location, err->message);
+        g_error_free(err);
+        g_clear_pointer(&location, g_free);
+    }
+    g_string_free(json, TRUE);
+    return location;
+}
+
+/* Write the pack's index and hand pack and index to the uploader; the index is only uploaded once its pack is */
+static void pack_flush(SilenceTracker *tracker) {
+    FragmentPack *pack = tracker->pack;
+    gchar *key, *index_location, *index_key;
+    GError *err = NULL;
+
+    if (!pack) {
+        return;
+    }
+    tracker->pack = NULL;
+
+    key = g_strdup_printf("%s/%lld_%lld.pack", KEY_PREFIX, pack->start_ms, pack->end_ms);
+    index_key = g_strdup_printf("%s/%lld_%lld.index", KEY_PREFIX, pack->start_ms, pack->end_ms);
+    index_location = g_strdup_printf("%s.index", pack->location);
+
+    // An all-silent pack has no data object, only its index
+    g_key_file_set_string(pack->index, "pack", "key", pack->size ? key : "");
+    g_key_file_set_uint64(pack->index, "pack", "size", pack->size);
+    g_key_file_set_integer(pack->index, "pack", "segments", pack->segments);
+    g_key_file_set_integer(pack->index, "pack", "segment-duration-ms", SEGMENT_DURATION);
+
+    if (!g_key_file_save_to_file(pack->index, index_location, &err)) {
+        g_printerr("Could not write %s: %s\n", index_location, err->message);
+        g_error_free(err);
+    } else {
+        UploadJob *job = upload_job_new(index_location, index_key);
+
+        if (pack->size) {
+            UploadJob *pack_job = upload_job_new(pack->location, key);
+
+            pack_job->then = job;
+            job = pack_job;
+        }
+        g_thread_pool_push(tracker->uploader, job, NULL);
+        g_print("Pack %s: %u fragment(s), %" G_GUINT64_FORMAT " bytes\n", key, pack->segments, pack->size);
+    }
+
+    g_free(key);
+    g_free(index_key);
+    g_free(index_location);
+    g_key_file_free(pack->index);
+    g_free(pack->location);
+    g_free(pack);
+}
+
+/* Append a closed fragment to the open pack and index its byte range; returns FALSE if it could not be appended */
+static gboolean pack_add_fragment(SilenceTracker *tracker, SpoolFragment *fragment, gboolean upload, GArray *spans,
+        GstClockTime duration, GstClockTime silent) {
+    FragmentPack *pack = tracker->pack;
+    gchar *contents = NULL, *group, *spans_json;
+    gsize length = 0;
+    GError *err = NULL;
+    FILE *file;
+
+    if (upload && !g_file_get_contents(fragment->location, &contents, &length, &err)) {
+        g_printerr("Could not read %s: %s\n", fragment->location, err->message);
+        g_error_free(err);
+        return FALSE;
+    }
+
+    if (!pack) {
+        pack = tracker->pack = g_new0(FragmentPack, 1);
+        pack->location = g_strdup_printf("%s/%lld.pack", SPOOL_DIR, fragment->start_ms);
+        pack->index = g_key_file_new();
+        pack->start_ms = fragment->start_ms;
+    }
+
+    if (upload) {
+        file = fopen(pack->location, "ab");
+        if (!file || fwrite(contents, 1, length, file) != length) {
+            g_printerr("Could not append %s to %s\n", fragment->location, pack->location);
+            if (file) {
+                fclose(file);
+                // Drop the partial write so the recorded offsets stay valid
+                if (truncate(pack->location, pack->size) != 0) {
+                    g_printerr("Could not truncate %s\n", pack->location);
+                }
+            }
+            g_free(contents);
+            return FALSE;
+        }
+        fclose(file);
+        g_free(contents);
+    }
+
+    group = g_strdup_printf("segment %05u", pack->segments++);
+    spans_json = silence_spans_json(fragment, spans);
+    g_key_file_set_string(pack->index, group, "key", fragment->key);
+    g_key_file_set_int64(pack->index, group, "start-ms", fragment->start_ms);
+    g_key_file_set_int64(pack->index, group, "end-ms", fragment->end_ms);
+    g_key_file_set_uint64(pack->index, group, "offset", pack->size);
+    g_key_file_set_uint64(pack->index, group, "size", length);
+    g_key_file_set_uint64(pack->index, group, "duration-ms", GST_TIME_AS_MSECONDS(duration));
+    g_key_file_set_uint64(pack->index, group, "silent-ms", GST_TIME_AS_MSECONDS(silent));
+    g_key_file_set_string(pack->index, group, "silence-spans", spans_json);
+    g_free(spans_json);
+    g_free(group);
+
+    pack->size += length;
+    pack->end_ms = fragment->end_ms;
+    g_remove(fragment->location);
+
+    if (pack->segments >= tracker->coalesce) {
+        pack_flush(tracker);
+    }
+    return TRUE;
+}
+
+/* A fragment is closed: clip the silence spans to it, write its sidecar and decide whether to upload it */
+static void silence_close_fragment(SilenceTracker *tracker, const gchar *location, GstClockTime closing_running_time) {
+    SpoolFragment *fragment;
+    GArray *clipped = g_array_new(FALSE, FALSE, sizeof(SilenceSpan));
+    GstClockTime silent = 0, duration;
+    gchar *sidecar, *sidecar_key;
+    gboolean upload;
+    guint i;
+
+    g_mutex_lock(&tracker->lock);
+    if (!g_hash_table_steal_extended(tracker->fragments, location, NULL, (gpointer *) &fragment)) {
+        g_mutex_unlock(&tracker->lock);
+        g_printerr("Closed fragment %s was never opened\n", location);
+        g_array_free(clipped, TRUE);
+        return;
+    }
+
+    for (i = 0; i <= tracker->spans->len; i++) {
+        SilenceSpan span;
+
+        if (i < tracker->spans->len) {
+            span = g_array_index(tracker->spans, SilenceSpan, i);
+        } else if (tracker->silent) {
+            // The open span counts up to the end of this fragment
+            span.start = tracker->span_start;
+            span.end = closing_running_time;
+        } else {
+            break;
+        }
+        span.start = MAX(span.start, fragment->start);
+        span.end = MIN(span.end, closing_running_time);
+        if (span.end > span.start) {
+            g_array_append_val(clipped, span);
+            silent += span.end - span.start;
+        }
+    }
+    // Later fragments start at or after this one's end
+    while (tracker->spans->len && g_array_index(tracker->spans, SilenceSpan, 0).end <= closing_running_time) {
+        g_array_remove_index(tracker->spans, 0);
+    }
+
+    duration = closing_running_time > fragment->start ? closing_running_time - fragment->start : 0;
+    upload = tracker->keep_silent || silent + SILENCE_EDGE_MS * GST_MSECOND < duration;
+    if (!upload) {
+        tracker->skipped++;
+    }
+    g_mutex_unlock(&tracker->lock);
+
+    g_print("Fragment %s: %" G_GUINT64_FORMAT " of %" G_GUINT64_FORMAT " ms silent in %u span(s)%s\n",
+            fragment->key, GST_TIME_AS_MSECONDS(silent), GST_TIME_AS_MSECONDS(duration), clipped->len,
+            upload ? "" : ", not uploaded");
+
+    // A fragment that could not be packed falls back to its own objects
+    if (tracker->coalesce > 1 && pack_add_fragment(tracker, fragment, upload, clipped, duration, silent)) {
+        g_array_free(clipped, TRUE);
+        spool_fragment_free(fragment);
+        return;
+    }
+
+    sidecar = write_silence_sidecar(fragment, clipped, duration, silent);
+    if (sidecar) {
+        sidecar_key = g_strdup_printf("%.*s.silence.json", (int) (strlen(fragment->key) - strlen(".mp4")), fragment->key);
+        queue_upload(tracker, sidecar, sidecar_key);
+        g_free(sidecar_key);
+        g_free(sidecar);
+    }
+    if (upload) {
+        queue_upload(tracker, fragment->location, fragment->key);
+    } else {
+        g_remove(fragment->location);
+    }
+
+    g_array_free(clipped, TRUE);
+    spool_fragment_free(fragment);
+}
+
+static GstBusSyncReply silence_sync_handler(GstBus *bus, GstMessage *msg, gpointer user_data) {
+    const GstStructure *s;
+    GstClockTime running_time;
+
+    if (GST_MESSAGE_TYPE(msg) != GST_MESSAGE_ELEMENT) {
+        return GST_BUS_PASS;
+    }
+    s = gst_message_get_structure(msg);
+    if (s && gst_structure_has_name(s, "splitmuxsink-fragment-closed") &&
+        gst_structure_get_clock_time(s, "running-time", &running_time)) {
+        silence_close_fragment((SilenceTracker *) user_data, gst_structure_get_string(s, "location"), running_time);
+    }
+
+    return GST_BUS_PASS;
 }
 
 static gboolean link_elements_with_audio_filter (GstElement *element1, GstElement *element2, int sampleRate, int numChannels)
@@ -50,17 +586,34 @@ static gboolean link_elements_with_audio_filter (GstElement *element1, GstElemen
 int main(int argc, char *argv[]) {
     GstElement *pipeline;
     GstElement *audio_source, *audio_queue, *audio_convert, *audio_resample, *avenc_aac;
-    GstElement *split_mux_sink, *gcs_sink;
+    GstElement *split_mux_sink;
+
+    SilenceTracker tracker = {0};
 
     GstBus *bus;
     GstMessage *msg;
+    gint64 eos_deadline = 0;
 
     GstPad *x264enc_src_pad, *avenc_aac_src_pad;
     GstPad *splitmuxsink_video_pad, *splitmuxsink_audio_pad;
+    GstPad *avenc_aac_sink_pad;
 
     /* Initialize GStreamer */
     gst_init (&argc, &argv);
 
+    g_mutex_init (&tracker.lock);
+    gst_segment_init (&tracker.segment, GST_FORMAT_TIME);
+    tracker.quiet_since = GST_CLOCK_TIME_NONE;
+    tracker.spans = g_array_new (FALSE, FALSE, sizeof (SilenceSpan));
+    tracker.fragments = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, spool_fragment_free);
+    tracker.uploader = g_thread_pool_new (upload_worker, &tracker, 1, FALSE, NULL);
+    tracker.keep_silent = g_strcmp0 (g_getenv ("KEEP_SILENT_SEGMENTS"), "1") == 0;
+    tracker.coalesce = g_getenv ("COALESCE_FRAGMENTS") ? MAX (atoi (g_getenv ("COALESCE_FRAGMENTS")), 1) : 1;
+    if (g_mkdir_with_parents (SPOOL_DIR, 0755) != 0) {
+        g_printerr ("Could not create %s\n", SPOOL_DIR);
+        return -1;
+    }
+
     /* Create the elements */
     audio_source = gst_element_factory_make ("audiotestsrc", "audio_source");
     audio_queue = gst_element_factory_make ("queue", "audio_queue");
@@ -69,12 +622,11 @@ int main(int argc, char *argv[]) {
     avenc_aac = gst_element_factory_make ("fdkaacenc", "avenc_aac");
 
     split_mux_sink = gst_element_factory_make ("splitmuxsink", "split_mux_sink");
-    gcs_sink = gst_element_factory_make ("awss3sink", "gcs_sink");
 
     /* Create the empty pipeline */
     pipeline = gst_pipeline_new ("test-pipeline");
 
-    if (!pipeline || !audio_source || !audio_queue || !audio_convert || !audio_resample || !avenc_aac || !split_mux_sink || !gcs_sink) {
+    if (!pipeline || !audio_source || !audio_queue || !audio_convert || !audio_resample || !avenc_aac || !split_mux_sink) {
         g_printerr ("Not all elements could be created.\n");
         return -1;
     } else {
@@ -83,11 +635,16 @@ int main(int argc, char *argv[]) {
 
     /* Configure elements */
     g_object_set (avenc_aac, "bitrate", 256, NULL);
-    g_object_set (gcs_sink, "access-key", "add-here", "bucket", "add-here", "endpoint-uri", "https://storage.googleapis.com", "force-path-style", true, "region", "add-here", "secret-access-key", "add-here", "sync", true,  NULL);
-    g_object_set(split_mux_sink, "max-size-time", (guint64)SEGMENT_DURATION * GST_MSECOND, "send-keyframe-requests", true, "sink", gcs_sink, NULL);
+    // rate-control and vbr-preset exist since GStreamer 1.22; older fdkaacenc stays CBR and zeroed frames still cost the full bitrate
+    if (g_object_class_find_property (G_OBJECT_GET_CLASS (avenc_aac), "rate-control")) {
+        g_object_set (avenc_aac, "rate-control", 1, "vbr-preset", AAC_VBR_PRESET, NULL);
+    } else {
+        g_warning ("fdkaacenc has no VBR mode, silence will not get cheaper to encode");
+    }
+    g_object_set(split_mux_sink, "max-size-time", (guint64)SEGMENT_DURATION * GST_MSECOND, "send-keyframe-requests", true, NULL);
 
-    // Connect the format-location signal to generate dynamic filenames
-    g_signal_connect(split_mux_sink, "format-location", G_CALLBACK(format_location_callback), gcs_sink);
+    // Fragments are spooled locally and uploaded from silence_sync_handler once closed
+    g_signal_connect(split_mux_sink, "format-location-full", G_CALLBACK(format_location_full_callback), &tracker);
 
     g_print ("All elements configured successfully.\n");
 
@@ -110,7 +667,7 @@ int main(int argc, char *argv[]) {
     /* Manually link the splitmuxsink which has "Request" pads */
     avenc_aac_src_pad = gst_element_get_static_pad (avenc_aac, "src");
     splitmuxsink_audio_pad = gst_element_request_pad_simple (split_mux_sink, "audio_%u");
-    g_print ("Obtained request pad %s for splitmuxsink audio branch.\n", gst_pad_get_name (splitmuxsink_audio_pad));
+    g_print ("Obtained request pad %s for splitmuxsink audio branch.\n", GST_PAD_NAME (splitmuxsink_audio_pad));
 
     if (gst_pad_link (avenc_aac_src_pad, splitmuxsink_audio_pad) != GST_PAD_LINK_OK) {
         g_printerr ("splitmuxsink could not be linked!\n");
@@ -121,15 +678,48 @@ int main(int argc, char *argv[]) {
     }
     gst_object_unref (avenc_aac_src_pad);
 
+    /* Silence detection on the encoder's input, fragment decisions on the bus */
+    avenc_aac_sink_pad = gst_element_get_static_pad (avenc_aac, "sink");
+    gst_pad_add_probe (avenc_aac_sink_pad, GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM, silence_probe, &tracker, NULL);
+    gst_object_unref (avenc_aac_sink_pad);
+
+    bus = gst_element_get_bus (pipeline);
+    gst_bus_set_sync_handler (bus, silence_sync_handler, &tracker, NULL);
+
     /* Start playing the pipeline */
     gst_element_set_state (pipeline, GST_STATE_PLAYING);
 
     /* Visualize the pipeline using GraphViz */
     gst_debug_bin_to_dot_file(GST_BIN(pipeline), GST_DEBUG_GRAPH_SHOW_ALL, "pipeline-splitmuxsink-awss3sink-audio");
 
-    /* Wait until error or EOS */
-    bus = gst_element_get_bus (pipeline);
-    msg = gst_bus_timed_pop_filtered (bus, GST_CLOCK_TIME_NONE, GST_MESSAGE_ERROR | GST_MESSAGE_EOS);
+    signal(SIGINT, signal_handler);
+
+    /* Wait until error or EOS; SIGINT sends EOS to the splitmuxsink pad so the last fragment is closed and packed */
+    while (TRUE) {
+        msg = gst_bus_timed_pop_filtered (bus, 1000 * GST_MSECOND, GST_MESSAGE_ERROR | GST_MESSAGE_EOS);
+        if (msg) {
+            if (GST_MESSAGE_TYPE(msg) == GST_MESSAGE_EOS) {
+                g_print("EOS received\n");
+            } else {
+                GError *err;
+                gchar *debug;
+                gst_message_parse_error(msg, &err, &debug);
+                g_printerr("Error: %s\n", err->message);
+                g_error_free(err);
+                g_free(debug);
+            }
+            break;
+        }
+
+        if (terminate && eos_deadline == 0) {
+            g_print("Sending EOS to splitmuxsink pad...\n");
+            gst_pad_send_event(splitmuxsink_audio_pad, gst_event_new_eos());
+            eos_deadline = g_get_monotonic_time() + EOS_TIMEOUT * G_USEC_PER_SEC;
+        } else if (eos_deadline != 0 && g_get_monotonic_time() > eos_deadline) {
+            g_printerr("No EOS after %d sec, the last fragment stays in %s\n", EOS_TIMEOUT, SPOOL_DIR);
+            break;
+        }
+    }
 
     /* Release the request pads from splitmuxsink, and unref them */
     gst_element_release_request_pad (split_mux_sink, splitmuxsink_audio_pad);
@@ -141,6 +731,14 @@ int main(int argc, char *argv[]) {
     gst_object_unref (bus);
     gst_element_set_state (pipeline, GST_STATE_NULL);
 
+    /* The last fragment was closed at EOS; a partly filled pack and its index go out as is, then the queued uploads are finished */
+    pack_flush (&tracker);
+    g_thread_pool_free (tracker.uploader, FALSE, TRUE);
+    g_print ("Uploaded %u object(s), skipped %u silent fragment(s)\n", tracker.uploaded, tracker.skipped);
+    g_hash_table_destroy (tracker.fragments);
+    g_array_free (tracker.spans, TRUE);
+    g_mutex_clear (&tracker.lock);
+
     gst_object_unref (pipeline);
     return 0;
 }
@@ -0,0 +1,395 @@
+#include <gst/gst.h>
+#include <glib-unix.h>
+#include <stdbool.h>
+#include <signal.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/time.h>
+#include <sys/signalfd.h>
+
+#define SEGMENT_DURATION 120000 // Duration for each segment in milliseconds
+#define GRACE_PERIOD 60 // Seconds to wait for EOS after SIGINT/SIGTERM before quitting anyway
+
+typedef struct {
+    GstElement *pipeline;
+    GstElement *video_source;
+    GstElement *video_queue;
+    GstElement *video_convert;
+    GstElement *x264_enc;
+    GstElement *audio_source;
+    GstElement *audio_queue;
+    GstElement *audio_convert;
+    GstElement *audio_resample;
+    GstElement *avenc_aac;
+    GstElement *split_mux_sink;
+    GstElement *gcs_sink;
+    GstPad *x264enc_src_pad;
+    GstPad *avenc_aac_src_pad;
+    GstPad *splitmuxsink_video_pad;
+    GstPad *splitmuxsink_audio_pad;
+    GMutex lock;
+    GMainLoop *loop;
+    int signal_fd;
+    gboolean eos_sent;
+    guint fragments_opened;
+    guint fragments_closed;
+    long long fragment_opened_at;   // Wall-clock time of the last fragment-opened message
+} MediaPush;
+
+// Function to get the current time in milliseconds since the Unix epoch
+static long long current_time_millis() {
+    struct timeval time_now;
+    gettimeofday(&time_now, NULL);
+    return (long long)(time_now.tv_sec) * 1000 + (long long)(time_now.tv_usec) / 1000;
+}
+
+static gchar* format_location_callback(GstElement *splitmuxsink, guint fragment_id, gpointer user_data) {
+    // Get the (Unix epoch time) for start and end time
+    long long start_time = current_time_millis();
+    long long end_time = start_time + SEGMENT_DURATION;
+
+    gchar *filename = g_strdup_printf("vm/%lld_%lld.mp4", start_time, end_time);
+
+    GstElement *gcs_sink = GST_ELEMENT(user_data); // Retrieve gcs_sink passed via user_data
+    if (gcs_sink) {
+        g_object_set(gcs_sink, "key", filename, NULL);  // Set the key dynamically
+    }
+
+    return filename;
+}
+
+static gboolean link_elements_with_video_filter (GstElement *element1, GstElement *element2)
+{
+    gboolean link_ok;
+    GstCaps *caps;
+
+    caps = gst_caps_new_simple ("video/x-raw",
+            "format", G_TYPE_STRING, "I420",
+            "width", G_TYPE_INT, 360,
+            "height", G_TYPE_INT, 640,
+            "framerate", GST_TYPE_FRACTION, 15, 1,
+            NULL);
+
+    link_ok = gst_element_link_filtered (element1, element2, caps);
+    gst_caps_unref (caps);
+
+    if (!link_ok) {
+        g_warning ("Failed to link element1 and element2 using video filter!");
+    }
+
+    return link_ok;
+}
+
+static gboolean link_elements_with_audio_filter (GstElement *element1, GstElement *element2, int sampleRate, int numChannels)
+{
+    gboolean link_ok;
+    GstCaps *caps;
+
+    caps = gst_caps_new_simple ("audio/x-raw",
+            "rate", G_TYPE_INT, sampleRate,
+            "channels", G_TYPE_INT, numChannels,
+            NULL);
+
+    link_ok = gst_element_link_filtered (element1, element2, caps);
+    gst_caps_unref (caps);
+
+    if (!link_ok) {
+        g_warning ("Failed to link element1 and element2 using audio filter!");
+    }
+
+    return link_ok;
+}
+
+gboolean run_splitmuxsink(MediaPush *self) {
+    /* Initialize GStreamer */
+    gst_init (NULL, NULL);
+
+    /* Create the elements */
+    self->video_source = gst_element_factory_make ("videotestsrc", "video_source");
+    self->video_queue = gst_element_factory_make ("queue", "video_queue");
+    self->video_convert = gst_element_factory_make ("videoconvert", "video_convert");
+    self->x264_enc = gst_element_factory_make ("x264enc", "x264_enc");
+
+    self->audio_source = gst_element_factory_make ("audiotestsrc", "audio_source");
+    self->audio_queue = gst_element_factory_make ("queue", "audio_queue");
+    self->audio_convert = gst_element_factory_make ("audioconvert", "audio_convert");
+    self->audio_resample = gst_element_factory_make ("audioresample", "audio_resample");
+    self->avenc_aac = gst_element_factory_make ("avenc_aac", "avenc_aac");
+
+    self->split_mux_sink = gst_element_factory_make ("splitmuxsink", "split_mux_sink");
+    self->gcs_sink = gst_element_factory_make ("awss3sink", "gcs_sink");
+
+    /* Create the empty pipeline */
+    self->pipeline = gst_pipeline_new ("test-pipeline");
+
+    if (!self->pipeline || !self->video_source || !self->video_queue || !self->video_convert || !self->x264_enc ||
+    !self->audio_source || !self->audio_queue || !self->audio_convert || !self->audio_resample || !self->avenc_aac ||
+    !self->split_mux_sink || !self->gcs_sink) {
+        g_printerr ("Not all elements could be created.\n");
+        return FALSE;
+    } else {
+        g_print ("All elements created successfully.\n");
+    }
+
+    /* Configure elements */
+    g_object_set (self->x264_enc, "speed-preset", 1, "bitrate", 128, NULL);
+    g_object_set (self->avenc_aac, "bitrate", 256, NULL);
+    g_object_set (self->gcs_sink, "access-key", "add-here", "bucket", "add-here", "endpoint-uri", "https://storage.googleapis.com", "force-path-style", true, "region", "add-here", "secret-access-key", "add-here", "sync", true,  NULL);
+    g_object_set(self->split_mux_sink, "max-size-time", (guint64)SEGMENT_DURATION * GST_MSECOND, "send-keyframe-requests", true, "sink", self->gcs_sink, NULL);
+
+    // Connect the format-location signal to generate dynamic filenames
+    g_signal_connect(self->split_mux_sink, "format-location", G_CALLBACK(format_location_callback), self->gcs_sink);
+
+    g_print ("All elements configured successfully.\n");
+
+    /* Link all elements that can be automatically linked because they have "Always" pads */
+    /* Adding caps filter between video_source and video_convert */
+    gst_bin_add_many (GST_BIN (self->pipeline), self->video_source, self->video_queue, self->video_convert, self->x264_enc,
+    self->audio_source, self->audio_queue, self->audio_convert, self->audio_resample, self->avenc_aac,
+    self->split_mux_sink, NULL);
+
+    if (link_elements_with_video_filter (self->video_source, self->video_queue) != TRUE ||
+        gst_element_link_many (self->video_queue, self->video_convert, self->x264_enc, NULL) != TRUE ||
+
+        link_elements_with_audio_filter (self->audio_source, self->audio_queue, 48000, 2) != TRUE ||
+        gst_element_link_many (self->audio_queue, self->audio_convert, self->audio_resample, NULL) != TRUE ||
+        link_elements_with_audio_filter (self->audio_resample, self->avenc_aac, 16000, 1) != TRUE) {
+        g_printerr ("Elements could not be linked.\n");
+        gst_object_unref (self->pipeline);
+        return FALSE;
+    } else {
+        g_print ("All elements linked successfully.\n");
+    }
+
+    /* Manually link the splitmuxsink which has "Request" pads */
+    self->x264enc_src_pad = gst_element_get_static_pad (self->x264_enc, "src");
+    self->splitmuxsink_video_pad = gst_element_request_pad_simple (self->split_mux_sink, "video");
+    g_print ("Obtained request pad %s for splitmuxsink video branch.\n", GST_PAD_NAME (self->splitmuxsink_video_pad));
+
+    self->avenc_aac_src_pad = gst_element_get_static_pad (self->avenc_aac, "src");
+    self->splitmuxsink_audio_pad = gst_element_request_pad_simple (self->split_mux_sink, "audio_%u");
+    g_print ("Obtained request pad %s for splitmuxsink audio branch.\n", GST_PAD_NAME (self->splitmuxsink_audio_pad));
+
+    if (gst_pad_link (self->x264enc_src_pad, self->splitmuxsink_video_pad) != GST_PAD_LINK_OK ||
+    gst_pad_link (self->avenc_aac_src_pad, self->splitmuxsink_audio_pad) != GST_PAD_LINK_OK) {
+        g_printerr ("splitmuxsink could not be linked!\n");
+        gst_object_unref (self->pipeline);
+        return FALSE;
+    } else {
+        g_print ("splitmuxsink linked successfully.\n");
+    }
+    gst_object_unref (self->x264enc_src_pad);
+    gst_object_unref (self->avenc_aac_src_pad);
+
+    return TRUE;
+}
+
+
+/* Send EOS to the pads of split_mux_sink so the last fragment is finalized and uploaded */
+static void send_eos(MediaPush *self) {
+    g_print("Sending EOS to splitmuxsink pads...\n");
+    gst_pad_send_event(self->splitmuxsink_video_pad, gst_event_new_eos());
+    gst_pad_send_event(self->splitmuxsink_audio_pad, gst_event_new_eos());
+    g_print("EOS sent to splitmuxsink pads\n");
+}
+
+static gboolean grace_period_expired(gpointer user_data) {
+    MediaPush *self = (MediaPush *) user_data;
+
+    g_printerr("No EOS after %d sec, quitting\n", GRACE_PERIOD);
+    g_main_loop_quit(self->loop);
+
+    return G_SOURCE_REMOVE;
+}
+
+/* SIGINT/SIGTERM are blocked in every thread and delivered through a signalfd watched by the main loop */
+static gboolean signal_fd_callback(gint fd, GIOCondition condition, gpointer user_data) {
+    MediaPush *self = (MediaPush *) user_data;
+    struct signalfd_siginfo info;
+
+    if (read(fd, &info, sizeof(info)) != sizeof(info)) {
+        return G_SOURCE_CONTINUE;
+    }
+
+    g_print("Received %s\n", info.ssi_signo == SIGINT ? "SIGINT" : "SIGTERM");
+    if (self->eos_sent) {
+        // A second signal skips the grace period
+        g_main_loop_quit(self->loop);
+    } else {
+        self->eos_sent = TRUE;
+        send_eos(self);
+        g_timeout_add_seconds(GRACE_PERIOD, grace_period_expired, self);
+    }
+
+    return G_SOURCE_CONTINUE;
+}
+
+static void handle_error(MediaPush *self, GstMessage *msg) {
+    GError *err;
+    gchar *debug;
+
+    gst_message_parse_error(msg, &err, &debug);
+    g_printerr("Error from %s: %s\n", GST_MESSAGE_SRC_NAME(msg), err->message);
+    g_printerr("Debugging information: %s\n", debug ? debug : "none");
+    g_error_free(err);
+    g_free(debug);
+    g_main_loop_quit(self->loop);
+}
+
+static void handle_warning(MediaPush *self, GstMessage *msg) {
+    GError *err;
+    gchar *debug;
+
+    gst_message_parse_warning(msg, &err, &debug);
+    g_printerr("Warning from %s: %s\n", GST_MESSAGE_SRC_NAME(msg), err->message);
+    g_error_free(err);
+    g_free(debug);
+}
+
+static void handle_eos(MediaPush *self, GstMessage *msg) {
+    g_print("EOS received after %u fragment(s)\n", self->fragments_closed);
+    g_main_loop_quit(self->loop);
+}
+
+static void handle_state_changed(MediaPush *self, GstMessage *msg) {
+    GstState old_state, new_state, pending_state;
+
+    // Only report the pipeline's own transitions
+    if (GST_MESSAGE_SRC(msg) != GST_OBJECT(self->pipeline)) {
+        return;
+    }
+    gst_message_parse_state_changed(msg, &old_state, &new_state, &pending_state);
+    g_print("Pipeline state changed from %s to %s\n",
+            gst_element_state_get_name(old_state), gst_element_state_get_name(new_state));
+}
+
+static void handle_qos(MediaPush *self, GstMessage *msg) {
+    GstFormat format;
+    guint64 processed, dropped;
+    gint64 jitter;
+    gdouble proportion;
+    gint quality;
+
+    gst_message_parse_qos_stats(msg, &format, &processed, &dropped);
+    gst_message_parse_qos_values(msg, &jitter, &proportion, &quality);
+    g_print("QoS from %s: processed=%" G_GUINT64_FORMAT " dropped=%" G_GUINT64_FORMAT " jitter=%" G_GINT64_FORMAT "ns proportion=%.3f\n",
+            GST_MESSAGE_SRC_NAME(msg), processed, dropped, jitter, proportion);
+}
+
+static void handle_latency(MediaPush *self, GstMessage *msg) {
+    gst_bin_recalculate_latency(GST_BIN(self->pipeline));
+}
+
+/* splitmuxsink-fragment-opened/closed carry the location and the running time of the boundary */
+static void handle_element(MediaPush *self, GstMessage *msg) {
+    const GstStructure *s = gst_message_get_structure(msg);
+    const gchar *location;
+    GstClockTime running_time = GST_CLOCK_TIME_NONE;
+
+    if (s == NULL) {
+        return;
+    }
+    location = gst_structure_get_string(s, "location");
+    gst_structure_get_clock_time(s, "running-time", &running_time);
+
+    if (gst_structure_has_name(s, "splitmuxsink-fragment-opened")) {
+        self->fragments_opened++;
+        self->fragment_opened_at = current_time_millis();
+        g_print("Fragment %u opened: %s at running time %" GST_TIME_FORMAT "\n",
+                self->fragments_opened, GST_STR_NULL(location), GST_TIME_ARGS(running_time));
+    } else if (gst_structure_has_name(s, "splitmuxsink-fragment-closed")) {
+        self->fragments_closed++;
+        g_print("Fragment %u closed: %s at running time %" GST_TIME_FORMAT ", open for %lld ms\n",
+                self->fragments_closed, GST_STR_NULL(location), GST_TIME_ARGS(running_time),
+                current_time_millis() - self->fragment_opened_at);
+    }
+}
+
+typedef void (*BusMessageHandler)(MediaPush *self, GstMessage *msg);
+
+typedef struct {
+    GstMessageType type;
+    BusMessageHandler handler;
+} BusMessageRoute;
+
+static const BusMessageRoute bus_routes[] = {
+    { GST_MESSAGE_ERROR, handle_error },
+    { GST_MESSAGE_WARNING, handle_warning },
+    { GST_MESSAGE_EOS, handle_eos },
+    { GST_MESSAGE_STATE_CHANGED, handle_state_changed },
+    { GST_MESSAGE_QOS, handle_qos },
+    { GST_MESSAGE_LATENCY, handle_latency },
+    { GST_MESSAGE_ELEMENT, handle_element },
+};
+
+/* Bus watch: route every message to its handler as soon as it is posted */
+static gboolean bus_dispatch(GstBus *bus, GstMessage *msg, gpointer user_data) {
+    MediaPush *self = (MediaPush *) user_data;
+
+    for (guint i = 0; i < G_N_ELEMENTS(bus_routes); i++) {
+        if (GST_MESSAGE_TYPE(msg) == bus_routes[i].type) {
+            bus_routes[i].handler(self, msg);
+            break;
+        }
+    }
+
+    return G_SOURCE_CONTINUE;
+}
+
+int main(int argc, char *argv[]) {
+    MediaPush self = {0}; // Initialize the struct with zeroes
+    sigset_t signals;
+    GstBus *bus;
+    guint bus_watch_id, signal_watch_id;
+
+    /* Block the signals before any streaming thread exists so they all inherit the mask */
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+    self.signal_fd = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (self.signal_fd < 0) {
+        g_printerr("Could not create signalfd\n");
+        return -1;
+    }
+
+    g_mutex_init(&self.lock);
+
+    g_mutex_lock (&self.lock);
+    gboolean ret = run_splitmuxsink(&self);
+    g_mutex_unlock (&self.lock);
+    if(!ret){
+        return -1;
+    }
+
+    self.loop = g_main_loop_new(NULL, FALSE);
+
+    bus = gst_element_get_bus (self.pipeline);
+    bus_watch_id = gst_bus_add_watch (bus, bus_dispatch, &self);
+    signal_watch_id = g_unix_fd_add (self.signal_fd, G_IO_IN, signal_fd_callback, &self);
+
+    /* Start playing the pipeline */
+    if (gst_element_set_state (self.pipeline, GST_STATE_PLAYING) == GST_STATE_CHANGE_FAILURE) {
+        g_printerr("Failed to start the pipeline\n");
+    } else {
+        g_print("Pipeline started successfully\n");
+        g_main_loop_run(self.loop);
+    }
+
+    g_print("Finished listening to bus messages\n");
+
+    g_source_remove (signal_watch_id);
+    g_source_remove (bus_watch_id);
+    close (self.signal_fd);
+
+    gst_element_set_state (self.pipeline, GST_STATE_NULL);
+    gst_element_release_request_pad (self.split_mux_sink, self.splitmuxsink_video_pad);
+    gst_object_unref (self.splitmuxsink_video_pad);
+    gst_element_release_request_pad (self.split_mux_sink, self.splitmuxsink_audio_pad);
+    gst_object_unref (self.splitmuxsink_audio_pad);
+    gst_object_unref (bus);
+    gst_object_unref (self.pipeline);
+    g_main_loop_unref (self.loop);
+
+    return 0;
+}
@@ -0,0 +1,476 @@
+#include <gst/gst.h>
+#include <glib/gstdio.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <time.h>
+#include <sys/time.h>
+
+#define SEGMENT_DURATION 15000 // Duration for each segment in milliseconds
+#define KEY_PREFIX "vm"
+#define MANIFEST_PATH "/Users/vivekchandela/Documents/mp4test/manifest.ini" // Local copy of the stream manifest
+#define SPOOL_DIR "/Users/vivekchandela/Documents/mp4test/spool" // Local copy of every segment at <SPOOL_DIR>/<key>, read by splitmuxsink-clip
+#define EOS_TIMEOUT 60 // Seconds to wait for EOS after SIGINT before giving up on the last fragment
+volatile gboolean terminate = FALSE;
+
+/*
+ * Object keys and manifest entries are derived from buffer running time,
+ * anchored once to the wall clock: wall(rt) = anchor_ms + rt. The manifest is
+ * a GKeyFile with a [stream] group and one [segment NNNNN] group per closed
+ * fragment in increasing start order, so a timestamp maps to a segment index
+ * with a single division (anchored at SEGMENT_DURATION) and a short scan.
+ * SIGINT sends EOS so the last, short fragment is closed and listed too; the
+ * finished manifest is then uploaded next to the segments it indexes.
+ *
+ * splitmuxsink's sink is a bin that tees each fragment to gcs_sink and to a
+ * filesink at SPOOL_DIR/<key>, so splitmuxsink-clip can cut clips from the
+ * manifest without downloading anything. The spool is never pruned.
+ */
+typedef struct {
+    gchar *key;
+    gint64 start_ms;
+} OpenSegment;
+
+typedef struct {
+    GMutex lock;
+    GstElement *pipeline;
+    GstElement *gcs_sink;
+    GstElement *file_sink;
+    gboolean anchored;
+    long long anchor_ms;        // Wall-clock time of running time 0
+    GQueue open_segments;       // OpenSegment, oldest first; fragments close in the order they were opened
+    GKeyFile *manifest;
+    guint segments;
+} SegmentManifest;
+
+// Signal handler for SIGINT
+void signal_handler(int signal) {
+  if (signal == SIGINT) {
+    g_print("Received SIGINT terminating\n");
+    terminate = TRUE;
+  }
+}
+
+// Function to get the current time in milliseconds since the Unix epoch
+static long long current_time_millis() {
+    struct timeval time_now;
+    gettimeofday(&time_now, NULL);
+    return (long long)(time_now.tv_sec) * 1000 + (long long)(time_now.tv_usec) / 1000;
+}
+
+/* Anchor running time 0 to the wall clock, once, using the pipeline clock and base time */
+static void anchor_to_wall_clock(SegmentManifest *manifest) {
+    GstClock *clock = gst_element_get_clock(manifest->pipeline);
+    GstClockTime running_now = 0;
+
+    if (clock) {
+        running_now = gst_clock_get_time(clock) - gst_element_get_base_time(manifest->pipeline);
+        gst_object_unref(clock);
+    }
+    manifest->anchor_ms = current_time_millis() - (long long) GST_TIME_AS_MSECONDS(running_now);
+    manifest->anchored = TRUE;
+
+    g_key_file_set_int64(manifest->manifest, "stream", "anchor-ms", manifest->anchor_ms);
+    g_key_file_set_integer(manifest->manifest, "stream", "segment-duration-ms", SEGMENT_DURATION);
+    g_key_file_set_string(manifest->manifest, "stream", "key-prefix", KEY_PREFIX);
+    g_print("Running time 0 anchored at %lld ms since the epoch\n", manifest->anchor_ms);
+}
+
+static gchar* format_location_full_callback(GstElement *splitmuxsink, guint fragment_id, GstSample *first_sample, gpointer user_data) {
+    SegmentManifest *manifest = (SegmentManifest *) user_data;
+    GstBuffer *buffer = gst_sample_get_buffer(first_sample);
+    const GstSegment *segment = gst_sample_get_segment(first_sample);
+    GstClockTime running_time = 0;
+    OpenSegment *open_segment = g_new(OpenSegment, 1);
+    gchar *filename, *location;
+
+    if (buffer && segment && GST_BUFFER_PTS_IS_VALID(buffer)) {
+        running_time = gst_segment_to_running_time(segment, GST_FORMAT_TIME, GST_BUFFER_PTS(buffer));
+    }
+
+    g_mutex_lock(&manifest->lock);
+    if (!manifest->anchored) {
+        anchor_to_wall_clock(manifest);
+    }
+    // Start of the fragment from its first buffer, not from when it happens to be opened
+    open_segment->start_ms = manifest->anchor_ms + (long long) GST_TIME_AS_MSECONDS(running_time);
+    filename = g_strdup_printf("%s/%" G_GINT64_FORMAT ".mp4", KEY_PREFIX, open_segment->start_ms);
+    open_segment->key = g_strdup(filename);
+    g_queue_push_tail(&manifest->open_segments, open_segment);
+    g_mutex_unlock(&manifest->lock);
+
+    g_object_set(manifest->gcs_sink, "key", filename, NULL);  // Set the key dynamically
+    location = g_build_filename(SPOOL_DIR, filename, NULL);
+    g_object_set(manifest->file_sink, "location", location, NULL);
+    g_free(location);
+
+    return filename;
+}
+
+static void open_segment_free(gpointer data) {
+    OpenSegment *open_segment = (OpenSegment *) data;
+
+    g_free(open_segment->key);
+    g_free(open_segment);
+}
+
+/* Append the oldest open fragment, which is the one that closed, and rewrite the manifest atomically */
+static void manifest_close_segment(SegmentManifest *manifest, GstClockTime closing_running_time) {
+    OpenSegment *open_segment;
+    gchar *group;
+    GError *err = NULL;
+
+    g_mutex_lock(&manifest->lock);
+    open_segment = g_queue_pop_head(&manifest->open_segments);
+    if (!open_segment) {
+        g_mutex_unlock(&manifest->lock);
+        g_printerr("A fragment closed that was never opened\n");
+        return;
+    }
+
+    group = g_strdup_printf("segment %05u", manifest->segments++);
+    g_key_file_set_string(manifest->manifest, group, "key", open_segment->key);
+    g_key_file_set_int64(manifest->manifest, group, "start-ms", open_segment->start_ms);
+    g_key_file_set_int64(manifest->manifest, group, "end-ms", manifest->anchor_ms + (long long) GST_TIME_AS_MSECONDS(closing_running_time));
+    g_key_file_set_integer(manifest->manifest, "stream", "segments", manifest->segments);
+
+    if (!g_key_file_save_to_file(manifest->manifest, MANIFEST_PATH, &err)) {
+        g_printerr("Could not write %s: %s\n", MANIFEST_PATH, err->message);
+        g_error_free(err);
+    } else {
+        g_print("Manifest: %s = %s [%" G_GINT64_FORMAT ", %lld]\n", group, open_segment->key, open_segment->start_ms,
+                manifest->anchor_ms + (long long) GST_TIME_AS_MSECONDS(closing_running_time));
+    }
+    g_free(group);
+    open_segment_free(open_segment);
+    g_mutex_unlock(&manifest->lock);
+}
+
+static void configure_gcs_sink(GstElement *gcs_sink) {
+    g_object_set (gcs_sink, "access-key", "add-here", "bucket", "add-here", "endpoint-uri", "https://storage.googleapis.com", "force-path-style", true, "region", "add-here", "secret-access-key", "add-here", "sync", true,  NULL);
+}
+
+/* splitmuxsink's sink: tee ! queue ! gcs_sink and tee ! queue ! file_sink, behind a ghost sink pad */
+static GstElement* make_segment_sink(GstElement *gcs_sink, GstElement *file_sink) {
+    GstElement *bin = gst_bin_new ("segment_sink");
+    GstElement *tee = gst_element_factory_make ("tee", "segment_tee");
+    GstElement *gcs_queue = gst_element_factory_make ("queue", "gcs_queue");
+    GstElement *file_queue = gst_element_factory_make ("queue", "file_queue");
+    GstPad *tee_sink_pad;
+
+    if (!tee || !gcs_queue || !file_queue) {
+        g_clear_object (&tee);
+        g_clear_object (&gcs_queue);
+        g_clear_object (&file_queue);
+        gst_object_unref (bin);
+        return NULL;
+    }
+
+    gst_bin_add_many (GST_BIN (bin), tee, gcs_queue, gcs_sink, file_queue, file_sink, NULL);
+    if (gst_element_link_many (tee, gcs_queue, gcs_sink, NULL) != TRUE ||
+        gst_element_link_many (tee, file_queue, file_sink, NULL) != TRUE) {
+        gst_object_unref (bin);
+        return NULL;
+    }
+    tee_sink_pad = gst_element_get_static_pad (tee, "sink");
+    gst_element_add_pad (bin, gst_ghost_pad_new ("sink", tee_sink_pad));
+    gst_object_unref (tee_sink_pad);
+
+    return bin;
+}
+
+/* Upload the finished manifest as <prefix>/<anchor_ms>.manifest.ini with its own filesrc ! awss3sink pipeline */
+static gboolean manifest_upload(SegmentManifest *manifest) {
+    GstElement *pipeline, *file_source, *gcs_sink;
+    GstBus *bus;
+    GstMessage *msg;
+    gchar *key;
+    gboolean uploaded;
+
+    if (!manifest->anchored) {
+        g_print("No fragment was recorded, not uploading a manifest\n");
+        return TRUE;
+    }
+
+    pipeline = gst_pipeline_new("manifest-upload");
+    file_source = gst_element_factory_make("filesrc", "file_source");
+    gcs_sink = gst_element_factory_make("awss3sink", "gcs_sink");
+    if (!pipeline || !file_source || !gcs_sink) {
+        g_printerr("Could not create the manifest upload pipeline\n");
+        g_clear_object(&pipeline);
+        g_clear_object(&file_source);
+        g_clear_object(&gcs_sink);
+        return FALSE;
+    }
+
+    key = g_strdup_printf("%s/%lld.manifest.ini", KEY_PREFIX, manifest->anchor_ms);
+    g_object_set(file_source, "location", MANIFEST_PATH, NULL);
+    configure_gcs_sink(gcs_sink);
+    g_object_set(gcs_sink, "key", key, NULL);
+    gst_bin_add_many(GST_BIN(pipeline), file_source, gcs_sink, NULL);
+    if (!gst_element_link(file_source, gcs_sink)) {
+        g_printerr("Could not link the manifest upload pipeline\n");
+        gst_object_unref(pipeline);
+        g_free(key);
+        return FALSE;
+    }
+
+    gst_element_set_state(pipeline, GST_STATE_PLAYING);
+    bus = gst_element_get_bus(pipeline);
+    msg = gst_bus_timed_pop_filtered(bus, GST_CLOCK_TIME_NONE, GST_MESSAGE_ERROR | GST_MESSAGE_EOS);
+    uploaded = GST_MESSAGE_TYPE(msg) != GST_MESSAGE_ERROR;
+    if (!uploaded) {
+        GError *err = NULL;
+
+        gst_message_parse_error(msg, &err, NULL);
+        g_printerr("Upload of %s failed, the manifest is kept at %s: %s\n", key, MANIFEST_PATH, err->message);
+        g_error_free(err);
+    } else {
+        g_print("Uploaded manifest %s (%u segments)\n", key, manifest->segments);
+    }
+    gst_message_unref(msg);
+    gst_object_unref(bus);
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+    gst_object_unref(pipeline);
+    g_free(key);
+
+    return uploaded;
+}
+
+static GstBusSyncReply manifest_sync_handler(GstBus *bus, GstMessage *msg, gpointer user_data) {
+    const GstStructure *s;
+    GstClockTime running_time;
+
+    if (GST_MESSAGE_TYPE(msg) != GST_MESSAGE_ELEMENT) {
+        return GST_BUS_PASS;
+    }
+    s = gst_message_get_structure(msg);
+    if (s && gst_structure_has_name(s, "splitmuxsink-fragment-closed") &&
+        gst_structure_get_clock_time(s, "running-time", &running_time)) {
+        manifest_close_segment((SegmentManifest *) user_data, running_time);
+    }
+
+    return GST_BUS_PASS;
+}
+
+static gboolean link_elements_with_video_filter (GstElement *element1, GstElement *element2)
+{
+    gboolean link_ok;
+    GstCaps *caps;
+
+    caps = gst_caps_new_simple ("video/x-raw",
+            "format", G_TYPE_STRING, "I420",
+            "width", G_TYPE_INT, 360,
+            "height", G_TYPE_INT, 640,
+            "framerate", GST_TYPE_FRACTION, 15, 1,
+            NULL);
+
+    link_ok = gst_element_link_filtered (element1, element2, caps);
+    gst_caps_unref (caps);
+
+    if (!link_ok) {
+        g_warning ("Failed to link element1 and element2 using video filter!");
+    }
+
+    return link_ok;
+}
+
+static gboolean link_elements_with_audio_filter (GstElement *element1, GstElement *element2, int sampleRate, int numChannels)
+{
+    gboolean link_ok;
+    GstCaps *caps;
+
+    caps = gst_caps_new_simple ("audio/x-raw",
+            "rate", G_TYPE_INT, sampleRate,
+            "channels", G_TYPE_INT, numChannels,
+            NULL);
+
+    link_ok = gst_element_link_filtered (element1, element2, caps);
+    gst_caps_unref (caps);
+
+    if (!link_ok) {
+        g_warning ("Failed to link element1 and element2 using audio filter!");
+    }
+
+    return link_ok;
+}
+
+int main(int argc, char *argv[]) {
+    GstElement *pipeline;
+    GstElement *video_source, *video_queue, *video_convert, *x264_enc;
+    GstElement *audio_source, *audio_queue, *audio_convert, *audio_resample, *avenc_aac;
+    GstElement *split_mux_sink, *gcs_sink, *file_sink, *segment_sink;
+
+    SegmentManifest manifest = {0};
+    gchar *spool_prefix;
+
+    GstBus *bus;
+    GstMessage *msg;
+    gint64 eos_deadline = 0;
+
+    GstPad *x264enc_src_pad, *avenc_aac_src_pad;
+    GstPad *splitmuxsink_video_pad, *splitmuxsink_audio_pad;
+
+    /* Initialize GStreamer */
+    gst_init (&argc, &argv);
+
+    /* Create the elements */
+    video_source = gst_element_factory_make ("videotestsrc", "video_source");
+    video_queue = gst_element_factory_make ("queue", "video_queue");
+    video_convert = gst_element_factory_make ("videoconvert", "video_convert");
+    x264_enc = gst_element_factory_make ("x264enc", "x264_enc");
+
+    audio_source = gst_element_factory_make ("audiotestsrc", "audio_source");
+    audio_queue = gst_element_factory_make ("queue", "audio_queue");
+    audio_convert = gst_element_factory_make ("audioconvert", "audio_convert");
+    audio_resample = gst_element_factory_make ("audioresample", "audio_resample");
+    avenc_aac = gst_element_factory_make ("avenc_aac", "avenc_aac");
+
+    split_mux_sink = gst_element_factory_make ("splitmuxsink", "split_mux_sink");
+    gcs_sink = gst_element_factory_make ("awss3sink", "gcs_sink");
+    file_sink = gst_element_factory_make ("filesink", "file_sink");
+
+    /* Create the empty pipeline */
+    pipeline = gst_pipeline_new ("test-pipeline");
+
+    if (!pipeline || !video_source || !video_queue || !video_convert || !x264_enc ||
+    !audio_source || !audio_queue || !audio_convert || !audio_resample || !avenc_aac ||
+    !split_mux_sink || !gcs_sink || !file_sink) {
+        g_printerr ("Not all elements could be created.\n");
+        return -1;
+    } else {
+        g_print ("All elements created successfully.\n");
+    }
+
+    /* Configure elements */
+    g_object_set (x264_enc, "speed-preset", 1, "bitrate", 128, NULL);
+    g_object_set (avenc_aac, "bitrate", 256, NULL);
+    configure_gcs_sink (gcs_sink);
+    segment_sink = make_segment_sink (gcs_sink, file_sink);
+    if (!segment_sink) {
+        g_printerr ("Could not build the segment sink.\n");
+        return -1;
+    }
+    g_object_set(split_mux_sink, "max-size-time", (guint64)SEGMENT_DURATION * GST_MSECOND, "send-keyframe-requests", true, "sink", segment_sink, NULL);
+
+    /* Keys are <prefix>/<start_ms>.mp4, so the spool needs the prefix directory */
+    spool_prefix = g_build_filename (SPOOL_DIR, KEY_PREFIX, NULL);
+    if (g_mkdir_with_parents (spool_prefix, 0755) != 0) {
+        g_printerr ("Could not create %s\n", spool_prefix);
+        g_free (spool_prefix);
+        return -1;
+    }
+    g_free (spool_prefix);
+
+    g_mutex_init(&manifest.lock);
+    manifest.pipeline = pipeline;
+    manifest.gcs_sink = gcs_sink;
+    manifest.file_sink = file_sink;
+    g_queue_init(&manifest.open_segments);
+    manifest.manifest = g_key_file_new();
+
+    // format-location-full hands over the first sample, which names the fragment
+    g_signal_connect(split_mux_sink, "format-location-full", G_CALLBACK(format_location_full_callback), &manifest);
+
+    g_print ("All elements configured successfully.\n");
+
+    /* Link all elements that can be automatically linked because they have "Always" pads */
+    /* Adding caps filter between video_source and video_convert */
+    gst_bin_add_many (GST_BIN (pipeline), video_source, video_queue, video_convert, x264_enc,
+    audio_source, audio_queue, audio_convert, audio_resample, avenc_aac,
+    split_mux_sink, NULL);
+
+    if (link_elements_with_video_filter (video_source, video_queue) != TRUE ||
+        gst_element_link_many (video_queue, video_convert, x264_enc, NULL) != TRUE ||
+
+        link_elements_with_audio_filter (audio_source, audio_queue, 48000, 2) != TRUE ||
+        gst_element_link_many (audio_queue, audio_convert, audio_resample, NULL) != TRUE ||
+        link_elements_with_audio_filter (audio_resample, avenc_aac, 16000, 1) != TRUE
+        ) {
+        g_printerr ("Elements could not be linked.\n");
+        gst_object_unref (pipeline);
+        return -1;
+    } else {
+        g_print ("All elements linked successfully.\n");
+    }
+
+    /* Manually link the splitmuxsink which has "Request" pads */
+    x264enc_src_pad = gst_element_get_static_pad (x264_enc, "src");
+    splitmuxsink_video_pad = gst_element_request_pad_simple (split_mux_sink, "video");
+    g_print ("Obtained request pad %s for splitmuxsink video branch.\n", GST_PAD_NAME (splitmuxsink_video_pad));
+
+    avenc_aac_src_pad = gst_element_get_static_pad (avenc_aac, "src");
+    splitmuxsink_audio_pad = gst_element_request_pad_simple (split_mux_sink, "audio_%u");
+    g_print ("Obtained request pad %s for splitmuxsink audio branch.\n", GST_PAD_NAME (splitmuxsink_audio_pad));
+
+    if (gst_pad_link (x264enc_src_pad, splitmuxsink_video_pad) != GST_PAD_LINK_OK ||
+    gst_pad_link (avenc_aac_src_pad, splitmuxsink_audio_pad) != GST_PAD_LINK_OK) {
+        g_printerr ("splitmuxsink could not be linked!\n");
+        gst_object_unref (pipeline);
+        return -1;
+    } else {
+        g_print ("splitmuxsink linked successfully.\n");
+    }
+    gst_object_unref (x264enc_src_pad);
+    gst_object_unref (avenc_aac_src_pad);
+
+    /* Fragment-closed messages append to the manifest */
+    bus = gst_element_get_bus (pipeline);
+    gst_bus_set_sync_handler (bus, manifest_sync_handler, &manifest, NULL);
+
+    /* Start playing the pipeline */
+    gst_element_set_state (pipeline, GST_STATE_PLAYING);
+
+    /* Visualize the pipeline using GraphViz */
+    gst_debug_bin_to_dot_file(GST_BIN(pipeline), GST_DEBUG_GRAPH_SHOW_ALL, "pipeline-splitmuxsink-awss3sink-manifest");
+
+    signal(SIGINT, signal_handler);
+
+    /* Wait until error or EOS; SIGINT sends EOS to the splitmuxsink pads so the last fragment is closed */
+    while (TRUE) {
+        msg = gst_bus_timed_pop_filtered (bus, 1000 * GST_MSECOND, GST_MESSAGE_ERROR | GST_MESSAGE_EOS);
+        if (msg) {
+            if (GST_MESSAGE_TYPE(msg) == GST_MESSAGE_EOS) {
+                g_print("EOS received\n");
+            } else {
+                GError *err;
+                gchar *debug;
+                gst_message_parse_error(msg, &err, &debug);
+                g_printerr("Error: %s\n", err->message);
+                g_error_free(err);
+                g_free(debug);
+            }
+            gst_message_unref(msg);
+            break;
+        }
+
+        if (terminate && eos_deadline == 0) {
+            g_print("Sending EOS to splitmuxsink pads...\n");
+            gst_pad_send_event(splitmuxsink_video_pad, gst_event_new_eos());
+            gst_pad_send_event(splitmuxsink_audio_pad, gst_event_new_eos());
+            eos_deadline = g_get_monotonic_time() + EOS_TIMEOUT * G_USEC_PER_SEC;
+        } else if (eos_deadline != 0 && g_get_monotonic_time() > eos_deadline) {
+            g_printerr("No EOS after %d sec, the last fragment is not in the manifest\n", EOS_TIMEOUT);
+            break;
+        }
+    }
+
+    /* Release the request pads from splitmuxsink, and unref them */
+    gst_element_release_request_pad (split_mux_sink, splitmuxsink_video_pad);
+    gst_object_unref (splitmuxsink_video_pad);
+    gst_element_release_request_pad (split_mux_sink, splitmuxsink_audio_pad);
+    gst_object_unref (splitmuxsink_audio_pad);
+
+    /* Free resources */
+    gst_object_unref (bus);
+    gst_element_set_state (pipeline, GST_STATE_NULL);
+
+    gst_object_unref (pipeline);
+
+    /* The pipeline is stopped, so no fragment is added any more: the manifest is final */
+    manifest_upload (&manifest);
+
+    g_queue_clear_full (&manifest.open_segments, open_segment_free);
+    g_key_file_free (manifest.manifest);
+    g_mutex_clear (&manifest.lock);
+    return 0;
+}
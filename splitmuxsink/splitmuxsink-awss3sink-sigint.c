@@ -165,11 +165,11 @@ gboolean run_splitmuxsink(MediaPush *self) {
     /* Manually link the splitmuxsink which has "Request" pads */
     self->x264enc_src_pad = gst_element_get_static_pad (self->x264_enc, "src");
     self->splitmuxsink_video_pad = gst_element_request_pad_simple (self->split_mux_sink, "video");
-    g_print ("Obtained request pad %s for splitmuxsink video branch.\n", gst_pad_get_name (self->splitmuxsink_video_pad));
+    g_print ("Obtained request pad %s for splitmuxsink video branch.\n", GST_PAD_NAME (self->splitmuxsink_video_pad));
 
     self->avenc_aac_src_pad = gst_element_get_static_pad (self->avenc_aac, "src");
     self->splitmuxsink_audio_pad = gst_element_request_pad_simple (self->split_mux_sink, "audio_%u");
-    g_print ("Obtained request pad %s for splitmuxsink audio branch.\n", gst_pad_get_name (self->splitmuxsink_audio_pad));
+    g_print ("Obtained request pad %s for splitmuxsink audio branch.\n", GST_PAD_NAME (self->splitmuxsink_audio_pad));
 
     if (gst_pad_link (self->x264enc_src_pad, self->splitmuxsink_video_pad) != GST_PAD_LINK_OK ||
     gst_pad_link (self->avenc_aac_src_pad, self->splitmuxsink_audio_pad) != GST_PAD_LINK_OK) {
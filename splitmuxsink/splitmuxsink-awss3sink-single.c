@@ -120,11 +120,11 @@ int main(int argc, char *argv[]) {
     /* Manually link the splitmuxsink which has "Request" pads */
     x264enc_src_pad = gst_element_get_static_pad (x264_enc, "src");
     splitmuxsink_video_pad = gst_element_request_pad_simple (split_mux_sink, "video");
-    g_print ("Obtained request pad %s for splitmuxsink video branch.\n", gst_pad_get_name (splitmuxsink_video_pad));
+    g_print ("Obtained request pad %s for splitmuxsink video branch.\n", GST_PAD_NAME (splitmuxsink_video_pad));
 
     avenc_aac_src_pad = gst_element_get_static_pad (avenc_aac, "src");
     splitmuxsink_audio_pad = gst_element_request_pad_simple (split_mux_sink, "audio_%u");
-    g_print ("Obtained request pad %s for splitmuxsink audio branch.\n", gst_pad_get_name (splitmuxsink_audio_pad));
+    g_print ("Obtained request pad %s for splitmuxsink audio branch.\n", GST_PAD_NAME (splitmuxsink_audio_pad));
 
     if (gst_pad_link (x264enc_src_pad, splitmuxsink_video_pad) != GST_PAD_LINK_OK ||
     gst_pad_link (avenc_aac_src_pad, splitmuxsink_audio_pad) != GST_PAD_LINK_OK) {
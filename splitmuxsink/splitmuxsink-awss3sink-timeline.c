@@ -0,0 +1,391 @@
+#include <gst/gst.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <time.h>
+#include <sys/time.h>
+
+#define SEGMENT_DURATION 15000 // Duration for each segment in milliseconds
+#define TIMELINE_PATH "/Users/vivekchandela/Documents/mp4test/segment-timeline.jsonl" // One JSON record per fragment
+#define EOS_TIMEOUT 60 // Seconds to wait for EOS after SIGINT before giving up on the last fragment
+volatile gboolean terminate = FALSE;
+
+/* Everything known about one fragment, from open to upload completion */
+typedef struct {
+    guint fragment_id;
+    gchar *key;
+    GstClockTime first_pts;
+    GstClockTime last_pts;          // End (PTS + duration) of the last buffer muxed into the fragment
+    GstClockTime first_running_time;
+    GstClockTime closing_running_time; // From splitmuxsink-fragment-closed
+    guint64 bytes;                  // Bytes written to gcs_sink
+    long long wall_opened;          // format-location-full
+    long long wall_closed;          // EOS reached gcs_sink: the muxer finished writing the fragment
+    long long wall_uploaded;        // splitmuxsink-fragment-closed: gcs_sink completed the upload
+} SegmentRecord;
+
+typedef struct {
+    GMutex lock;
+    GstElement *gcs_sink;
+    SegmentRecord *current;
+    FILE *output;
+} SegmentTimeline;
+
+// Signal handler for SIGINT
+void signal_handler(int signal) {
+  if (signal == SIGINT) {
+    g_print("Received SIGINT terminating\n");
+    terminate = TRUE;
+  }
+}
+
+// Function to get the current time in milliseconds since the Unix epoch
+static long long current_time_millis() {
+    struct timeval time_now;
+    gettimeofday(&time_now, NULL);
+    return (long long)(time_now.tv_sec) * 1000 + (long long)(time_now.tv_usec) / 1000;
+}
+
+static gchar* format_location_full_callback(GstElement *splitmuxsink, guint fragment_id, GstSample *first_sample, gpointer user_data) {
+    SegmentTimeline *timeline = (SegmentTimeline *) user_data;
+    GstBuffer *buffer = gst_sample_get_buffer(first_sample);
+    const GstSegment *segment = gst_sample_get_segment(first_sample);
+    SegmentRecord *record;
+
+    // Get the (Unix epoch time) for start and end time
+    long long start_time = current_time_millis();
+    long long end_time = start_time + SEGMENT_DURATION;
+
+    gchar *filename = g_strdup_printf("vm/%lld_%lld.mp4", start_time, end_time);
+
+    g_object_set(timeline->gcs_sink, "key", filename, NULL);  // Set the key dynamically
+
+    record = g_new0(SegmentRecord, 1);
+    record->fragment_id = fragment_id;
+    record->key = g_strdup(filename);
+    record->first_pts = buffer ? GST_BUFFER_PTS(buffer) : GST_CLOCK_TIME_NONE;
+    record->last_pts = GST_CLOCK_TIME_NONE;
+    record->first_running_time = (buffer && segment) ? gst_segment_to_running_time(segment, GST_FORMAT_TIME, GST_BUFFER_PTS(buffer)) : GST_CLOCK_TIME_NONE;
+    record->closing_running_time = GST_CLOCK_TIME_NONE;
+    record->wall_opened = start_time;
+
+    g_mutex_lock(&timeline->lock);
+    timeline->current = record;
+    g_mutex_unlock(&timeline->lock);
+
+    return filename;
+}
+
+/* Signed difference in milliseconds, 0 if either side is unknown */
+static long long clock_diff_ms(GstClockTime from, GstClockTime to) {
+    if (!GST_CLOCK_TIME_IS_VALID(from) || !GST_CLOCK_TIME_IS_VALID(to)) {
+        return 0;
+    }
+    return (long long) GST_CLOCK_DIFF(from, to) / (long long) GST_MSECOND;
+}
+
+static void emit_record(SegmentTimeline *timeline, SegmentRecord *record) {
+    long long media_ms = clock_diff_ms(record->first_pts, record->last_pts);
+    gchar *line = g_strdup_printf("{\"fragment\": %u, \"key\": \"%s\", "
+            "\"first_pts_ms\": %lld, \"last_pts_ms\": %lld, \"media_ms\": %lld, \"planned_ms\": %d, \"drift_ms\": %lld, "
+            "\"first_running_time_ms\": %lld, \"closing_running_time_ms\": %lld, \"bytes\": %" G_GUINT64_FORMAT ", "
+            "\"wall_opened_ms\": %lld, \"wall_closed_ms\": %lld, \"wall_uploaded_ms\": %lld, \"upload_ms\": %lld}",
+            record->fragment_id, record->key,
+            clock_diff_ms(0, record->first_pts), clock_diff_ms(0, record->last_pts), media_ms, SEGMENT_DURATION, media_ms - SEGMENT_DURATION,
+            clock_diff_ms(0, record->first_running_time), clock_diff_ms(0, record->closing_running_time), record->bytes,
+            record->wall_opened, record->wall_closed, record->wall_uploaded,
+            record->wall_closed ? record->wall_uploaded - record->wall_closed : 0);
+
+    g_print("%s\n", line);
+    if (timeline->output) {
+        fprintf(timeline->output, "%s\n", line);
+        fflush(timeline->output);
+    }
+    g_free(line);
+}
+
+/* Buffers entering the muxer: track where the current fragment ends in media time */
+static GstPadProbeReturn muxer_sink_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
+    SegmentTimeline *timeline = (SegmentTimeline *) user_data;
+    GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+    GstClockTime end;
+
+    if (!GST_BUFFER_PTS_IS_VALID(buffer)) {
+        return GST_PAD_PROBE_OK;
+    }
+    end = GST_BUFFER_PTS(buffer) + (GST_BUFFER_DURATION_IS_VALID(buffer) ? GST_BUFFER_DURATION(buffer) : 0);
+
+    g_mutex_lock(&timeline->lock);
+    if (timeline->current && (!GST_CLOCK_TIME_IS_VALID(timeline->current->last_pts) || end > timeline->current->last_pts)) {
+        timeline->current->last_pts = end;
+    }
+    g_mutex_unlock(&timeline->lock);
+
+    return GST_PAD_PROBE_OK;
+}
+
+static void muxer_pad_added(GstElement *muxer, GstPad *pad, gpointer user_data) {
+    if (GST_PAD_DIRECTION(pad) == GST_PAD_SINK) {
+        gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, muxer_sink_probe, user_data, NULL);
+    }
+}
+
+/* Bytes written to gcs_sink, and the moment the muxer finished the fragment (EOS) */
+static GstPadProbeReturn sink_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
+    SegmentTimeline *timeline = (SegmentTimeline *) user_data;
+
+    g_mutex_lock(&timeline->lock);
+    if (timeline->current) {
+        if (GST_PAD_PROBE_INFO_TYPE(info) & GST_PAD_PROBE_TYPE_BUFFER) {
+            timeline->current->bytes += gst_buffer_get_size(GST_PAD_PROBE_INFO_BUFFER(info));
+        } else if (GST_EVENT_TYPE(GST_PAD_PROBE_INFO_EVENT(info)) == GST_EVENT_EOS) {
+            timeline->current->wall_closed = current_time_millis();
+        }
+    }
+    g_mutex_unlock(&timeline->lock);
+
+    return GST_PAD_PROBE_OK;
+}
+
+/* Runs in the posting thread, so wall-clock times are not delayed by the bus */
+static GstBusSyncReply timeline_sync_handler(GstBus *bus, GstMessage *msg, gpointer user_data) {
+    SegmentTimeline *timeline = (SegmentTimeline *) user_data;
+    const GstStructure *s;
+    SegmentRecord *record;
+
+    if (GST_MESSAGE_TYPE(msg) != GST_MESSAGE_ELEMENT) {
+        return GST_BUS_PASS;
+    }
+    s = gst_message_get_structure(msg);
+    if (!s || !gst_structure_has_name(s, "splitmuxsink-fragment-closed")) {
+        return GST_BUS_PASS;
+    }
+
+    g_mutex_lock(&timeline->lock);
+    record = timeline->current;
+    timeline->current = NULL;
+    g_mutex_unlock(&timeline->lock);
+
+    if (record) {
+        record->wall_uploaded = current_time_millis();
+        gst_structure_get_clock_time(s, "running-time", &record->closing_running_time);
+        emit_record(timeline, record);
+        g_free(record->key);
+        g_free(record);
+    }
+
+    return GST_BUS_PASS;
+}
+
+static gboolean link_elements_with_video_filter (GstElement *element1, GstElement *element2)
+{
+    gboolean link_ok;
+    GstCaps *caps;
+
+    caps = gst_caps_new_simple ("video/x-raw",
+            "format", G_TYPE_STRING, "I420",
+            "width", G_TYPE_INT, 360,
+            "height", G_TYPE_INT, 640,
+            "framerate", GST_TYPE_FRACTION, 15, 1,
+            NULL);
+
+    link_ok = gst_element_link_filtered (element1, element2, caps);
+    gst_caps_unref (caps);
+
+    if (!link_ok) {
+        g_warning ("Failed to link element1 and element2 using video filter!");
+    }
+
+    return link_ok;
+}
+
+static gboolean link_elements_with_audio_filter (GstElement *element1, GstElement *element2, int sampleRate, int numChannels)
+{
+    gboolean link_ok;
+    GstCaps *caps;
+
+    caps = gst_caps_new_simple ("audio/x-raw",
+            "rate", G_TYPE_INT, sampleRate,
+            "channels", G_TYPE_INT, numChannels,
+            NULL);
+
+    link_ok = gst_element_link_filtered (element1, element2, caps);
+    gst_caps_unref (caps);
+
+    if (!link_ok) {
+        g_warning ("Failed to link element1 and element2 using audio filter!");
+    }
+
+    return link_ok;
+}
+
+int main(int argc, char *argv[]) {
+    GstElement *pipeline;
+    GstElement *video_source, *video_queue, *video_convert, *x264_enc;
+    GstElement *audio_source, *audio_queue, *audio_convert, *audio_resample, *avenc_aac;
+    GstElement *split_mux_sink, *gcs_sink, *mp4_mux;
+
+    SegmentTimeline timeline = {0};
+    GstPad *gcs_sink_pad;
+
+    GstBus *bus;
+    GstMessage *msg;
+    gint64 eos_deadline = 0;
+
+    GstPad *x264enc_src_pad, *avenc_aac_src_pad;
+    GstPad *splitmuxsink_video_pad, *splitmuxsink_audio_pad;
+
+    /* Initialize GStreamer */
+    gst_init (&argc, &argv);
+
+    /* Create the elements */
+    video_source = gst_element_factory_make ("videotestsrc", "video_source");
+    video_queue = gst_element_factory_make ("queue", "video_queue");
+    video_convert = gst_element_factory_make ("videoconvert", "video_convert");
+    x264_enc = gst_element_factory_make ("x264enc", "x264_enc");
+
+    audio_source = gst_element_factory_make ("audiotestsrc", "audio_source");
+    audio_queue = gst_element_factory_make ("queue", "audio_queue");
+    audio_convert = gst_element_factory_make ("audioconvert", "audio_convert");
+    audio_resample = gst_element_factory_make ("audioresample", "audio_resample");
+    avenc_aac = gst_element_factory_make ("avenc_aac", "avenc_aac");
+
+    split_mux_sink = gst_element_factory_make ("splitmuxsink", "split_mux_sink");
+    gcs_sink = gst_element_factory_make ("awss3sink", "gcs_sink");
+    mp4_mux = gst_element_factory_make ("mp4mux", "mp4_mux");
+
+    /* Create the empty pipeline */
+    pipeline = gst_pipeline_new ("test-pipeline");
+
+    if (!pipeline || !video_source || !video_queue || !video_convert || !x264_enc ||
+    !audio_source || !audio_queue || !audio_convert || !audio_resample || !avenc_aac ||
+    !split_mux_sink || !gcs_sink || !mp4_mux) {
+        g_printerr ("Not all elements could be created.\n");
+        return -1;
+    } else {
+        g_print ("All elements created successfully.\n");
+    }
+
+    /* Configure elements */
+    g_object_set (x264_enc, "speed-preset", 1, "bitrate", 128, NULL);
+    g_object_set (avenc_aac, "bitrate", 256, NULL);
+    g_object_set (gcs_sink, "access-key", "add-here", "bucket", "add-here", "endpoint-uri", "https://storage.googleapis.com", "force-path-style", true, "region", "add-here", "secret-access-key", "add-here", "sync", true,  NULL);
+    g_object_set(split_mux_sink, "max-size-time", (guint64)SEGMENT_DURATION * GST_MSECOND, "send-keyframe-requests", true, "sink", gcs_sink, "muxer", mp4_mux, NULL);
+
+    g_mutex_init(&timeline.lock);
+    timeline.gcs_sink = gcs_sink;
+    timeline.output = fopen(TIMELINE_PATH, "a");
+    if (!timeline.output) {
+        g_printerr ("Could not open %s, segment records only go to stdout\n", TIMELINE_PATH);
+    }
+
+    // format-location-full also hands over the first sample of the fragment
+    g_signal_connect(split_mux_sink, "format-location-full", G_CALLBACK(format_location_full_callback), &timeline);
+    // Track the media time that reaches the muxer and the bytes that reach the sink
+    g_signal_connect(mp4_mux, "pad-added", G_CALLBACK(muxer_pad_added), &timeline);
+    gcs_sink_pad = gst_element_get_static_pad (gcs_sink, "sink");
+    gst_pad_add_probe (gcs_sink_pad, GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM, sink_probe, &timeline, NULL);
+    gst_object_unref (gcs_sink_pad);
+
+    g_print ("All elements configured successfully.\n");
+
+    /* Link all elements that can be automatically linked because they have "Always" pads */
+    /* Adding caps filter between video_source and video_convert */
+    gst_bin_add_many (GST_BIN (pipeline), video_source, video_queue, video_convert, x264_enc,
+    audio_source, audio_queue, audio_convert, audio_resample, avenc_aac,
+    split_mux_sink, NULL);
+
+    if (link_elements_with_video_filter (video_source, video_queue) != TRUE ||
+        gst_element_link_many (video_queue, video_convert, x264_enc, NULL) != TRUE ||
+
+        link_elements_with_audio_filter (audio_source, audio_queue, 48000, 2) != TRUE ||
+        gst_element_link_many (audio_queue, audio_convert, audio_resample, NULL) != TRUE ||
+        link_elements_with_audio_filter (audio_resample, avenc_aac, 16000, 1) != TRUE
+        ) {
+        g_printerr ("Elements could not be linked.\n");
+        gst_object_unref (pipeline);
+        return -1;
+    } else {
+        g_print ("All elements linked successfully.\n");
+    }
+
+    /* Manually link the splitmuxsink which has "Request" pads */
+    x264enc_src_pad = gst_element_get_static_pad (x264_enc, "src");
+    splitmuxsink_video_pad = gst_element_request_pad_simple (split_mux_sink, "video");
+    g_print ("Obtained request pad %s for splitmuxsink video branch.\n", GST_PAD_NAME (splitmuxsink_video_pad));
+
+    avenc_aac_src_pad = gst_element_get_static_pad (avenc_aac, "src");
+    splitmuxsink_audio_pad = gst_element_request_pad_simple (split_mux_sink, "audio_%u");
+    g_print ("Obtained request pad %s for splitmuxsink audio branch.\n", GST_PAD_NAME (splitmuxsink_audio_pad));
+
+    if (gst_pad_link (x264enc_src_pad, splitmuxsink_video_pad) != GST_PAD_LINK_OK ||
+    gst_pad_link (avenc_aac_src_pad, splitmuxsink_audio_pad) != GST_PAD_LINK_OK) {
+        g_printerr ("splitmuxsink could not be linked!\n");
+        gst_object_unref (pipeline);
+        return -1;
+    } else {
+        g_print ("splitmuxsink linked successfully.\n");
+    }
+    gst_object_unref (x264enc_src_pad);
+    gst_object_unref (avenc_aac_src_pad);
+
+    /* Fragment-closed messages complete the records */
+    bus = gst_element_get_bus (pipeline);
+    gst_bus_set_sync_handler (bus, timeline_sync_handler, &timeline, NULL);
+
+    /* Start playing the pipeline */
+    gst_element_set_state (pipeline, GST_STATE_PLAYING);
+
+    /* Visualize the pipeline using GraphViz */
+    gst_debug_bin_to_dot_file(GST_BIN(pipeline), GST_DEBUG_GRAPH_SHOW_ALL, "pipeline-splitmuxsink-awss3sink-timeline");
+
+    signal(SIGINT, signal_handler);
+
+    /* Wait until error or EOS; SIGINT sends EOS to the splitmuxsink pads so the last, short fragment is recorded too */
+    while (TRUE) {
+        msg = gst_bus_timed_pop_filtered (bus, 1000 * GST_MSECOND, GST_MESSAGE_ERROR | GST_MESSAGE_EOS);
+        if (msg) {
+            if (GST_MESSAGE_TYPE(msg) == GST_MESSAGE_EOS) {
+                g_print("EOS received\n");
+            } else {
+                GError *err;
+                gchar *debug;
+                gst_message_parse_error(msg, &err, &debug);
+                g_printerr("Error: %s\n", err->message);
+                g_error_free(err);
+                g_free(debug);
+            }
+            break;
+        }
+
+        if (terminate && eos_deadline == 0) {
+            g_print("Sending EOS to splitmuxsink pads...\n");
+            gst_pad_send_event(splitmuxsink_video_pad, gst_event_new_eos());
+            gst_pad_send_event(splitmuxsink_audio_pad, gst_event_new_eos());
+            eos_deadline = g_get_monotonic_time() + EOS_TIMEOUT * G_USEC_PER_SEC;
+        } else if (eos_deadline != 0 && g_get_monotonic_time() > eos_deadline) {
+            g_printerr("No EOS after %d sec, the last fragment is not in the timeline\n", EOS_TIMEOUT);
+            break;
+        }
+    }
+
+    /* Release the request pads from splitmuxsink, and unref them */
+    gst_element_release_request_pad (split_mux_sink, splitmuxsink_video_pad);
+    gst_object_unref (splitmuxsink_video_pad);
+    gst_element_release_request_pad (split_mux_sink, splitmuxsink_audio_pad);
+    gst_object_unref (splitmuxsink_audio_pad);
+
+    /* Free resources */
+    if (msg != NULL)
+        gst_message_unref (msg);
+    gst_object_unref (bus);
+    gst_element_set_state (pipeline, GST_STATE_NULL);
+
+    gst_object_unref (pipeline);
+
+    if (timeline.output) {
+        fclose (timeline.output);
+    }
+    g_mutex_clear (&timeline.lock);
+    return 0;
+}
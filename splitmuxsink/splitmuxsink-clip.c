@@ -0,0 +1,422 @@
+#include <gst/gst.h>
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include <string.h>
+
+/*
+ * Cut the clip [T1, T2) (epoch ms) out of a recording made by
+ * splitmuxsink-awss3sink-manifest.c without re-encoding it.
+ *
+ *   splitmuxsink-clip <manifest.ini> <spool_dir> <t1_ms> <t2_ms> <out> [--accurate]
+ *
+ * Only the fragments overlapping the clip are opened, from <spool_dir>/<key>.
+ * The recorder keeps that local copy of every segment in its SPOOL_DIR, so
+ * <spool_dir> is the recorder's SPOOL_DIR (or a copy of it).
+ * splitmuxsrc plays them as one timeline and qtdemux only reads the moov and
+ * the samples the seek lands on, so the clip costs a few range reads instead
+ * of downloading every fragment.
+ *
+ * By default the clip starts at the keyframe at or before T1 and is remuxed
+ * into MP4. With --accurate only the partial GOP [T1, K) up to the next
+ * keyframe K is decoded and re-encoded, [K, T2) is remuxed as before, and the
+ * two parts are written as MPEG-TS one after the other: the re-encoded head
+ * has its own SPS/PPS, which mp4mux cannot switch to mid-file.
+ */
+
+#define MAX_SEGMENT_SCAN 4 // Manifest entries to step over when the index guess is off
+
+typedef struct {
+    GPtrArray *files;           // Fragment paths, in playback order
+    gint64 timeline_start_ms;   // Epoch ms of splitmuxsrc running time 0
+    GstClockTime start;         // Clip start on the splitmuxsrc timeline
+    GstClockTime stop;          // Clip stop on the splitmuxsrc timeline
+} ClipPlan;
+
+typedef struct {
+    GstElement *pipeline;
+    GstElement *mux;            // NULL when the branch only prerolls into fakesinks
+    GstElement *video_sink;     // Video fakesink when mux is NULL
+    gboolean reencode;
+    GstClockTimeDiff offset;    // Running-time offset of the muxer sink pads
+} ClipBranch;
+
+static gboolean plan_clip(const gchar *manifest_path, const gchar *spool_dir, gint64 t1, gint64 t2, ClipPlan *plan) {
+    GKeyFile *manifest = g_key_file_new();
+    GError *err = NULL;
+    gint64 anchor, duration;
+    gint segments, index, scanned;
+    gchar *group;
+
+    if (!g_key_file_load_from_file(manifest, manifest_path, G_KEY_FILE_NONE, &err)) {
+        g_printerr("Could not read manifest %s: %s\n", manifest_path, err->message);
+        g_error_free(err);
+        g_key_file_free(manifest);
+        return FALSE;
+    }
+
+    anchor = g_key_file_get_int64(manifest, "stream", "anchor-ms", NULL);
+    duration = g_key_file_get_integer(manifest, "stream", "segment-duration-ms", NULL);
+    segments = g_key_file_get_integer(manifest, "stream", "segments", NULL);
+    if (segments <= 0 || duration <= 0) {
+        g_printerr("Manifest %s has no segments.\n", manifest_path);
+        g_key_file_free(manifest);
+        return FALSE;
+    }
+
+    // Fragments are SEGMENT_DURATION long give or take a GOP, so the index is a division away
+    index = CLAMP((t1 - anchor) / duration, 0, segments - 1);
+    for (scanned = 0; scanned < MAX_SEGMENT_SCAN; scanned++) {
+        gint64 start_ms, end_ms;
+
+        group = g_strdup_printf("segment %05d", index);
+        start_ms = g_key_file_get_int64(manifest, group, "start-ms", NULL);
+        end_ms = g_key_file_get_int64(manifest, group, "end-ms", NULL);
+        g_free(group);
+
+        if (t1 < start_ms && index > 0) {
+            index--;
+        } else if (t1 >= end_ms && index < segments - 1) {
+            index++;
+        } else {
+            break;
+        }
+    }
+
+    plan->files = g_ptr_array_new_with_free_func(g_free);
+    for (; index < segments; index++) {
+        gint64 start_ms;
+        gchar *key, *path;
+
+        group = g_strdup_printf("segment %05d", index);
+        start_ms = g_key_file_get_int64(manifest, group, "start-ms", NULL);
+        key = g_key_file_get_string(manifest, group, "key", NULL);
+        g_free(group);
+
+        if (start_ms >= t2 || !key) {
+            g_free(key);
+            break;
+        }
+        if (plan->files->len == 0) {
+            plan->timeline_start_ms = start_ms;
+        }
+        path = g_build_filename(spool_dir, key, NULL);
+        g_free(key);
+        if (!g_file_test(path, G_FILE_TEST_IS_REGULAR)) {
+            g_printerr("Segment %s is not in the spool; pass the recorder's SPOOL_DIR.\n", path);
+            g_free(path);
+            g_ptr_array_unref(plan->files);
+            g_key_file_free(manifest);
+            return FALSE;
+        }
+        g_ptr_array_add(plan->files, path);
+    }
+    g_key_file_free(manifest);
+
+    if (plan->files->len == 0) {
+        g_printerr("No recorded segment overlaps [%" G_GINT64_FORMAT ", %" G_GINT64_FORMAT ").\n", t1, t2);
+        g_ptr_array_unref(plan->files);
+        return FALSE;
+    }
+
+    plan->start = (t1 > plan->timeline_start_ms ? t1 - plan->timeline_start_ms : 0) * GST_MSECOND;
+    plan->stop = (t2 - plan->timeline_start_ms) * GST_MSECOND;
+    g_ptr_array_add(plan->files, NULL);
+    return TRUE;
+}
+
+static gchar** format_location_callback(GstElement *splitmuxsrc, gpointer user_data) {
+    ClipPlan *plan = (ClipPlan *) user_data;
+
+    // splitmuxsrc takes ownership of the returned array
+    return g_strdupv((gchar **) plan->files->pdata);
+}
+
+static void link_to_mux(ClipBranch *branch, GstElement *last, gboolean is_video) {
+    GstPad *src_pad, *mux_pad;
+
+    if (!branch->mux) {
+        GstElement *sink = gst_element_factory_make("fakesink", NULL);
+
+        gst_bin_add(GST_BIN(branch->pipeline), sink);
+        gst_element_sync_state_with_parent(sink);
+        gst_element_link(last, sink);
+        if (is_video) {
+            branch->video_sink = sink;
+        }
+        return;
+    }
+
+    if (!gst_element_link(last, branch->mux)) {
+        g_printerr("Could not link %s to %s.\n", GST_ELEMENT_NAME(last), GST_ELEMENT_NAME(branch->mux));
+        return;
+    }
+
+    // Shift this part behind the one written before it so the timestamps continue
+    src_pad = gst_element_get_static_pad(last, "src");
+    mux_pad = gst_pad_get_peer(src_pad);
+    gst_pad_set_offset(mux_pad, branch->offset);
+    gst_object_unref(mux_pad);
+    gst_object_unref(src_pad);
+}
+
+static void pad_added_handler(GstElement *src, GstPad *new_pad, gpointer user_data) {
+    ClipBranch *branch = (ClipBranch *) user_data;
+    const gchar *pad_name = GST_PAD_NAME(new_pad);
+    GstElement *first, *last;
+    GstPad *sink_pad;
+
+    if (g_str_has_prefix(pad_name, "video")) {
+        first = last = gst_element_factory_make("h264parse", NULL);
+        gst_bin_add(GST_BIN(branch->pipeline), first);
+
+        if (branch->reencode) {
+            GstElement *decoder = gst_element_factory_make("avdec_h264", NULL);
+            GstElement *convert = gst_element_factory_make("videoconvert", NULL);
+            GstElement *encoder = gst_element_factory_make("x264enc", NULL);
+            GstElement *parse = gst_element_factory_make("h264parse", NULL);
+
+            g_object_set(encoder, "speed-preset", 1, "key-int-max", 300, NULL); // ultrafast, one IDR for the head
+            g_object_set(parse, "config-interval", -1, NULL);
+            gst_bin_add_many(GST_BIN(branch->pipeline), decoder, convert, encoder, parse, NULL);
+            gst_element_link_many(first, decoder, convert, encoder, parse, NULL);
+            last = parse;
+        } else if (branch->mux) {
+            g_object_set(first, "config-interval", -1, NULL);
+        }
+    } else if (g_str_has_prefix(pad_name, "audio")) {
+        first = last = gst_element_factory_make("aacparse", NULL);
+        gst_bin_add(GST_BIN(branch->pipeline), first);
+    } else {
+        g_print("Ignoring pad '%s' from '%s'.\n", pad_name, GST_ELEMENT_NAME(src));
+        return;
+    }
+
+    link_to_mux(branch, last, g_str_has_prefix(pad_name, "video"));
+    gst_element_sync_state_with_parent(last);
+    if (last != first) {
+        GstElement *element = last;
+
+        // Bring up the rest of the chain, downstream first
+        while (element != first) {
+            GstPad *pad = gst_element_get_static_pad(element, "sink");
+            GstPad *peer = gst_pad_get_peer(pad);
+            GstElement *upstream = gst_pad_get_parent_element(peer);
+
+            gst_object_unref(peer);
+            gst_object_unref(pad);
+            gst_element_sync_state_with_parent(upstream);
+            gst_object_unref(upstream);
+            element = upstream;
+        }
+    }
+
+    sink_pad = gst_element_get_static_pad(first, "sink");
+    if (gst_pad_link(new_pad, sink_pad) != GST_PAD_LINK_OK) {
+        g_printerr("Could not link pad '%s' of '%s'.\n", pad_name, GST_ELEMENT_NAME(src));
+    }
+    gst_object_unref(sink_pad);
+}
+
+static GstElement* build_clip_pipeline(ClipPlan *plan, ClipBranch *branch, const gchar *muxer, const gchar *location) {
+    GstElement *source = gst_element_factory_make("splitmuxsrc", "clip_source");
+
+    branch->pipeline = gst_pipeline_new("clip-pipeline");
+    gst_bin_add(GST_BIN(branch->pipeline), source);
+
+    if (muxer) {
+        GstElement *sink = gst_element_factory_make("filesink", "clip_sink");
+
+        branch->mux = gst_element_factory_make(muxer, "clip_mux");
+        g_object_set(sink, "location", location, NULL);
+        gst_bin_add_many(GST_BIN(branch->pipeline), branch->mux, sink, NULL);
+        gst_element_link(branch->mux, sink);
+    }
+
+    g_signal_connect(source, "format-location", G_CALLBACK(format_location_callback), plan);
+    g_signal_connect(source, "pad-added", G_CALLBACK(pad_added_handler), branch);
+    return branch->pipeline;
+}
+
+/* Preroll, seek, then (unless only prerolling) play to EOS */
+static gboolean run_clip_pipeline(GstElement *pipeline, GstSeekFlags flags, GstClockTime start, GstClockTime stop, gboolean play) {
+    GstBus *bus;
+    GstMessage *msg;
+    gboolean ok = TRUE;
+
+    gst_element_set_state(pipeline, GST_STATE_PAUSED);
+    if (gst_element_get_state(pipeline, NULL, NULL, GST_CLOCK_TIME_NONE) == GST_STATE_CHANGE_FAILURE ||
+        !gst_element_seek(pipeline, 1.0, GST_FORMAT_TIME, GST_SEEK_FLAG_FLUSH | flags,
+                          GST_SEEK_TYPE_SET, start, GST_SEEK_TYPE_SET, stop) ||
+        gst_element_get_state(pipeline, NULL, NULL, GST_CLOCK_TIME_NONE) == GST_STATE_CHANGE_FAILURE) {
+        g_printerr("Could not preroll and seek the clip pipeline.\n");
+        return FALSE;
+    }
+    if (!play) {
+        return TRUE;
+    }
+
+    gst_element_set_state(pipeline, GST_STATE_PLAYING);
+    bus = gst_element_get_bus(pipeline);
+    msg = gst_bus_timed_pop_filtered(bus, GST_CLOCK_TIME_NONE, GST_MESSAGE_ERROR | GST_MESSAGE_EOS);
+    if (GST_MESSAGE_TYPE(msg) == GST_MESSAGE_ERROR) {
+        GError *err;
+        gchar *debug_info;
+
+        gst_message_parse_error(msg, &err, &debug_info);
+        g_printerr("Error received from element %s: %s\n", GST_OBJECT_NAME(msg->src), err->message);
+        g_printerr("Debugging information: %s\n", debug_info ? debug_info : "none");
+        g_clear_error(&err);
+        g_free(debug_info);
+        ok = FALSE;
+    }
+    gst_message_unref(msg);
+    gst_object_unref(bus);
+    return ok;
+}
+
+static void free_clip_pipeline(GstElement *pipeline) {
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+    gst_object_unref(pipeline);
+}
+
+/* Timeline position of the first keyframe at or after the clip start */
+static gboolean find_next_keyframe(ClipPlan *plan, GstClockTime *keyframe) {
+    ClipBranch branch = {0};
+    GstElement *pipeline = build_clip_pipeline(plan, &branch, NULL, NULL);
+    GstSample *sample = NULL;
+    gboolean ok = FALSE;
+
+    if (run_clip_pipeline(pipeline, GST_SEEK_FLAG_KEY_UNIT | GST_SEEK_FLAG_SNAP_AFTER, plan->start, plan->stop, FALSE) &&
+        branch.video_sink) {
+        g_object_get(branch.video_sink, "last-sample", &sample, NULL);
+    }
+    if (sample) {
+        GstBuffer *buffer = gst_sample_get_buffer(sample);
+
+        if (buffer && GST_BUFFER_PTS_IS_VALID(buffer)) {
+            *keyframe = gst_segment_to_stream_time(gst_sample_get_segment(sample), GST_FORMAT_TIME, GST_BUFFER_PTS(buffer));
+            ok = TRUE;
+        }
+        gst_sample_unref(sample);
+    }
+
+    free_clip_pipeline(pipeline);
+    return ok;
+}
+
+static gboolean append_file(FILE *out, const gchar *path) {
+    gchar buffer[64 * 1024];
+    size_t n;
+    FILE *in = fopen(path, "rb");
+
+    if (!in) {
+        g_printerr("Could not open %s.\n", path);
+        return FALSE;
+    }
+    while ((n = fread(buffer, 1, sizeof(buffer), in)) > 0) {
+        fwrite(buffer, 1, n, out);
+    }
+    fclose(in);
+    return TRUE;
+}
+
+static gboolean cut_accurate(ClipPlan *plan, const gchar *output) {
+    ClipBranch head = {0}, body = {0};
+    GstElement *pipeline;
+    GstClockTime keyframe;
+    gchar *head_path = g_strdup_printf("%s.head.ts", output);
+    gchar *body_path = g_strdup_printf("%s.body.ts", output);
+    gboolean ok = FALSE;
+    FILE *out;
+
+    if (!find_next_keyframe(plan, &keyframe)) {
+        g_printerr("Could not find a keyframe after the clip start.\n");
+        goto done;
+    }
+    g_print("Re-encoding %" GST_TIME_FORMAT " - %" GST_TIME_FORMAT ", remuxing the rest.\n",
+            GST_TIME_ARGS(plan->start), GST_TIME_ARGS(keyframe));
+
+    if (keyframe > plan->start) {
+        head.reencode = TRUE;
+        pipeline = build_clip_pipeline(plan, &head, "mpegtsmux", head_path);
+        ok = run_clip_pipeline(pipeline, GST_SEEK_FLAG_ACCURATE, plan->start, MIN(keyframe, plan->stop), TRUE);
+        free_clip_pipeline(pipeline);
+        if (!ok) {
+            goto done;
+        }
+    }
+
+    if (keyframe < plan->stop) {
+        body.offset = keyframe - plan->start;
+        pipeline = build_clip_pipeline(plan, &body, "mpegtsmux", body_path);
+        ok = run_clip_pipeline(pipeline, GST_SEEK_FLAG_KEY_UNIT, keyframe, plan->stop, TRUE);
+        free_clip_pipeline(pipeline);
+        if (!ok) {
+            goto done;
+        }
+    }
+
+    // MPEG-TS parts concatenate byte for byte
+    out = fopen(output, "wb");
+    if (!out) {
+        g_printerr("Could not create %s.\n", output);
+        ok = FALSE;
+        goto done;
+    }
+    ok = (keyframe <= plan->start || append_file(out, head_path)) &&
+         (keyframe >= plan->stop || append_file(out, body_path));
+    fclose(out);
+
+done:
+    g_remove(head_path);
+    g_remove(body_path);
+    g_free(head_path);
+    g_free(body_path);
+    return ok;
+}
+
+static gboolean cut_remux(ClipPlan *plan, const gchar *output) {
+    ClipBranch branch = {0};
+    GstElement *pipeline = build_clip_pipeline(plan, &branch, "mp4mux", output);
+    gboolean ok = run_clip_pipeline(pipeline, GST_SEEK_FLAG_KEY_UNIT | GST_SEEK_FLAG_SNAP_BEFORE, plan->start, plan->stop, TRUE);
+
+    free_clip_pipeline(pipeline);
+    return ok;
+}
+
+int main(int argc, char *argv[]) {
+    ClipPlan plan = {0};
+    gboolean accurate, ok;
+    gint64 t1, t2, started;
+
+    gst_init(&argc, &argv);
+
+    if (argc < 6) {
+        g_printerr("Usage: %s <manifest.ini> <spool_dir> <t1_ms> <t2_ms> <out> [--accurate]\n", argv[0]);
+        return -1;
+    }
+    t1 = g_ascii_strtoll(argv[3], NULL, 10);
+    t2 = g_ascii_strtoll(argv[4], NULL, 10);
+    accurate = argc > 6 && g_strcmp0(argv[6], "--accurate") == 0;
+    if (t2 <= t1) {
+        g_printerr("Clip end must be after its start.\n");
+        return -1;
+    }
+
+    started = g_get_monotonic_time();
+    if (!plan_clip(argv[1], argv[2], t1, t2, &plan)) {
+        return -1;
+    }
+    g_print("Clip %" G_GINT64_FORMAT " - %" G_GINT64_FORMAT " spans %u segment(s), timeline %" GST_TIME_FORMAT " - %" GST_TIME_FORMAT ".\n",
+            t1, t2, plan.files->len - 1, GST_TIME_ARGS(plan.start), GST_TIME_ARGS(plan.stop));
+
+    ok = accurate ? cut_accurate(&plan, argv[5]) : cut_remux(&plan, argv[5]);
+    g_ptr_array_unref(plan.files);
+
+    if (!ok) {
+        g_printerr("Clip extraction failed.\n");
+        return -1;
+    }
+    g_print("Wrote %s in %" G_GINT64_FORMAT " ms.\n", argv[5], (g_get_monotonic_time() - started) / 1000);
+    return 0;
+}
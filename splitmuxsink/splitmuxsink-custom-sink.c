@@ -1,9 +1,22 @@
 #include <gst/gst.h>
+#include <gst/video/video.h>
 #include <stdbool.h>
+#include <stdlib.h>
 #include <time.h>
 #include <sys/time.h>
+#ifdef __linux__
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
 
 #define SEGMENT_DURATION 15000 // Duration for each segment in milliseconds
+#define FRAME_POOL_QUEUE 8 // video_queue max-size-buffers
+#define FRAME_POOL_SPARE 3 // Frames being filled by video_source or converted
+#define FRAME_POOL_ALIGN 64 // Plane and stride alignment in bytes, enough for AVX-512 loads
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
 
 // Function to get the current time in milliseconds since the Unix epoch
 static long long current_time_millis() {
@@ -63,6 +76,434 @@ static gboolean link_elements_with_audio_filter (GstElement *element1, GstElemen
     return link_ok;
 }
 
+/*
+ * Optional (HUGEPAGES=1) allocator behind the raw video pool: every frame is
+ * a slot in one arena backed by 2 MB pages, so a 1.4 MB frame is covered by
+ * one or two TLB entries instead of ~350. The arena is mapped with explicit
+ * huge pages (MAP_HUGETLB, needs vm.nr_hugepages) if possible, otherwise as
+ * 2 MB aligned memory with MADV_HUGEPAGE for transparent huge pages. Without
+ * either, the pool keeps the default system memory allocator. Allocations
+ * that don't fit a free slot also go to system memory and are counted.
+ */
+typedef enum {
+    HUGE_PAGES_EXPLICIT,
+    HUGE_PAGES_TRANSPARENT,
+} HugePageMode;
+
+typedef struct {
+    GstAllocator parent;
+    HugePageMode mode;
+    guint8 *arena;
+    gsize arena_size;
+    gsize slot_size;
+    GMutex lock;
+    guint8 **free_slots;        // Stack of free slot addresses, never reallocated
+    guint n_free;
+    guint allocated;            // Slots handed out
+    guint fallbacks;
+} HugePageAllocator;
+
+typedef struct {
+    GstAllocatorClass parent_class;
+} HugePageAllocatorClass;
+
+typedef struct {
+    GstMemory mem;
+    guint8 *data;
+    gboolean owns_slot;         // FALSE for shared sub-memories
+} HugePageMemory;
+
+G_DEFINE_TYPE (HugePageAllocator, huge_page_allocator, GST_TYPE_ALLOCATOR);
+
+static GstMemory* huge_page_allocator_alloc (GstAllocator *allocator, gsize size, GstAllocationParams *params)
+{
+    HugePageAllocator *self = (HugePageAllocator *) allocator;
+    gsize maxsize = size + params->prefix + params->padding;
+    HugePageMemory *mem;
+    guint8 *slot = NULL;
+
+    if (maxsize <= self->slot_size) {
+        g_mutex_lock (&self->lock);
+        if (self->n_free > 0) {
+            slot = self->free_slots[--self->n_free];
+            self->allocated++;
+        }
+        g_mutex_unlock (&self->lock);
+    }
+    if (!slot) {
+        g_atomic_int_inc ((gint *) &self->fallbacks);
+        return gst_allocator_alloc (NULL, size, params);
+    }
+
+    mem = g_new (HugePageMemory, 1);
+    mem->data = slot;
+    mem->owns_slot = TRUE;
+    gst_memory_init (GST_MEMORY_CAST (mem), params->flags, allocator, NULL, self->slot_size, FRAME_POOL_ALIGN - 1, params->prefix, size);
+    return GST_MEMORY_CAST (mem);
+}
+
+static void huge_page_allocator_free (GstAllocator *allocator, GstMemory *memory)
+{
+    HugePageAllocator *self = (HugePageAllocator *) allocator;
+    HugePageMemory *mem = (HugePageMemory *) memory;
+
+    if (mem->owns_slot) {
+        g_mutex_lock (&self->lock);
+        self->free_slots[self->n_free++] = mem->data;
+        g_mutex_unlock (&self->lock);
+    }
+    g_free (mem);
+}
+
+static gpointer huge_page_mem_map (GstMemory *memory, gsize maxsize, GstMapFlags flags)
+{
+    return ((HugePageMemory *) memory)->data;
+}
+
+static void huge_page_mem_unmap (GstMemory *memory)
+{
+}
+
+static GstMemory* huge_page_mem_share (GstMemory *memory, gssize offset, gssize size)
+{
+    HugePageMemory *mem = (HugePageMemory *) memory;
+    HugePageMemory *sub = g_new (HugePageMemory, 1);
+    GstMemory *parent = memory->parent ? memory->parent : memory;
+
+    if (size == -1) {
+        size = memory->size - offset;
+    }
+    sub->data = mem->data;
+    sub->owns_slot = FALSE;
+    gst_memory_init (GST_MEMORY_CAST (sub), GST_MINI_OBJECT_FLAGS (parent) | GST_MINI_OBJECT_FLAG_LOCK_READONLY,
+                     memory->allocator, parent, memory->maxsize, memory->align, memory->offset + offset, size);
+    return GST_MEMORY_CAST (sub);
+}
+
+static void huge_page_allocator_finalize (GObject *object)
+{
+    HugePageAllocator *self = (HugePageAllocator *) object;
+
+#ifdef __linux__
+    munmap (self->arena, self->arena_size);
+#endif
+    g_free (self->free_slots);
+    g_mutex_clear (&self->lock);
+    G_OBJECT_CLASS (huge_page_allocator_parent_class)->finalize (object);
+}
+
+static void huge_page_allocator_class_init (HugePageAllocatorClass *klass)
+{
+    GstAllocatorClass *allocator_class = GST_ALLOCATOR_CLASS (klass);
+
+    allocator_class->alloc = huge_page_allocator_alloc;
+    allocator_class->free = huge_page_allocator_free;
+    G_OBJECT_CLASS (klass)->finalize = huge_page_allocator_finalize;
+}
+
+static void huge_page_allocator_init (HugePageAllocator *self)
+{
+    GstAllocator *allocator = GST_ALLOCATOR (self);
+
+    allocator->mem_type = "HugePageMemory";
+    allocator->mem_map = huge_page_mem_map;
+    allocator->mem_unmap = huge_page_mem_unmap;
+    allocator->mem_share = huge_page_mem_share;
+    g_mutex_init (&self->lock);
+    GST_OBJECT_FLAG_SET (self, GST_ALLOCATOR_FLAG_CUSTOM_ALLOC);
+}
+
+/* Map and prefault an arena of `slots` frames of `slot_size` bytes, NULL if no huge pages are available */
+static HugePageAllocator* huge_page_allocator_new (guint slots, gsize slot_size)
+{
+#ifdef __linux__
+    HugePageAllocator *self;
+    gsize arena_size = GST_ROUND_UP_N ((gsize) slots * slot_size, HUGE_PAGE_SIZE);
+    HugePageMode mode = HUGE_PAGES_EXPLICIT;
+    guint8 *arena;
+    guint i;
+
+    arena = mmap (NULL, arena_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_POPULATE, -1, 0);
+    if (arena == MAP_FAILED) {
+        /* Over-map by one huge page so the arena can start on a 2 MB boundary */
+        guint8 *base = mmap (NULL, arena_size + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        gsize head;
+
+        if (base == MAP_FAILED) {
+            return NULL;
+        }
+        arena = (guint8 *) GST_ROUND_UP_N ((guintptr) base, HUGE_PAGE_SIZE);
+        head = arena - base;
+        if (head > 0) {
+            munmap (base, head);
+        }
+        munmap (arena + arena_size, HUGE_PAGE_SIZE - head);
+
+        if (madvise (arena, arena_size, MADV_HUGEPAGE) != 0) {
+            munmap (arena, arena_size);
+            return NULL;
+        }
+        mode = HUGE_PAGES_TRANSPARENT;
+        memset (arena, 0, arena_size);  // Fault the pages in now rather than on the first frames
+    }
+
+    self = g_object_new (huge_page_allocator_get_type (), NULL);
+    gst_object_ref_sink (self);
+    self->mode = mode;
+    self->arena = arena;
+    self->arena_size = arena_size;
+    self->slot_size = slot_size;
+    self->free_slots = g_new (guint8 *, slots);
+    for (i = slots; i > 0; i--) {
+        self->free_slots[self->n_free++] = arena + (gsize) (i - 1) * slot_size;
+    }
+
+    g_print ("Huge page arena: %" G_GSIZE_FORMAT " MB, %u slots of %" G_GSIZE_FORMAT " bytes, %s huge pages\n",
+            arena_size >> 20, slots, slot_size, mode == HUGE_PAGES_EXPLICIT ? "explicit" : "transparent");
+    return self;
+#else
+    return NULL;
+#endif
+}
+
+#ifdef __linux__
+/* dTLB load misses of the calling thread and the threads it spawns later (x264 workers) */
+static int open_dtlb_counter (void)
+{
+    struct perf_event_attr attr;
+
+    memset (&attr, 0, sizeof (attr));
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.size = sizeof (attr);
+    attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attr.inherit = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+
+    return syscall (__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+#endif
+
+G_LOCK_DEFINE_STATIC (tlb_counters);
+
+/* Benchmark mode: count dTLB misses on every streaming thread as it starts */
+static GstBusSyncReply tlb_sync_handler (GstBus *bus, GstMessage *msg, gpointer user_data)
+{
+#ifdef __linux__
+    GArray *counters = (GArray *) user_data;
+    GstStreamStatusType type;
+    GstElement *owner;
+    int fd;
+
+    if (GST_MESSAGE_TYPE (msg) != GST_MESSAGE_STREAM_STATUS) {
+        return GST_BUS_PASS;
+    }
+    gst_message_parse_stream_status (msg, &type, &owner);
+    if (type == GST_STREAM_STATUS_TYPE_ENTER && (fd = open_dtlb_counter ()) >= 0) {
+        G_LOCK (tlb_counters);
+        g_array_append_val (counters, fd);
+        G_UNLOCK (tlb_counters);
+    }
+#endif
+    return GST_BUS_PASS;
+}
+
+/* Sum after the pipeline is in NULL, so that exited x264 threads have been folded into their parents */
+static gint64 read_tlb_counters (GArray *counters)
+{
+    gint64 total = -1;
+#ifdef __linux__
+    guint i;
+
+    for (i = 0; i < counters->len; i++) {
+        guint64 value;
+        int fd = g_array_index (counters, int, i);
+
+        if (read (fd, &value, sizeof (value)) == sizeof (value)) {
+            total = MAX (total, 0) + value;
+        }
+        close (fd);
+    }
+#endif
+    return total;
+}
+
+/*
+ * Raw video pool for video_source -> video_queue -> video_convert -> x264_enc.
+ * The pool is created when video_source asks for one (ALLOCATION query) and
+ * holds exactly as many frames as can be in flight: video_queue, the frames
+ * x264_enc keeps for lookahead/threading, and FRAME_POOL_SPARE. min == max,
+ * so every frame is allocated once at activation and never again; a full
+ * pool makes the source wait instead of allocating.
+ */
+typedef struct {
+    GstVideoBufferPool parent;
+    guint allocated;            // Buffers ever allocated, stays at the pool size
+    guint64 acquired;
+    guint64 misses;             // Acquires that found no free frame and had to wait
+} FramePool;
+
+typedef struct {
+    GstVideoBufferPoolClass parent_class;
+} FramePoolClass;
+
+typedef struct {
+    GstElement *x264_enc;
+    FramePool *pool;
+    guint frames;
+    gboolean use_huge_pages;
+    HugePageAllocator *allocator;   // NULL when huge pages are off or unavailable
+} FramePoolPolicy;
+
+G_DEFINE_TYPE (FramePool, frame_pool, GST_TYPE_VIDEO_BUFFER_POOL);
+
+static GstFlowReturn frame_pool_alloc_buffer (GstBufferPool *pool, GstBuffer **buffer, GstBufferPoolAcquireParams *params)
+{
+    ((FramePool *) pool)->allocated++;
+    return GST_BUFFER_POOL_CLASS (frame_pool_parent_class)->alloc_buffer (pool, buffer, params);
+}
+
+static GstFlowReturn frame_pool_acquire_buffer (GstBufferPool *pool, GstBuffer **buffer, GstBufferPoolAcquireParams *params)
+{
+    FramePool *self = (FramePool *) pool;
+    GstBufferPoolAcquireParams dontwait = { 0, };
+    GstFlowReturn ret;
+
+    if (params) {
+        dontwait = *params;
+    }
+    dontwait.flags |= GST_BUFFER_POOL_ACQUIRE_FLAG_DONTWAIT;
+
+    self->acquired++;   // Only video_source acquires, from its streaming thread
+    ret = GST_BUFFER_POOL_CLASS (frame_pool_parent_class)->acquire_buffer (pool, buffer, &dontwait);
+    if (ret == GST_FLOW_EOS && !(params && (params->flags & GST_BUFFER_POOL_ACQUIRE_FLAG_DONTWAIT))) {
+        self->misses++;
+        ret = GST_BUFFER_POOL_CLASS (frame_pool_parent_class)->acquire_buffer (pool, buffer, params);
+    }
+
+    return ret;
+}
+
+static void frame_pool_class_init (FramePoolClass *klass)
+{
+    GstBufferPoolClass *pool_class = GST_BUFFER_POOL_CLASS (klass);
+
+    pool_class->alloc_buffer = frame_pool_alloc_buffer;
+    pool_class->acquire_buffer = frame_pool_acquire_buffer;
+}
+
+static void frame_pool_init (FramePool *self)
+{
+}
+
+/* After downstream answered video_source's ALLOCATION query, replace its pool with ours */
+static GstPadProbeReturn frame_pool_allocation_probe (GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+    FramePoolPolicy *policy = (FramePoolPolicy *) user_data;
+    GstQuery *query = GST_PAD_PROBE_INFO_QUERY (info);
+    GstStructure *config;
+    GstAllocationParams params;
+    GstVideoAlignment align;
+    GstVideoInfo video_info, aligned_info;
+    GstClockTime min_latency = 0, max_latency = 0;
+    GstCaps *caps;
+    gboolean need_pool, video_meta;
+    guint size, i, encoder_frames = 0;
+
+    if (GST_QUERY_TYPE (query) != GST_QUERY_ALLOCATION) {
+        return GST_PAD_PROBE_OK;
+    }
+    gst_query_parse_allocation (query, &caps, &need_pool);
+    if (!caps || !gst_video_info_from_caps (&video_info, caps)) {
+        return GST_PAD_PROBE_OK;
+    }
+
+    /* x264_enc has seen the caps by now (the query is serialized behind them), so its latency is known */
+    gst_video_encoder_get_latency (GST_VIDEO_ENCODER (policy->x264_enc), &min_latency, &max_latency);
+    if (GST_CLOCK_TIME_IS_VALID (max_latency) && video_info.fps_n > 0) {
+        encoder_frames = (guint) gst_util_uint64_scale_ceil (max_latency, video_info.fps_n, GST_SECOND * video_info.fps_d);
+    }
+    policy->frames = FRAME_POOL_QUEUE + encoder_frames + FRAME_POOL_SPARE;
+
+    if (policy->pool) {
+        gst_buffer_pool_set_active (GST_BUFFER_POOL (policy->pool), FALSE);
+        gst_object_unref (policy->pool);
+    }
+    policy->pool = g_object_new (frame_pool_get_type (), NULL);
+
+    gst_allocation_params_init (&params);
+    params.align = FRAME_POOL_ALIGN - 1;
+
+    /* Padded strides need downstream to read them from the video meta */
+    video_meta = gst_query_find_allocation_meta (query, GST_VIDEO_META_API_TYPE, NULL);
+    aligned_info = video_info;
+    gst_video_alignment_reset (&align);
+    if (video_meta) {
+        for (i = 0; i < GST_VIDEO_MAX_PLANES; i++) {
+            align.stride_align[i] = FRAME_POOL_ALIGN - 1;
+        }
+        gst_video_info_align (&aligned_info, &align);
+    }
+
+    if (policy->use_huge_pages) {
+        gst_clear_object (&policy->allocator);
+        policy->allocator = huge_page_allocator_new (policy->frames, GST_ROUND_UP_64 (aligned_info.size));
+        if (!policy->allocator) {
+            g_warning ("Huge pages unavailable, raw video frames use system memory");
+        }
+    }
+
+    config = gst_buffer_pool_get_config (GST_BUFFER_POOL (policy->pool));
+    gst_buffer_pool_config_set_params (config, caps, video_info.size, policy->frames, policy->frames);
+    gst_buffer_pool_config_set_allocator (config, (GstAllocator *) policy->allocator, &params);
+    if (video_meta) {
+        gst_buffer_pool_config_add_option (config, GST_BUFFER_POOL_OPTION_VIDEO_META);
+        gst_buffer_pool_config_add_option (config, GST_BUFFER_POOL_OPTION_VIDEO_ALIGNMENT);
+        gst_buffer_pool_config_set_video_alignment (config, &align);
+    }
+    if (!gst_buffer_pool_set_config (GST_BUFFER_POOL (policy->pool), config)) {
+        g_warning ("Raw video pool rejected its configuration, keeping the default pool");
+        gst_clear_object (&policy->pool);
+        return GST_PAD_PROBE_OK;
+    }
+
+    /* The pool may have grown the size for padding */
+    config = gst_buffer_pool_get_config (GST_BUFFER_POOL (policy->pool));
+    gst_buffer_pool_config_get_params (config, NULL, &size, NULL, NULL);
+    gst_structure_free (config);
+
+    if (gst_query_get_n_allocation_pools (query) > 0) {
+        gst_query_set_nth_allocation_pool (query, 0, GST_BUFFER_POOL (policy->pool), size, policy->frames, policy->frames);
+    } else {
+        gst_query_add_allocation_pool (query, GST_BUFFER_POOL (policy->pool), size, policy->frames, policy->frames);
+    }
+
+    /* GstBaseSrc's decide_allocation re-sets the pool's allocator and its alignment from the query's first allocation param */
+    if (gst_query_get_n_allocation_params (query) > 0) {
+        gst_query_set_nth_allocation_param (query, 0, (GstAllocator *) policy->allocator, &params);
+    } else {
+        gst_query_add_allocation_param (query, (GstAllocator *) policy->allocator, &params);
+    }
+
+    g_print ("Raw video pool: %u frames of %u bytes (queue %d + encoder %u + spare %d), %d-byte aligned, %s memory\n",
+            policy->frames, size, FRAME_POOL_QUEUE, encoder_frames, FRAME_POOL_SPARE, FRAME_POOL_ALIGN,
+            policy->allocator ? "huge page" : "system");
+
+    return GST_PAD_PROBE_OK;
+}
+
+static void frame_pool_print_stats (FramePoolPolicy *policy)
+{
+    if (policy->pool) {
+        g_print ("Raw video pool: size=%u allocated=%u acquired=%" G_GUINT64_FORMAT " misses=%" G_GUINT64_FORMAT "\n",
+                policy->frames, policy->pool->allocated, policy->pool->acquired, policy->pool->misses);
+    }
+    if (policy->allocator) {
+        g_print ("Huge page arena: slots handed out=%u fallbacks to system memory=%u\n",
+                policy->allocator->allocated, policy->allocator->fallbacks);
+    }
+}
+
 int main(int argc, char *argv[]) {
     GstElement *pipeline;
     GstElement *video_source, *video_queue, *video_convert, *x264_enc;
@@ -72,6 +513,16 @@ int main(int argc, char *argv[]) {
     GstBus *bus;
     GstMessage *msg;
 
+    FramePoolPolicy pool_policy = { 0, };
+    GstPad *video_source_src_pad;
+
+    /* Benchmark mode (BENCH_FRAMES=N): run N frames as fast as possible and report fps and dTLB misses.
+     * Compare HUGEPAGES=0 against HUGEPAGES=1. */
+    const gchar *bench_env = g_getenv ("BENCH_FRAMES");
+    gint bench_frames = bench_env ? atoi (bench_env) : 0;
+    GArray *tlb_counters = g_array_new (FALSE, FALSE, sizeof (int));
+    gint64 bench_started = 0, bench_finished = 0, tlb_misses;
+
     GstPad *x264enc_src_pad, *avenc_aac_src_pad;
     GstPad *splitmuxsink_video_pad, *splitmuxsink_audio_pad;
     
@@ -106,9 +557,16 @@ int main(int argc, char *argv[]) {
     }
 
     /* Configure elements */
+    g_object_set (video_queue, "max-size-buffers", FRAME_POOL_QUEUE, "max-size-bytes", 0, "max-size-time", (guint64) 0, NULL);
     g_object_set (x264_enc, "speed-preset", 1, "bitrate", 128, NULL);
     g_object_set (avenc_aac, "bitrate", 256, NULL);
     g_object_set (custom_file_sink, "sync", true, NULL);
+    if (bench_frames > 0) {
+        /* audiotestsrc sends 1024 samples per buffer at 48 kHz */
+        g_object_set (video_source, "num-buffers", bench_frames, NULL);
+        g_object_set (audio_source, "num-buffers", (gint) gst_util_uint64_scale_ceil (bench_frames, 48000, 15 * 1024), NULL);
+        g_object_set (custom_file_sink, "sync", false, NULL);
+    }
     g_object_set(split_mux_sink, "max-size-time", (guint64)SEGMENT_DURATION * GST_MSECOND, "send-keyframe-requests", true, "sink", custom_file_sink, NULL);
 
     // Connect the format-location signal to generate dynamic filenames
@@ -139,11 +597,11 @@ int main(int argc, char *argv[]) {
     /* Manually link the splitmuxsink which has "Request" pads */
     x264enc_src_pad = gst_element_get_static_pad (x264_enc, "src");
     splitmuxsink_video_pad = gst_element_request_pad_simple (split_mux_sink, "video");
-    g_print ("Obtained request pad %s for splitmuxsink video branch.\n", gst_pad_get_name (splitmuxsink_video_pad));
+    g_print ("Obtained request pad %s for splitmuxsink video branch.\n", GST_PAD_NAME (splitmuxsink_video_pad));
 
     avenc_aac_src_pad = gst_element_get_static_pad (avenc_aac, "src");
     splitmuxsink_audio_pad = gst_element_request_pad_simple (split_mux_sink, "audio_%u");
-    g_print ("Obtained request pad %s for splitmuxsink audio branch.\n", gst_pad_get_name (splitmuxsink_audio_pad));
+    g_print ("Obtained request pad %s for splitmuxsink audio branch.\n", GST_PAD_NAME (splitmuxsink_audio_pad));
 
     if (gst_pad_link (x264enc_src_pad, splitmuxsink_video_pad) != GST_PAD_LINK_OK ||
     gst_pad_link (avenc_aac_src_pad, splitmuxsink_audio_pad) != GST_PAD_LINK_OK) {
@@ -156,15 +614,28 @@ int main(int argc, char *argv[]) {
     gst_object_unref (x264enc_src_pad);
     gst_object_unref (avenc_aac_src_pad);
 
+    /* Preallocate the raw video frames once caps are negotiated */
+    pool_policy.x264_enc = x264_enc;
+    pool_policy.use_huge_pages = g_strcmp0 (g_getenv ("HUGEPAGES"), "1") == 0;
+    video_source_src_pad = gst_element_get_static_pad (video_source, "src");
+    gst_pad_add_probe (video_source_src_pad, GST_PAD_PROBE_TYPE_QUERY_DOWNSTREAM | GST_PAD_PROBE_TYPE_PULL, frame_pool_allocation_probe, &pool_policy, NULL);
+    gst_object_unref (video_source_src_pad);
+
+    bus = gst_element_get_bus (pipeline);
+    if (bench_frames > 0) {
+        gst_bus_set_sync_handler (bus, tlb_sync_handler, tlb_counters, NULL);
+    }
+
     /* Start playing the pipeline */
+    bench_started = g_get_monotonic_time ();
     gst_element_set_state (pipeline, GST_STATE_PLAYING);
 
     /* Visualize the pipeline using GraphViz */
     gst_debug_bin_to_dot_file(GST_BIN(pipeline), GST_DEBUG_GRAPH_SHOW_ALL, "pipeline-splitmuxsink-custom-sink");
 
     /* Wait until error or EOS */
-    bus = gst_element_get_bus (pipeline);
     msg = gst_bus_timed_pop_filtered (bus, GST_CLOCK_TIME_NONE, GST_MESSAGE_ERROR | GST_MESSAGE_EOS);
+    bench_finished = g_get_monotonic_time ();
 
     /* Release the request pads from splitmuxsink, and unref them */
     gst_element_release_request_pad (split_mux_sink, splitmuxsink_video_pad);
@@ -179,5 +650,22 @@ int main(int argc, char *argv[]) {
     gst_element_set_state (pipeline, GST_STATE_NULL);
 
     gst_object_unref (pipeline);
+
+    frame_pool_print_stats (&pool_policy);
+    if (bench_frames > 0) {
+        tlb_misses = read_tlb_counters (tlb_counters);
+        // "on" only if frames really came from the arena
+        g_print ("Benchmark: huge pages=%s frames=%d wall=%.3fs fps=%.1f",
+                pool_policy.allocator && pool_policy.allocator->allocated > 0 ? "on" : "off", bench_frames, (bench_finished - bench_started) / 1e6,
+                bench_frames * 1e6 / MAX (bench_finished - bench_started, 1));
+        if (tlb_misses >= 0) {
+            g_print (" dTLB-load-misses=%" G_GINT64_FORMAT " per frame=%.0f\n", tlb_misses, (gdouble) tlb_misses / bench_frames);
+        } else {
+            g_print (" dTLB-load-misses=unavailable (perf_event_paranoid?)\n");
+        }
+    }
+    g_array_unref (tlb_counters);
+    gst_clear_object (&pool_policy.pool);
+    gst_clear_object (&pool_policy.allocator);
     return 0;
 }
@@ -0,0 +1,418 @@
+#include <gst/gst.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <sys/time.h>
+
+#define RUN_SEGMENTS 6 // Each configuration runs for this many segments
+#define DEFAULT_S3_ENDPOINT "http://127.0.0.1:9000" // Local S3-compatible stand-in (e.g. MinIO)
+#define GLASS_CAPS "timestamp/x-glass-wallclock" // Reference timestamp meta carrying the capture time
+
+/*
+ * Glass-to-object latency of the splitmuxsink-awss3sink.c pipeline: the time
+ * from a frame being captured to the object holding it being durably
+ * readable from the object store.
+ *
+ * Every frame leaving videotestsrc gets a GstReferenceTimestampMeta with the
+ * wall-clock capture time (and the PTS is remembered, in case an element
+ * drops the meta). Frames are collected per fragment as they enter the
+ * muxer; when splitmuxsink posts splitmuxsink-fragment-closed, awss3sink has
+ * completed the upload and every frame of that fragment becomes durable.
+ *
+ * The same pipeline runs once per BenchConfig (splitmuxsink max-size-time and
+ * mp4mux fragment-duration) against S3_ENDPOINT, and p50/p99 are reported for
+ * capture to muxer and capture to durable.
+ */
+
+typedef struct {
+    guint segment_ms;           // splitmuxsink max-size-time
+    guint fragment_ms;          // mp4mux fragment-duration, 0 for a plain MP4
+} BenchConfig;
+
+static const BenchConfig configs[] = {
+    { 2000, 0 },
+    { 2000, 500 },
+    { 6000, 0 },
+    { 6000, 1000 },
+    { 15000, 0 },
+    { 15000, 1000 },
+};
+
+typedef struct {
+    GMutex lock;
+    const BenchConfig *config;
+    GstElement *gcs_sink;
+    GstCaps *glass_caps;
+    GHashTable *capture_by_pts;     // PTS -> capture time (gint64 us), fallback for a dropped meta
+    GArray *open_frames;            // Capture times of frames in the fragment being muxed
+    GQueue closed_fragments;        // GArray per fragment finished by the muxer, waiting for upload
+    GArray *to_mux_us;              // Capture to muxer, per frame
+    GArray *to_durable_us;          // Capture to durable in the object store, per frame
+    guint fragments;
+} GlassBench;
+
+// Function to get the current time in milliseconds since the Unix epoch
+static long long current_time_millis() {
+    struct timeval time_now;
+    gettimeofday(&time_now, NULL);
+    return (long long)(time_now.tv_sec) * 1000 + (long long)(time_now.tv_usec) / 1000;
+}
+
+static gchar* format_location_callback(GstElement *splitmuxsink, guint fragment_id, gpointer user_data) {
+    GlassBench *bench = (GlassBench *) user_data;
+
+    // Get the (Unix epoch time) for start and end time
+    long long start_time = current_time_millis();
+    long long end_time = start_time + bench->config->segment_ms;
+
+    gchar *filename = g_strdup_printf("vm/glass/%u_%u/%lld_%lld.mp4", bench->config->segment_ms, bench->config->fragment_ms, start_time, end_time);
+
+    g_object_set(bench->gcs_sink, "key", filename, NULL);  // Set the key dynamically
+
+    return filename;
+}
+
+/* Stamp every captured frame with the wall clock */
+static GstPadProbeReturn source_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
+    GlassBench *bench = (GlassBench *) user_data;
+    GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+    gint64 now = g_get_real_time();
+
+    buffer = gst_buffer_make_writable(buffer);
+    gst_buffer_add_reference_timestamp_meta(buffer, bench->glass_caps, now * GST_USECOND, GST_CLOCK_TIME_NONE);
+    GST_PAD_PROBE_INFO_DATA(info) = buffer;
+
+    if (GST_BUFFER_PTS_IS_VALID(buffer)) {
+        gint64 *capture = g_new(gint64, 1);
+
+        *capture = now;
+        g_mutex_lock(&bench->lock);
+        g_hash_table_insert(bench->capture_by_pts, GSIZE_TO_POINTER(GST_BUFFER_PTS(buffer)), capture);
+        g_mutex_unlock(&bench->lock);
+    }
+
+    return GST_PAD_PROBE_OK;
+}
+
+/* Video entering the muxer belongs to the fragment being written; EOS finishes it */
+static GstPadProbeReturn muxer_video_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
+    GlassBench *bench = (GlassBench *) user_data;
+
+    g_mutex_lock(&bench->lock);
+    if (GST_PAD_PROBE_INFO_TYPE(info) & GST_PAD_PROBE_TYPE_BUFFER) {
+        GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+        GstReferenceTimestampMeta *meta = gst_buffer_get_reference_timestamp_meta(buffer, bench->glass_caps);
+        gint64 capture = -1;
+        gint64 *remembered = NULL;
+
+        if (GST_BUFFER_PTS_IS_VALID(buffer)) {
+            remembered = g_hash_table_lookup(bench->capture_by_pts, GSIZE_TO_POINTER(GST_BUFFER_PTS(buffer)));
+        }
+        if (meta) {
+            capture = GST_TIME_AS_USECONDS(meta->timestamp);
+        } else if (remembered) {
+            capture = *remembered;
+        }
+        if (remembered) {
+            g_hash_table_remove(bench->capture_by_pts, GSIZE_TO_POINTER(GST_BUFFER_PTS(buffer)));
+        }
+
+        if (capture >= 0) {
+            gint64 to_mux = g_get_real_time() - capture;
+
+            g_array_append_val(bench->to_mux_us, to_mux);
+            g_array_append_val(bench->open_frames, capture);
+        }
+    } else if (GST_EVENT_TYPE(GST_PAD_PROBE_INFO_EVENT(info)) == GST_EVENT_EOS && bench->open_frames->len > 0) {
+        g_queue_push_tail(&bench->closed_fragments, bench->open_frames);
+        bench->open_frames = g_array_new(FALSE, FALSE, sizeof(gint64));
+    }
+    g_mutex_unlock(&bench->lock);
+
+    return GST_PAD_PROBE_OK;
+}
+
+static void muxer_pad_added(GstElement *muxer, GstPad *pad, gpointer user_data) {
+    if (GST_PAD_DIRECTION(pad) == GST_PAD_SINK && g_str_has_prefix(GST_PAD_NAME(pad), "video")) {
+        gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM, muxer_video_probe, user_data, NULL);
+    }
+}
+
+/* Runs in the posting thread: the fragment's upload has completed, its frames are durable */
+static GstBusSyncReply glass_sync_handler(GstBus *bus, GstMessage *msg, gpointer user_data) {
+    GlassBench *bench = (GlassBench *) user_data;
+    const GstStructure *s;
+    GArray *frames;
+    gint64 now;
+    guint i;
+
+    if (GST_MESSAGE_TYPE(msg) != GST_MESSAGE_ELEMENT) {
+        return GST_BUS_PASS;
+    }
+    s = gst_message_get_structure(msg);
+    if (!s || !gst_structure_has_name(s, "splitmuxsink-fragment-closed")) {
+        return GST_BUS_PASS;
+    }
+
+    now = g_get_real_time();
+    g_mutex_lock(&bench->lock);
+    frames = g_queue_pop_head(&bench->closed_fragments);
+    if (frames) {
+        for (i = 0; i < frames->len; i++) {
+            gint64 to_durable = now - g_array_index(frames, gint64, i);
+
+            g_array_append_val(bench->to_durable_us, to_durable);
+        }
+        bench->fragments++;
+        g_array_unref(frames);
+    }
+    g_mutex_unlock(&bench->lock);
+
+    return GST_BUS_PASS;
+}
+
+static gint compare_latency(gconstpointer a, gconstpointer b) {
+    gint64 x = *(const gint64 *) a, y = *(const gint64 *) b;
+
+    return x < y ? -1 : x > y;
+}
+
+static gint64 percentile_ms(GArray *sorted, gdouble p) {
+    if (sorted->len == 0) {
+        return -1;
+    }
+    return g_array_index(sorted, gint64, (guint) (p * (sorted->len - 1))) / 1000;
+}
+
+static gboolean link_elements_with_video_filter (GstElement *element1, GstElement *element2)
+{
+    gboolean link_ok;
+    GstCaps *caps;
+
+    caps = gst_caps_new_simple ("video/x-raw",
+            "format", G_TYPE_STRING, "I420",
+            "width", G_TYPE_INT, 360,
+            "height", G_TYPE_INT, 640,
+            "framerate", GST_TYPE_FRACTION, 15, 1,
+            NULL);
+
+    link_ok = gst_element_link_filtered (element1, element2, caps);
+    gst_caps_unref (caps);
+
+    if (!link_ok) {
+        g_warning ("Failed to link element1 and element2 using video filter!");
+    }
+
+    return link_ok;
+}
+
+static gboolean link_elements_with_audio_filter (GstElement *element1, GstElement *element2, int sampleRate, int numChannels)
+{
+    gboolean link_ok;
+    GstCaps *caps;
+
+    caps = gst_caps_new_simple ("audio/x-raw",
+            "rate", G_TYPE_INT, sampleRate,
+            "channels", G_TYPE_INT, numChannels,
+            NULL);
+
+    link_ok = gst_element_link_filtered (element1, element2, caps);
+    gst_caps_unref (caps);
+
+    if (!link_ok) {
+        g_warning ("Failed to link element1 and element2 using audio filter!");
+    }
+
+    return link_ok;
+}
+
+/* Same element graph as splitmuxsink-awss3sink.c, with live sources and an explicit muxer */
+static int run_config(const BenchConfig *config) {
+    GstElement *pipeline;
+    GstElement *video_source, *video_queue, *video_convert, *x264_enc;
+    GstElement *audio_source, *audio_queue, *audio_convert, *audio_resample, *avenc_aac;
+    GstElement *split_mux_sink, *mp4_mux, *gcs_sink;
+
+    GstBus *bus;
+    GstMessage *msg;
+    GstPad *pad;
+    GstPad *x264enc_src_pad, *avenc_aac_src_pad;
+    GstPad *splitmuxsink_video_pad, *splitmuxsink_audio_pad;
+
+    GlassBench bench = {0};
+    const gchar *endpoint = g_getenv ("S3_ENDPOINT");
+    gint64 deadline;
+    gboolean done = FALSE;
+    int ret = 0;
+
+    /* Create the elements */
+    video_source = gst_element_factory_make ("videotestsrc", "video_source");
+    video_queue = gst_element_factory_make ("queue", "video_queue");
+    video_convert = gst_element_factory_make ("videoconvert", "video_convert");
+    x264_enc = gst_element_factory_make ("x264enc", "x264_enc");
+
+    audio_source = gst_element_factory_make ("audiotestsrc", "audio_source");
+    audio_queue = gst_element_factory_make ("queue", "audio_queue");
+    audio_convert = gst_element_factory_make ("audioconvert", "audio_convert");
+    audio_resample = gst_element_factory_make ("audioresample", "audio_resample");
+    avenc_aac = gst_element_factory_make ("avenc_aac", "avenc_aac");
+
+    split_mux_sink = gst_element_factory_make ("splitmuxsink", "split_mux_sink");
+    mp4_mux = gst_element_factory_make ("mp4mux", "mp4_mux");
+    gcs_sink = gst_element_factory_make ("awss3sink", "gcs_sink");
+
+    /* Create the empty pipeline */
+    pipeline = gst_pipeline_new ("glass-pipeline");
+
+    if (!pipeline || !video_source || !video_queue || !video_convert || !x264_enc ||
+    !audio_source || !audio_queue || !audio_convert || !audio_resample || !avenc_aac ||
+    !split_mux_sink || !mp4_mux || !gcs_sink) {
+        g_printerr ("Not all elements could be created.\n");
+        return -1;
+    }
+
+    g_mutex_init (&bench.lock);
+    bench.config = config;
+    bench.gcs_sink = gcs_sink;
+    bench.glass_caps = gst_caps_new_empty_simple (GLASS_CAPS);
+    bench.capture_by_pts = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, g_free);
+    bench.open_frames = g_array_new (FALSE, FALSE, sizeof (gint64));
+    bench.to_mux_us = g_array_new (FALSE, FALSE, sizeof (gint64));
+    bench.to_durable_us = g_array_new (FALSE, FALSE, sizeof (gint64));
+    g_queue_init (&bench.closed_fragments);
+
+    /* Configure elements */
+    g_object_set (video_source, "is-live", true, NULL);
+    g_object_set (audio_source, "is-live", true, NULL);
+    g_object_set (x264_enc, "speed-preset", 1, "bitrate", 128, NULL);
+    g_object_set (avenc_aac, "bitrate", 256, NULL);
+    g_object_set (mp4_mux, "fragment-duration", config->fragment_ms, NULL);
+    g_object_set (gcs_sink, "access-key", g_getenv ("S3_ACCESS_KEY") ? g_getenv ("S3_ACCESS_KEY") : "minioadmin",
+                  "bucket", g_getenv ("S3_BUCKET") ? g_getenv ("S3_BUCKET") : "bench",
+                  "endpoint-uri", endpoint ? endpoint : DEFAULT_S3_ENDPOINT, "force-path-style", true, "region", "us-east-1",
+                  "secret-access-key", g_getenv ("S3_SECRET_KEY") ? g_getenv ("S3_SECRET_KEY") : "minioadmin", "sync", true, NULL);
+    g_object_set (split_mux_sink, "max-size-time", (guint64)config->segment_ms * GST_MSECOND, "send-keyframe-requests", true, "sink", gcs_sink, "muxer", mp4_mux, NULL);
+
+    g_signal_connect (split_mux_sink, "format-location", G_CALLBACK (format_location_callback), &bench);
+    g_signal_connect (mp4_mux, "pad-added", G_CALLBACK (muxer_pad_added), &bench);
+
+    gst_bin_add_many (GST_BIN (pipeline), video_source, video_queue, video_convert, x264_enc,
+    audio_source, audio_queue, audio_convert, audio_resample, avenc_aac,
+    split_mux_sink, NULL);
+
+    if (link_elements_with_video_filter (video_source, video_queue) != TRUE ||
+        gst_element_link_many (video_queue, video_convert, x264_enc, NULL) != TRUE ||
+
+        link_elements_with_audio_filter (audio_source, audio_queue, 48000, 2) != TRUE ||
+        gst_element_link_many (audio_queue, audio_convert, audio_resample, NULL) != TRUE ||
+        link_elements_with_audio_filter (audio_resample, avenc_aac, 16000, 1) != TRUE
+        ) {
+        g_printerr ("Elements could not be linked.\n");
+        gst_object_unref (pipeline);
+        return -1;
+    }
+
+    /* Manually link the splitmuxsink which has "Request" pads */
+    x264enc_src_pad = gst_element_get_static_pad (x264_enc, "src");
+    splitmuxsink_video_pad = gst_element_request_pad_simple (split_mux_sink, "video");
+    avenc_aac_src_pad = gst_element_get_static_pad (avenc_aac, "src");
+    splitmuxsink_audio_pad = gst_element_request_pad_simple (split_mux_sink, "audio_%u");
+
+    if (gst_pad_link (x264enc_src_pad, splitmuxsink_video_pad) != GST_PAD_LINK_OK ||
+    gst_pad_link (avenc_aac_src_pad, splitmuxsink_audio_pad) != GST_PAD_LINK_OK) {
+        g_printerr ("splitmuxsink could not be linked!\n");
+        gst_object_unref (pipeline);
+        return -1;
+    }
+    gst_object_unref (x264enc_src_pad);
+    gst_object_unref (avenc_aac_src_pad);
+
+    /* Stamp frames as they leave the camera stand-in */
+    pad = gst_element_get_static_pad (video_source, "src");
+    gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BUFFER, source_probe, &bench, NULL);
+    gst_object_unref (pad);
+
+    bus = gst_element_get_bus (pipeline);
+    gst_bus_set_sync_handler (bus, glass_sync_handler, &bench, NULL);
+
+    g_print ("segment=%u ms fragment=%u ms: running for %u ms\n", config->segment_ms, config->fragment_ms, config->segment_ms * RUN_SEGMENTS);
+    gst_element_set_state (pipeline, GST_STATE_PLAYING);
+
+    /* Run for RUN_SEGMENTS segments, then EOS so the last fragment is uploaded too */
+    deadline = g_get_monotonic_time () + (gint64) config->segment_ms * RUN_SEGMENTS * 1000;
+    while (!done) {
+        gint64 remaining = deadline - g_get_monotonic_time ();
+
+        if (remaining <= 0 && deadline != G_MAXINT64) {
+            gst_element_send_event (pipeline, gst_event_new_eos ());
+            deadline = G_MAXINT64;
+        }
+        msg = gst_bus_timed_pop_filtered (bus, deadline == G_MAXINT64 ? GST_CLOCK_TIME_NONE : MAX (remaining, 0) * GST_USECOND,
+                                          GST_MESSAGE_ERROR | GST_MESSAGE_EOS);
+        if (msg == NULL) {
+            continue;
+        }
+        if (GST_MESSAGE_TYPE (msg) == GST_MESSAGE_ERROR) {
+            GError *err;
+            gchar *debug_info;
+
+            gst_message_parse_error (msg, &err, &debug_info);
+            g_printerr ("Error received from element %s: %s\n", GST_OBJECT_NAME (msg->src), err->message);
+            g_printerr ("Debugging information: %s\n", debug_info ? debug_info : "none");
+            g_clear_error (&err);
+            g_free (debug_info);
+            ret = -1;
+        }
+        gst_message_unref (msg);
+        done = TRUE;
+    }
+
+    gst_element_set_state (pipeline, GST_STATE_NULL);
+
+    g_array_sort (bench.to_mux_us, compare_latency);
+    g_array_sort (bench.to_durable_us, compare_latency);
+    printf ("{\"segment_ms\":%u,\"fragment_ms\":%u,\"fragments\":%u,\"frames\":%u,"
+            "\"to_mux_p50_ms\":%" G_GINT64_FORMAT ",\"to_mux_p99_ms\":%" G_GINT64_FORMAT ","
+            "\"to_durable_p50_ms\":%" G_GINT64_FORMAT ",\"to_durable_p99_ms\":%" G_GINT64_FORMAT ",\"to_durable_max_ms\":%" G_GINT64_FORMAT "}\n",
+            config->segment_ms, config->fragment_ms, bench.fragments, bench.to_durable_us->len,
+            percentile_ms (bench.to_mux_us, 0.5), percentile_ms (bench.to_mux_us, 0.99),
+            percentile_ms (bench.to_durable_us, 0.5), percentile_ms (bench.to_durable_us, 0.99),
+            percentile_ms (bench.to_durable_us, 1.0));
+    fflush (stdout);
+
+    /* Release the request pads from splitmuxsink, and unref them */
+    gst_element_release_request_pad (split_mux_sink, splitmuxsink_video_pad);
+    gst_object_unref (splitmuxsink_video_pad);
+    gst_element_release_request_pad (split_mux_sink, splitmuxsink_audio_pad);
+    gst_object_unref (splitmuxsink_audio_pad);
+
+    /* Free resources */
+    gst_object_unref (bus);
+    gst_object_unref (pipeline);
+
+    g_queue_clear_full (&bench.closed_fragments, (GDestroyNotify) g_array_unref);
+    g_array_unref (bench.open_frames);
+    g_array_unref (bench.to_mux_us);
+    g_array_unref (bench.to_durable_us);
+    g_hash_table_destroy (bench.capture_by_pts);
+    gst_caps_unref (bench.glass_caps);
+    g_mutex_clear (&bench.lock);
+    return ret;
+}
+
+int main(int argc, char *argv[]) {
+    guint i;
+    int ret = 0;
+
+    /* Initialize GStreamer */
+    gst_init (&argc, &argv);
+
+    for (i = 0; i < G_N_ELEMENTS (configs); i++) {
+        if (run_config (&configs[i]) != 0) {
+            ret = -1;
+        }
+    }
+
+    return ret;
+}
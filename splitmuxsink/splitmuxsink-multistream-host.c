@@ -0,0 +1,1322 @@
+#include <gst/gst.h>
+#include <gst/base/gstbasetransform.h>
+#include <glib-unix.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#define SEGMENT_DURATION 120000 // Duration for each segment in milliseconds
+#define STOP_TIMEOUT 60 // Seconds to wait for EOS after a stop request before forcing teardown
+#define TASK_THREADS_PER_CORE 32 // Worker cap per processor; streaming tasks mostly sleep on clocks and queues. Overridden by the env variable of the same name
+#define MAX_TASKS_PER_STREAM 8 // Per-stream quota: 2 sources, 2 queues, splitmuxsink's 2 internal queues, 2 spare
+#define STATS_INTERVAL 10 // Seconds between task pool statistics
+#define VIDEO_BITRATE 128 // x264_enc bitrate in kbit/s
+#define AUDIO_BITRATE 32 // fdkaac_enc bitrate in kbit/s
+#define PACKET_ARENA_GOP_MS 16667 // x264enc's default key-int-max (250 frames) at 15 fps
+#define PACKET_ARENA_MAX_SLABS 4 // GOP being encoded, GOP queued in splitmuxsink, GOP being written, spare
+
+typedef struct _StreamHost StreamHost;
+
+/*
+ * Workers shared by every pipeline. A GstTask hands the pool one function that
+ * loops until the task is paused, so a worker is busy for the task's lifetime:
+ * the pool accounts for streaming threads, it does not time-slice them. Idle
+ * workers are reused by the next task instead of creating a new thread.
+ *
+ * The worker count is fixed at TASK_THREADS_PER_CORE per processor. A stream
+ * is admitted only if its quota of MAX_TASKS_PER_STREAM still fits, so the
+ * tasks of a stream within its quota always find a worker. A task beyond its
+ * stream's quota is queued on that stream and started when one of the
+ * stream's own tasks ends; queued streams are served round-robin.
+ *
+ * A push cannot fail: gst_task_start has already marked the task running and
+ * the join at teardown waits for it. For the same reason a stream being torn
+ * down has its queued tasks started on threads of their own, they see the
+ * stopped state and return at once.
+ */
+typedef struct {
+    GThreadPool *workers;
+    GMutex lock;
+    guint max_threads;      // Worker cap: processors x TASK_THREADS_PER_CORE
+    guint reserved_tasks;   // Sum of the admitted streams' quotas, never above max_threads
+    guint active_tasks;     // Tasks running on a worker (or on a drain thread)
+    guint peak_tasks;
+    guint queued_tasks;     // Tasks waiting for their stream's quota
+    GQueue waiting;         // StreamTaskPools with queued tasks, served round-robin
+    guint refused_streams;
+    guint deferred_tasks;   // Tasks that had to wait for their stream's quota
+    guint drained_tasks;    // Queued tasks started past the cap at teardown
+    guint64 wakeups;
+    gint64 wakeup_total_us;
+    gint64 wakeup_max_us;
+} SharedTaskPool;
+
+/* Per-stream view of the shared workers, installed on every GstTask of one pipeline */
+typedef struct {
+    GstTaskPool parent;
+    SharedTaskPool *shared;
+    guint stream_id;
+    guint active_tasks;
+    GQueue pending;         // TaskJobs beyond the quota, in push order
+    gboolean draining;      // Torn down: start queued tasks without waiting
+} StreamTaskPool;
+
+typedef struct {
+    GstTaskPoolClass parent_class;
+} StreamTaskPoolClass;
+
+typedef struct {
+    StreamTaskPool *pool;
+    GstTaskPoolFunction func;
+    gpointer user_data;
+    gint64 push_time;
+} TaskJob;
+
+/*
+ * Encoded packets of one encoder are carved out of GOP-sized slabs instead of
+ * one malloc per packet. The GstMemory header is placed in the slab next to
+ * its data, so a packet costs no system allocation at all. splitmuxsink keeps
+ * a whole GOP queued before it picks the fragment to put it in, so a slab
+ * holds about one GOP; it goes back to the stream's free list when its last
+ * packet has been written out by the muxer. The arena is per stream and per
+ * encoder, so its lock is only shared by that encoder and that stream's mux
+ * thread, never by other streams.
+ */
+typedef struct _PacketSlab PacketSlab;
+
+struct _PacketSlab {
+    PacketSlab *next;       // Free list link
+    gsize used;
+    guint live;             // Packets carved from this slab and not freed yet
+    guint8 data[];
+};
+
+typedef struct {
+    GstMemory mem;
+    PacketSlab *slab;       // NULL for shared sub-memories, which are allocated on their own
+    guint8 *data;
+} PacketMemory;
+
+typedef struct {
+    GstAllocator parent;
+    GMutex lock;
+    gsize slab_size;
+    PacketSlab *current;
+    PacketSlab *free_slabs;
+    guint n_slabs;
+    guint peak_slabs;       // Most slabs holding live packets at once
+    guint in_use;
+    guint64 packets;
+    guint64 fallbacks;      // Packets bigger than a slab or beyond PACKET_ARENA_MAX_SLABS
+} PacketArena;
+
+typedef struct {
+    GstAllocatorClass parent_class;
+} PacketArenaClass;
+
+G_DEFINE_TYPE (PacketArena, packet_arena, GST_TYPE_ALLOCATOR);
+
+/* Called with the lock held */
+static void packet_arena_release_slab(PacketArena *self, PacketSlab *slab) {
+    slab->used = 0;
+    self->in_use--;
+    if (slab != self->current) {
+        slab->next = self->free_slabs;
+        self->free_slabs = slab;
+    }
+}
+
+static GstMemory* packet_arena_alloc(GstAllocator *allocator, gsize size, GstAllocationParams *params) {
+    PacketArena *self = (PacketArena *) allocator;
+    gsize align = params->align | gst_memory_alignment | 7;   // At least 8 so the header before the data is aligned
+    gsize header = GST_ROUND_UP_8 (sizeof (PacketMemory));
+    gsize maxsize = size + params->prefix + params->padding;
+    PacketMemory *mem = NULL;
+    PacketSlab *slab;
+    guint8 *data;
+
+    g_mutex_lock (&self->lock);
+    self->packets++;
+    slab = self->current;
+    if (slab != NULL) {
+        data = (guint8 *) (((guintptr) slab->data + slab->used + header + align) & ~(guintptr) align);
+        if (data + maxsize > slab->data + self->slab_size) {
+            /* Start the next slab; this one is recycled as soon as its packets are gone */
+            self->current = NULL;
+            if (slab->live == 0) {
+                packet_arena_release_slab (self, slab);
+            }
+            slab = NULL;
+        }
+    }
+    if (slab == NULL && header + align + maxsize <= self->slab_size) {
+        if (self->free_slabs != NULL) {
+            slab = self->free_slabs;
+            self->free_slabs = slab->next;
+        } else if (self->n_slabs < PACKET_ARENA_MAX_SLABS) {
+            slab = g_malloc (sizeof (PacketSlab) + self->slab_size);
+            self->n_slabs++;
+        }
+        if (slab != NULL) {
+            slab->used = 0;
+            slab->live = 0;
+            self->current = slab;
+            self->in_use++;
+            self->peak_slabs = MAX (self->peak_slabs, self->in_use);
+            data = (guint8 *) (((guintptr) slab->data + header + align) & ~(guintptr) align);
+        }
+    }
+    if (slab != NULL) {
+        mem = (PacketMemory *) (data - header);
+        mem->slab = slab;
+        mem->data = data;
+        slab->used = data + maxsize - slab->data;
+        slab->live++;
+    } else {
+        self->fallbacks++;
+    }
+    g_mutex_unlock (&self->lock);
+
+    if (mem == NULL) {
+        return gst_allocator_alloc (NULL, size, params);
+    }
+
+    gst_memory_init (GST_MEMORY_CAST (mem), params->flags, allocator, NULL, maxsize, align, params->prefix, size);
+    return GST_MEMORY_CAST (mem);
+}
+
+static void packet_arena_free(GstAllocator *allocator, GstMemory *memory) {
+    PacketArena *self = (PacketArena *) allocator;
+    PacketMemory *mem = (PacketMemory *) memory;
+    PacketSlab *slab = mem->slab;
+
+    if (slab == NULL) {
+        g_free (mem);
+        return;
+    }
+
+    g_mutex_lock (&self->lock);
+    if (--slab->live == 0) {
+        if (slab == self->current) {
+            slab->used = 0;
+        } else {
+            packet_arena_release_slab (self, slab);
+        }
+    }
+    g_mutex_unlock (&self->lock);
+}
+
+static gpointer packet_memory_map(GstMemory *memory, gsize maxsize, GstMapFlags flags) {
+    return ((PacketMemory *) memory)->data;
+}
+
+static void packet_memory_unmap(GstMemory *memory) {
+}
+
+static GstMemory* packet_memory_share(GstMemory *memory, gssize offset, gssize size) {
+    PacketMemory *sub = g_new (PacketMemory, 1);
+    GstMemory *parent = memory->parent ? memory->parent : memory;
+
+    if (size == -1) {
+        size = memory->size - offset;
+    }
+    sub->slab = NULL;
+    sub->data = ((PacketMemory *) memory)->data;
+    gst_memory_init (GST_MEMORY_CAST (sub), GST_MINI_OBJECT_FLAGS (parent) | GST_MINI_OBJECT_FLAG_LOCK_READONLY,
+            memory->allocator, parent, memory->maxsize, memory->align, memory->offset + offset, size);
+    return GST_MEMORY_CAST (sub);
+}
+
+/* Every packet holds a ref on the arena, so all slabs are back on the free list (or current) here */
+static void packet_arena_finalize(GObject *object) {
+    PacketArena *self = (PacketArena *) object;
+    PacketSlab *slab;
+
+    while ((slab = self->free_slabs) != NULL) {
+        self->free_slabs = slab->next;
+        g_free (slab);
+    }
+    g_free (self->current);
+    g_mutex_clear (&self->lock);
+    G_OBJECT_CLASS (packet_arena_parent_class)->finalize (object);
+}
+
+static void packet_arena_class_init(PacketArenaClass *klass) {
+    GstAllocatorClass *allocator_class = GST_ALLOCATOR_CLASS (klass);
+
+    allocator_class->alloc = packet_arena_alloc;
+    allocator_class->free = packet_arena_free;
+    G_OBJECT_CLASS (klass)->finalize = packet_arena_finalize;
+}
+
+static void packet_arena_init(PacketArena *self) {
+    GstAllocator *allocator = GST_ALLOCATOR (self);
+
+    allocator->mem_type = "PacketArenaMemory";
+    allocator->mem_map = packet_memory_map;
+    allocator->mem_unmap = packet_memory_unmap;
+    allocator->mem_share = packet_memory_share;
+    g_mutex_init (&self->lock);
+    GST_OBJECT_FLAG_SET (self, GST_ALLOCATOR_FLAG_CUSTOM_ALLOC);
+}
+
+/* A slab fits one GOP at twice the nominal bitrate, to leave room for keyframes and VBR peaks */
+static PacketArena *packet_arena_new(guint bitrate_kbps) {
+    PacketArena *self = g_object_new (packet_arena_get_type (), NULL);
+
+    gst_object_ref_sink (self);
+    self->slab_size = (gsize) bitrate_kbps * 1000 / 8 * PACKET_ARENA_GOP_MS / 1000 * 2;
+    return self;
+}
+
+/* After splitmuxsink answered the encoder's ALLOCATION query, point the encoder at the stream's arena */
+static GstPadProbeReturn packet_arena_allocation_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
+    GstAllocator *allocator = GST_ALLOCATOR (user_data);
+    GstQuery *query = GST_PAD_PROBE_INFO_QUERY (info);
+    GstAllocationParams params;
+
+    if (GST_QUERY_TYPE (query) != GST_QUERY_ALLOCATION) {
+        return GST_PAD_PROBE_OK;
+    }
+
+    gst_allocation_params_init (&params);
+    if (gst_query_get_n_allocation_params (query) > 0) {
+        gst_query_parse_nth_allocation_param (query, 0, NULL, &params);
+        gst_query_set_nth_allocation_param (query, 0, allocator, &params);
+    } else {
+        gst_query_add_allocation_param (query, allocator, &params);
+    }
+
+    return GST_PAD_PROBE_OK;
+}
+
+static void packet_arena_print_stats(const gchar *name, PacketArena *arena) {
+    g_mutex_lock (&arena->lock);
+    g_print (" %s packets=%" G_GUINT64_FORMAT " slabs=%u/%u (peak %u, %" G_GSIZE_FORMAT " KB) fallbacks=%" G_GUINT64_FORMAT,
+            name, arena->packets, arena->in_use, arena->n_slabs, arena->peak_slabs, arena->slab_size / 1024, arena->fallbacks);
+    g_mutex_unlock (&arena->lock);
+}
+
+/*
+ * Stereo 48 kHz to mono 16 kHz in one pass, replacing audioconvert !
+ * audioresample in front of the AAC encoder. The two channels are summed
+ * while converting to float, and a windowed-sinc low-pass is evaluated only at
+ * the input positions that survive decimation (the polyphase form of a
+ * decimator), so no sample is filtered just to be thrown away. One kernel is
+ * generated per supported ratio so the tap count and step are constants the
+ * compiler can unroll, and AVX2 or SSE2 variants are picked at runtime on
+ * x86. Every kernel sums the taps in 8 lanes and reduces them in the same
+ * order, without FMA, so all three give bit-identical output (as long as the
+ * build doesn't contract the scalar loop into FMA, e.g. with -march=native).
+ * DOWNMIX_KERNEL=scalar|sse2 forces one for comparisons.
+ */
+#define DOWNMIX_OUTPUT_RATE 16000
+#define DOWNMIX_TAPS_PER_PHASE 32   // Filter length per unit of ratio: 96 taps at 48 kHz, over 60 dB down at 8 kHz
+#define DOWNMIX_CUTOFF 0.42         // Cutoff as a fraction of the output rate: 6.7 kHz at 16 kHz
+
+typedef void (*DownmixFunc) (const gint16 *in, gfloat *out, guint frames);
+typedef guint (*DecimateFunc) (const gfloat *work, guint total, guint *pos, const gfloat *taps, gint16 *out);
+
+typedef struct {
+    const gchar *name;
+    DownmixFunc downmix;
+    DecimateFunc decimate[3];   // Ratio 2, 3 and 6: 32, 48 and 96 kHz input
+} DownmixKernels;
+
+typedef struct {
+    GstBaseTransform parent;
+    guint ratio;
+    guint n_taps;
+    gfloat *taps;           // Reversed filter with the 1/2 of the downmix folded in, 32-byte aligned
+    DecimateFunc decimate;
+    gfloat *work;           // Filter history followed by the downmixed input of the current buffer
+    guint work_size;
+    guint history;          // Samples carried over from the previous buffer
+} DownmixDecimate;
+
+typedef struct {
+    GstBaseTransformClass parent_class;
+    const DownmixKernels *kernels;
+} DownmixDecimateClass;
+
+static GstStaticPadTemplate downmix_decimate_sink_template = GST_STATIC_PAD_TEMPLATE ("sink", GST_PAD_SINK, GST_PAD_ALWAYS,
+        GST_STATIC_CAPS ("audio/x-raw, format=(string)S16LE, layout=(string)interleaved, rate=(int){ 32000, 48000, 96000 }, channels=(int)2"));
+
+static GstStaticPadTemplate downmix_decimate_src_template = GST_STATIC_PAD_TEMPLATE ("src", GST_PAD_SRC, GST_PAD_ALWAYS,
+        GST_STATIC_CAPS ("audio/x-raw, format=(string)S16LE, layout=(string)interleaved, rate=(int)16000, channels=(int)1"));
+
+static inline gint16 downmix_to_s16(gfloat sample) {
+    return (gint16) CLAMP (lrintf (sample), G_MININT16, G_MAXINT16);
+}
+
+static void downmix_scalar(const gint16 *in, gfloat *out, guint frames) {
+    for (guint i = 0; i < frames; i++) {
+        out[i] = (gfloat) in[2 * i] + (gfloat) in[2 * i + 1];
+    }
+}
+
+/* Same lanes and reduction order as the SIMD kernels: lane l sums x[k + l] * h[k + l] */
+static inline gfloat dot_scalar(const gfloat *x, const gfloat *h, guint n) {
+    gfloat acc[8] = { 0.0f, };
+
+    for (guint k = 0; k < n; k += 8) {
+        for (guint l = 0; l < 8; l++) {
+            acc[l] += x[k + l] * h[k + l];
+        }
+    }
+    return ((acc[0] + acc[4]) + (acc[2] + acc[6])) + ((acc[1] + acc[5]) + (acc[3] + acc[7]));
+}
+
+/* RATIO and TAPS are constants in each instance, the loop below is the whole decimator */
+#define DEFINE_DECIMATE(SUFFIX, ATTR, DOT, RATIO) \
+    ATTR static guint decimate_##SUFFIX##_##RATIO(const gfloat *work, guint total, guint *pos, const gfloat *taps, gint16 *out) { \
+        guint n = 0, p = *pos; \
+        for (; p + DOWNMIX_TAPS_PER_PHASE * RATIO <= total; p += RATIO) { \
+            out[n++] = downmix_to_s16 (DOT (work + p, taps, DOWNMIX_TAPS_PER_PHASE * RATIO)); \
+        } \
+        *pos = p; \
+        return n; \
+    }
+
+DEFINE_DECIMATE (scalar, , dot_scalar, 2)
+DEFINE_DECIMATE (scalar, , dot_scalar, 3)
+DEFINE_DECIMATE (scalar, , dot_scalar, 6)
+
+static const DownmixKernels downmix_kernels_scalar = {
+    "scalar", downmix_scalar, { decimate_scalar_2, decimate_scalar_3, decimate_scalar_6 }
+};
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+
+#define SSE2_ATTR __attribute__ ((target ("sse2")))
+#define AVX2_ATTR __attribute__ ((target ("avx2")))
+
+/* pmaddwd against ones adds each left/right pair into one 32-bit lane */
+SSE2_ATTR static void downmix_sse2(const gint16 *in, gfloat *out, guint frames) {
+    const __m128i ones = _mm_set1_epi16 (1);
+    guint i = 0;
+
+    for (; i + 4 <= frames; i += 4) {
+        __m128i pairs = _mm_madd_epi16 (_mm_loadu_si128 ((const __m128i *) (in + 2 * i)), ones);
+        _mm_storeu_ps (out + i, _mm_cvtepi32_ps (pairs));
+    }
+    downmix_scalar (in + 2 * i, out + i, frames - i);
+}
+
+SSE2_ATTR static inline gfloat dot_sse2(const gfloat *x, const gfloat *h, guint n) {
+    __m128 acc0 = _mm_setzero_ps (), acc1 = _mm_setzero_ps ();
+    __m128 sum;
+
+    // Every tap count is a multiple of 8; taps are aligned, the input window is not
+    for (guint k = 0; k < n; k += 8) {
+        acc0 = _mm_add_ps (acc0, _mm_mul_ps (_mm_loadu_ps (x + k), _mm_load_ps (h + k)));
+        acc1 = _mm_add_ps (acc1, _mm_mul_ps (_mm_loadu_ps (x + k + 4), _mm_load_ps (h + k + 4)));
+    }
+    sum = _mm_add_ps (acc0, acc1);
+    sum = _mm_add_ps (sum, _mm_movehl_ps (sum, sum));
+    sum = _mm_add_ss (sum, _mm_shuffle_ps (sum, sum, 1));
+    return _mm_cvtss_f32 (sum);
+}
+
+AVX2_ATTR static void downmix_avx2(const gint16 *in, gfloat *out, guint frames) {
+    const __m256i ones = _mm256_set1_epi16 (1);
+    guint i = 0;
+
+    for (; i + 8 <= frames; i += 8) {
+        __m256i pairs = _mm256_madd_epi16 (_mm256_loadu_si256 ((const __m256i *) (in + 2 * i)), ones);
+        _mm256_storeu_ps (out + i, _mm256_cvtepi32_ps (pairs));
+    }
+    downmix_scalar (in + 2 * i, out + i, frames - i);
+}
+
+AVX2_ATTR static inline gfloat dot_avx2(const gfloat *x, const gfloat *h, guint n) {
+    __m256 acc = _mm256_setzero_ps ();
+    __m128 sum;
+
+    // Multiply and add round separately, as in the SSE2 and scalar kernels; FMA would round once
+    for (guint k = 0; k < n; k += 8) {
+        acc = _mm256_add_ps (acc, _mm256_mul_ps (_mm256_loadu_ps (x + k), _mm256_load_ps (h + k)));
+    }
+    sum = _mm_add_ps (_mm256_castps256_ps128 (acc), _mm256_extractf128_ps (acc, 1));
+    sum = _mm_add_ps (sum, _mm_movehl_ps (sum, sum));
+    sum = _mm_add_ss (sum, _mm_shuffle_ps (sum, sum, 1));
+    return _mm_cvtss_f32 (sum);
+}
+
+DEFINE_DECIMATE (sse2, SSE2_ATTR, dot_sse2, 2)
+DEFINE_DECIMATE (sse2, SSE2_ATTR, dot_sse2, 3)
+DEFINE_DECIMATE (sse2, SSE2_ATTR, dot_sse2, 6)
+DEFINE_DECIMATE (avx2, AVX2_ATTR, dot_avx2, 2)
+DEFINE_DECIMATE (avx2, AVX2_ATTR, dot_avx2, 3)
+DEFINE_DECIMATE (avx2, AVX2_ATTR, dot_avx2, 6)
+
+static const DownmixKernels downmix_kernels_sse2 = {
+    "sse2", downmix_sse2, { decimate_sse2_2, decimate_sse2_3, decimate_sse2_6 }
+};
+
+static const DownmixKernels downmix_kernels_avx2 = {
+    "avx2", downmix_avx2, { decimate_avx2_2, decimate_avx2_3, decimate_avx2_6 }
+};
+#endif
+
+static const DownmixKernels *downmix_select_kernels(void) {
+    const gchar *forced = g_getenv ("DOWNMIX_KERNEL");
+
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init ();
+    if (g_strcmp0 (forced, "scalar") != 0 && g_strcmp0 (forced, "sse2") != 0 &&
+        __builtin_cpu_supports ("avx2")) {
+        return &downmix_kernels_avx2;
+    }
+    if (g_strcmp0 (forced, "scalar") != 0 && __builtin_cpu_supports ("sse2")) {
+        return &downmix_kernels_sse2;
+    }
+#endif
+    return &downmix_kernels_scalar;
+}
+
+G_DEFINE_TYPE (DownmixDecimate, downmix_decimate, GST_TYPE_BASE_TRANSFORM);
+
+/* Blackman-windowed sinc at the output band edge, unity DC gain for the sum of both channels */
+static void downmix_decimate_design(DownmixDecimate *self) {
+    gdouble cutoff = DOWNMIX_CUTOFF / self->ratio;   // In cycles per input sample
+    gdouble center = (self->n_taps - 1) / 2.0, sum = 0.0;
+    gdouble *h = g_new (gdouble, self->n_taps);
+
+    for (guint k = 0; k < self->n_taps; k++) {
+        gdouble t = k - center;
+        gdouble sinc = t == 0.0 ? 2.0 * cutoff : sin (2.0 * G_PI * cutoff * t) / (G_PI * t);
+        gdouble window = 0.42 - 0.5 * cos (2.0 * G_PI * k / (self->n_taps - 1)) + 0.08 * cos (4.0 * G_PI * k / (self->n_taps - 1));
+        h[k] = sinc * window;
+        sum += h[k];
+    }
+    // Reversed so the kernels walk taps and input in the same direction
+    for (guint k = 0; k < self->n_taps; k++) {
+        self->taps[k] = (gfloat) (0.5 * h[self->n_taps - 1 - k] / sum);
+    }
+    g_free (h);
+}
+
+static void downmix_decimate_reset(DownmixDecimate *self) {
+    // A full window of silence, so the first output is centred on the first input frame's filter delay
+    if (self->n_taps == 0) {
+        return;
+    }
+    self->history = self->n_taps - 1;
+    if (self->history > self->work_size) {
+        self->work = g_renew (gfloat, self->work, self->history);
+        self->work_size = self->history;
+    }
+    memset (self->work, 0, self->history * sizeof (gfloat));
+}
+
+static GstCaps* downmix_decimate_transform_caps(GstBaseTransform *trans, GstPadDirection direction, GstCaps *caps, GstCaps *filter) {
+    GstCaps *other = gst_static_pad_template_get_caps (direction == GST_PAD_SINK ?
+            &downmix_decimate_src_template : &downmix_decimate_sink_template);
+
+    if (filter) {
+        GstCaps *intersection = gst_caps_intersect_full (filter, other, GST_CAPS_INTERSECT_FIRST);
+        gst_caps_unref (other);
+        other = intersection;
+    }
+    return other;
+}
+
+static gboolean downmix_decimate_set_caps(GstBaseTransform *trans, GstCaps *incaps, GstCaps *outcaps) {
+    DownmixDecimate *self = (DownmixDecimate *) trans;
+    const DownmixKernels *kernels = ((DownmixDecimateClass *) G_OBJECT_GET_CLASS (self))->kernels;
+    gint rate;
+
+    if (!gst_structure_get_int (gst_caps_get_structure (incaps, 0), "rate", &rate)) {
+        return FALSE;
+    }
+
+    self->ratio = rate / DOWNMIX_OUTPUT_RATE;
+    self->decimate = kernels->decimate[self->ratio == 2 ? 0 : self->ratio == 3 ? 1 : 2];
+    self->n_taps = DOWNMIX_TAPS_PER_PHASE * self->ratio;
+    free (self->taps);
+    if (posix_memalign ((void **) &self->taps, 32, self->n_taps * sizeof (gfloat)) != 0) {
+        self->taps = NULL;
+        return FALSE;
+    }
+    downmix_decimate_design (self);
+    downmix_decimate_reset (self);
+
+    GST_INFO_OBJECT (self, "%d Hz stereo -> %d Hz mono, %u taps, %s kernels", rate, DOWNMIX_OUTPUT_RATE, self->n_taps, kernels->name);
+    return TRUE;
+}
+
+/* Upper bound: the carried-over history can complete at most one more output */
+static gboolean downmix_decimate_transform_size(GstBaseTransform *trans, GstPadDirection direction, GstCaps *caps, gsize size,
+        GstCaps *othercaps, gsize *othersize) {
+    DownmixDecimate *self = (DownmixDecimate *) trans;
+
+    if (direction != GST_PAD_SINK || self->ratio == 0) {
+        return FALSE;
+    }
+    *othersize = (size / (2 * sizeof (gint16)) / self->ratio + 1) * sizeof (gint16);
+    return TRUE;
+}
+
+static GstFlowReturn downmix_decimate_transform(GstBaseTransform *trans, GstBuffer *inbuf, GstBuffer *outbuf) {
+    DownmixDecimate *self = (DownmixDecimate *) trans;
+    const DownmixKernels *kernels = ((DownmixDecimateClass *) G_OBJECT_GET_CLASS (self))->kernels;
+    GstMapInfo in_map, out_map;
+    guint frames, total, pos = 0, produced;
+
+    if (GST_BUFFER_IS_DISCONT (inbuf)) {
+        downmix_decimate_reset (self);
+    }
+
+    gst_buffer_map (inbuf, &in_map, GST_MAP_READ);
+    frames = in_map.size / (2 * sizeof (gint16));
+    total = self->history + frames;
+
+    // Grows to the largest buffer seen once, then stays
+    if (total > self->work_size) {
+        self->work = g_renew (gfloat, self->work, total);
+        self->work_size = total;
+    }
+    kernels->downmix ((const gint16 *) in_map.data, self->work + self->history, frames);
+    gst_buffer_unmap (inbuf, &in_map);
+
+    gst_buffer_map (outbuf, &out_map, GST_MAP_WRITE);
+    produced = self->decimate (self->work, total, &pos, self->taps, (gint16 *) out_map.data);
+    gst_buffer_unmap (outbuf, &out_map);
+    gst_buffer_set_size (outbuf, produced * sizeof (gint16));
+
+    // Keep everything from the next output's first tap on
+    self->history = total - pos;
+    memmove (self->work, self->work + pos, self->history * sizeof (gfloat));
+
+    return GST_FLOW_OK;
+}
+
+static gboolean downmix_decimate_stop(GstBaseTransform *trans) {
+    DownmixDecimate *self = (DownmixDecimate *) trans;
+
+    g_clear_pointer (&self->work, g_free);
+    self->work_size = 0;
+    free (self->taps);
+    self->taps = NULL;
+    self->ratio = 0;
+    self->n_taps = 0;
+    return TRUE;
+}
+
+static gboolean downmix_decimate_sink_event(GstBaseTransform *trans, GstEvent *event) {
+    if (GST_EVENT_TYPE (event) == GST_EVENT_FLUSH_STOP) {
+        downmix_decimate_reset ((DownmixDecimate *) trans);
+    }
+    return GST_BASE_TRANSFORM_CLASS (downmix_decimate_parent_class)->sink_event (trans, event);
+}
+
+static void downmix_decimate_class_init(DownmixDecimateClass *klass) {
+    GstElementClass *element_class = GST_ELEMENT_CLASS (klass);
+    GstBaseTransformClass *transform_class = GST_BASE_TRANSFORM_CLASS (klass);
+
+    gst_element_class_add_static_pad_template (element_class, &downmix_decimate_sink_template);
+    gst_element_class_add_static_pad_template (element_class, &downmix_decimate_src_template);
+    gst_element_class_set_static_metadata (element_class, "Downmix and decimate", "Filter/Converter/Audio",
+            "Stereo to mono downmix fused with an integer-ratio FIR decimator to 16 kHz", "gstreamer-vm-test");
+
+    transform_class->transform_caps = downmix_decimate_transform_caps;
+    transform_class->set_caps = downmix_decimate_set_caps;
+    transform_class->transform_size = downmix_decimate_transform_size;
+    transform_class->transform = downmix_decimate_transform;
+    transform_class->stop = downmix_decimate_stop;
+    transform_class->sink_event = downmix_decimate_sink_event;
+
+    klass->kernels = downmix_select_kernels ();
+}
+
+static void downmix_decimate_init(DownmixDecimate *self) {
+}
+
+typedef struct {
+    guint id;
+    StreamHost *host;
+    GstElement *pipeline;
+    GstElement *video_source;
+    GstElement *video_queue;
+    GstElement *video_convert;
+    GstElement *x264_enc;
+    GstElement *audio_source;
+    GstElement *audio_queue;
+    GstElement *audio_downmix;
+    GstElement *fdkaac_enc;
+    GstElement *split_mux_sink;
+    GstElement *gcs_sink;
+    GstPad *splitmuxsink_video_pad;
+    GstPad *splitmuxsink_audio_pad;
+    StreamTaskPool *task_pool;
+    PacketArena *video_arena;
+    PacketArena *audio_arena;
+    guint bus_watch_id;
+    guint stop_timeout_id;
+    gboolean reserved;      // Holds a quota of MAX_TASKS_PER_STREAM workers of the shared pool
+    gboolean stopping;
+} MediaPush;
+
+struct _StreamHost {
+    GMainLoop *loop;
+    GstClock *clock;        // Shared by every pipeline
+    GHashTable *streams;    // stream id -> MediaPush
+    SharedTaskPool task_pool;
+    guint next_id;
+    gboolean shutting_down;
+};
+
+// Function to get the current time in milliseconds since the Unix epoch
+static long long current_time_millis() {
+    struct timeval time_now;
+    gettimeofday(&time_now, NULL);
+    return (long long)(time_now.tv_sec) * 1000 + (long long)(time_now.tv_usec) / 1000;
+}
+
+static gchar* format_location_callback(GstElement *splitmuxsink, guint fragment_id, gpointer user_data) {
+    MediaPush *self = (MediaPush *) user_data;
+
+    // Get the (Unix epoch time) for start and end time
+    long long start_time = current_time_millis();
+    long long end_time = start_time + SEGMENT_DURATION;
+
+    // Every stream writes under its own prefix
+    gchar *filename = g_strdup_printf("vm/%u/%lld_%lld.mp4", self->id, start_time, end_time);
+
+    g_object_set(self->gcs_sink, "key", filename, NULL);  // Set the key dynamically
+
+    return filename;
+}
+
+static gboolean link_elements_with_video_filter (GstElement *element1, GstElement *element2)
+{
+    gboolean link_ok;
+    GstCaps *caps;
+
+    caps = gst_caps_new_simple ("video/x-raw",
+            "format", G_TYPE_STRING, "I420",
+            "width", G_TYPE_INT, 360,
+            "height", G_TYPE_INT, 640,
+            "framerate", GST_TYPE_FRACTION, 15, 1,
+            NULL);
+
+    link_ok = gst_element_link_filtered (element1, element2, caps);
+    gst_caps_unref (caps);
+
+    if (!link_ok) {
+        g_warning ("Failed to link element1 and element2 using video filter!");
+    }
+
+    return link_ok;
+}
+
+static gboolean link_elements_with_audio_filter (GstElement *element1, GstElement *element2, int sampleRate, int numChannels)
+{
+    gboolean link_ok;
+    GstCaps *caps;
+
+    caps = gst_caps_new_simple ("audio/x-raw",
+            "rate", G_TYPE_INT, sampleRate,
+            "channels", G_TYPE_INT, numChannels,
+            NULL);
+
+    link_ok = gst_element_link_filtered (element1, element2, caps);
+    gst_caps_unref (caps);
+
+    if (!link_ok) {
+        g_warning ("Failed to link element1 and element2 using audio filter!");
+    }
+
+    return link_ok;
+}
+
+G_DEFINE_TYPE (StreamTaskPool, stream_task_pool, GST_TYPE_TASK_POOL);
+
+static void shared_task_worker(gpointer data, gpointer user_data);
+
+/* Hand a job to a worker; the lock is held and a worker is known to be free */
+static void shared_task_pool_start_locked(SharedTaskPool *shared, TaskJob *job) {
+    shared->active_tasks++;
+    shared->peak_tasks = MAX (shared->peak_tasks, shared->active_tasks);
+    job->pool->active_tasks++;
+    // Cannot fail for an exclusive pool that already has threads, and cannot queue below max_threads
+    g_thread_pool_push (shared->workers, job, NULL);
+}
+
+/* Start queued tasks of streams that are back under their quota, one per stream in turn */
+static void shared_task_pool_dispatch_locked(SharedTaskPool *shared) {
+    guint skipped = 0;
+
+    while (shared->active_tasks < shared->max_threads && skipped < g_queue_get_length (&shared->waiting)) {
+        StreamTaskPool *stream = g_queue_pop_head (&shared->waiting);
+
+        if (stream->active_tasks >= MAX_TASKS_PER_STREAM) {
+            g_queue_push_tail (&shared->waiting, stream);
+            skipped++;
+            continue;
+        }
+        skipped = 0;
+        shared->queued_tasks--;
+        shared_task_pool_start_locked (shared, g_queue_pop_head (&stream->pending));
+        if (!g_queue_is_empty (&stream->pending)) {
+            g_queue_push_tail (&shared->waiting, stream);
+        }
+    }
+}
+
+/* Runs on a shared worker: measure how long the task waited for a thread, then run it */
+static void shared_task_worker(gpointer data, gpointer user_data) {
+    TaskJob *job = (TaskJob *) data;
+    SharedTaskPool *shared = (SharedTaskPool *) user_data;
+    gint64 wakeup_us = g_get_monotonic_time () - job->push_time;
+
+    g_mutex_lock (&shared->lock);
+    shared->wakeups++;
+    shared->wakeup_total_us += wakeup_us;
+    shared->wakeup_max_us = MAX (shared->wakeup_max_us, wakeup_us);
+    g_mutex_unlock (&shared->lock);
+
+    job->func (job->user_data);
+
+    g_mutex_lock (&shared->lock);
+    shared->active_tasks--;
+    job->pool->active_tasks--;
+    shared_task_pool_dispatch_locked (shared);
+    g_mutex_unlock (&shared->lock);
+
+    gst_object_unref (job->pool);
+    g_free (job);
+}
+
+static gpointer drain_thread_func(gpointer data) {
+    TaskJob *job = (TaskJob *) data;
+
+    shared_task_worker (job, job->pool->shared);
+    return NULL;
+}
+
+/* Run a job on a thread of its own, outside the cap; the lock is held */
+static void shared_task_pool_drain_job_locked(SharedTaskPool *shared, TaskJob *job) {
+    shared->active_tasks++;
+    shared->drained_tasks++;
+    job->pool->active_tasks++;
+    g_thread_unref (g_thread_new ("task-drain", drain_thread_func, job));
+}
+
+static gpointer stream_task_pool_push(GstTaskPool *pool, GstTaskPoolFunction func, gpointer user_data, GError **error) {
+    StreamTaskPool *self = (StreamTaskPool *) pool;
+    SharedTaskPool *shared = self->shared;
+    TaskJob *job;
+
+    job = g_new0 (TaskJob, 1);
+    job->pool = gst_object_ref (self);
+    job->func = func;
+    job->user_data = user_data;
+    job->push_time = g_get_monotonic_time ();
+
+    g_mutex_lock (&shared->lock);
+    if (self->draining) {
+        shared_task_pool_drain_job_locked (shared, job);
+    } else if (self->active_tasks < MAX_TASKS_PER_STREAM && g_queue_is_empty (&self->pending)) {
+        // Within the quota of an admitted stream, so a worker is free
+        shared_task_pool_start_locked (shared, job);
+    } else {
+        shared->queued_tasks++;
+        shared->deferred_tasks++;
+        if (g_queue_is_empty (&self->pending)) {
+            g_queue_push_tail (&shared->waiting, self);
+        }
+        g_queue_push_tail (&self->pending, job);
+        g_warning ("Stream %u runs %u tasks, queueing one beyond its quota of %d", self->stream_id, self->active_tasks, MAX_TASKS_PER_STREAM);
+    }
+    g_mutex_unlock (&shared->lock);
+
+    return NULL;
+}
+
+/* Workers belong to the host, there is nothing to prepare or clean up per stream */
+static void stream_task_pool_prepare(GstTaskPool *pool, GError **error) {
+}
+
+static void stream_task_pool_cleanup(GstTaskPool *pool) {
+}
+
+/* GstTask waits for its function to return before joining, so there is no thread handle to join */
+static void stream_task_pool_join(GstTaskPool *pool, gpointer id) {
+}
+
+static void stream_task_pool_class_init(StreamTaskPoolClass *klass) {
+    GstTaskPoolClass *task_pool_class = (GstTaskPoolClass *) klass;
+
+    task_pool_class->prepare = stream_task_pool_prepare;
+    task_pool_class->cleanup = stream_task_pool_cleanup;
+    task_pool_class->push = stream_task_pool_push;
+    task_pool_class->join = stream_task_pool_join;
+}
+
+static void stream_task_pool_init(StreamTaskPool *self) {
+    g_queue_init (&self->pending);
+}
+
+static StreamTaskPool *stream_task_pool_new(SharedTaskPool *shared, guint stream_id) {
+    StreamTaskPool *self = g_object_new (stream_task_pool_get_type (), NULL);
+
+    self->shared = shared;
+    self->stream_id = stream_id;
+
+    return self;
+}
+
+/* Before the pipeline goes to NULL: its joins must not wait behind the quota */
+static void stream_task_pool_drain(StreamTaskPool *self) {
+    SharedTaskPool *shared = self->shared;
+    TaskJob *job;
+
+    g_mutex_lock (&shared->lock);
+    self->draining = TRUE;
+    if (!g_queue_is_empty (&self->pending)) {
+        g_queue_remove (&shared->waiting, self);
+    }
+    while ((job = g_queue_pop_head (&self->pending))) {
+        shared->queued_tasks--;
+        shared_task_pool_drain_job_locked (shared, job);
+    }
+    g_mutex_unlock (&shared->lock);
+}
+
+static gboolean shared_task_pool_init(SharedTaskPool *shared) {
+    GError *err = NULL;
+    const gchar *per_core = g_getenv ("TASK_THREADS_PER_CORE");
+    guint threads_per_core = per_core ? (guint) atoi (per_core) : TASK_THREADS_PER_CORE;
+
+    g_mutex_init (&shared->lock);
+    g_queue_init (&shared->waiting);
+    shared->max_threads = g_get_num_processors () * MAX (threads_per_core, 1);
+    // At least one stream must fit
+    shared->max_threads = MAX (shared->max_threads, MAX_TASKS_PER_STREAM);
+    shared->workers = g_thread_pool_new (shared_task_worker, shared, shared->max_threads, FALSE, &err);
+    if (!shared->workers) {
+        g_printerr ("Could not create the shared task pool: %s\n", err->message);
+        g_error_free (err);
+        return FALSE;
+    }
+    // Keep idle workers around so restarted streams do not create new threads
+    g_thread_pool_set_max_unused_threads (shared->max_threads);
+
+    g_print ("Shared task pool: %u workers, up to %u streams x %d tasks\n",
+            shared->max_threads, shared->max_threads / MAX_TASKS_PER_STREAM, MAX_TASKS_PER_STREAM);
+    return TRUE;
+}
+
+/* Admit a stream before it is built if its quota still fits in the workers, or refuse it */
+static gboolean shared_task_pool_reserve(SharedTaskPool *shared) {
+    g_mutex_lock (&shared->lock);
+    if (shared->reserved_tasks + MAX_TASKS_PER_STREAM > shared->max_threads) {
+        shared->refused_streams++;
+        g_mutex_unlock (&shared->lock);
+        return FALSE;
+    }
+    shared->reserved_tasks += MAX_TASKS_PER_STREAM;
+    g_mutex_unlock (&shared->lock);
+    return TRUE;
+}
+
+/* Called once the stream's tasks have been joined */
+static void shared_task_pool_release(SharedTaskPool *shared) {
+    g_mutex_lock (&shared->lock);
+    shared->reserved_tasks -= MAX_TASKS_PER_STREAM;
+    g_mutex_unlock (&shared->lock);
+}
+
+static void shared_task_pool_print_stats(StreamHost *host) {
+    SharedTaskPool *shared = &host->task_pool;
+    GHashTableIter iter;
+    gpointer value;
+
+    g_mutex_lock (&shared->lock);
+    g_print ("Task pool: active=%u peak=%u queued=%u reserved=%u/%u threads=%u refused=%u deferred=%u drained=%u wakeup avg=%" G_GINT64_FORMAT "us max=%" G_GINT64_FORMAT "us\n",
+            shared->active_tasks, shared->peak_tasks, shared->queued_tasks, shared->reserved_tasks, shared->max_threads,
+            g_thread_pool_get_num_threads (shared->workers),
+            shared->refused_streams, shared->deferred_tasks, shared->drained_tasks,
+            shared->wakeups ? shared->wakeup_total_us / (gint64) shared->wakeups : 0, shared->wakeup_max_us);
+    g_hash_table_iter_init (&iter, host->streams);
+    while (g_hash_table_iter_next (&iter, NULL, &value)) {
+        MediaPush *self = (MediaPush *) value;
+        if (self->task_pool) {
+            g_print ("  stream %u: %u task(s), %u queued", self->id, self->task_pool->active_tasks,
+                    g_queue_get_length (&self->task_pool->pending));
+            packet_arena_print_stats ("video", self->video_arena);
+            packet_arena_print_stats ("audio", self->audio_arena);
+            g_print ("\n");
+        }
+    }
+    g_mutex_unlock (&shared->lock);
+}
+
+static gboolean stats_callback(gpointer user_data) {
+    shared_task_pool_print_stats ((StreamHost *) user_data);
+    return G_SOURCE_CONTINUE;
+}
+
+/* Hand every new GstTask of the pipeline to the stream's view of the shared pool */
+static GstBusSyncReply stream_sync_handler(GstBus *bus, GstMessage *msg, gpointer user_data) {
+    MediaPush *self = (MediaPush *) user_data;
+
+    if (GST_MESSAGE_TYPE (msg) == GST_MESSAGE_STREAM_STATUS) {
+        GstStreamStatusType type;
+        GstElement *owner;
+        const GValue *val;
+
+        gst_message_parse_stream_status (msg, &type, &owner);
+        val = gst_message_get_stream_status_object (msg);
+        if (type == GST_STREAM_STATUS_TYPE_CREATE && val != NULL && G_VALUE_TYPE (val) == GST_TYPE_TASK) {
+            gst_task_set_pool (GST_TASK (g_value_get_object (val)), GST_TASK_POOL (self->task_pool));
+        }
+    }
+
+    return GST_BUS_PASS;
+}
+
+/* Same element graph as run_splitmuxsink in splitmuxsink-awss3sink-sigint.c, without gst_init and with fdkaacenc for audio */
+static gboolean build_splitmuxsink(MediaPush *self) {
+    gchar *pipeline_name = g_strdup_printf ("stream-%u", self->id);
+    GstPad *x264enc_src_pad, *fdkaacenc_src_pad;
+
+    /* Create the elements */
+    self->video_source = gst_element_factory_make ("videotestsrc", "video_source");
+    self->video_queue = gst_element_factory_make ("queue", "video_queue");
+    self->video_convert = gst_element_factory_make ("videoconvert", "video_convert");
+    self->x264_enc = gst_element_factory_make ("x264enc", "x264_enc");
+
+    self->audio_source = gst_element_factory_make ("audiotestsrc", "audio_source");
+    self->audio_queue = gst_element_factory_make ("queue", "audio_queue");
+    self->audio_downmix = gst_element_factory_make ("downmixdecimate", "audio_downmix");   // Replaces audioconvert ! audioresample
+    self->fdkaac_enc = gst_element_factory_make ("fdkaacenc", "fdkaac_enc");   // Not avenc_aac: it wraps libav's packets and ignores downstream allocators
+
+    self->split_mux_sink = gst_element_factory_make ("splitmuxsink", "split_mux_sink");
+    self->gcs_sink = gst_element_factory_make ("awss3sink", "gcs_sink");
+
+    /* Create the empty pipeline */
+    self->pipeline = gst_pipeline_new (pipeline_name);
+    g_free (pipeline_name);
+
+    if (!self->pipeline || !self->video_source || !self->video_queue || !self->video_convert || !self->x264_enc ||
+    !self->audio_source || !self->audio_queue || !self->audio_downmix || !self->fdkaac_enc ||
+    !self->split_mux_sink || !self->gcs_sink) {
+        g_printerr ("[stream %u] Not all elements could be created.\n", self->id);
+        return FALSE;
+    }
+
+    /* Configure elements */
+    g_object_set (self->video_source, "is-live", true, NULL);
+    g_object_set (self->audio_source, "is-live", true, NULL);
+    g_object_set (self->x264_enc, "speed-preset", 1, "bitrate", VIDEO_BITRATE, NULL);
+    g_object_set (self->fdkaac_enc, "bitrate", AUDIO_BITRATE * 1000, NULL);   // bit/s: the 256 copied from the avenc_aac programs was 256 bit/s, not kbit/s
+    g_object_set (self->gcs_sink, "access-key", "add-here", "bucket", "add-here", "endpoint-uri", "https://storage.googleapis.com", "force-path-style", true, "region", "add-here", "secret-access-key", "add-here", "sync", true,  NULL);
+    g_object_set(self->split_mux_sink, "max-size-time", (guint64)SEGMENT_DURATION * GST_MSECOND, "send-keyframe-requests", true, "sink", self->gcs_sink, NULL);
+
+    // Connect the format-location signal to generate dynamic filenames
+    g_signal_connect(self->split_mux_sink, "format-location", G_CALLBACK(format_location_callback), self);
+
+    /* Every pipeline runs against the host's clock instead of electing its own */
+    gst_pipeline_use_clock (GST_PIPELINE (self->pipeline), self->host->clock);
+
+    gst_bin_add_many (GST_BIN (self->pipeline), self->video_source, self->video_queue, self->video_convert, self->x264_enc,
+    self->audio_source, self->audio_queue, self->audio_downmix, self->fdkaac_enc,
+    self->split_mux_sink, NULL);
+
+    if (link_elements_with_video_filter (self->video_source, self->video_queue) != TRUE ||
+        gst_element_link_many (self->video_queue, self->video_convert, self->x264_enc, NULL) != TRUE ||
+
+        link_elements_with_audio_filter (self->audio_source, self->audio_queue, 48000, 2) != TRUE ||
+        gst_element_link (self->audio_queue, self->audio_downmix) != TRUE ||
+        link_elements_with_audio_filter (self->audio_downmix, self->fdkaac_enc, 16000, 1) != TRUE) {
+        g_printerr ("[stream %u] Elements could not be linked.\n", self->id);
+        return FALSE;
+    }
+
+    /* Manually link the splitmuxsink which has "Request" pads */
+    x264enc_src_pad = gst_element_get_static_pad (self->x264_enc, "src");
+    self->splitmuxsink_video_pad = gst_element_request_pad_simple (self->split_mux_sink, "video");
+
+    fdkaacenc_src_pad = gst_element_get_static_pad (self->fdkaac_enc, "src");
+    self->splitmuxsink_audio_pad = gst_element_request_pad_simple (self->split_mux_sink, "audio_%u");
+
+    if (gst_pad_link (x264enc_src_pad, self->splitmuxsink_video_pad) != GST_PAD_LINK_OK ||
+    gst_pad_link (fdkaacenc_src_pad, self->splitmuxsink_audio_pad) != GST_PAD_LINK_OK) {
+        g_printerr ("[stream %u] splitmuxsink could not be linked!\n", self->id);
+        gst_object_unref (x264enc_src_pad);
+        gst_object_unref (fdkaacenc_src_pad);
+        return FALSE;
+    }
+
+    /* Encoded packets come from the stream's own slabs */
+    gst_pad_add_probe (x264enc_src_pad, GST_PAD_PROBE_TYPE_QUERY_DOWNSTREAM | GST_PAD_PROBE_TYPE_PULL, packet_arena_allocation_probe, self->video_arena, NULL);
+    gst_pad_add_probe (fdkaacenc_src_pad, GST_PAD_PROBE_TYPE_QUERY_DOWNSTREAM | GST_PAD_PROBE_TYPE_PULL, packet_arena_allocation_probe, self->audio_arena, NULL);
+    gst_object_unref (x264enc_src_pad);
+    gst_object_unref (fdkaacenc_src_pad);
+
+    return TRUE;
+}
+
+/* Stop the pipeline and release everything; the stream is removed from the host */
+static void teardown_stream(MediaPush *self) {
+    StreamHost *host = self->host;
+
+    if (self->bus_watch_id) {
+        g_source_remove (self->bus_watch_id);
+    }
+    if (self->stop_timeout_id) {
+        g_source_remove (self->stop_timeout_id);
+    }
+
+    if (self->task_pool) {
+        stream_task_pool_drain (self->task_pool);
+    }
+    if (self->pipeline) {
+        gst_element_set_state (self->pipeline, GST_STATE_NULL);
+        if (self->splitmuxsink_video_pad) {
+            gst_element_release_request_pad (self->split_mux_sink, self->splitmuxsink_video_pad);
+            gst_object_unref (self->splitmuxsink_video_pad);
+        }
+        if (self->splitmuxsink_audio_pad) {
+            gst_element_release_request_pad (self->split_mux_sink, self->splitmuxsink_audio_pad);
+            gst_object_unref (self->splitmuxsink_audio_pad);
+        }
+        gst_object_unref (self->pipeline);
+    }
+    if (self->task_pool) {
+        gst_object_unref (self->task_pool);
+    }
+    // The pipeline is in NULL, so every task of the stream has been joined
+    if (self->reserved) {
+        shared_task_pool_release (&host->task_pool);
+    }
+    /* Packets still referenced elsewhere keep their arena alive */
+    gst_clear_object (&self->video_arena);
+    gst_clear_object (&self->audio_arena);
+
+    g_print ("[stream %u] Torn down, %u stream(s) running\n", self->id, g_hash_table_size (host->streams) - 1);
+    g_hash_table_remove (host->streams, GUINT_TO_POINTER (self->id));
+
+    if (host->shutting_down && g_hash_table_size (host->streams) == 0) {
+        g_main_loop_quit (host->loop);
+    }
+}
+
+static gboolean stop_timeout_callback(gpointer user_data) {
+    MediaPush *self = (MediaPush *) user_data;
+
+    g_printerr ("[stream %u] No EOS after %d sec, forcing teardown\n", self->id, STOP_TIMEOUT);
+    self->stop_timeout_id = 0;
+    teardown_stream (self);
+
+    return G_SOURCE_REMOVE;
+}
+
+static gboolean stream_bus_callback(GstBus *bus, GstMessage *msg, gpointer user_data) {
+    MediaPush *self = (MediaPush *) user_data;
+
+    switch (GST_MESSAGE_TYPE (msg)) {
+        case GST_MESSAGE_EOS:
+            g_print ("[stream %u] EOS received\n", self->id);
+            self->bus_watch_id = 0;
+            teardown_stream (self);
+            return G_SOURCE_REMOVE;
+        case GST_MESSAGE_ERROR: {
+            GError *err;
+            gchar *debug;
+            gst_message_parse_error (msg, &err, &debug);
+            g_printerr ("[stream %u] Error from %s: %s\n", self->id, GST_OBJECT_NAME (GST_MESSAGE_SRC (msg)), err->message);
+            g_error_free (err);
+            g_free (debug);
+            // An error only takes down its own stream
+            self->bus_watch_id = 0;
+            teardown_stream (self);
+            return G_SOURCE_REMOVE;
+        }
+        default:
+            break;
+    }
+
+    return G_SOURCE_CONTINUE;
+}
+
+static void free_stream(gpointer data) {
+    g_free (data);
+}
+
+static MediaPush *host_start_stream(StreamHost *host) {
+    MediaPush *self;
+    GstBus *bus;
+
+    if (!shared_task_pool_reserve (&host->task_pool)) {
+        g_printerr ("Refusing to start a stream: %u stream(s) already hold the %u workers\n",
+                g_hash_table_size (host->streams), host->task_pool.max_threads);
+        return NULL;
+    }
+
+    self = g_new0 (MediaPush, 1);
+    self->reserved = TRUE;
+    self->id = host->next_id++;
+    self->host = host;
+    self->task_pool = stream_task_pool_new (&host->task_pool, self->id);
+    self->video_arena = packet_arena_new (VIDEO_BITRATE);
+    self->audio_arena = packet_arena_new (AUDIO_BITRATE);
+    g_hash_table_insert (host->streams, GUINT_TO_POINTER (self->id), self);
+
+    if (!build_splitmuxsink (self)) {
+        teardown_stream (self);
+        return NULL;
+    }
+
+    bus = gst_element_get_bus (self->pipeline);
+    gst_bus_set_sync_handler (bus, stream_sync_handler, self, NULL);
+    self->bus_watch_id = gst_bus_add_watch (bus, stream_bus_callback, self);
+    gst_object_unref (bus);
+
+    if (gst_element_set_state (self->pipeline, GST_STATE_PLAYING) == GST_STATE_CHANGE_FAILURE) {
+        g_printerr ("[stream %u] Failed to start the pipeline\n", self->id);
+        teardown_stream (self);
+        return NULL;
+    }
+
+    g_print ("[stream %u] Pipeline started, %u stream(s) running\n", self->id, g_hash_table_size (host->streams));
+    return self;
+}
+
+/* Send EOS to the splitmuxsink pads so the current fragment is finalized and uploaded */
+static void host_stop_stream(MediaPush *self) {
+    if (self->stopping) {
+        return;
+    }
+    self->stopping = TRUE;
+
+    g_print ("[stream %u] Sending EOS to splitmuxsink pads...\n", self->id);
+    gst_pad_send_event (self->splitmuxsink_video_pad, gst_event_new_eos ());
+    gst_pad_send_event (self->splitmuxsink_audio_pad, gst_event_new_eos ());
+    self->stop_timeout_id = g_timeout_add_seconds (STOP_TIMEOUT, stop_timeout_callback, self);
+}
+
+static void host_stop_all(StreamHost *host) {
+    GList *streams = g_hash_table_get_values (host->streams);
+
+    host->shutting_down = TRUE;
+    if (streams == NULL) {
+        g_main_loop_quit (host->loop);
+    }
+    for (GList *l = streams; l != NULL; l = l->next) {
+        host_stop_stream ((MediaPush *) l->data);
+    }
+    g_list_free (streams);
+}
+
+static gboolean sigint_callback(gpointer user_data) {
+    StreamHost *host = (StreamHost *) user_data;
+
+    g_print ("Received SIGINT, stopping %u stream(s)\n", g_hash_table_size (host->streams));
+    host_stop_all (host);
+
+    return G_SOURCE_CONTINUE;
+}
+
+/*
+ * Commands, one per line on stdin:
+ *   start [count]  - start count (default 1) new streams
+ *   stop <id>      - finalize and tear down one stream
+ *   list           - print the running streams
+ *   stats          - print the shared task pool statistics
+ *   quit           - stop every stream and exit
+ */
+static gboolean stdin_callback(GIOChannel *channel, GIOCondition condition, gpointer user_data) {
+    StreamHost *host = (StreamHost *) user_data;
+    gchar *line = NULL;
+    gchar **args;
+
+    if (g_io_channel_read_line (channel, &line, NULL, NULL, NULL) != G_IO_STATUS_NORMAL) {
+        // stdin closed, keep running until SIGINT
+        g_free (line);
+        return G_SOURCE_REMOVE;
+    }
+
+    args = g_strsplit (g_strstrip (line), " ", -1);
+    if (g_strcmp0 (args[0], "start") == 0) {
+        int count = args[1] ? atoi (args[1]) : 1;
+        for (int i = 0; i < count && !host->shutting_down; i++) {
+            host_start_stream (host);
+        }
+    } else if (g_strcmp0 (args[0], "stop") == 0 && args[1] != NULL) {
+        MediaPush *self = g_hash_table_lookup (host->streams, GUINT_TO_POINTER ((guint) atoi (args[1])));
+        if (self) {
+            host_stop_stream (self);
+        } else {
+            g_printerr ("No stream %s\n", args[1]);
+        }
+    } else if (g_strcmp0 (args[0], "list") == 0) {
+        GHashTableIter iter;
+        gpointer value;
+        g_hash_table_iter_init (&iter, host->streams);
+        while (g_hash_table_iter_next (&iter, NULL, &value)) {
+            MediaPush *self = (MediaPush *) value;
+            g_print ("stream %u%s\n", self->id, self->stopping ? " (stopping)" : "");
+        }
+    } else if (g_strcmp0 (args[0], "stats") == 0) {
+        shared_task_pool_print_stats (host);
+    } else if (g_strcmp0 (args[0], "quit") == 0) {
+        host_stop_all (host);
+    } else if (args[0][0] != '\0') {
+        g_printerr ("Unknown command '%s'\n", args[0]);
+    }
+
+    g_strfreev (args);
+    g_free (line);
+    return G_SOURCE_CONTINUE;
+}
+
+int main(int argc, char *argv[]) {
+    StreamHost host = {0};
+    GIOChannel *stdin_channel;
+    int initial_streams = argc > 1 ? atoi (argv[1]) : 1;
+
+    /* Initialize GStreamer once: the registry is shared by every stream */
+    gst_init (&argc, &argv);
+    gst_element_register (NULL, "downmixdecimate", GST_RANK_NONE, downmix_decimate_get_type ());
+
+    /* Streaming tasks of all pipelines run on one bounded set of workers */
+    if (!shared_task_pool_init (&host.task_pool)) {
+        return -1;
+    }
+
+    host.loop = g_main_loop_new (NULL, FALSE);
+    host.clock = gst_system_clock_obtain ();
+    host.streams = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, free_stream);
+
+    for (int i = 0; i < initial_streams; i++) {
+        host_start_stream (&host);
+    }
+
+    g_timeout_add_seconds (STATS_INTERVAL, stats_callback, &host);
+    g_unix_signal_add (SIGINT, sigint_callback, &host);
+    stdin_channel = g_io_channel_unix_new (STDIN_FILENO);
+    g_io_add_watch (stdin_channel, G_IO_IN | G_IO_HUP, stdin_callback, &host);
+
+    g_main_loop_run (host.loop);
+
+    g_print ("All streams stopped\n");
+
+    g_io_channel_unref (stdin_channel);
+    shared_task_pool_print_stats (&host);
+    g_hash_table_destroy (host.streams);
+    g_thread_pool_free (host.task_pool.workers, FALSE, TRUE);
+    g_mutex_clear (&host.task_pool.lock);
+    gst_object_unref (host.clock);
+    g_main_loop_unref (host.loop);
+
+    return 0;
+}
@@ -0,0 +1,504 @@
+#include <gst/gst.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+#define SEGMENT_DURATION 2000 // Short segments so that hours of soak cover thousands of fragments
+#define SOAK_HOURS 6 // Default soak duration, overridden by the first argument
+#define SOAK_SPOOL "/tmp/soak" // Fragments are written here unless SOAK_S3_ENDPOINT is set
+#define SOAK_RING 8 // Local fragments are overwritten round-robin
+#define SOAK_LOG "soak.csv" // One line per fragment
+#define WARMUP_FRAGMENTS 30 // Caches and pools fill up during the first fragments, not sampled for growth
+#define GROWTH_WINDOW 200 // Fragments a metric has to grow over to be flagged
+#define GROWTH_STEADY_RATIO 0.9 // Share of fragment-to-fragment steps that must not decrease
+#define MIN_GROWTH_PER_1000 16 // Ignore slopes below this many units (kB, objects) per 1000 fragments
+
+/*
+ * Soak mode: a splitmuxsink-awss3sink.c pipeline with live sources and
+ * SEGMENT_DURATION fragments, running for hours. On every
+ * splitmuxsink-fragment-closed message it samples
+ *   - process RSS,
+ *   - malloc statistics (in-use and mmapped bytes),
+ *   - live objects by type from the leaks tracer (GST_TRACERS=leaks is
+ *     enabled unless GST_TRACERS is already set),
+ * and keeps the last GROWTH_WINDOW samples of each. A metric is flagged when
+ * it grew over the whole window, almost never went down from one fragment to
+ * the next, and its least-squares slope is at least MIN_GROWTH_PER_1000.
+ * The exit status is 1 if anything was flagged.
+ */
+
+typedef struct {
+    gchar *name;
+    gdouble samples[GROWTH_WINDOW];
+    guint count;                // Samples taken, the ring holds the last GROWTH_WINDOW
+    gboolean flagged;
+    gdouble slope;              // Per fragment, at the last check
+} GrowthSeries;
+
+typedef struct {
+    GMainLoop *loop;
+    GstElement *pipeline;
+    GstElement *gcs_sink;
+    GstTracer *leaks_tracer;
+    GHashTable *series;         // metric name -> GrowthSeries
+    FILE *log;
+    guint fragments;
+    gint64 started;
+    guint flagged;
+} SoakRun;
+
+// Function to get the current time in milliseconds since the Unix epoch
+static long long current_time_millis() {
+    struct timeval time_now;
+    gettimeofday(&time_now, NULL);
+    return (long long)(time_now.tv_sec) * 1000 + (long long)(time_now.tv_usec) / 1000;
+}
+
+static gchar* format_location_callback(GstElement *splitmuxsink, guint fragment_id, gpointer user_data) {
+    SoakRun *run = (SoakRun *) user_data;
+    long long start_time, end_time;
+    gchar *filename;
+
+    if (!g_getenv("SOAK_S3_ENDPOINT")) {
+        return g_strdup_printf("%s/soak_%02u.mp4", SOAK_SPOOL, fragment_id % SOAK_RING);
+    }
+
+    // Get the (Unix epoch time) for start and end time
+    start_time = current_time_millis();
+    end_time = start_time + SEGMENT_DURATION;
+
+    filename = g_strdup_printf("vm/soak/%lld_%lld.mp4", start_time, end_time);
+    g_object_set(run->gcs_sink, "key", filename, NULL);  // Set the key dynamically
+
+    return filename;
+}
+
+static gboolean link_elements_with_video_filter (GstElement *element1, GstElement *element2)
+{
+    gboolean link_ok;
+    GstCaps *caps;
+
+    caps = gst_caps_new_simple ("video/x-raw",
+            "format", G_TYPE_STRING, "I420",
+            "width", G_TYPE_INT, 360,
+            "height", G_TYPE_INT, 640,
+            "framerate", GST_TYPE_FRACTION, 15, 1,
+            NULL);
+
+    link_ok = gst_element_link_filtered (element1, element2, caps);
+    gst_caps_unref (caps);
+
+    if (!link_ok) {
+        g_warning ("Failed to link element1 and element2 using video filter!");
+    }
+
+    return link_ok;
+}
+
+static gboolean link_elements_with_audio_filter (GstElement *element1, GstElement *element2, int sampleRate, int numChannels)
+{
+    gboolean link_ok;
+    GstCaps *caps;
+
+    caps = gst_caps_new_simple ("audio/x-raw",
+            "rate", G_TYPE_INT, sampleRate,
+            "channels", G_TYPE_INT, numChannels,
+            NULL);
+
+    link_ok = gst_element_link_filtered (element1, element2, caps);
+    gst_caps_unref (caps);
+
+    if (!link_ok) {
+        g_warning ("Failed to link element1 and element2 using audio filter!");
+    }
+
+    return link_ok;
+}
+
+static void growth_series_free(gpointer data) {
+    GrowthSeries *series = (GrowthSeries *) data;
+
+    g_free(series->name);
+    g_free(series);
+}
+
+/* Append one sample; returns TRUE the first time the series is flagged */
+static gboolean growth_series_add(SoakRun *run, const gchar *name, gdouble value) {
+    GrowthSeries *series = g_hash_table_lookup(run->series, name);
+    gdouble sum_x = 0, sum_y = 0, sum_xy = 0, sum_xx = 0, first, last, previous;
+    guint i, n, oldest, steady = 0;
+
+    if (!series) {
+        series = g_new0(GrowthSeries, 1);
+        series->name = g_strdup(name);
+        g_hash_table_insert(run->series, series->name, series);
+    }
+    series->samples[series->count++ % GROWTH_WINDOW] = value;
+    if (series->count < GROWTH_WINDOW || series->flagged) {
+        return FALSE;
+    }
+
+    // Oldest sample first
+    n = GROWTH_WINDOW;
+    oldest = series->count % GROWTH_WINDOW;
+    first = previous = series->samples[oldest];
+    for (i = 0; i < n; i++) {
+        gdouble y = series->samples[(oldest + i) % GROWTH_WINDOW];
+
+        sum_x += i;
+        sum_y += y;
+        sum_xy += i * y;
+        sum_xx += (gdouble) i * i;
+        if (i > 0 && y >= previous) {
+            steady++;
+        }
+        previous = y;
+    }
+    last = previous;
+    series->slope = (n * sum_xy - sum_x * sum_y) / (n * sum_xx - sum_x * sum_x);
+
+    if (last > first && steady >= GROWTH_STEADY_RATIO * (n - 1) && series->slope * 1000 >= MIN_GROWTH_PER_1000) {
+        series->flagged = TRUE;
+        return TRUE;
+    }
+    return FALSE;
+}
+
+static void sample_metric(SoakRun *run, const gchar *name, gdouble value) {
+    if (run->fragments <= WARMUP_FRAGMENTS) {
+        return;
+    }
+    if (growth_series_add(run, name, value)) {
+        GrowthSeries *series = g_hash_table_lookup(run->series, name);
+
+        run->flagged++;
+        g_printerr("GROWTH after %u fragments: %s grows %.1f per 1000 fragments (now %.0f)\n",
+                   run->fragments, name, series->slope * 1000, value);
+    }
+}
+
+static long read_rss_kb(void) {
+#ifdef __linux__
+    long pages = 0;
+    FILE *file = fopen("/proc/self/statm", "r");
+
+    if (file) {
+        if (fscanf(file, "%*ld %ld", &pages) != 1) {
+            pages = 0;
+        }
+        fclose(file);
+    }
+    return pages * (sysconf(_SC_PAGESIZE) / 1024);
+#else
+    // Peak rather than current RSS; ru_maxrss is in bytes on macOS
+    struct rusage usage;
+
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss / 1024;
+#endif
+}
+
+/* Live objects tracked by the leaks tracer, counted by type; returns the total */
+static guint sample_live_objects(SoakRun *run) {
+    GstStructure *info = NULL;
+    const GValue *list;
+    GHashTable *counts;
+    GHashTableIter iter;
+    gpointer key, value;
+    guint i, total;
+
+    if (!run->leaks_tracer) {
+        return 0;
+    }
+
+    g_signal_emit_by_name(run->leaks_tracer, "get-live-objects", &info);
+    if (!info) {
+        return 0;
+    }
+
+    counts = g_hash_table_new(g_str_hash, g_str_equal);
+    list = gst_structure_get_value(info, "live-objects-list");
+    total = list ? gst_value_list_get_size(list) : 0;
+    for (i = 0; i < total; i++) {
+        const GstStructure *entry = gst_value_get_structure(gst_value_list_get_value(list, i));
+        const GValue *object = gst_structure_get_value(entry, "object");
+        const gchar *type_name = object ? g_type_name(G_VALUE_TYPE(object)) : "unknown";
+
+        g_hash_table_insert(counts, (gpointer) type_name,
+                            GUINT_TO_POINTER(GPOINTER_TO_UINT(g_hash_table_lookup(counts, type_name)) + 1));
+    }
+
+    g_hash_table_iter_init(&iter, counts);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        gchar *name = g_strdup_printf("live %s", (const gchar *) key);
+
+        sample_metric(run, name, GPOINTER_TO_UINT(value));
+        g_free(name);
+    }
+
+    g_hash_table_destroy(counts);
+    gst_structure_free(info);
+    return total;
+}
+
+static void sample_fragment(SoakRun *run) {
+    long rss_kb = read_rss_kb();
+    gsize malloc_in_use = 0, malloc_mmapped = 0;
+    guint live_objects;
+
+#ifdef __GLIBC__
+    struct mallinfo2 heap = mallinfo2();
+
+    malloc_in_use = heap.uordblks;
+    malloc_mmapped = heap.hblkhd;
+#endif
+
+    run->fragments++;
+    live_objects = sample_live_objects(run);
+    sample_metric(run, "rss kB", rss_kb);
+    sample_metric(run, "malloc in-use kB", malloc_in_use / 1024);
+    sample_metric(run, "malloc mmapped kB", malloc_mmapped / 1024);
+    sample_metric(run, "live objects", live_objects);
+
+    if (run->log) {
+        fprintf(run->log, "%u,%.1f,%ld,%" G_GSIZE_FORMAT ",%" G_GSIZE_FORMAT ",%u\n", run->fragments,
+                (g_get_monotonic_time() - run->started) / 1e6, rss_kb, malloc_in_use, malloc_mmapped, live_objects);
+        fflush(run->log);
+    }
+    if (run->fragments % 100 == 0) {
+        g_print("%u fragments: rss=%ldkB malloc=%" G_GSIZE_FORMAT "kB live-objects=%u flagged=%u\n",
+                run->fragments, rss_kb, malloc_in_use / 1024, live_objects, run->flagged);
+    }
+}
+
+static GstTracer* find_leaks_tracer(void) {
+    GList *tracers = gst_tracing_get_active_tracers();
+    GstTracer *found = NULL;
+    GList *l;
+
+    for (l = tracers; l != NULL; l = l->next) {
+        if (!found && g_strcmp0(G_OBJECT_TYPE_NAME(l->data), "GstLeaksTracer") == 0) {
+            found = gst_object_ref(l->data);
+        }
+    }
+    g_list_free_full(tracers, gst_object_unref);
+    return found;
+}
+
+static gboolean soak_timeout_callback(gpointer user_data) {
+    SoakRun *run = (SoakRun *) user_data;
+
+    g_print("Soak duration reached after %u fragments, sending EOS\n", run->fragments);
+    gst_element_send_event(run->pipeline, gst_event_new_eos());
+    return G_SOURCE_REMOVE;
+}
+
+static gboolean bus_callback(GstBus *bus, GstMessage *msg, gpointer user_data) {
+    SoakRun *run = (SoakRun *) user_data;
+
+    switch (GST_MESSAGE_TYPE(msg)) {
+        case GST_MESSAGE_ELEMENT: {
+            const GstStructure *s = gst_message_get_structure(msg);
+
+            if (s && gst_structure_has_name(s, "splitmuxsink-fragment-closed")) {
+                sample_fragment(run);
+            }
+            break;
+        }
+        case GST_MESSAGE_ERROR: {
+            GError *err;
+            gchar *debug_info;
+
+            gst_message_parse_error(msg, &err, &debug_info);
+            g_printerr("Error received from element %s: %s\n", GST_OBJECT_NAME(msg->src), err->message);
+            g_printerr("Debugging information: %s\n", debug_info ? debug_info : "none");
+            g_clear_error(&err);
+            g_free(debug_info);
+            g_main_loop_quit(run->loop);
+            break;
+        }
+        case GST_MESSAGE_EOS:
+            g_print("End-Of-Stream reached.\n");
+            g_main_loop_quit(run->loop);
+            break;
+        default:
+            break;
+    }
+
+    return G_SOURCE_CONTINUE;
+}
+
+static void print_growth_summary(SoakRun *run) {
+    GHashTableIter iter;
+    gpointer value;
+
+    g_print("Soak finished after %u fragments, %u metric(s) flagged\n", run->fragments, run->flagged);
+    g_hash_table_iter_init(&iter, run->series);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        GrowthSeries *series = (GrowthSeries *) value;
+
+        if (series->flagged) {
+            g_print("  %-40s %+.1f per 1000 fragments\n", series->name, series->slope * 1000);
+        }
+    }
+}
+
+int main(int argc, char *argv[]) {
+    GstElement *pipeline;
+    GstElement *video_source, *video_queue, *video_convert, *x264_enc;
+    GstElement *audio_source, *audio_queue, *audio_convert, *audio_resample, *avenc_aac;
+    GstElement *split_mux_sink, *gcs_sink;
+
+    GstBus *bus;
+    SoakRun run = {0};
+    gdouble hours = argc > 1 ? g_ascii_strtod(argv[1], NULL) : SOAK_HOURS;
+    const gchar *endpoint = g_getenv("SOAK_S3_ENDPOINT");
+
+    GstPad *x264enc_src_pad, *avenc_aac_src_pad;
+    GstPad *splitmuxsink_video_pad, *splitmuxsink_audio_pad;
+
+    /* The leaks tracer has to be enabled before gst_init */
+    g_setenv ("GST_TRACERS", "leaks", FALSE);
+
+    /* Initialize GStreamer */
+    gst_init (&argc, &argv);
+
+    run.leaks_tracer = find_leaks_tracer ();
+    if (!run.leaks_tracer) {
+        g_printerr ("Leaks tracer not active (GST_TRACERS=%s), live objects are not sampled.\n", g_getenv ("GST_TRACERS"));
+    }
+
+    /* Create the elements */
+    video_source = gst_element_factory_make ("videotestsrc", "video_source");
+    video_queue = gst_element_factory_make ("queue", "video_queue");
+    video_convert = gst_element_factory_make ("videoconvert", "video_convert");
+    x264_enc = gst_element_factory_make ("x264enc", "x264_enc");
+
+    audio_source = gst_element_factory_make ("audiotestsrc", "audio_source");
+    audio_queue = gst_element_factory_make ("queue", "audio_queue");
+    audio_convert = gst_element_factory_make ("audioconvert", "audio_convert");
+    audio_resample = gst_element_factory_make ("audioresample", "audio_resample");
+    avenc_aac = gst_element_factory_make ("avenc_aac", "avenc_aac");
+
+    split_mux_sink = gst_element_factory_make ("splitmuxsink", "split_mux_sink");
+    gcs_sink = gst_element_factory_make (endpoint ? "awss3sink" : "filesink", "gcs_sink");
+
+    /* Create the empty pipeline */
+    pipeline = gst_pipeline_new ("test-pipeline");
+
+    if (!pipeline || !video_source || !video_queue || !video_convert || !x264_enc ||
+    !audio_source || !audio_queue || !audio_convert || !audio_resample || !avenc_aac ||
+    !split_mux_sink || !gcs_sink) {
+        g_printerr ("Not all elements could be created.\n");
+        return -1;
+    } else {
+        g_print ("All elements created successfully.\n");
+    }
+
+    /* Configure elements */
+    g_object_set (video_source, "is-live", true, NULL);
+    g_object_set (audio_source, "is-live", true, NULL);
+    g_object_set (x264_enc, "speed-preset", 1, "bitrate", 128, NULL);
+    g_object_set (avenc_aac, "bitrate", 256, NULL);
+    if (endpoint) {
+        g_object_set (gcs_sink, "access-key", g_getenv ("SOAK_S3_ACCESS_KEY"), "bucket", g_getenv ("SOAK_S3_BUCKET"), "endpoint-uri", endpoint, "force-path-style", true, "region", "us-east-1", "secret-access-key", g_getenv ("SOAK_S3_SECRET_KEY"), "sync", true,  NULL);
+    } else {
+        g_mkdir_with_parents (SOAK_SPOOL, 0755);
+    }
+    g_object_set(split_mux_sink, "max-size-time", (guint64)SEGMENT_DURATION * GST_MSECOND, "send-keyframe-requests", true, "sink", gcs_sink, NULL);
+
+    run.pipeline = pipeline;
+    run.gcs_sink = gcs_sink;
+    run.series = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, growth_series_free);
+
+    // Connect the format-location signal to generate dynamic filenames
+    g_signal_connect(split_mux_sink, "format-location", G_CALLBACK(format_location_callback), &run);
+
+    g_print ("All elements configured successfully.\n");
+
+    /* Link all elements that can be automatically linked because they have "Always" pads */
+    /* Adding caps filter between video_source and video_convert */
+    gst_bin_add_many (GST_BIN (pipeline), video_source, video_queue, video_convert, x264_enc,
+    audio_source, audio_queue, audio_convert, audio_resample, avenc_aac,
+    split_mux_sink, NULL);
+
+    if (link_elements_with_video_filter (video_source, video_queue) != TRUE ||
+        gst_element_link_many (video_queue, video_convert, x264_enc, NULL) != TRUE ||
+
+        link_elements_with_audio_filter (audio_source, audio_queue, 48000, 2) != TRUE ||
+        gst_element_link_many (audio_queue, audio_convert, audio_resample, NULL) != TRUE ||
+        link_elements_with_audio_filter (audio_resample, avenc_aac, 16000, 1) != TRUE
+        ) {
+        g_printerr ("Elements could not be linked.\n");
+        gst_object_unref (pipeline);
+        return -1;
+    } else {
+        g_print ("All elements linked successfully.\n");
+    }
+
+    /* Manually link the splitmuxsink which has "Request" pads */
+    x264enc_src_pad = gst_element_get_static_pad (x264_enc, "src");
+    splitmuxsink_video_pad = gst_element_request_pad_simple (split_mux_sink, "video");
+    g_print ("Obtained request pad %s for splitmuxsink video branch.\n", GST_PAD_NAME (splitmuxsink_video_pad));
+
+    avenc_aac_src_pad = gst_element_get_static_pad (avenc_aac, "src");
+    splitmuxsink_audio_pad = gst_element_request_pad_simple (split_mux_sink, "audio_%u");
+    g_print ("Obtained request pad %s for splitmuxsink audio branch.\n", GST_PAD_NAME (splitmuxsink_audio_pad));
+
+    if (gst_pad_link (x264enc_src_pad, splitmuxsink_video_pad) != GST_PAD_LINK_OK ||
+    gst_pad_link (avenc_aac_src_pad, splitmuxsink_audio_pad) != GST_PAD_LINK_OK) {
+        g_printerr ("splitmuxsink could not be linked!\n");
+        gst_object_unref (pipeline);
+        return -1;
+    } else {
+        g_print ("splitmuxsink linked successfully.\n");
+    }
+    gst_object_unref (x264enc_src_pad);
+    gst_object_unref (avenc_aac_src_pad);
+
+    run.log = fopen (SOAK_LOG, "w");
+    if (run.log) {
+        fprintf (run.log, "fragment,elapsed_s,rss_kb,malloc_in_use,malloc_mmapped,live_objects\n");
+    }
+
+    /* Sample on every closed fragment until the soak duration is reached */
+    run.loop = g_main_loop_new (NULL, FALSE);
+    bus = gst_element_get_bus (pipeline);
+    gst_bus_add_watch (bus, bus_callback, &run);
+    g_timeout_add_seconds ((guint) (hours * 3600), soak_timeout_callback, &run);
+
+    /* Start playing the pipeline */
+    run.started = g_get_monotonic_time ();
+    gst_element_set_state (pipeline, GST_STATE_PLAYING);
+    g_print ("Soaking for %.1f hour(s) with %d ms fragments\n", hours, SEGMENT_DURATION);
+
+    g_main_loop_run (run.loop);
+    print_growth_summary (&run);
+
+    /* Release the request pads from splitmuxsink, and unref them */
+    gst_element_release_request_pad (split_mux_sink, splitmuxsink_video_pad);
+    gst_object_unref (splitmuxsink_video_pad);
+    gst_element_release_request_pad (split_mux_sink, splitmuxsink_audio_pad);
+    gst_object_unref (splitmuxsink_audio_pad);
+
+    /* Free resources */
+    gst_bus_remove_watch (bus);
+    gst_object_unref (bus);
+    gst_element_set_state (pipeline, GST_STATE_NULL);
+
+    gst_object_unref (pipeline);
+    if (run.log)
+        fclose (run.log);
+    if (run.leaks_tracer)
+        gst_object_unref (run.leaks_tracer);
+    g_hash_table_destroy (run.series);
+    g_main_loop_unref (run.loop);
+    return run.flagged ? 1 : 0;
+}
@@ -1,6 +1,11 @@
 #include <gst/gst.h>
+#include <gst/video/video.h>
 #include <stdbool.h>    
 
+#define FRAME_POOL_QUEUE 8 // video_queue max-size-buffers
+#define FRAME_POOL_SPARE 3 // Frames being filled by video_source or converted
+#define FRAME_POOL_ALIGN 64 // Plane and stride alignment in bytes, enough for AVX-512 loads
+
 static gboolean link_elements_with_video_filter (GstElement *element1, GstElement *element2)
 {
     gboolean link_ok;
@@ -43,6 +48,160 @@ static gboolean link_elements_with_audio_filter (GstElement *element1, GstElemen
     return link_ok;
 }
 
+/*
+ * Raw video pool for video_source -> video_queue -> video_convert -> x264_enc.
+ * The pool is created when video_source asks for one (ALLOCATION query) and
+ * holds exactly as many frames as can be in flight: video_queue, the frames
+ * x264_enc keeps for lookahead/threading, and FRAME_POOL_SPARE. min == max,
+ * so every frame is allocated once at activation and never again; a full
+ * pool makes the source wait instead of allocating.
+ */
+typedef struct {
+    GstVideoBufferPool parent;
+    guint allocated;            // Buffers ever allocated, stays at the pool size
+    guint64 acquired;
+    guint64 misses;             // Acquires that found no free frame and had to wait
+} FramePool;
+
+typedef struct {
+    GstVideoBufferPoolClass parent_class;
+} FramePoolClass;
+
+typedef struct {
+    GstElement *x264_enc;
+    FramePool *pool;
+    guint frames;
+} FramePoolPolicy;
+
+G_DEFINE_TYPE (FramePool, frame_pool, GST_TYPE_VIDEO_BUFFER_POOL);
+
+static GstFlowReturn frame_pool_alloc_buffer (GstBufferPool *pool, GstBuffer **buffer, GstBufferPoolAcquireParams *params)
+{
+    ((FramePool *) pool)->allocated++;
+    return GST_BUFFER_POOL_CLASS (frame_pool_parent_class)->alloc_buffer (pool, buffer, params);
+}
+
+static GstFlowReturn frame_pool_acquire_buffer (GstBufferPool *pool, GstBuffer **buffer, GstBufferPoolAcquireParams *params)
+{
+    FramePool *self = (FramePool *) pool;
+    GstBufferPoolAcquireParams dontwait = { 0, };
+    GstFlowReturn ret;
+
+    if (params) {
+        dontwait = *params;
+    }
+    dontwait.flags |= GST_BUFFER_POOL_ACQUIRE_FLAG_DONTWAIT;
+
+    self->acquired++;   // Only video_source acquires, from its streaming thread
+    ret = GST_BUFFER_POOL_CLASS (frame_pool_parent_class)->acquire_buffer (pool, buffer, &dontwait);
+    if (ret == GST_FLOW_EOS && !(params && (params->flags & GST_BUFFER_POOL_ACQUIRE_FLAG_DONTWAIT))) {
+        self->misses++;
+        ret = GST_BUFFER_POOL_CLASS (frame_pool_parent_class)->acquire_buffer (pool, buffer, params);
+    }
+
+    return ret;
+}
+
+static void frame_pool_class_init (FramePoolClass *klass)
+{
+    GstBufferPoolClass *pool_class = GST_BUFFER_POOL_CLASS (klass);
+
+    pool_class->alloc_buffer = frame_pool_alloc_buffer;
+    pool_class->acquire_buffer = frame_pool_acquire_buffer;
+}
+
+static void frame_pool_init (FramePool *self)
+{
+}
+
+/* After downstream answered video_source's ALLOCATION query, replace its pool with ours */
+static GstPadProbeReturn frame_pool_allocation_probe (GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+    FramePoolPolicy *policy = (FramePoolPolicy *) user_data;
+    GstQuery *query = GST_PAD_PROBE_INFO_QUERY (info);
+    GstStructure *config;
+    GstAllocationParams params;
+    GstVideoAlignment align;
+    GstVideoInfo video_info;
+    GstClockTime min_latency = 0, max_latency = 0;
+    GstCaps *caps;
+    gboolean need_pool;
+    guint size, i, encoder_frames = 0;
+
+    if (GST_QUERY_TYPE (query) != GST_QUERY_ALLOCATION) {
+        return GST_PAD_PROBE_OK;
+    }
+    gst_query_parse_allocation (query, &caps, &need_pool);
+    if (!caps || !gst_video_info_from_caps (&video_info, caps)) {
+        return GST_PAD_PROBE_OK;
+    }
+
+    /* x264_enc has seen the caps by now (the query is serialized behind them), so its latency is known */
+    gst_video_encoder_get_latency (GST_VIDEO_ENCODER (policy->x264_enc), &min_latency, &max_latency);
+    if (GST_CLOCK_TIME_IS_VALID (max_latency) && video_info.fps_n > 0) {
+        encoder_frames = (guint) gst_util_uint64_scale_ceil (max_latency, video_info.fps_n, GST_SECOND * video_info.fps_d);
+    }
+    policy->frames = FRAME_POOL_QUEUE + encoder_frames + FRAME_POOL_SPARE;
+
+    if (policy->pool) {
+        gst_buffer_pool_set_active (GST_BUFFER_POOL (policy->pool), FALSE);
+        gst_object_unref (policy->pool);
+    }
+    policy->pool = g_object_new (frame_pool_get_type (), NULL);
+
+    gst_allocation_params_init (&params);
+    params.align = FRAME_POOL_ALIGN - 1;
+
+    config = gst_buffer_pool_get_config (GST_BUFFER_POOL (policy->pool));
+    gst_buffer_pool_config_set_params (config, caps, video_info.size, policy->frames, policy->frames);
+    gst_buffer_pool_config_set_allocator (config, NULL, &params);
+    /* Padded strides need downstream to read them from the video meta */
+    if (gst_query_find_allocation_meta (query, GST_VIDEO_META_API_TYPE, NULL)) {
+        gst_video_alignment_reset (&align);
+        for (i = 0; i < GST_VIDEO_MAX_PLANES; i++) {
+            align.stride_align[i] = FRAME_POOL_ALIGN - 1;
+        }
+        gst_buffer_pool_config_add_option (config, GST_BUFFER_POOL_OPTION_VIDEO_META);
+        gst_buffer_pool_config_add_option (config, GST_BUFFER_POOL_OPTION_VIDEO_ALIGNMENT);
+        gst_buffer_pool_config_set_video_alignment (config, &align);
+    }
+    if (!gst_buffer_pool_set_config (GST_BUFFER_POOL (policy->pool), config)) {
+        g_warning ("Raw video pool rejected its configuration, keeping the default pool");
+        gst_clear_object (&policy->pool);
+        return GST_PAD_PROBE_OK;
+    }
+
+    /* The pool may have grown the size for padding */
+    config = gst_buffer_pool_get_config (GST_BUFFER_POOL (policy->pool));
+    gst_buffer_pool_config_get_params (config, NULL, &size, NULL, NULL);
+    gst_structure_free (config);
+
+    if (gst_query_get_n_allocation_pools (query) > 0) {
+        gst_query_set_nth_allocation_pool (query, 0, GST_BUFFER_POOL (policy->pool), size, policy->frames, policy->frames);
+    } else {
+        gst_query_add_allocation_pool (query, GST_BUFFER_POOL (policy->pool), size, policy->frames, policy->frames);
+    }
+    /* GstBaseSrc's decide_allocation re-sets the pool's allocator and its alignment from the query's first allocation param */
+    if (gst_query_get_n_allocation_params (query) > 0) {
+        gst_query_set_nth_allocation_param (query, 0, NULL, &params);
+    } else {
+        gst_query_add_allocation_param (query, NULL, &params);
+    }
+
+    g_print ("Raw video pool: %u frames of %u bytes (queue %d + encoder %u + spare %d), %d-byte aligned\n",
+            policy->frames, size, FRAME_POOL_QUEUE, encoder_frames, FRAME_POOL_SPARE, FRAME_POOL_ALIGN);
+
+    return GST_PAD_PROBE_OK;
+}
+
+static void frame_pool_print_stats (FramePoolPolicy *policy)
+{
+    if (policy->pool) {
+        g_print ("Raw video pool: size=%u allocated=%u acquired=%" G_GUINT64_FORMAT " misses=%" G_GUINT64_FORMAT "\n",
+                policy->frames, policy->pool->allocated, policy->pool->acquired, policy->pool->misses);
+    }
+}
+
 int main(int argc, char *argv[]) {
     GstElement *pipeline;
     GstElement *video_source, *video_queue, *video_convert, *x264_enc;
@@ -52,6 +211,9 @@ int main(int argc, char *argv[]) {
     GstBus *bus;
     GstMessage *msg;
 
+    FramePoolPolicy pool_policy = { 0, };
+    GstPad *video_source_src_pad;
+
     GstPad *x264enc_src_pad, *avenc_aac_src_pad;
     GstPad *splitmuxsink_video_pad, *splitmuxsink_audio_pad;
     
@@ -85,6 +247,7 @@ int main(int argc, char *argv[]) {
     }
 
     /* Configure elements */
+    g_object_set (video_queue, "max-size-buffers", FRAME_POOL_QUEUE, "max-size-bytes", 0, "max-size-time", (guint64) 0, NULL);
     g_object_set (x264_enc, "speed-preset", 1, "bitrate", 128, NULL);
     g_object_set (avenc_aac, "bitrate", 256, NULL);
     g_object_set(split_mux_sink, "location", "/Users/vivekchandela/Documents/mp4test/chunk%02d.mp4", "max-size-time", 15000000000, "async-finalize", true, "send-keyframe-requests", true, NULL);
@@ -114,11 +277,11 @@ int main(int argc, char *argv[]) {
     /* Manually link the splitmuxsink which has "Request" pads */
     x264enc_src_pad = gst_element_get_static_pad (x264_enc, "src");
     splitmuxsink_video_pad = gst_element_request_pad_simple (split_mux_sink, "video");
-    g_print ("Obtained request pad %s for splitmuxsink video branch.\n", gst_pad_get_name (splitmuxsink_video_pad));
+    g_print ("Obtained request pad %s for splitmuxsink video branch.\n", GST_PAD_NAME (splitmuxsink_video_pad));
 
     avenc_aac_src_pad = gst_element_get_static_pad (avenc_aac, "src");
     splitmuxsink_audio_pad = gst_element_request_pad_simple (split_mux_sink, "audio_%u");
-    g_print ("Obtained request pad %s for splitmuxsink audio branch.\n", gst_pad_get_name (splitmuxsink_audio_pad));
+    g_print ("Obtained request pad %s for splitmuxsink audio branch.\n", GST_PAD_NAME (splitmuxsink_audio_pad));
 
     if (gst_pad_link (x264enc_src_pad, splitmuxsink_video_pad) != GST_PAD_LINK_OK ||
     gst_pad_link (avenc_aac_src_pad, splitmuxsink_audio_pad) != GST_PAD_LINK_OK) {
@@ -131,6 +294,12 @@ int main(int argc, char *argv[]) {
     gst_object_unref (x264enc_src_pad);
     gst_object_unref (avenc_aac_src_pad);
 
+    /* Preallocate the raw video frames once caps are negotiated */
+    pool_policy.x264_enc = x264_enc;
+    video_source_src_pad = gst_element_get_static_pad (video_source, "src");
+    gst_pad_add_probe (video_source_src_pad, GST_PAD_PROBE_TYPE_QUERY_DOWNSTREAM | GST_PAD_PROBE_TYPE_PULL, frame_pool_allocation_probe, &pool_policy, NULL);
+    gst_object_unref (video_source_src_pad);
+
     /* Start playing the pipeline */
     gst_element_set_state (pipeline, GST_STATE_PLAYING);
 
@@ -154,5 +323,8 @@ int main(int argc, char *argv[]) {
     gst_element_set_state (pipeline, GST_STATE_NULL);
 
     gst_object_unref (pipeline);
+
+    frame_pool_print_stats (&pool_policy);
+    gst_clear_object (&pool_policy.pool);
     return 0;
 }